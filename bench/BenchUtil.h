@@ -0,0 +1,74 @@
+#pragma once
+
+// Fixtures shared by the benchmarks: timing and synthetic meshes.
+#include "mesh/Mesh.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+inline double seconds_since(std::chrono::steady_clock::time_point tic)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+}
+
+// Rolling hills over [0, 1000]^2, within 25 units of zero
+inline float terrain_height(float x, float y)
+{
+    return 20.0f * std::sin(0.02f * x) * std::cos(0.015f * y) + 5.0f * std::sin(0.11f * x + 0.07f * y);
+}
+
+// A grid of 2 * size * size triangles over [0, extent]^2 with heights from
+// `height` and uvs over [0, 1]^2, no normals
+inline void make_grid(int size, float extent, float (*height)(float x, float y), MeshData& mesh)
+{
+    mesh.clear();
+    for (int i = 0; i <= size; ++i)
+    {
+        for (int j = 0; j <= size; ++j)
+        {
+            const float x = extent * j / size, y = extent * i / size;
+            mesh.positions.insert(mesh.positions.end(), { x, y, height(x, y) });
+            mesh.uvs.insert(mesh.uvs.end(), { x / extent, y / extent });
+        }
+    }
+    for (int i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < size; ++j)
+        {
+            const uint32_t a = i * (size + 1) + j, b = a + 1, c = a + size + 1, d = c + 1;
+            mesh.indices.insert(mesh.indices.end(), { a, b, d, a, d, c });
+        }
+    }
+}
+
+// The 1000 x 1000 terrain of the paging and point cloud benchmarks
+inline void make_terrain(int size, MeshData& mesh)
+{
+    make_grid(size, 1000.0f, terrain_height, mesh);
+}
+
+// OBJ text of a mesh with uvs and normals, every face corner indexing all
+// three streams
+inline std::string mesh_to_obj(const MeshData& mesh)
+{
+    std::string text;
+    char line[256];
+    for (size_t v = 0; v < mesh.num_vertices(); ++v)
+    {
+        const float* p = &mesh.positions[3 * v];
+        const float* t = &mesh.uvs[2 * v];
+        const float* n = &mesh.normals[3 * v];
+        snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %g %g %g\n", p[0], p[1], p[2], t[0], t[1],
+            n[0], n[1], n[2]);
+        text += line;
+    }
+    for (size_t f = 0; f < mesh.num_triangles(); ++f)
+    {
+        const uint32_t a = mesh.indices[3 * f] + 1, b = mesh.indices[3 * f + 1] + 1, c = mesh.indices[3 * f + 2] + 1;
+        snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,154 @@
+// Out-of-core mesh paging: a camera flies low over a large terrain whose
+// clusters are paged through caches of several sizes, with and without
+// motion prefetch.
+//
+//   mesh_paging_bench [mesh.gvm | mesh.obj | grid size] [frames]
+//
+// Without a file the mesh is a 1000 x 1000 terrain grid of
+// 2 * size * size triangles. Missed clusters are the ones that were in view
+// but not yet resident (they pop in a frame or more late).
+#include "BenchUtil.h"
+#include "mesh/MeshPager.h"
+#include "mesh/PagedMesh.h"
+#include "util/Parallel.h"
+#include "viewer/Camera.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int WIDTH = 1280, HEIGHT = 800;
+
+static Eigen::Matrix4f look_at(const Eigen::Vector3f& eye, const Eigen::Vector3f& target, const Eigen::Vector3f& up)
+{
+    const Eigen::Vector3f f = (target - eye).normalized();
+    const Eigen::Vector3f s = f.cross(up).normalized();
+    const Eigen::Vector3f u = s.cross(f);
+    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+    view.row(0) << s.transpose(), -s.dot(eye);
+    view.row(1) << u.transpose(), -u.dot(eye);
+    view.row(2) << -f.transpose(), f.dot(eye);
+    return view;
+}
+
+struct Result
+{
+    size_t missed = 0;
+    int incomplete_frames = 0;
+    size_t peak_visible_bytes = 0;
+    PageCacheStats stats;
+    double seconds = 0.0;
+};
+
+// Flies along the terrain and back with a slow weave, at 60 frames per second
+static Result fly(MeshPager& pager, int frames, const Eigen::Matrix4f& proj)
+{
+    Result result;
+    const float dt = 1.0f / 60.0f;
+    auto tic = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        const float t = (float)frame / frames;
+        const float x = 100.0f + 800.0f * t;
+        const float y = 500.0f + 150.0f * std::sin(6.0f * t);
+        const float heading = std::atan2(150.0f * 6.0f * std::cos(6.0f * t), 800.0f);
+        const Eigen::Vector3f eye(x, y, terrain_height(x, y) + 40.0f);
+        const Eigen::Vector3f target = eye + Eigen::Vector3f(std::cos(heading), std::sin(heading), -0.35f);
+        pager.update(look_at(eye, target, Eigen::Vector3f::UnitZ()), proj, HEIGHT, dt);
+
+        result.missed += pager.missing_clusters;
+        result.incomplete_frames += pager.missing_clusters > 0;
+        size_t bytes = 0;
+        for (const PagedCluster& c : pager.resident)
+        {
+            bytes += (size_t)pager.mesh.clusters()[c.cluster].bytes;
+        }
+        result.peak_visible_bytes = std::max(result.peak_visible_bytes, bytes);
+        std::this_thread::sleep_until(tic + std::chrono::duration<double>(dt * (frame + 1)));
+    }
+    result.seconds = seconds_since(tic);
+    result.stats = pager.cache.stats();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    int size = 1024;
+    std::string input;
+    if (argc > 1 && std::atoi(argv[1]) > 0)
+    {
+        size = std::atoi(argv[1]);
+    }
+    else if (argc > 1)
+    {
+        input = argv[1];
+    }
+    const int frames = argc > 2 ? std::atoi(argv[2]) : 300;
+
+    const std::string output = "mesh_paging_bench.gvmp";
+    PagedMeshBuildStats build_stats;
+    bool ok;
+    if (input.empty())
+    {
+        MeshData mesh;
+        make_terrain(size, mesh);
+        ok = build_paged_mesh(mesh.view(), MeshCacheSource(), output, PagedMeshBuildOptions(), &build_stats);
+    }
+    else
+    {
+        ok = build_paged_mesh(input, output, PagedMeshBuildOptions(), &build_stats);
+    }
+    if (!ok)
+    {
+        return EXIT_FAILURE;
+    }
+    printf("%u hardware threads\n", hardware_threads());
+    printf("build: %zu triangles in %zu clusters, %.2f vertices per triangle, %.1f MB in %.2f s (%.1f Mtris/s)\n",
+        build_stats.triangles, build_stats.clusters, (double)build_stats.vertices / build_stats.triangles,
+        build_stats.bytes / 1048576.0, build_stats.seconds, build_stats.mtris_per_second());
+
+    MeshPager pager;
+    if (!pager.open(output))
+    {
+        return EXIT_FAILURE;
+    }
+    Camera camera;
+    camera.near_plane = 0.5f;
+    camera.far_plane = 250.0f;
+    const Eigen::Matrix4f proj = camera.projection_matrix(WIDTH, HEIGHT);
+
+    const double total_mb = build_stats.bytes / 1048576.0;
+    printf("\n%8s %9s %8s %11s %9s %8s %10s %10s %9s\n", "cache", "prefetch", "missed", "incomplete", "hit rate",
+        "loads", "evictions", "paged MB", "MB/s");
+    for (double fraction : { 0.25, 0.5, 1.0 })
+    {
+        for (bool prefetch : { false, true })
+        {
+            // Reopened for an empty cache and a camera at rest
+            pager.open(output);
+            pager.cache.budget = (size_t)(fraction * build_stats.bytes);
+            pager.prefetch = prefetch;
+            pager.cache.reset_stats();
+            const Result r = fly(pager, frames, proj);
+            const double paged_mb = r.stats.bytes_loaded / 1048576.0;
+            printf("%6.0f%% %9s %8zu %10.1f%% %8.1f%% %8llu %10llu %10.1f %9.1f\n", 100.0 * fraction,
+                prefetch ? "on" : "off", r.missed, 100.0 * r.incomplete_frames / frames, 100.0 * r.stats.hit_rate(),
+                (unsigned long long)r.stats.loads, (unsigned long long)r.stats.evictions, paged_mb,
+                paged_mb / r.seconds);
+            if (r.peak_visible_bytes > pager.cache.budget)
+            {
+                printf("         (the view needs up to %.1f MB, more than the cache)\n",
+                    r.peak_visible_bytes / 1048576.0);
+            }
+        }
+    }
+    printf("\n%.1f MB paged mesh; cache sizes are fractions of it\n", total_mb);
+    pager.print_stats();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+// Vertex normal and tangent kernels against the naive per-face scatter.
+//
+//   normals_bench [mesh.obj | grid size] [runs]
+//
+// Without a file the mesh is a wavy grid of 2 * size * size triangles.
+#include "BenchUtil.h"
+#include "mesh/Normals.h"
+#include "mesh/ObjLoader.h"
+#include "util/Parallel.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+
+static float wave_height(float x, float y)
+{
+    return 0.05f * std::sin(20.0f * x) * std::cos(15.0f * y);
+}
+
+// Reference: one serial pass scattering every face into its three vertices
+static void naive_normals(const MeshView& mesh, std::vector<float>& normals)
+{
+    normals.assign(3 * mesh.num_vertices(), 0.0f);
+    for (size_t f = 0; f < mesh.num_triangles(); ++f)
+    {
+        const uint32_t* t = &mesh.indices[3 * f];
+        const Eigen::Map<const Eigen::Vector3f> p0(&mesh.positions[3 * t[0]]), p1(&mesh.positions[3 * t[1]]),
+            p2(&mesh.positions[3 * t[2]]);
+        const Eigen::Vector3f n = (p1 - p0).cross(p2 - p0);
+        for (int k = 0; k < 3; ++k)
+        {
+            Eigen::Map<Eigen::Vector3f>(&normals[3 * t[k]]) += n;
+        }
+    }
+    for (size_t v = 0; v < mesh.num_vertices(); ++v)
+    {
+        Eigen::Map<Eigen::Vector3f> n(&normals[3 * v]);
+        const float length = n.norm();
+        if (length > 0.0f)
+        {
+            n /= length;
+        }
+    }
+}
+
+static double best_of(int runs, const std::function<void()>& fn)
+{
+    double best = 1e30;
+    for (int r = 0; r < runs; ++r)
+    {
+        auto tic = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, seconds_since(tic));
+    }
+    return best;
+}
+
+static float max_difference(const std::vector<float>& a, const std::vector<float>& b)
+{
+    float d = 0.0f;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i)
+    {
+        d = std::max(d, std::abs(a[i] - b[i]));
+    }
+    return d;
+}
+
+int main(int argc, char* argv[])
+{
+    MeshData mesh;
+    std::string input = argc > 1 ? argv[1] : "1024";
+    const int runs = argc > 2 ? std::max(1, atoi(argv[2])) : 5;
+    if (input.size() > 4 && input.compare(input.size() - 4, 4, ".obj") == 0)
+    {
+        if (!load_obj(input, mesh))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        make_grid(std::max(1, atoi(input.c_str())), 1.0f, wave_height, mesh);
+    }
+    const MeshView view = mesh.view();
+    const double mtris = view.num_triangles() * 1e-6;
+    printf("%zu vertices, %zu triangles, %u hardware threads, best of %d\n",
+        view.num_vertices(), view.num_triangles(), hardware_threads(), runs);
+
+    std::vector<float> reference, normals, tangents;
+    VertexCorners adjacency;
+    auto report = [&](const char* name, double seconds)
+    {
+        printf("  %-34s %9.2f ms %8.1f Mtris/s\n", name, 1000.0 * seconds, mtris / seconds);
+    };
+
+    report("naive scatter (1 thread)", best_of(runs, [&] { naive_normals(view, reference); }));
+    report("adjacency build", best_of(runs, [&] { adjacency.build(view); }));
+    report("area normals, 1 thread", best_of(runs, [&]
+        { compute_normals(view, normals, NormalWeighting::Area, 1, &adjacency); }));
+    const float difference = max_difference(reference, normals);
+    report("area normals, all threads", best_of(runs, [&]
+        { compute_normals(view, normals, NormalWeighting::Area, 0, &adjacency); }));
+    report("area normals incl. adjacency", best_of(runs, [&]
+        { compute_normals(view, normals, NormalWeighting::Area); }));
+    report("angle normals, all threads", best_of(runs, [&]
+        { compute_normals(view, normals, NormalWeighting::Angle, 0, &adjacency); }));
+    printf("  max difference to naive (area): %g\n", difference);
+
+    if (view.has_uvs())
+    {
+        mesh.normals = normals;
+        const MeshView with_normals = mesh.view();
+        report("tangents, all threads", best_of(runs, [&]
+            { compute_tangents(with_normals, tangents, 0, &adjacency); }));
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+// Point cloud octree: build throughput, LOD rendering against every point,
+// and paging along a camera path.
+//
+//   pointcloud_bench [cloud.las | cloud.xyz | million points] [cache MB]
+//
+// Without a file the cloud is a synthetic coloured terrain written as LAS
+// next to the working directory.
+#include "BenchUtil.h"
+#include "points/PointCloud.h"
+#include "render/PointSplatter.h"
+#include "util/PageCache.h"
+#include "util/Parallel.h"
+#include "viewer/Camera.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int WIDTH = 1280, HEIGHT = 800;
+// Opaque black, as Framebuffer::clear packs it
+static const uint32_t BACKGROUND = 0xff000000;
+
+template <typename T>
+static void put(std::vector<char>& out, size_t offset, T value)
+{
+    memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+// LAS 1.2, point format 2 (XYZ + RGB), over a 1000 x 1000 m terrain
+static bool write_terrain(const std::string& filename, uint64_t count)
+{
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", filename.c_str());
+        return false;
+    }
+    const double scale = 0.001;
+    std::vector<char> header(227, 0);
+    memcpy(header.data(), "LASF", 4);
+    header[24] = 1;
+    header[25] = 2;
+    put<uint16_t>(header, 94, 227);
+    put<uint32_t>(header, 96, 227);
+    header[104] = 2;
+    put<uint16_t>(header, 105, 26);
+    put<uint32_t>(header, 107, (uint32_t)count);
+    for (int k = 0; k < 3; ++k)
+    {
+        put<double>(header, 131 + 8 * k, scale);
+    }
+    const double lo[3] = { 0.0, 0.0, -30.0 }, hi[3] = { 1000.0, 1000.0, 30.0 };
+    for (int k = 0; k < 3; ++k)
+    {
+        put<double>(header, 179 + 16 * k, hi[k]);
+        put<double>(header, 187 + 16 * k, lo[k]);
+    }
+    fwrite(header.data(), 1, header.size(), file);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(0.0f, 1000.0f);
+    std::vector<char> record(26, 0);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const float x = uniform(rng), y = uniform(rng), z = terrain_height(x, y);
+        put<int32_t>(record, 0, (int32_t)std::lround(x / scale));
+        put<int32_t>(record, 4, (int32_t)std::lround(y / scale));
+        put<int32_t>(record, 8, (int32_t)std::lround(z / scale));
+        // Height bands with a fine stripe pattern, so missing detail shows
+        const float t = (z + 25.0f) / 50.0f;
+        const float stripe = 0.5f + 0.5f * std::sin(0.8f * x) * std::sin(0.8f * y);
+        put<uint16_t>(record, 20, (uint16_t)(65535.0f * std::clamp(t, 0.0f, 1.0f)));
+        put<uint16_t>(record, 22, (uint16_t)(65535.0f * stripe));
+        put<uint16_t>(record, 24, (uint16_t)(65535.0f * std::clamp(1.0f - t, 0.0f, 1.0f)));
+        fwrite(record.data(), 1, record.size(), file);
+    }
+    return fclose(file) == 0;
+}
+
+struct View
+{
+    const char* name;
+    Eigen::Quaternionf rotation;
+    Eigen::Vector3f pivot;
+    float distance;
+};
+
+static void set_camera(Camera& camera, const Eigen::AlignedBox3f& bounds, const View& view)
+{
+    camera.set_pose(view.rotation, view.pivot, view.distance);
+    camera.near_plane = std::max(view.distance * 1e-3f, 0.05f);
+    camera.far_plane = view.distance + bounds.diagonal().norm();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string input = "pointcloud_bench.las";
+    uint64_t millions = 8;
+    if (argc > 1 && std::strtoull(argv[1], nullptr, 10) > 0)
+    {
+        millions = std::strtoull(argv[1], nullptr, 10);
+    }
+    else if (argc > 1)
+    {
+        input = argv[1];
+    }
+    const size_t cache_mb = argc > 2 ? (size_t)std::atoi(argv[2]) : 64;
+
+    if (input == "pointcloud_bench.las")
+    {
+        auto tic = std::chrono::steady_clock::now();
+        if (!write_terrain(input, millions * 1000000))
+        {
+            return EXIT_FAILURE;
+        }
+        printf("Wrote %s: %llu M points in %.2f s\n", input.c_str(), (unsigned long long)millions, seconds_since(tic));
+    }
+
+    // Build, with chunks small enough to exercise the out-of-core path
+    PointCloudBuildOptions build_options;
+    build_options.chunk_points = size_t(1) << 20;
+    PointCloudBuildStats build_stats;
+    const std::string output = input + ".gvpc";
+    if (!build_point_cloud(input, output, build_options, &build_stats))
+    {
+        return EXIT_FAILURE;
+    }
+    printf("%u hardware threads\n", hardware_threads());
+    printf("build: %llu points, %zu nodes, depth %d, %zu chunks in %.2f s (%.2f Mpoints/s)\n",
+        (unsigned long long)build_stats.points, build_stats.nodes, build_stats.depth, build_stats.chunks,
+        build_stats.seconds, build_stats.points_per_second() * 1e-6);
+
+    PointCloud cloud;
+    if (!cloud.open(output))
+    {
+        return EXIT_FAILURE;
+    }
+    const Eigen::AlignedBox3f bounds = cloud.bounds();
+    const Eigen::Vector3f center = bounds.center();
+    const float extent = bounds.diagonal().norm();
+    const Eigen::Quaternionf oblique(Eigen::AngleAxisf(0.9f, Eigen::Vector3f::UnitX()));
+    const View views[] = {
+        { "overview", Eigen::Quaternionf::Identity(), center, 0.9f * extent },
+        { "oblique", oblique, center, 0.4f * extent },
+        { "close-up", oblique, center, 0.05f * extent },
+    };
+
+    // LOD against the brute-force reference, every node fully resident
+    PointSplatter splatter;
+    Framebuffer lod, reference;
+    lod.resize(WIDTH, HEIGHT);
+    reference.resize(WIDTH, HEIGHT);
+    std::vector<SplatBatch> all;
+    for (uint32_t node = 0; node < (uint32_t)cloud.nodes().size(); ++node)
+    {
+        const Span<const Point> points = cloud.points(node);
+        all.push_back({ points.data(), points.size(), 1 });
+    }
+    PointSelectOptions select_options;
+    std::vector<PointSelection> selection;
+    std::vector<float> spacing;
+    printf("\n%-10s %12s %10s %10s %10s %9s %9s %9s\n", "view", "selected", "select ms", "lod ms", "all ms",
+        "speedup", "differ", "rmse");
+    for (const View& view : views)
+    {
+        Camera camera;
+        set_camera(camera, bounds, view);
+        const Eigen::Matrix4f V = camera.view_matrix(), P = camera.projection_matrix(WIDTH, HEIGHT);
+
+        auto tic = std::chrono::steady_clock::now();
+        const uint64_t selected = cloud.select(V, P, HEIGHT, select_options, selection);
+        drawn_spacing(selection, std::vector<uint8_t>(), spacing);
+        const double select_seconds = seconds_since(tic);
+        std::vector<SplatBatch> batches;
+        for (size_t i = 0; i < selection.size(); ++i)
+        {
+            const Span<const Point> points = cloud.points(selection[i].node);
+            const int size = std::max(1, std::min((int)std::ceil(spacing[i]), 8));
+            batches.push_back({ points.data(), points.size(), size });
+        }
+        lod.clear(Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f));
+        splatter.draw(lod, batches, P * V);
+        const double lod_seconds = splatter.stats().seconds;
+        reference.clear(Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f));
+        splatter.draw(reference, all, P * V);
+        const double all_seconds = splatter.stats().seconds;
+
+        const ImageDifference d = compare_images(lod, reference, BACKGROUND, 16);
+        printf("%-10s %11.1f%% %10.2f %10.2f %10.2f %8.1fx %8.2f%% %9.2f\n", view.name,
+            100.0 * (double)selected / (double)cloud.header().num_points, 1000.0 * select_seconds,
+            1000.0 * lod_seconds, 1000.0 * all_seconds, all_seconds / (select_seconds + lod_seconds),
+            100.0 * d.differing_fraction(), d.rmse);
+    }
+
+    // Fly from the overview down to the close-up with a RAM budget; nodes
+    // are paged in by the loader thread while the frames go on
+    PageCache cache;
+    cache.budget = cache_mb << 20;
+    cache.load = [&](uint32_t node, std::vector<char>& data)
+    {
+        const Span<const Point> points = cloud.points(node);
+        const char* bytes = reinterpret_cast<const char*>(points.data());
+        data.assign(bytes, bytes + points.size_bytes());
+        return true;
+    };
+    cache.reset((size_t)cloud.header().num_nodes);
+    const int frames = 240;
+    size_t complete_frames = 0;
+    auto tic = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        const float t = (float)frame / (frames - 1);
+        View view = views[0];
+        view.rotation = Eigen::Quaternionf::Identity().slerp(t, oblique);
+        view.distance = views[0].distance * std::pow(views[2].distance / views[0].distance, t);
+        view.pivot = center + Eigen::Vector3f(0.2f * t * extent, 0.0f, 0.0f);
+        Camera camera;
+        set_camera(camera, bounds, view);
+        cloud.select(camera.view_matrix(), camera.projection_matrix(WIDTH, HEIGHT), HEIGHT, select_options, selection);
+        size_t resident = 0;
+        for (const PointSelection& s : selection)
+        {
+            resident += cache.acquire(s.node, s.pixel_spacing) != nullptr;
+        }
+        complete_frames += resident == selection.size();
+        cache.update();
+        // About a 60 Hz frame
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    const double fly_seconds = seconds_since(tic);
+    const PageCacheStats stats = cache.stats();
+    cache.stop();
+    printf("\nfly-through, %zu MB cache: %d frames in %.2f s, %zu complete\n", cache_mb, frames, fly_seconds,
+        complete_frames);
+    printf("  hits %llu, misses %llu (%.1f%% hit rate), loads %llu, evictions %llu\n",
+        (unsigned long long)stats.hits, (unsigned long long)stats.misses, 100.0 * stats.hit_rate(),
+        (unsigned long long)stats.loads, (unsigned long long)stats.evictions);
+    printf("  %.1f MB paged in (%.1f MB/s), %zu nodes / %.1f MB resident\n", stats.bytes_loaded / 1048576.0,
+        stats.bytes_loaded / 1048576.0 / fly_seconds, stats.resident_pages, stats.resident_bytes / 1048576.0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+// Autosave of a large plugin state: every save touches a few percent of
+// it. Compares a plain serialize() into one buffer written out in full on
+// the calling thread with chunked delta snapshots, which hash the state,
+// copy only the changed chunks and compress and write them in the
+// background. Every full_every-th save starts a new chain with a full
+// snapshot, whose unchanged chunks the background thread copies from the
+// previous chain ("copied MB").
+//
+//   snapshot_bench [state MB] [saves] [percent changed per save] [full_every]
+//
+// "stall" is the time the calling (render) thread spends per save.
+#include "BenchUtil.h"
+#include "util/Parallel.h"
+#include "viewer/Snapshot.h"
+#include "viewer/Viewer.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// A simulation grid: smooth fields that compress, edited in patches
+class StatePlugin : public ViewerPluginBase<StatePlugin>
+{
+public:
+    explicit StatePlugin(size_t bytes) : values(bytes / sizeof(float))
+    {
+        mName = "state";
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = std::floor(100.0f * std::sin(i * 1e-4f)) * 0.25f;
+        }
+    }
+
+    bool serialize(std::vector<char>& buffer) const override
+    {
+        const uint64_t count = values.size();
+        buffer.insert(buffer.end(), (const char*)&count, (const char*)&count + sizeof(count));
+        buffer.insert(buffer.end(), (const char*)values.data(), (const char*)(values.data() + values.size()));
+        return true;
+    }
+
+    bool snapshot(SnapshotOut& out) const override
+    {
+        out.write_value((uint64_t)values.size());
+        out.write(values.data(), values.size() * sizeof(float));
+        return true;
+    }
+
+    bool restore(SnapshotIn& in) override
+    {
+        uint64_t count;
+        if (!in.read_value(count) || count * sizeof(float) != in.remaining())
+        {
+            return false;
+        }
+        values.resize((size_t)count);
+        return in.read(values.data(), values.size() * sizeof(float));
+    }
+
+    // Rewrites `fraction` of the grid in patches of 64 KB
+    void edit(double fraction, std::mt19937& rng)
+    {
+        const size_t patch = 16384;
+        const size_t patches = (size_t)(fraction * values.size() / patch);
+        for (size_t p = 0; p < patches; ++p)
+        {
+            const size_t begin = rng() % (values.size() - patch);
+            for (size_t i = begin; i < begin + patch; ++i)
+            {
+                values[i] += 1.0f;
+            }
+        }
+    }
+
+    std::vector<float> values;
+};
+
+int main(int argc, char* argv[])
+{
+    const size_t mb = argc > 1 ? (size_t)std::atoi(argv[1]) : 256;
+    const int saves = argc > 2 ? std::atoi(argv[2]) : 10;
+    const double percent = argc > 3 ? std::atof(argv[3]) : 2.0;
+    const int full_every = argc > 4 ? std::atoi(argv[4]) : (int)SnapshotOptions().full_every;
+    if (mb == 0 || saves <= 0 || full_every <= 0)
+    {
+        fprintf(stderr, "Error: State size, saves and full_every must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    StatePlugin state(mb << 20);
+    std::vector<ViewerPlugin*> plugins = { &state };
+    std::mt19937 rng(7);
+    printf("%u hardware threads, %zu MB state, %.1f%% changed per save\n", hardware_threads(), mb, percent);
+
+    // Baseline: the whole state copied into one buffer and written out
+    double full_stall = 0.0;
+    const std::string full_file = "snapshot_bench.full";
+    for (int i = 0; i < saves; ++i)
+    {
+        state.edit(percent / 100.0, rng);
+        auto tic = std::chrono::steady_clock::now();
+        std::vector<char> buffer;
+        state.serialize(buffer);
+        FILE* f = fopen(full_file.c_str(), "wb");
+        const bool ok = f && fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+        if (f)
+        {
+            fclose(f);
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "Error: Could not write %s\n", full_file.c_str());
+            return EXIT_FAILURE;
+        }
+        full_stall += seconds_since(tic);
+    }
+    std::remove(full_file.c_str());
+    printf("\nserialize + fwrite: %.1f ms stall per save, %.1f MB written per save\n", 1e3 * full_stall / saves,
+        (double)mb);
+
+    printf("\n%6s %6s %10s %12s %12s %12s %12s %10s\n", "save", "kind", "stall ms", "changed MB", "stored MB",
+        "copied MB", "write ms", "chunks");
+    SnapshotWriter writer;
+    writer.options.full_every = (uint32_t)full_every;
+    writer.open("snapshot_bench");
+    double stall = 0.0, stored = 0.0;
+    for (int i = 0; i < saves; ++i)
+    {
+        state.edit(percent / 100.0, rng);
+        auto tic = std::chrono::steady_clock::now();
+        if (!writer.save(plugins))
+        {
+            return EXIT_FAILURE;
+        }
+        const double capture = seconds_since(tic);
+        writer.wait();
+        const SnapshotStats s = writer.stats();
+        if (!s.ok)
+        {
+            return EXIT_FAILURE;
+        }
+        stall += i > 0 ? capture : 0.0;
+        stored += i > 0 ? (s.stored_bytes + s.copied_bytes) / 1048576.0 : 0.0;
+        printf("%6d %6s %10.1f %12.1f %12.1f %12.1f %12.1f %4zu/%zu\n", i, s.delta ? "delta" : "full",
+            1e3 * capture, s.changed_bytes / 1048576.0, s.stored_bytes / 1048576.0, s.copied_bytes / 1048576.0,
+            1e3 * s.write_seconds, s.changed_chunks, s.chunks);
+    }
+    if (saves > 1)
+    {
+        printf("\nlater snapshots: %.1f ms stall per save, %.1f MB written per save (%.1fx less stall)\n",
+            1e3 * stall / (saves - 1), stored / (saves - 1), full_stall / stall);
+    }
+
+    // The last snapshot and its chain restore the current state
+    const std::vector<float> expected = state.values;
+    std::fill(state.values.begin(), state.values.end(), 0.0f);
+    auto tic = std::chrono::steady_clock::now();
+    SnapshotReader reader;
+    const bool restored = reader.open(writer.last_file()) && reader.restore(plugins);
+    const double restore_seconds = seconds_since(tic);
+    if (!restored || state.values != expected)
+    {
+        fprintf(stderr, "Error: The restored state differs\n");
+        return EXIT_FAILURE;
+    }
+    printf("restored %s and its chain in %.1f ms\n", writer.last_file().c_str(), 1e3 * restore_seconds);
+    for (int i = 0; i < saves; ++i)
+    {
+        std::remove(SnapshotWriter::file_name("snapshot_bench", i).c_str());
+    }
+    return EXIT_SUCCESS;
+}
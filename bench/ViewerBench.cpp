@@ -0,0 +1,874 @@
+// Benchmark suite for the viewer core: event dispatch, frames, input replay,
+// camera math, mesh parsing, software rasterization and the SIMD kernels at
+// every level this CPU supports. Runs headless (the viewer falls back to no window and
+// no GL context) and writes machine-readable JSON for tracking results
+// across releases.
+//
+//   viewer_bench [--json results.json] [--filter substring] [--quick]
+//                [--simd baseline|sse4.2|avx2|avx512]
+//                [--write-session session.gvi]
+//
+// --simd caps the kernel level of every benchmark but kernels/*.
+// --write-session records the synthetic session of the replay benchmarks
+// and exits; bench/data/session.gvi was written this way.
+//
+// Every result is the best of three timed runs, each long enough (doubling
+// the iteration count) to last at least a fixed minimum time.
+#include "BenchUtil.h"
+#include "kernels/Kernels.h"
+#include "mesh/Mesh.h"
+#include "mesh/MeshPlugin.h"
+#include "mesh/ObjLoader.h"
+#include "render/SoftwareRasterizer.h"
+#include "util/CpuFeatures.h"
+#include "util/Parallel.h"
+#include "viewer/Camera.h"
+#include "viewer/Viewer.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Checked-in inputs (see CMakeLists.txt)
+#ifndef VIEWER_BENCH_DATA
+#define VIEWER_BENCH_DATA "bench/data"
+#endif
+
+static const int SUITE_VERSION = 1;
+
+struct Result
+{
+    std::string name;
+    double value;
+    std::string unit;
+    uint64_t iterations;
+    double seconds; // of the best run
+};
+
+class Suite
+{
+public:
+    std::string filter;
+    bool quick = false;
+    std::vector<Result> results;
+
+    bool enabled(const std::string& group) const
+    {
+        return filter.empty() || group.find(filter) != std::string::npos || filter.find(group) != std::string::npos;
+    }
+
+    // Seconds per iteration of fn(iterations)
+    template <typename Fn>
+    double time(Fn&& fn, uint64_t& iterations)
+    {
+        const double min_seconds = quick ? 0.02 : 0.2;
+        iterations = 1;
+        double seconds = run(fn, iterations);
+        while (seconds < min_seconds && iterations < (uint64_t(1) << 40))
+        {
+            iterations *= seconds > 0.0 ? std::max<uint64_t>(2, std::min<uint64_t>(100, (uint64_t)(min_seconds / seconds) + 1)) : 100;
+            seconds = run(fn, iterations);
+        }
+        for (int i = 0; i < 2; ++i)
+        {
+            seconds = std::min(seconds, run(fn, iterations));
+        }
+        last_seconds_ = seconds;
+        return seconds / iterations;
+    }
+
+    void add(const std::string& name, double value, const std::string& unit, uint64_t iterations)
+    {
+        if (filter.empty() || name.find(filter) != std::string::npos)
+        {
+            results.push_back({ name, value, unit, iterations, last_seconds_ });
+            printf("%-40s %14.3f %-10s (%llu iterations)\n", name.c_str(), value, unit.c_str(),
+                (unsigned long long)iterations);
+        }
+    }
+
+    bool write_json(const std::string& filename) const
+    {
+        FILE* f = fopen(filename.c_str(), "w");
+        if (!f)
+        {
+            fprintf(stderr, "Error: Could not write %s\n", filename.c_str());
+            return false;
+        }
+        fprintf(f, "{\n  \"suite\": \"viewer_bench\",\n  \"version\": %d,\n  \"hardware_threads\": %u,\n"
+            "  \"simd\": \"%s\",\n  \"quick\": %s,\n  \"results\": [\n", SUITE_VERSION, hardware_threads(),
+            simd_level_name(simd_level()), quick ? "true" : "false");
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            fprintf(f, "    { \"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\", \"iterations\": %llu, "
+                "\"seconds\": %.6g }%s\n", r.name.c_str(), r.value, r.unit.c_str(),
+                (unsigned long long)r.iterations, r.seconds, i + 1 < results.size() ? "," : "");
+        }
+        fprintf(f, "  ]\n}\n");
+        return fclose(f) == 0;
+    }
+
+private:
+    template <typename Fn>
+    static double run(Fn& fn, uint64_t iterations)
+    {
+        auto tic = std::chrono::steady_clock::now();
+        fn(iterations);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+
+    double last_seconds_ = 0.0;
+};
+
+// Keeps results alive without the compiler seeing through them
+static volatile float sink;
+
+////////////////////////////////////////////////////////////////////////////////
+// Plugins
+////////////////////////////////////////////////////////////////////////////////
+
+// Derives from ViewerPlugin directly: gets every hook, implements none
+class LegacyPlugin : public ViewerPlugin
+{
+};
+
+// Declares no hooks at all
+class EmptyPlugin : public ViewerPluginBase<EmptyPlugin>
+{
+};
+
+// Handles the mouse, like a camera controller
+class InputPlugin : public ViewerPluginBase<InputPlugin>
+{
+public:
+    bool mouse_move(int mouse_x, int mouse_y) override
+    {
+        sum += mouse_x - mouse_y;
+        return false;
+    }
+
+    long long sum = 0;
+};
+
+// Per-frame CPU work: transforms its points on the job system, then
+// reduces them in pre_draw
+class HeavyPlugin : public ViewerPluginBase<HeavyPlugin>
+{
+public:
+    explicit HeavyPlugin(size_t count) : points(4, (Eigen::Index)count), transformed(4, (Eigen::Index)count)
+    {
+        points.setRandom();
+        points.row(3).setOnes();
+    }
+
+    bool pre_draw_tasks(TaskGraph& tasks, bool /*first*/) override
+    {
+        tasks.add([this]
+            {
+                transformed.noalias() = (mViewer->proj * mViewer->view) * points;
+            });
+        return false;
+    }
+
+    bool pre_draw(bool /*first*/) override
+    {
+        sink = transformed.row(2).sum();
+        return false;
+    }
+
+    Eigen::Matrix4Xf points;
+    Eigen::Matrix4Xf transformed;
+};
+
+// Counts the events it is handed and hashes them with the frame they
+// arrived in, so a replay can be compared with its recording
+class CountingPlugin : public ViewerPluginBase<CountingPlugin>
+{
+public:
+    bool pre_draw(bool /*first*/) override
+    {
+        ++frames;
+        return false;
+    }
+
+    bool mouse_down(int button, int modifier) override { return count(1, button, modifier); }
+    bool mouse_up(int button, int modifier) override { return count(2, button, modifier); }
+    bool mouse_move(int mouse_x, int mouse_y) override { return count(3, mouse_x, mouse_y); }
+    bool mouse_scroll(float delta_y) override { return count(4, (int)(delta_y * 1000.0f), 0); }
+    bool key_down(int key, int modifiers) override { return count(5, key, modifiers); }
+    bool key_up(int key, int modifiers) override { return count(6, key, modifiers); }
+
+    bool operator==(const CountingPlugin& other) const
+    {
+        return frames == other.frames && events == other.events && checksum == other.checksum;
+    }
+
+    int frames = 0;
+    uint64_t events = 0;
+    uint64_t checksum = 0;
+
+private:
+    bool count(int type, int a, int b)
+    {
+        ++events;
+        for (int64_t v : { (int64_t)frames, (int64_t)type, (int64_t)a, (int64_t)b })
+        {
+            checksum = (checksum ^ (uint64_t)v) * 0x100000001b3ull;
+        }
+        return false;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+////////////////////////////////////////////////////////////////////////////////
+
+// n - 1 plugins that implement nothing and one input plugin, the common
+// shape of a scene with one camera controller. Legacy plugins are called
+// for every hook, hooked ones for none: the gap is what the per-hook lists
+// save on every event and every frame.
+static void bench_dispatch(Suite& suite, Viewer& viewer)
+{
+    for (int n : { 1, 4, 16, 64 })
+    {
+        long long legacy_sum = 0;
+        for (bool legacy : { true, false })
+        {
+            std::vector<std::unique_ptr<ViewerPlugin>> owned;
+            viewer.plugins.clear();
+            for (int i = 0; i + 1 < n; ++i)
+            {
+                owned.emplace_back(legacy ? (ViewerPlugin*)new LegacyPlugin() : new EmptyPlugin());
+                viewer.plugins.push_back(owned.back().get());
+            }
+            InputPlugin input;
+            viewer.plugins.push_back(&input);
+            viewer.init_plugins();
+
+            const std::string suffix = std::string(legacy ? "legacy/" : "hooked/") + std::to_string(n);
+            uint64_t iterations;
+            double seconds = suite.time([&](uint64_t count)
+                {
+                    for (uint64_t i = 0; i < count; ++i)
+                    {
+                        viewer.mouse_move((int)i & 1023, (int)(i >> 10) & 1023);
+                    }
+                }, iterations);
+            suite.add("dispatch/mouse_move/" + suffix, seconds * 1e9, "ns/event", iterations);
+
+            // Both paths must hand the input plugin the same events
+            input.sum = 0;
+            for (int i = 0; i < 1024; ++i)
+            {
+                viewer.mouse_move(i, 1023 - i);
+            }
+            if (!legacy && input.sum != legacy_sum)
+            {
+                fprintf(stderr, "Error: The hooked dispatch delivered different events than the legacy one\n");
+                exit(EXIT_FAILURE);
+            }
+            legacy_sum = input.sum;
+
+            viewer.launch_frames(2); // warm up pools and arenas
+            seconds = suite.time([&](uint64_t count)
+                {
+                    viewer.launch_frames((int)count);
+                }, iterations);
+            suite.add("dispatch/frame/" + suffix, seconds * 1e6, "us/frame", iterations);
+        }
+    }
+    viewer.plugins.clear();
+    viewer.init_plugins();
+}
+
+static void bench_draw(Suite& suite, Viewer& viewer)
+{
+    const size_t points = suite.quick ? 16384 : 65536;
+    for (int n : { 0, 1, 8, 32 })
+    {
+        for (bool heavy : { false, true })
+        {
+            if (heavy && n == 0)
+            {
+                continue;
+            }
+            std::vector<std::unique_ptr<ViewerPlugin>> owned;
+            viewer.plugins.clear();
+            for (int i = 0; i < n; ++i)
+            {
+                owned.emplace_back(heavy ? (ViewerPlugin*)new HeavyPlugin(points) : new EmptyPlugin());
+                viewer.plugins.push_back(owned.back().get());
+            }
+            viewer.init_plugins();
+            viewer.launch_frames(2); // warm up pools and arenas
+
+            uint64_t iterations;
+            const double seconds = suite.time([&](uint64_t count)
+                {
+                    viewer.launch_frames((int)count);
+                }, iterations);
+            suite.add("draw/" + std::string(heavy ? "heavy/" : "empty/") + std::to_string(n), seconds * 1e6,
+                "us/frame", iterations);
+        }
+    }
+    viewer.plugins.clear();
+    viewer.init_plugins();
+}
+
+// Frames of the synthetic session: a left drag with a scroll now and then
+// and a key press, several mouse moves per frame so some get coalesced
+static const int SESSION_FRAMES = 120;
+
+static void record_session(Viewer& viewer)
+{
+    for (int f = 0; f < SESSION_FRAMES; ++f)
+    {
+        if (f == 10)
+        {
+            viewer.input_queue.push(InputEvent::mouse_button(InputEvent::Type::MouseDown, 0, 0));
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            viewer.input_queue.push(InputEvent::mouse_move(100 + 4 * f + k, 200 + 2 * f - k));
+        }
+        if (f % 15 == 7)
+        {
+            viewer.input_queue.push(InputEvent::mouse_scroll(f % 2 ? 1.0f : -0.5f));
+        }
+        if (f == 60)
+        {
+            viewer.input_queue.push(InputEvent::mouse_button(InputEvent::Type::MouseUp, 0, 0));
+        }
+        if (f == 80 || f == 82)
+        {
+            viewer.input_queue.push(InputEvent::key(f == 80 ? InputEvent::Type::KeyDown : InputEvent::Type::KeyUp,
+                'A', 0));
+        }
+        viewer.launch_frames(1);
+    }
+}
+
+// Replays `log` with a fresh CountingPlugin in `plugin`
+static ReplayStats replay_session(Viewer& viewer, const InputLog& log, CountingPlugin& plugin)
+{
+    plugin = CountingPlugin();
+    viewer.plugins.clear();
+    viewer.plugins.push_back(&plugin);
+    viewer.init_plugins();
+    ReplayStats stats;
+    viewer.replay_input(log, false, &stats);
+    viewer.plugins.clear();
+    viewer.init_plugins();
+    return stats;
+}
+
+static bool write_session(Viewer& viewer, const std::string& filename)
+{
+    if (!viewer.start_recording(filename))
+    {
+        return false;
+    }
+    record_session(viewer);
+    return viewer.stop_recording();
+}
+
+// A log that does not replay into the frames and events it was recorded
+// with has broken the recorder or the player
+static void check_replay(const char* what, const ReplayStats& stats, const CountingPlugin& replayed,
+    const InputLog& log, const CountingPlugin& expected)
+{
+    if ((uint64_t)stats.frames != log.header.num_frames || stats.events != log.header.num_events
+        || !(replayed == expected))
+    {
+        fprintf(stderr, "Error: %s replayed %d frames, %llu events, plugin saw %d frames, %llu events "
+            "(checksum %016llx); expected %llu frames, %llu events, plugin %d frames, %llu events "
+            "(checksum %016llx)\n", what, stats.frames, (unsigned long long)stats.events, replayed.frames,
+            (unsigned long long)replayed.events, (unsigned long long)replayed.checksum,
+            (unsigned long long)log.header.num_frames, (unsigned long long)log.header.num_events,
+            expected.frames, (unsigned long long)expected.events, (unsigned long long)expected.checksum);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void bench_replay(Suite& suite, Viewer& viewer)
+{
+    // Round trip: record the session, load it and replay it
+    const std::string filename = "viewer_bench.gvi";
+    CountingPlugin recorded;
+    viewer.plugins.clear();
+    viewer.plugins.push_back(&recorded);
+    viewer.init_plugins();
+    const bool written = write_session(viewer, filename);
+    viewer.plugins.clear();
+    viewer.init_plugins();
+    InputLog log;
+    if (!written || !log.load(filename))
+    {
+        exit(EXIT_FAILURE);
+    }
+    std::remove(filename.c_str());
+    if (log.header.num_frames != SESSION_FRAMES || log.header.num_events != viewer.input_recorder.events())
+    {
+        fprintf(stderr, "Error: Recorded %llu frames, %llu events, the log holds %llu frames, %llu events\n",
+            (unsigned long long)SESSION_FRAMES, (unsigned long long)viewer.input_recorder.events(),
+            (unsigned long long)log.header.num_frames, (unsigned long long)log.header.num_events);
+        exit(EXIT_FAILURE);
+    }
+    CountingPlugin replayed;
+    check_replay("Recorded session", replay_session(viewer, log, replayed), replayed, log, recorded);
+
+    // The checked-in session, recorded by an earlier build: the format
+    // still loads and replays to the same events
+    const std::string fixture = std::string(VIEWER_BENCH_DATA) + "/session.gvi";
+    InputLog checked_in;
+    if (!checked_in.load(fixture))
+    {
+        exit(EXIT_FAILURE);
+    }
+    check_replay(fixture.c_str(), replay_session(viewer, checked_in, replayed), replayed, checked_in, recorded);
+
+    uint64_t iterations;
+    const double seconds = suite.time([&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                replay_session(viewer, checked_in, replayed);
+            }
+        }, iterations);
+    suite.add("replay/session", seconds / checked_in.frames.size() * 1e6, "us/frame", iterations);
+}
+
+static void bench_eigen(Suite& suite)
+{
+    const Eigen::Index count = suite.quick ? 100000 : 1000000;
+    Eigen::Matrix4Xf points = Eigen::Matrix4Xf::Random(4, count);
+    Eigen::Matrix4Xf out(4, count);
+    Camera camera;
+    camera.fit(Eigen::AlignedBox3f(Eigen::Vector3f(-1, -1, -1), Eigen::Vector3f(1, 1, 1)));
+    const Eigen::Matrix4f mvp = camera.projection_matrix(1280, 800) * camera.view_matrix();
+
+    uint64_t iterations;
+    double seconds = suite.time([&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                out.noalias() = mvp * points;
+            }
+            sink = out(0, 0);
+        }, iterations);
+    suite.add("eigen/transform_points", count / seconds * 1e-6, "Mpoints/s", iterations);
+
+    Eigen::Matrix4f m = mvp;
+    seconds = suite.time([&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                m = (mvp * m).eval();
+                m(3, 3) = 1.0f;
+            }
+            sink = m(0, 0);
+        }, iterations);
+    suite.add("eigen/matrix4_multiply", seconds * 1e9, "ns", iterations);
+
+    seconds = suite.time([&](uint64_t n)
+        {
+            float acc = 0.0f;
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                camera.set_pose(Eigen::Quaternionf(Eigen::AngleAxisf(i * 1e-3f, Eigen::Vector3f::UnitY())),
+                    Eigen::Vector3f::Zero(), 3.0f);
+                acc += (camera.projection_matrix(1280, 800) * camera.view_matrix())(0, 0);
+            }
+            sink = acc;
+        }, iterations);
+    suite.add("eigen/camera_matrices", seconds * 1e9, "ns", iterations);
+}
+
+// A size x size grid with positions, uvs and normals
+static std::string make_obj(int size)
+{
+    MeshData mesh;
+    make_grid(size, 1.0f, [](float x, float y) { return 0.1f * std::sin(10.0f * x) * std::cos(10.0f * y); }, mesh);
+    mesh.normals.resize(mesh.positions.size());
+    for (size_t v = 0; v < mesh.num_vertices(); ++v)
+    {
+        mesh.normals[3 * v + 2] = 1.0f;
+    }
+    return mesh_to_obj(mesh);
+}
+
+// A grid from make_obj(size) that did not parse into 2 * size^2 triangles
+// would make every number measured on it meaningless
+static void check_grid(const MeshData& mesh, int size)
+{
+    if (mesh.num_triangles() != (size_t)2 * size * size)
+    {
+        fprintf(stderr, "Error: Grid of size %d parsed into %zu triangles instead of %zu\n", size,
+            mesh.num_triangles(), (size_t)2 * size * size);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Loads the grid as the viewer does in the background and culls it against a
+// frustum around part of it: every culled range must be a run of the index
+// stream uploaded to the GPU that draws the triangles the BVH put there, and
+// together the ranges must draw every triangle that reaches into the frustum
+static void check_culled_draws(const std::string& filename, int size)
+{
+    MeshPlugin plugin;
+    plugin.use_cache = false;
+    plugin.use_lod = false;
+    Asset asset;
+    asset.filename = filename;
+    asset.plugin = &plugin;
+    if (!plugin.load_async(asset))
+    {
+        fprintf(stderr, "Error: Could not load %s\n", filename.c_str());
+        exit(EXIT_FAILURE);
+    }
+    const std::vector<uint32_t> uploaded(asset.view.indices.data(),
+        asset.view.indices.data() + asset.view.indices.size());
+    plugin.load_finished(asset);
+    check_grid(plugin.mesh, size);
+
+    // Orthographic view of x in [0.1, 0.4], y in [0.2, 0.5]
+    const float l = 0.1f, r = 0.4f, b = 0.2f, t = 0.5f;
+    Eigen::Matrix4f view_proj = Eigen::Matrix4f::Identity();
+    view_proj(0, 0) = 2.0f / (r - l);
+    view_proj(0, 3) = -(r + l) / (r - l);
+    view_proj(1, 1) = 2.0f / (t - b);
+    view_proj(1, 3) = -(t + b) / (t - b);
+    const Frustum frustum = Frustum::from_matrix(view_proj);
+    std::vector<Bvh::Range> ranges;
+    plugin.bvh.cull(frustum, ranges);
+
+    const uint32_t* F = plugin.view.indices.data();
+    const float* V = plugin.view.positions.data();
+    const size_t triangles = plugin.view.num_triangles();
+    std::vector<bool> drawn(triangles, false);
+    size_t drawn_triangles = 0;
+    for (const Bvh::Range& range : ranges)
+    {
+        for (uint32_t k = range.first; k < range.first + range.count; ++k)
+        {
+            const uint32_t triangle = plugin.bvh.primitives()[k];
+            if (!std::equal(F + 3 * (size_t)triangle, F + 3 * (size_t)triangle + 3, uploaded.data() + 3 * (size_t)k))
+            {
+                fprintf(stderr, "Error: Draw %u of a culled range is not triangle %u of the BVH\n", k, triangle);
+                exit(EXIT_FAILURE);
+            }
+            drawn[triangle] = true;
+            ++drawn_triangles;
+        }
+    }
+    for (size_t i = 0; i < triangles; ++i)
+    {
+        Eigen::AlignedBox3f box;
+        for (int c = 0; c < 3; ++c)
+        {
+            box.extend(Eigen::Vector3f::Map(V + 3 * (size_t)F[3 * i + c]));
+        }
+        if (!drawn[i] && frustum.classify(box) != Frustum::Outside)
+        {
+            fprintf(stderr, "Error: Triangle %zu is in the frustum but in no culled range\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (drawn_triangles >= triangles)
+    {
+        fprintf(stderr, "Error: Culling a tenth of the grid drew all %zu triangles\n", triangles);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void bench_mesh(Suite& suite)
+{
+    const int size = suite.quick ? 200 : 700;
+    const std::string text = make_obj(size);
+    const double mb = text.size() / 1048576.0;
+    MeshData mesh;
+
+    for (unsigned threads : { 1u, 0u })
+    {
+        ObjLoadOptions options;
+        options.threads = threads;
+        uint64_t iterations;
+        const double seconds = suite.time([&](uint64_t n)
+            {
+                for (uint64_t i = 0; i < n; ++i)
+                {
+                    parse_obj(text.data(), text.size(), mesh, options);
+                }
+            }, iterations);
+        check_grid(mesh, size);
+        const std::string suffix = threads == 1 ? "serial" : "parallel";
+        suite.add("mesh/parse_obj/" + suffix, mb / seconds, "MB/s", iterations);
+        suite.add("mesh/parse_obj/" + suffix + "/triangles", mesh.num_triangles() / seconds * 1e-6, "Mtris/s",
+            iterations);
+    }
+
+    const std::string filename = "viewer_bench.obj";
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (!f || fwrite(text.data(), 1, text.size(), f) != text.size())
+    {
+        fprintf(stderr, "Error: Could not write %s\n", filename.c_str());
+        if (f)
+        {
+            fclose(f);
+        }
+        return;
+    }
+    fclose(f);
+    uint64_t iterations;
+    const double seconds = suite.time([&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                load_obj(filename, mesh);
+            }
+        }, iterations);
+    check_grid(mesh, size);
+    suite.add("mesh/load_obj", mb / seconds, "MB/s", iterations);
+    check_culled_draws(filename, size);
+    std::remove(filename.c_str());
+}
+
+// Fill rate scene: full-screen quads drawn back to front, so early-z never
+// rejects a pixel
+static void make_layers(RowMatrixX3f& V, RowMatrixX3u& F)
+{
+    const int layers = 8;
+    V.resize(4 * layers, 3);
+    F.resize(2 * layers, 3);
+    for (int l = 0; l < layers; ++l)
+    {
+        const float z = 0.9f - 0.1f * l;
+        V.row(4 * l + 0) << -1.0f, -1.0f, z;
+        V.row(4 * l + 1) << 1.0f, -1.0f, z;
+        V.row(4 * l + 2) << 1.0f, 1.0f, z;
+        V.row(4 * l + 3) << -1.0f, 1.0f, z;
+        F.row(2 * l + 0) << 4 * l + 0, 4 * l + 1, 4 * l + 2;
+        F.row(2 * l + 1) << 4 * l + 0, 4 * l + 2, 4 * l + 3;
+    }
+}
+
+static void bench_raster(Suite& suite)
+{
+    const int width = 1920, height = 1080;
+    Framebuffer fb;
+    fb.resize(width, height);
+    SoftwareRasterizer rasterizer;
+
+    RowMatrixX3f V;
+    RowMatrixX3u F;
+    make_layers(V, F);
+    RasterState state;
+    uint64_t iterations;
+    double seconds = suite.time([&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                fb.clear(Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f));
+                rasterizer.draw(fb, V, F, state);
+            }
+        }, iterations);
+    suite.add("raster/fill", rasterizer.stats().pixels_shaded / seconds * 1e-6, "Mpixels/s", iterations);
+
+    // Triangle rate: a dense grid of small triangles across the screen
+    const int size = suite.quick ? 200 : 500;
+    const std::string text = make_obj(size);
+    MeshData mesh;
+    parse_obj(text.data(), text.size(), mesh);
+    check_grid(mesh, size);
+    state.mvp = Eigen::Matrix4f::Identity();
+    state.mvp.block<2, 2>(0, 0) *= 1.8f;
+    state.mvp.block<2, 1>(0, 3).setConstant(-0.9f);
+    seconds = suite.time([&](uint64_t n)
+        {
+            for (uint64_t i = 0; i < n; ++i)
+            {
+                fb.clear(Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f));
+                rasterizer.draw(fb, mesh.view(), state);
+            }
+        }, iterations);
+    suite.add("raster/triangles", mesh.num_triangles() / seconds * 1e-6, "Mtris/s", iterations);
+}
+
+// Every kernel at every level compiled in and supported, single-threaded
+static void bench_kernels(Suite& suite)
+{
+    const SimdLevel active = simd_level();
+    const size_t count = suite.quick ? 100000 : 1000000;
+    std::vector<float> points(3 * count), clip(4 * count);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        points[i] = std::sin((float)i);
+    }
+    Camera camera;
+    camera.fit(Eigen::AlignedBox3f(Eigen::Vector3f(-1, -1, -1), Eigen::Vector3f(1, 1, 1)));
+    const Eigen::Matrix4f mvp = camera.projection_matrix(1280, 800) * camera.view_matrix();
+
+    MeshData mesh;
+    const int size = suite.quick ? 200 : 500;
+    const std::string text = make_obj(size);
+    parse_obj(text.data(), text.size(), mesh);
+    check_grid(mesh, size);
+    const size_t nt = mesh.num_triangles();
+    std::vector<float> normals(3 * nt), angles(3 * nt);
+
+    Framebuffer fb;
+    fb.resize(1920, 1080);
+    RowMatrixX3f V;
+    RowMatrixX3u F;
+    make_layers(V, F);
+    SoftwareRasterizer rasterizer;
+    rasterizer.threads = 1;
+
+    for (int l = 0; l <= (int)detect_simd_level(); ++l)
+    {
+        const Kernels& k = kernels((SimdLevel)l);
+        if ((int)k.level != l)
+        {
+            continue; // not compiled in
+        }
+        const std::string prefix = std::string("kernels/") + simd_level_name(k.level) + "/";
+        uint64_t iterations;
+        double seconds = suite.time([&](uint64_t n)
+            {
+                for (uint64_t i = 0; i < n; ++i)
+                {
+                    k.transform_points(mvp.data(), points.data(), 3, count, clip.data(), 4);
+                }
+                sink = clip[0];
+            }, iterations);
+        suite.add(prefix + "transform_points", count / seconds * 1e-6, "Mpoints/s", iterations);
+
+        seconds = suite.time([&](uint64_t n)
+            {
+                for (uint64_t i = 0; i < n; ++i)
+                {
+                    k.face_normals(mesh.positions.data(), mesh.indices.data(), nt, normals.data(), angles.data());
+                }
+                sink = normals[0];
+            }, iterations);
+        suite.add(prefix + "face_normals", nt / seconds * 1e-6, "Mtris/s", iterations);
+
+        set_simd_level(k.level);
+        seconds = suite.time([&](uint64_t n)
+            {
+                for (uint64_t i = 0; i < n; ++i)
+                {
+                    fb.clear(Eigen::Vector4f(0.0f, 0.0f, 0.0f, 1.0f));
+                    rasterizer.draw(fb, V, F, RasterState());
+                }
+            }, iterations);
+        suite.add(prefix + "raster_fill", rasterizer.stats().pixels_shaded / seconds * 1e-6, "Mpixels/s",
+            iterations);
+        set_simd_level(active);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Suite suite;
+    std::string json;
+    std::string session;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json = argv[++i];
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            suite.filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--quick") == 0)
+        {
+            suite.quick = true;
+        }
+        else if (strcmp(argv[i], "--simd") == 0 && i + 1 < argc)
+        {
+            SimdLevel level;
+            if (!parse_simd_level(argv[++i], level))
+            {
+                fprintf(stderr, "Error: Unknown SIMD level %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            set_simd_level(level);
+        }
+        else if (strcmp(argv[i], "--write-session") == 0 && i + 1 < argc)
+        {
+            session = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: viewer_bench [--json results.json] [--filter substring] [--quick] "
+                "[--simd level] [--write-session session.gvi]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (!session.empty())
+    {
+        Viewer viewer;
+        const bool written = viewer.launch_init_offscreen(640, 400) != EXIT_FAILURE && write_session(viewer, session);
+        viewer.launch_shut();
+        return written ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    printf("%u hardware threads, %s kernels (%s supported)\n", hardware_threads(), simd_level_name(simd_level()),
+        simd_level_name(detect_simd_level()));
+
+    if (suite.enabled("dispatch") || suite.enabled("draw") || suite.enabled("replay"))
+    {
+        Viewer viewer;
+        if (viewer.launch_init_offscreen(640, 400) == EXIT_FAILURE)
+        {
+            viewer.launch_shut();
+            return EXIT_FAILURE;
+        }
+        if (suite.enabled("replay"))
+        {
+            bench_replay(suite, viewer);
+        }
+        if (suite.enabled("dispatch"))
+        {
+            bench_dispatch(suite, viewer);
+        }
+        if (suite.enabled("draw"))
+        {
+            bench_draw(suite, viewer);
+        }
+        viewer.launch_shut();
+    }
+    if (suite.enabled("eigen"))
+    {
+        bench_eigen(suite);
+    }
+    if (suite.enabled("mesh"))
+    {
+        bench_mesh(suite);
+    }
+    if (suite.enabled("raster"))
+    {
+        bench_raster(suite);
+    }
+    if (suite.enabled("kernels"))
+    {
+        bench_kernels(suite);
+    }
+
+    if (!json.empty() && !suite.write_json(json))
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+#include "Kernels.h"
+#include "KernelsImpl.h"
+
+namespace
+{
+const Kernels KERNELS_BASELINE = { SimdLevel::Baseline, rasterize_tile, transform_points, face_normals };
+}
+
+#ifdef GLFW_VIEWER_ISA_DISPATCH
+extern const Kernels KERNELS_SSE42;
+extern const Kernels KERNELS_AVX2;
+extern const Kernels KERNELS_AVX512;
+#endif
+
+const Kernels& kernels()
+{
+    return kernels(simd_level());
+}
+
+const Kernels& kernels(SimdLevel level)
+{
+#ifdef GLFW_VIEWER_ISA_DISPATCH
+    static const Kernels* const tables[] = { &KERNELS_BASELINE, &KERNELS_SSE42, &KERNELS_AVX2, &KERNELS_AVX512 };
+#else
+    static const Kernels* const tables[] = { &KERNELS_BASELINE, &KERNELS_BASELINE, &KERNELS_BASELINE,
+        &KERNELS_BASELINE };
+#endif
+    static_assert(sizeof(tables) / sizeof(tables[0]) == (size_t)SimdLevel::Count, "One table per level");
+    const int detected = (int)detect_simd_level();
+    return *tables[(int)level < detected ? (int)level : detected];
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "../util/CpuFeatures.h"
+#include <cstddef>
+#include <cstdint>
+
+// Hot loops compiled once per SimdLevel and picked at run time, so one
+// binary uses the widest vectors of the CPU it runs on. Kernels.cpp holds
+// the baseline build; KernelsSse42.cpp, KernelsAvx2.cpp and
+// KernelsAvx512.cpp compile the same bodies (KernelsImpl.h) with their
+// level's flags when GLFW_VIEWER_ISA_DISPATCH is on.
+//
+// The interfaces take plain arrays: an Eigen or standard library template
+// instantiated under wider flags could be merged by the linker into code
+// that runs on any CPU. Results may differ in the last bits between levels
+// (FMA contraction, vector widths).
+
+// Clip-space vertex with its color
+struct ClipVertex
+{
+    float x, y, z, w;
+    float r, g, b;
+};
+
+// Triangle ready for rasterization, in pixels
+struct TriangleSetup
+{
+    float A[3], B[3], C[3];   // edge functions E_i = A x + B y + C
+    bool top_left[3];
+    float z[3];               // depth plane (a x + b y + c)
+    float inv_w[3];           // 1/w plane
+    float rgb_w[3][3];        // color/w planes
+    int min_x, min_y, max_x, max_y;
+};
+
+// Row stride multiple of the framebuffers, in pixels: the widest kernel
+// loads and stores whole vectors of this many pixels
+constexpr int RASTER_ALIGNMENT = 16;
+
+// Color and depth rows of a framebuffer, row 0 at the top
+struct RasterTarget
+{
+    uint32_t* color;
+    float* depth;
+    int width;
+    int height;
+    int stride;
+};
+
+struct Kernels
+{
+    SimdLevel level;
+
+    // Pixels of `s` inside the tile [x0, x1) x [y0, y1): coverage, early-z,
+    // then color. x0 and x1 are multiples of RASTER_ALIGNMENT, so a vector
+    // never crosses into a neighbouring tile. Returns the pixels shaded.
+    size_t (*rasterize_tile)(const TriangleSetup& s, const RasterTarget& target, int x0, int y0, int x1, int y1);
+
+    // out = m * (x, y, z, 1) for `count` points, 3 floats read from every
+    // `in_stride` floats of `in` and 4 written to every `out_stride` of
+    // `out`. m is column-major (Eigen's default).
+    void (*transform_points)(const float* m, const float* in, size_t in_stride, size_t count, float* out,
+        size_t out_stride);
+
+    // Normals of `count` triangles (3 indices each) into `normals`, 3 floats
+    // per triangle: the cross product of the edges (twice the area), or the
+    // unit normal and the 3 interior angles into `angles` if it is given.
+    void (*face_normals)(const float* positions, const uint32_t* indices, size_t count, float* normals,
+        float* angles);
+};
+
+// Kernels for simd_level()
+const Kernels& kernels();
+
+// Highest level compiled in that is no higher than `level` and supported by
+// this CPU; its `level` field tells which one that is
+const Kernels& kernels(SimdLevel level);
@@ -0,0 +1,9 @@
+// AVX2 build of the kernels: -mavx2 -mfma or /arch:AVX2 (see CMakeLists.txt)
+#ifdef GLFW_VIEWER_ISA_DISPATCH
+#if !defined(__AVX2__)
+#error "KernelsAvx2.cpp must be compiled with AVX2 enabled"
+#endif
+#include "KernelsImpl.h"
+
+extern const Kernels KERNELS_AVX2 = { SimdLevel::AVX2, rasterize_tile, transform_points, face_normals };
+#endif
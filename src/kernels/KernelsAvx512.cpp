@@ -0,0 +1,10 @@
+// AVX-512 build of the kernels: -mavx512f -mavx512vl -mavx512bw -mavx512dq
+// or /arch:AVX512 (see CMakeLists.txt)
+#ifdef GLFW_VIEWER_ISA_DISPATCH
+#if !defined(__AVX512F__)
+#error "KernelsAvx512.cpp must be compiled with AVX-512 enabled"
+#endif
+#include "KernelsImpl.h"
+
+extern const Kernels KERNELS_AVX512 = { SimdLevel::AVX512, rasterize_tile, transform_points, face_normals };
+#endif
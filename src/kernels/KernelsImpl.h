@@ -0,0 +1,452 @@
+#pragma once
+
+// Kernel bodies, included by one translation unit per SimdLevel and built
+// with that level's flags. Everything has internal linkage and only uses
+// intrinsics and C math, see Kernels.h.
+
+#include "Kernels.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define GV_KERNEL_LANES 16
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define GV_KERNEL_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#define GV_KERNEL_LANES 4
+#endif
+
+namespace
+{
+// Triangles per batch of face_normals(): every arithmetic loop runs over a
+// whole batch, a trip count the compiler vectorizes without a remainder loop
+const size_t BATCH = 256;
+
+inline int min_i(int a, int b)
+{
+    return a < b ? a : b;
+}
+
+inline int max_i(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+inline size_t min_size(size_t a, size_t b)
+{
+    return a < b ? a : b;
+}
+
+inline int popcount(unsigned mask)
+{
+#if defined(__POPCNT__)
+    return _mm_popcnt_u32(mask);
+#else
+    int n = 0;
+    for (; mask; mask &= mask - 1)
+    {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+#if GV_KERNEL_LANES == 16
+struct Vec
+{
+    static const int W = 16;
+    using F = __m512;
+    using I = __m512i;
+    using M = __mmask16;
+
+    static F set1(float v) { return _mm512_set1_ps(v); }
+    static F lanes()
+    {
+        return _mm512_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f, 8.5f, 9.5f, 10.5f, 11.5f, 12.5f,
+            13.5f, 14.5f, 15.5f);
+    }
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F madd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+    static F div(F a, F b) { return _mm512_div_ps(a, b); }
+    static F min(F a, F b) { return _mm512_min_ps(a, b); }
+    static F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static M eq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static M both(M a, M b) { return (M)(a & b); }
+    static M either(M a, M b) { return (M)(a | b); }
+    static M mask(bool on) { return (M)(on ? 0xffff : 0); }
+    static unsigned bits(M m) { return (unsigned)m; }
+    static F load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, M m, F v) { _mm512_mask_storeu_ps(p, m, v); }
+    // Channels in [0, 1] to RGBA8 with alpha 1
+    static I rgba(F r, F g, F b)
+    {
+        const F scale = set1(255.0f), half = set1(0.5f);
+        const I ri = _mm512_cvttps_epi32(madd(r, scale, half));
+        const I gi = _mm512_cvttps_epi32(madd(g, scale, half));
+        const I bi = _mm512_cvttps_epi32(madd(b, scale, half));
+        const I c = _mm512_or_si512(ri, _mm512_or_si512(_mm512_slli_epi32(gi, 8), _mm512_slli_epi32(bi, 16)));
+        return _mm512_or_si512(c, _mm512_set1_epi32((int)0xff000000u));
+    }
+    static void store(uint32_t* p, M m, I v) { _mm512_mask_storeu_epi32(p, m, v); }
+};
+#elif GV_KERNEL_LANES == 8
+struct Vec
+{
+    static const int W = 8;
+    using F = __m256;
+    using I = __m256i;
+    using M = __m256;
+
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F lanes() { return _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F madd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+    static F div(F a, F b) { return _mm256_div_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M eq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static M both(M a, M b) { return _mm256_and_ps(a, b); }
+    static M either(M a, M b) { return _mm256_or_ps(a, b); }
+    static M mask(bool on) { return _mm256_castsi256_ps(_mm256_set1_epi32(on ? -1 : 0)); }
+    static unsigned bits(M m) { return (unsigned)_mm256_movemask_ps(m); }
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, M m, F v) { _mm256_storeu_ps(p, _mm256_blendv_ps(_mm256_loadu_ps(p), v, m)); }
+    static I rgba(F r, F g, F b)
+    {
+        const F scale = set1(255.0f), half = set1(0.5f);
+        const I ri = _mm256_cvttps_epi32(madd(r, scale, half));
+        const I gi = _mm256_cvttps_epi32(madd(g, scale, half));
+        const I bi = _mm256_cvttps_epi32(madd(b, scale, half));
+        const I c = _mm256_or_si256(ri, _mm256_or_si256(_mm256_slli_epi32(gi, 8), _mm256_slli_epi32(bi, 16)));
+        return _mm256_or_si256(c, _mm256_set1_epi32((int)0xff000000u));
+    }
+    static void store(uint32_t* p, M m, I v)
+    {
+        __m256i* dst = (__m256i*)p;
+        _mm256_storeu_si256(dst, _mm256_blendv_epi8(_mm256_loadu_si256(dst), v, _mm256_castps_si256(m)));
+    }
+};
+#elif GV_KERNEL_LANES == 4
+struct Vec
+{
+    static const int W = 4;
+    using F = __m128;
+    using I = __m128i;
+    using M = __m128;
+
+    static F set1(float v) { return _mm_set1_ps(v); }
+    static F lanes() { return _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F madd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F div(F a, F b) { return _mm_div_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static M eq(F a, F b) { return _mm_cmpeq_ps(a, b); }
+    static M both(M a, M b) { return _mm_and_ps(a, b); }
+    static M either(M a, M b) { return _mm_or_ps(a, b); }
+    static M mask(bool on) { return _mm_castsi128_ps(_mm_set1_epi32(on ? -1 : 0)); }
+    static unsigned bits(M m) { return (unsigned)_mm_movemask_ps(m); }
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, M m, F v)
+    {
+        const F old = _mm_loadu_ps(p);
+#if defined(__SSE4_1__)
+        _mm_storeu_ps(p, _mm_blendv_ps(old, v, m));
+#else
+        _mm_storeu_ps(p, _mm_or_ps(_mm_and_ps(m, v), _mm_andnot_ps(m, old)));
+#endif
+    }
+    static I rgba(F r, F g, F b)
+    {
+        const F scale = set1(255.0f), half = set1(0.5f);
+        const I ri = _mm_cvttps_epi32(madd(r, scale, half));
+        const I gi = _mm_cvttps_epi32(madd(g, scale, half));
+        const I bi = _mm_cvttps_epi32(madd(b, scale, half));
+        const I c = _mm_or_si128(ri, _mm_or_si128(_mm_slli_epi32(gi, 8), _mm_slli_epi32(bi, 16)));
+        return _mm_or_si128(c, _mm_set1_epi32((int)0xff000000u));
+    }
+    static void store(uint32_t* p, M m, I v)
+    {
+        __m128i* dst = (__m128i*)p;
+        const I old = _mm_loadu_si128(dst);
+        const I mi = _mm_castps_si128(m);
+#if defined(__SSE4_1__)
+        _mm_storeu_si128(dst, _mm_blendv_epi8(old, v, mi));
+#else
+        _mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(mi, v), _mm_andnot_si128(mi, old)));
+#endif
+    }
+};
+#endif
+
+#ifdef GV_KERNEL_LANES
+// Edge functions are evaluated for Vec::W pixels at a time, from groups
+// that start Vec::W-aligned; the depth test runs before anything else is
+// interpolated.
+size_t rasterize_tile(const TriangleSetup& s, const RasterTarget& fb, int tx0, int ty0, int tx1, int ty1)
+{
+    using F = Vec::F;
+    using M = Vec::M;
+    const int x_begin = max_i(s.min_x, tx0) & ~(Vec::W - 1);
+    const int x_end = min_i(min_i(s.max_x + 1, tx1), fb.width);
+    const int y_begin = max_i(s.min_y, ty0);
+    const int y_end = min_i(min_i(s.max_y + 1, ty1), fb.height);
+    size_t shaded = 0;
+
+    const F zero = Vec::set1(0.0f);
+    const F one = Vec::set1(1.0f);
+    const F lane = Vec::lanes();
+    const F x_limit = Vec::set1((float)x_end);
+    F A[3];
+    M top_left[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        A[i] = Vec::set1(s.A[i]);
+        top_left[i] = Vec::mask(s.top_left[i]);
+    }
+    const F za = Vec::set1(s.z[0]), wa = Vec::set1(s.inv_w[0]);
+    const F ra = Vec::set1(s.rgb_w[0][0]), ga = Vec::set1(s.rgb_w[1][0]), ba = Vec::set1(s.rgb_w[2][0]);
+
+    for (int y = y_begin; y < y_end; ++y)
+    {
+        const float yc = (float)y + 0.5f;
+        F row[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            row[i] = Vec::set1(s.B[i] * yc + s.C[i]);
+        }
+        const F zrow = Vec::set1(s.z[1] * yc + s.z[2]);
+        const F wrow = Vec::set1(s.inv_w[1] * yc + s.inv_w[2]);
+        const F rrow = Vec::set1(s.rgb_w[0][1] * yc + s.rgb_w[0][2]);
+        const F grow = Vec::set1(s.rgb_w[1][1] * yc + s.rgb_w[1][2]);
+        const F brow = Vec::set1(s.rgb_w[2][1] * yc + s.rgb_w[2][2]);
+        float* depth_row = fb.depth + (size_t)y * fb.stride;
+        uint32_t* color_row = fb.color + (size_t)y * fb.stride;
+
+        for (int x = x_begin; x < x_end; x += Vec::W)
+        {
+            const F px = Vec::add(Vec::set1((float)x), lane);
+            M cover = Vec::lt(px, x_limit);
+            for (int i = 0; i < 3; ++i)
+            {
+                const F e = Vec::madd(A[i], px, row[i]);
+                cover = Vec::both(cover, Vec::either(Vec::gt(e, zero), Vec::both(Vec::eq(e, zero), top_left[i])));
+            }
+            if (Vec::bits(cover) == 0)
+            {
+                continue;
+            }
+
+            // Early-z: nothing else is interpolated for occluded pixels
+            const F z = Vec::madd(za, px, zrow);
+            const M pass = Vec::both(cover, Vec::lt(z, Vec::load(depth_row + x)));
+            const unsigned mask = Vec::bits(pass);
+            if (mask == 0)
+            {
+                continue;
+            }
+            Vec::store(depth_row + x, pass, z);
+
+            const F w = Vec::div(one, Vec::madd(wa, px, wrow));
+            auto channel = [&](F a, F rw) { return Vec::min(Vec::max(Vec::mul(Vec::madd(a, px, rw), w), zero), one); };
+            Vec::store(color_row + x, pass, Vec::rgba(channel(ra, rrow), channel(ga, grow), channel(ba, brow)));
+            shaded += popcount(mask);
+        }
+    }
+    return shaded;
+}
+#else
+inline uint32_t pack_rgba(float r, float g, float b)
+{
+    auto to8 = [](float v) { return (uint32_t)((v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v) * 255.0f + 0.5f); };
+    return to8(r) | (to8(g) << 8) | (to8(b) << 16) | 0xff000000u;
+}
+
+size_t rasterize_tile(const TriangleSetup& s, const RasterTarget& fb, int tx0, int ty0, int tx1, int ty1)
+{
+    const int x_begin = max_i(s.min_x, tx0);
+    const int x_end = min_i(min_i(s.max_x + 1, tx1), fb.width);
+    const int y_begin = max_i(s.min_y, ty0);
+    const int y_end = min_i(min_i(s.max_y + 1, ty1), fb.height);
+    size_t shaded = 0;
+    for (int y = y_begin; y < y_end; ++y)
+    {
+        const float yc = (float)y + 0.5f;
+        float* depth_row = fb.depth + (size_t)y * fb.stride;
+        uint32_t* color_row = fb.color + (size_t)y * fb.stride;
+        for (int x = x_begin; x < x_end; ++x)
+        {
+            const float xc = (float)x + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < 3 && inside; ++i)
+            {
+                float e = s.A[i] * xc + s.B[i] * yc + s.C[i];
+                inside = e > 0.0f || (e == 0.0f && s.top_left[i]);
+            }
+            if (!inside)
+            {
+                continue;
+            }
+            const float z = s.z[0] * xc + s.z[1] * yc + s.z[2];
+            if (!(z < depth_row[x]))
+            {
+                continue;
+            }
+            depth_row[x] = z;
+            const float w = 1.0f / (s.inv_w[0] * xc + s.inv_w[1] * yc + s.inv_w[2]);
+            float c[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                c[k] = (s.rgb_w[k][0] * xc + s.rgb_w[k][1] * yc + s.rgb_w[k][2]) * w;
+            }
+            color_row[x] = pack_rgba(c[0], c[1], c[2]);
+            ++shaded;
+        }
+    }
+    return shaded;
+}
+#endif
+
+#ifdef GV_KERNEL_LANES
+// One point per iteration as a sum of the matrix columns: strided points
+// do not pay for gathering them into vectors
+void transform_points(const float* m, const float* in, size_t in_stride, size_t count, float* out,
+    size_t out_stride)
+{
+    const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+    for (size_t i = 0; i < count; ++i, in += in_stride, out += out_stride)
+    {
+#if defined(__FMA__)
+        __m128 r = _mm_fmadd_ps(c0, _mm_set1_ps(in[0]), c3);
+        r = _mm_fmadd_ps(c1, _mm_set1_ps(in[1]), r);
+        r = _mm_fmadd_ps(c2, _mm_set1_ps(in[2]), r);
+#else
+        __m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(in[0])), c3);
+        r = _mm_add_ps(_mm_mul_ps(c1, _mm_set1_ps(in[1])), r);
+        r = _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(in[2])), r);
+#endif
+        _mm_storeu_ps(out, r);
+    }
+}
+#else
+void transform_points(const float* m, const float* in, size_t in_stride, size_t count, float* out,
+    size_t out_stride)
+{
+    for (size_t i = 0; i < count; ++i, in += in_stride, out += out_stride)
+    {
+        const float x = in[0], y = in[1], z = in[2];
+        for (int r = 0; r < 4; ++r)
+        {
+            out[r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r];
+        }
+    }
+}
+#endif
+
+// acos to within 7e-5 rad (Abramowitz and Stegun 4.4.45)
+inline float fast_acos(float x)
+{
+    const float a = fabsf(x);
+    const float r = sqrtf(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+    return x < 0.0f ? 3.14159265f - r : r;
+}
+
+// Angle between (ax, ay, az) and (bx, by, bz), 0 if either is degenerate
+inline float angle(float ax, float ay, float az, float bx, float by, float bz)
+{
+    const float lengths = sqrtf((ax * ax + ay * ay + az * az) * (bx * bx + by * by + bz * bz));
+    float cosine = (ax * bx + ay * by + az * bz) / (lengths > 1e-30f ? lengths : 1e-30f);
+    cosine = cosine < -1.0f ? -1.0f : cosine > 1.0f ? 1.0f : cosine;
+    return lengths > 0.0f ? fast_acos(cosine) : 0.0f;
+}
+
+void face_normals(const float* positions, const uint32_t* indices, size_t count, float* normals, float* angles)
+{
+    // p[corner][coordinate][triangle]
+    float p[3][3][BATCH], n[3][BATCH], a[3][BATCH];
+    for (size_t first = 0; first < count; first += BATCH)
+    {
+        const size_t nt = min_size(BATCH, count - first);
+        for (size_t i = 0; i < nt; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const float* v = positions + 3 * (size_t)indices[3 * (first + i) + k];
+                p[k][0][i] = v[0];
+                p[k][1][i] = v[1];
+                p[k][2][i] = v[2];
+            }
+        }
+        for (size_t i = nt; i < BATCH; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k][0][i] = p[k][1][i] = p[k][2][i] = 0.0f;
+            }
+        }
+
+        for (size_t i = 0; i < BATCH; ++i)
+        {
+            const float e0x = p[1][0][i] - p[0][0][i], e0y = p[1][1][i] - p[0][1][i], e0z = p[1][2][i] - p[0][2][i];
+            const float e1x = p[2][0][i] - p[0][0][i], e1y = p[2][1][i] - p[0][1][i], e1z = p[2][2][i] - p[0][2][i];
+            n[0][i] = e0y * e1z - e0z * e1y;
+            n[1][i] = e0z * e1x - e0x * e1z;
+            n[2][i] = e0x * e1y - e0y * e1x;
+        }
+        if (angles)
+        {
+            for (size_t i = 0; i < BATCH; ++i)
+            {
+                const float length = sqrtf(n[0][i] * n[0][i] + n[1][i] * n[1][i] + n[2][i] * n[2][i]);
+                const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+                n[0][i] *= scale;
+                n[1][i] *= scale;
+                n[2][i] *= scale;
+            }
+            for (size_t i = 0; i < BATCH; ++i)
+            {
+                const float e0x = p[1][0][i] - p[0][0][i], e0y = p[1][1][i] - p[0][1][i];
+                const float e0z = p[1][2][i] - p[0][2][i];
+                const float e1x = p[2][0][i] - p[0][0][i], e1y = p[2][1][i] - p[0][1][i];
+                const float e1z = p[2][2][i] - p[0][2][i];
+                const float e2x = p[2][0][i] - p[1][0][i], e2y = p[2][1][i] - p[1][1][i];
+                const float e2z = p[2][2][i] - p[1][2][i];
+                a[0][i] = angle(e0x, e0y, e0z, e1x, e1y, e1z);
+                a[1][i] = angle(-e0x, -e0y, -e0z, e2x, e2y, e2z);
+                a[2][i] = angle(e1x, e1y, e1z, e2x, e2y, e2z);
+            }
+            float* out = angles + 3 * first;
+            for (size_t i = 0; i < nt; ++i)
+            {
+                out[3 * i + 0] = a[0][i];
+                out[3 * i + 1] = a[1][i];
+                out[3 * i + 2] = a[2][i];
+            }
+        }
+        float* out = normals + 3 * first;
+        for (size_t i = 0; i < nt; ++i)
+        {
+            out[3 * i + 0] = n[0][i];
+            out[3 * i + 1] = n[1][i];
+            out[3 * i + 2] = n[2][i];
+        }
+    }
+}
+}
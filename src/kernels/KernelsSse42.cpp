@@ -0,0 +1,10 @@
+// SSE4.2 build of the kernels: -msse4.2 -mpopcnt, or the SSE2 baseline on
+// MSVC, which has no switch for it (see CMakeLists.txt)
+#ifdef GLFW_VIEWER_ISA_DISPATCH
+#if !defined(__SSE4_2__) && !defined(_MSC_VER)
+#error "KernelsSse42.cpp must be compiled with SSE4.2 enabled"
+#endif
+#include "KernelsImpl.h"
+
+extern const Kernels KERNELS_SSE42 = { SimdLevel::SSE42, rasterize_tile, transform_points, face_normals };
+#endif
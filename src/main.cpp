@@ -5,11 +5,61 @@
 #include <iostream>
 #include "viewer/Viewer.h"
 #include <filesystem>
+#include <cstdlib>
+#include <cstring>
 
 using namespace  std;
 namespace   fs = std::filesystem;
 //========================================================================
-int main() {
+int main(int argc, char* argv[]) {
+
+	// --offscreen <frames>: render a fixed number of frames without a visible window
+	// --record <file.gvi>: log the input events of the session
+	// --replay <file.gvi>: play a recorded session back offscreen and print the frame times,
+	//   at the recorded pace or with --max-speed as fast as possible; --frame-times <file.csv>
+	//   writes the time of every frame
+	// --stats: print the job system and task graph statistics after an offscreen run, and the
+	//   heap allocations per frame in builds with GLFW_VIEWER_COUNT_ALLOCATIONS; after an
+	//   interactive session, the frames drawn and skipped by the lazy redraw
+	int offscreen_frames = -1;
+	const char* record_file = nullptr;
+	const char* replay_file = nullptr;
+	const char* frame_times_file = nullptr;
+	bool max_speed = false;
+	bool print_stats = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--offscreen") == 0 && i + 1 < argc)
+		{
+			offscreen_frames = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+		{
+			record_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replay_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "--frame-times") == 0 && i + 1 < argc)
+		{
+			frame_times_file = argv[++i];
+		}
+		else if (strcmp(argv[i], "--max-speed") == 0)
+		{
+			max_speed = true;
+		}
+		else if (strcmp(argv[i], "--stats") == 0)
+		{
+			print_stats = true;
+		}
+	}
+
+	InputLog replay_log;
+	if (replay_file && !replay_log.load(replay_file))
+	{
+		return EXIT_FAILURE;
+	}
 
 	Viewer viewer;
 	// Change default path
@@ -21,9 +71,16 @@ int main() {
 	/*viewer.core().is_animating = false;
 	viewer.core().animation_max_fps = 30.;
 	viewer.core().background_color = Eigen::Vector4f(0.6f, 0.6f, 0.6f, 1.0f);*/
+	viewer.frame_pacer.target_fps = 60.;
+	viewer.frame_pacer.adaptive = true;
 
 	// Initialize viewer
-	if (viewer.launch_init(true, false, true, "viewer", 0, 0) == EXIT_FAILURE)
+	int status = replay_file
+		? viewer.launch_init_offscreen(replay_log.header.width, replay_log.header.height)
+		: offscreen_frames >= 0
+		? viewer.launch_init_offscreen(1280, 800)
+		: viewer.launch_init(true, false, true, "viewer", 0, 0);
+	if (status == EXIT_FAILURE || (record_file && !viewer.start_recording(record_file)))
 	{
 		viewer.launch_shut();
 		return EXIT_FAILURE;
@@ -47,7 +104,37 @@ int main() {
 	// Rendering
 	try
 	{
-		viewer.launch_rendering(true);
+		if (replay_file)
+		{
+			ReplayStats stats;
+			viewer.replay_input(replay_log, !max_speed, &stats);
+			stats.print();
+			viewer.profiler.print_summary();
+			if (frame_times_file)
+			{
+				stats.write_csv(frame_times_file);
+			}
+		}
+		else if (offscreen_frames >= 0)
+		{
+			viewer.launch_frames(offscreen_frames);
+			if (print_stats && heap_counting_enabled())
+			{
+				viewer.print_heap_stats();
+			}
+			if (print_stats)
+			{
+				viewer.jobs.print_stats();
+			}
+		}
+		else
+		{
+			viewer.launch_rendering(true);
+			if (print_stats)
+			{
+				viewer.damage.print_stats();
+			}
+		}
 	}
 	catch (...)
 	{
@@ -0,0 +1,772 @@
+#include "Bvh.h"
+#include "../util/Parallel.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+namespace
+{
+const int BINS = 16;
+// Below this many primitives a range is binned on one thread and becomes a
+// subtree of its own
+const uint32_t SERIAL_THRESHOLD = 1u << 14;
+const uint32_t BLOCK_SIZE = 1u << 14;
+
+// Plain float box; the build loops run over every primitive per level
+struct Bounds
+{
+    float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    void grow(const float* p)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            lo[k] = std::min(lo[k], p[k]);
+            hi[k] = std::max(hi[k], p[k]);
+        }
+    }
+    void grow(const Bounds& b)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            lo[k] = std::min(lo[k], b.lo[k]);
+            hi[k] = std::max(hi[k], b.hi[k]);
+        }
+    }
+    float half_area() const
+    {
+        if (lo[0] > hi[0])
+        {
+            return 0.0f;
+        }
+        float x = hi[0] - lo[0], y = hi[1] - lo[1], z = hi[2] - lo[2];
+        return x * y + y * z + z * x;
+    }
+};
+
+void store_box(Bvh::Node& node, const Bounds& box)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        node.bmin[k] = box.lo[k];
+        node.bmax[k] = box.hi[k];
+    }
+}
+
+struct TrianglePrims
+{
+    const MeshView& mesh;
+
+    size_t size() const { return mesh.num_triangles(); }
+    Bounds bounds(uint32_t i) const
+    {
+        const uint32_t* f = mesh.indices.data() + 3 * (size_t)i;
+        const float* p = mesh.positions.data();
+        Bounds box;
+        box.grow(p + 3 * (size_t)f[0]);
+        box.grow(p + 3 * (size_t)f[1]);
+        box.grow(p + 3 * (size_t)f[2]);
+        return box;
+    }
+};
+
+struct BoxPrims
+{
+    const std::vector<Eigen::AlignedBox3f>& boxes;
+
+    size_t size() const { return boxes.size(); }
+    Bounds bounds(uint32_t i) const
+    {
+        Bounds box;
+        box.grow(boxes[i].min().data());
+        box.grow(boxes[i].max().data());
+        return box;
+    }
+};
+
+// A primitive during the build: its bounds and index, moved along with the
+// partitions so every level streams through memory instead of gathering
+// through the index buffer
+struct PrimRef
+{
+    Bounds box;
+    uint32_t index;
+    uint32_t pad;
+
+    float centroid(int axis) const { return 0.5f * (box.lo[axis] + box.hi[axis]); }
+};
+
+struct BinSet
+{
+    uint32_t count[3][BINS];
+    Bounds box[3][BINS];
+
+    explicit BinSet(int bins = BINS)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            for (int b = 0; b < bins; ++b)
+            {
+                count[a][b] = 0;
+                box[a][b] = Bounds();
+            }
+        }
+    }
+};
+
+class Builder
+{
+public:
+    Builder(std::vector<PrimRef>& refs, int max_leaf_size)
+        : refs(refs), max_leaf_size(std::max(1, max_leaf_size))
+    {
+    }
+
+    // Sets the bounds of `node` and either splits [begin, end) at `mid` or
+    // turns the node into a leaf (returns false)
+    bool split(Bvh::Node& node, uint32_t begin, uint32_t end, uint32_t& mid, unsigned threads)
+    {
+        const uint32_t count = end - begin;
+        if (count < SERIAL_THRESHOLD)
+        {
+            threads = 1;
+        }
+
+        // Node and centroid bounds
+        Bounds box, cbox;
+        const size_t blocks = threads > 1 ? (count + BLOCK_SIZE - 1) / BLOCK_SIZE : 1;
+        if (blocks == 1)
+        {
+            accumulate_bounds(begin, end, box, cbox);
+        }
+        else
+        {
+            std::vector<Bounds> boxes(2 * blocks);
+            parallel_for(blocks, [&](size_t block, unsigned)
+                {
+                    uint32_t b = begin + (uint32_t)(block * BLOCK_SIZE);
+                    accumulate_bounds(b, std::min(end, b + BLOCK_SIZE), boxes[2 * block], boxes[2 * block + 1]);
+                }, threads);
+            for (size_t i = 0; i < blocks; ++i)
+            {
+                box.grow(boxes[2 * i]);
+                cbox.grow(boxes[2 * i + 1]);
+            }
+        }
+        store_box(node, box);
+
+        if (count == 1)
+        {
+            return make_leaf(node, begin, count);
+        }
+
+        // Bin the centroids along all three axes; small nodes get fewer bins
+        const int nbins = (int)std::min<uint32_t>(BINS, std::max<uint32_t>(4, count));
+        float scale[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            float extent = cbox.hi[a] - cbox.lo[a];
+            scale[a] = extent > 0.0f ? nbins / extent : 0.0f;
+        }
+        BinSet set(nbins);
+        if (blocks == 1)
+        {
+            accumulate_bins(begin, end, cbox.lo, scale, nbins, set);
+        }
+        else
+        {
+            std::vector<BinSet> bins(blocks);
+            parallel_for(blocks, [&](size_t block, unsigned)
+                {
+                    uint32_t b = begin + (uint32_t)(block * BLOCK_SIZE);
+                    accumulate_bins(b, std::min(end, b + BLOCK_SIZE), cbox.lo, scale, nbins, bins[block]);
+                }, threads);
+            for (const BinSet& part : bins)
+            {
+                for (int a = 0; a < 3; ++a)
+                {
+                    for (int b = 0; b < nbins; ++b)
+                    {
+                        set.count[a][b] += part.count[a][b];
+                        set.box[a][b].grow(part.box[a][b]);
+                    }
+                }
+            }
+        }
+
+        // Sweep for the cheapest split: cost = A_left * N_left + A_right * N_right
+        int best_axis = -1, best_bin = 0;
+        float best_cost = std::numeric_limits<float>::max();
+        for (int a = 0; a < 3; ++a)
+        {
+            if (scale[a] == 0.0f)
+            {
+                continue;
+            }
+            float right_cost[BINS];
+            Bounds acc;
+            uint32_t n = 0;
+            for (int b = nbins - 1; b > 0; --b)
+            {
+                acc.grow(set.box[a][b]);
+                n += set.count[a][b];
+                right_cost[b] = acc.half_area() * n;
+            }
+            acc = Bounds();
+            n = 0;
+            for (int b = 0; b < nbins - 1; ++b)
+            {
+                acc.grow(set.box[a][b]);
+                n += set.count[a][b];
+                float cost = acc.half_area() * n + right_cost[b + 1];
+                if (n > 0 && n < count && cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = a;
+                    best_bin = b;
+                }
+            }
+        }
+
+        // Traversal costs about as much as one primitive test
+        const float leaf_cost = box.half_area() * count;
+        if (count <= (uint32_t)max_leaf_size && (best_axis < 0 || best_cost + box.half_area() >= leaf_cost))
+        {
+            return make_leaf(node, begin, count);
+        }
+
+        if (best_axis < 0)
+        {
+            // All centroids coincide: halve to keep leaves small
+            mid = begin + count / 2;
+        }
+        else
+        {
+            const int a = best_axis;
+            auto it = std::partition(refs.begin() + begin, refs.begin() + end, [&](const PrimRef& ref)
+                {
+                    return std::min(nbins - 1, (int)((ref.centroid(a) - cbox.lo[a]) * scale[a])) <= best_bin;
+                });
+            mid = (uint32_t)(it - refs.begin());
+        }
+        node.count = 0;
+        return true;
+    }
+
+    // Builds [begin, end) on this thread; out[0] is the root
+    void build_subtree(std::vector<Bvh::Node>& out, uint32_t begin, uint32_t end)
+    {
+        struct Item
+        {
+            uint32_t node, begin, end;
+        };
+        out.clear();
+        out.reserve(2 * (size_t)(end - begin));
+        out.emplace_back();
+        std::vector<Item> stack{ { 0, begin, end } };
+        while (!stack.empty())
+        {
+            Item item = stack.back();
+            stack.pop_back();
+            uint32_t mid;
+            if (!split(out[item.node], item.begin, item.end, mid, 1))
+            {
+                continue;
+            }
+            uint32_t left = (uint32_t)out.size();
+            out[item.node].first = left;
+            out.resize(out.size() + 2);
+            stack.push_back({ left + 1, mid, item.end });
+            stack.push_back({ left, item.begin, mid });
+        }
+    }
+
+private:
+    void accumulate_bounds(uint32_t begin, uint32_t end, Bounds& box, Bounds& cbox) const
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const PrimRef& ref = refs[i];
+            float c[3] = { ref.centroid(0), ref.centroid(1), ref.centroid(2) };
+            box.grow(ref.box);
+            cbox.grow(c);
+        }
+    }
+
+    void accumulate_bins(uint32_t begin, uint32_t end, const float* cmin, const float* scale, int nbins,
+        BinSet& set) const
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const PrimRef& ref = refs[i];
+            for (int a = 0; a < 3; ++a)
+            {
+                int bin = std::min(nbins - 1, (int)((ref.centroid(a) - cmin[a]) * scale[a]));
+                ++set.count[a][bin];
+                set.box[a][bin].grow(ref.box);
+            }
+        }
+    }
+
+    bool make_leaf(Bvh::Node& node, uint32_t begin, uint32_t count)
+    {
+        node.first = begin;
+        node.count = count;
+        return false;
+    }
+
+    std::vector<PrimRef>& refs;
+    int max_leaf_size;
+};
+
+template <typename Prims>
+void build_nodes(const Prims& prims, int max_leaf_size, unsigned threads,
+    std::vector<Bvh::Node>& nodes, std::vector<uint32_t>& order)
+{
+    const uint32_t n = (uint32_t)prims.size();
+    std::vector<PrimRef> refs(n);
+    const size_t blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    parallel_for(blocks, [&](size_t block, unsigned)
+        {
+            uint32_t end = std::min<uint32_t>(n, (uint32_t)(block + 1) * BLOCK_SIZE);
+            for (uint32_t i = (uint32_t)block * BLOCK_SIZE; i < end; ++i)
+            {
+                refs[i].box = prims.bounds(i);
+                refs[i].index = i;
+            }
+        }, threads);
+    Builder builder(refs, max_leaf_size);
+
+    // Upper levels, breadth first, until there are enough subtrees to keep
+    // every thread busy
+    struct Task
+    {
+        uint32_t node, begin, end;
+    };
+    nodes.assign(1, Bvh::Node());
+    std::vector<Task> pending{ { 0, 0, n } }, subtrees;
+    const size_t target = threads > 1 ? 4 * (size_t)threads : 1;
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        Task task = pending[i];
+        if (task.end - task.begin < SERIAL_THRESHOLD || subtrees.size() + (pending.size() - i) >= target)
+        {
+            subtrees.push_back(task);
+            continue;
+        }
+        uint32_t mid;
+        if (!builder.split(nodes[task.node], task.begin, task.end, mid, threads))
+        {
+            continue;
+        }
+        uint32_t left = (uint32_t)nodes.size();
+        nodes[task.node].first = left;
+        nodes.resize(nodes.size() + 2);
+        pending.push_back({ left, task.begin, mid });
+        pending.push_back({ left + 1, mid, task.end });
+    }
+
+    std::vector<std::vector<Bvh::Node>> local(subtrees.size());
+    parallel_for(subtrees.size(), [&](size_t i, unsigned)
+        {
+            builder.build_subtree(local[i], subtrees[i].begin, subtrees[i].end);
+        }, threads);
+
+    // Stitch: the subtree root replaces its placeholder, the rest is
+    // appended with the child links shifted
+    for (size_t i = 0; i < subtrees.size(); ++i)
+    {
+        const uint32_t offset = (uint32_t)nodes.size() - 1;
+        for (size_t k = 0; k < local[i].size(); ++k)
+        {
+            Bvh::Node node = local[i][k];
+            if (!node.is_leaf())
+            {
+                node.first += offset;
+            }
+            if (k == 0)
+            {
+                nodes[subtrees[i].node] = node;
+            }
+            else
+            {
+                nodes.push_back(node);
+            }
+        }
+        std::vector<Bvh::Node>().swap(local[i]);
+    }
+
+    order.resize(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        order[i] = refs[i].index;
+    }
+}
+
+template <typename Prims>
+void refit_nodes(const Prims& prims, const std::vector<uint32_t>& order, const std::vector<uint32_t>& leaves,
+    std::vector<Bvh::Node>& nodes, unsigned threads)
+{
+    const size_t blocks = (leaves.size() + 1023) / 1024;
+    parallel_for(blocks, [&](size_t block, unsigned)
+        {
+            size_t end = std::min(leaves.size(), (block + 1) * 1024);
+            for (size_t i = block * 1024; i < end; ++i)
+            {
+                Bvh::Node& node = nodes[leaves[i]];
+                Bounds box;
+                for (uint32_t p = node.first; p < node.first + node.count; ++p)
+                {
+                    box.grow(prims.bounds(order[p]));
+                }
+                store_box(node, box);
+            }
+        }, threads);
+
+    // Children always follow their parent
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Bvh::Node& node = nodes[i];
+        if (node.is_leaf())
+        {
+            continue;
+        }
+        const Bvh::Node& left = nodes[node.first];
+        const Bvh::Node& right = nodes[node.first + 1];
+        for (int k = 0; k < 3; ++k)
+        {
+            node.bmin[k] = std::min(left.bmin[k], right.bmin[k]);
+            node.bmax[k] = std::max(left.bmax[k], right.bmax[k]);
+        }
+    }
+}
+
+std::vector<uint32_t> collect_leaves(const std::vector<Bvh::Node>& nodes)
+{
+    std::vector<uint32_t> leaves;
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i].is_leaf())
+        {
+            leaves.push_back(i);
+        }
+    }
+    return leaves;
+}
+} // namespace
+
+Frustum Frustum::from_matrix(const Eigen::Matrix4f& m)
+{
+    Frustum f;
+    for (int i = 0; i < 3; ++i)
+    {
+        f.planes[2 * i] = (m.row(3) + m.row(i)).transpose();
+        f.planes[2 * i + 1] = (m.row(3) - m.row(i)).transpose();
+    }
+    for (auto& plane : f.planes)
+    {
+        float length = plane.head<3>().norm();
+        if (length > 0.0f)
+        {
+            plane /= length;
+        }
+    }
+    return f;
+}
+
+Frustum::Result Frustum::classify(const Eigen::AlignedBox3f& box) const
+{
+    Result result = Inside;
+    for (const auto& plane : planes)
+    {
+        // Corners furthest along and against the plane normal
+        Eigen::Vector3f p, q;
+        for (int k = 0; k < 3; ++k)
+        {
+            p[k] = plane[k] >= 0.0f ? box.max()[k] : box.min()[k];
+            q[k] = plane[k] >= 0.0f ? box.min()[k] : box.max()[k];
+        }
+        if (plane.head<3>().dot(p) + plane[3] < 0.0f)
+        {
+            return Outside;
+        }
+        if (plane.head<3>().dot(q) + plane[3] < 0.0f)
+        {
+            result = Intersecting;
+        }
+    }
+    return result;
+}
+
+bool Bvh::build(const MeshView& mesh, BuildStats* stats)
+{
+    clear();
+    if (mesh.num_triangles() == 0 || mesh.num_triangles() >= std::numeric_limits<uint32_t>::max())
+    {
+        return false;
+    }
+    auto tic = std::chrono::steady_clock::now();
+    const unsigned n_threads = threads == 0 ? hardware_threads() : threads;
+    TrianglePrims prims{ mesh };
+    build_nodes(prims, max_leaf_size, n_threads, nodes_, primitives_);
+    leaves_ = collect_leaves(nodes_);
+    mesh_view_ = mesh;
+    if (stats)
+    {
+        stats->primitives = prims.size();
+        stats->nodes = nodes_.size();
+        stats->leaves = leaves_.size();
+        stats->threads = n_threads;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
+
+bool Bvh::build(const std::vector<Eigen::AlignedBox3f>& boxes, BuildStats* stats)
+{
+    clear();
+    if (boxes.empty() || boxes.size() >= std::numeric_limits<uint32_t>::max())
+    {
+        return false;
+    }
+    auto tic = std::chrono::steady_clock::now();
+    const unsigned n_threads = threads == 0 ? hardware_threads() : threads;
+    BoxPrims prims{ boxes };
+    build_nodes(prims, max_leaf_size, n_threads, nodes_, primitives_);
+    leaves_ = collect_leaves(nodes_);
+    if (stats)
+    {
+        stats->primitives = prims.size();
+        stats->nodes = nodes_.size();
+        stats->leaves = leaves_.size();
+        stats->threads = n_threads;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
+
+void Bvh::clear()
+{
+    nodes_.clear();
+    primitives_.clear();
+    leaves_.clear();
+    mesh_view_ = MeshView();
+}
+
+void Bvh::refit(const MeshView& mesh)
+{
+    if (nodes_.empty() || mesh.num_triangles() != primitives_.size())
+    {
+        return;
+    }
+    mesh_view_ = mesh;
+    refit_nodes(TrianglePrims{ mesh }, primitives_, leaves_, nodes_, threads == 0 ? hardware_threads() : threads);
+}
+
+void Bvh::refit(const std::vector<Eigen::AlignedBox3f>& boxes)
+{
+    if (nodes_.empty() || boxes.size() != primitives_.size())
+    {
+        return;
+    }
+    refit_nodes(BoxPrims{ boxes }, primitives_, leaves_, nodes_, threads == 0 ? hardware_threads() : threads);
+}
+
+// Entry distance of the ray into the node, or infinity if it misses
+static float intersect_box(const Bvh::Node& node, const Eigen::Vector3f& origin,
+    const Eigen::Vector3f& inv_dir, float t_max)
+{
+    float t0 = 0.0f, t1 = t_max;
+    for (int k = 0; k < 3; ++k)
+    {
+        float a = (node.bmin[k] - origin[k]) * inv_dir[k];
+        float b = (node.bmax[k] - origin[k]) * inv_dir[k];
+        if (a > b)
+        {
+            std::swap(a, b);
+        }
+        // NaN (origin on a slab with a zero direction) keeps the old bounds
+        t0 = a > t0 ? a : t0;
+        t1 = b < t1 ? b : t1;
+    }
+    return t0 <= t1 ? t0 : std::numeric_limits<float>::infinity();
+}
+
+bool Bvh::intersect(const Ray& ray, Hit& hit, float t_max) const
+{
+    hit = Hit();
+    if (nodes_.empty() || mesh_view_.num_triangles() == 0)
+    {
+        return false;
+    }
+    const Eigen::Vector3f& o = ray.origin;
+    const Eigen::Vector3f& d = ray.direction;
+    const Eigen::Vector3f inv_dir = d.cwiseInverse();
+    const float* P = mesh_view_.positions.data();
+    const uint32_t* F = mesh_view_.indices.data();
+    hit.t = t_max;
+
+    // Degenerate trees can be deeper than the inline stack: spill to the
+    // heap rather than drop children and miss hits
+    uint32_t local[64];
+    std::vector<uint32_t> spill;
+    uint32_t* stack = local;
+    size_t capacity = 64, top = 0;
+    auto push = [&](uint32_t index)
+    {
+        if (top == capacity)
+        {
+            if (spill.empty())
+            {
+                spill.assign(local, local + top);
+            }
+            capacity *= 2;
+            spill.resize(capacity);
+            stack = spill.data();
+        }
+        stack[top++] = index;
+    };
+    if (intersect_box(nodes_[0], o, inv_dir, hit.t) == std::numeric_limits<float>::infinity())
+    {
+        return false;
+    }
+    push(0);
+    while (top > 0)
+    {
+        const Node& node = nodes_[stack[--top]];
+        if (node.is_leaf())
+        {
+            // Moller-Trumbore
+            for (uint32_t i = node.first; i < node.first + node.count; ++i)
+            {
+                const uint32_t prim = primitives_[i];
+                const uint32_t* f = F + 3 * (size_t)prim;
+                Eigen::Vector3f v0(P + 3 * (size_t)f[0]), v1(P + 3 * (size_t)f[1]), v2(P + 3 * (size_t)f[2]);
+                Eigen::Vector3f e1 = v1 - v0, e2 = v2 - v0;
+                Eigen::Vector3f p = d.cross(e2);
+                float det = e1.dot(p);
+                if (std::abs(det) < 1e-12f)
+                {
+                    continue;
+                }
+                float inv_det = 1.0f / det;
+                Eigen::Vector3f s = o - v0;
+                float u = s.dot(p) * inv_det;
+                if (u < 0.0f || u > 1.0f)
+                {
+                    continue;
+                }
+                Eigen::Vector3f q = s.cross(e1);
+                float v = d.dot(q) * inv_det;
+                if (v < 0.0f || u + v > 1.0f)
+                {
+                    continue;
+                }
+                float t = e2.dot(q) * inv_det;
+                if (t > 0.0f && t < hit.t)
+                {
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.primitive = prim;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first
+        uint32_t closer = node.first, further = node.first + 1;
+        float t_closer = intersect_box(nodes_[closer], o, inv_dir, hit.t);
+        float t_further = intersect_box(nodes_[further], o, inv_dir, hit.t);
+        if (t_further < t_closer)
+        {
+            std::swap(closer, further);
+            std::swap(t_closer, t_further);
+        }
+        if (t_further != std::numeric_limits<float>::infinity())
+        {
+            push(further);
+        }
+        if (t_closer != std::numeric_limits<float>::infinity())
+        {
+            push(closer);
+        }
+    }
+    return hit.valid();
+}
+
+Bvh::Range Bvh::subtree_range(uint32_t node) const
+{
+    uint32_t left = node, right = node;
+    while (!nodes_[left].is_leaf())
+    {
+        left = nodes_[left].first;
+    }
+    while (!nodes_[right].is_leaf())
+    {
+        right = nodes_[right].first + 1;
+    }
+    return { nodes_[left].first, nodes_[right].first + nodes_[right].count - nodes_[left].first };
+}
+
+void Bvh::cull(const Frustum& frustum, std::vector<Range>& visible) const
+{
+    visible.clear();
+    if (nodes_.empty())
+    {
+        return;
+    }
+    auto emit = [&](Range range)
+    {
+        if (!visible.empty() && visible.back().first + visible.back().count == range.first)
+        {
+            visible.back().count += range.count;
+        }
+        else
+        {
+            visible.push_back(range);
+        }
+    };
+
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const uint32_t index = stack[--top];
+        const Node& node = nodes_[index];
+        Frustum::Result result = frustum.classify(node.box());
+        if (result == Frustum::Outside)
+        {
+            continue;
+        }
+        if (node.is_leaf())
+        {
+            emit({ node.first, node.count });
+        }
+        else if (result == Frustum::Inside || top + 2 > 64)
+        {
+            emit(subtree_range(index));
+        }
+        else
+        {
+            // Left on top so ranges come out in order
+            stack[top++] = node.first + 1;
+            stack[top++] = node.first;
+        }
+    }
+}
+
+void Bvh::reorder_indices(const MeshView& mesh, std::vector<uint32_t>& indices) const
+{
+    indices.resize(3 * primitives_.size());
+    const uint32_t* F = mesh.indices.data();
+    for (size_t i = 0; i < primitives_.size(); ++i)
+    {
+        const uint32_t* f = F + 3 * (size_t)primitives_[i];
+        indices[3 * i] = f[0];
+        indices[3 * i + 1] = f[1];
+        indices[3 * i + 2] = f[2];
+    }
+}
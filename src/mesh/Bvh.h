@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Mesh.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+struct Ray
+{
+    Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+    Eigen::Vector3f direction = Eigen::Vector3f::UnitZ();
+};
+
+// The six clip planes of a view-projection matrix (GL conventions), with
+// normals pointing inside: n.dot(p) + d >= 0 for points in the frustum.
+struct Frustum
+{
+    enum Result { Outside, Intersecting, Inside };
+
+    Eigen::Vector4f planes[6];
+
+    static Frustum from_matrix(const Eigen::Matrix4f& view_proj);
+    Result classify(const Eigen::AlignedBox3f& box) const;
+};
+
+// Bounding volume hierarchy over the triangles of a mesh, or over a list of
+// boxes (e.g. the bounds of sub-meshes or scene objects).
+//
+// Built top-down with a binned SAH. The upper levels split the whole range
+// with binning spread over the worker threads, the subtrees below are then
+// built in parallel and stitched into one array. Nodes are 32 bytes, stored
+// depth-first per subtree with the two children of a node next to each
+// other, and a node always comes before its children, so refit() is one
+// backward sweep. The primitives of a subtree are contiguous in
+// primitives(), which makes a culled subtree one range of draws.
+class Bvh
+{
+public:
+    struct Node
+    {
+        float bmin[3];
+        uint32_t first;     // leaf: first primitive, inner: left child (right is first + 1)
+        float bmax[3];
+        uint32_t count;     // primitives in a leaf, 0 for inner nodes
+
+        bool is_leaf() const { return count > 0; }
+        Eigen::AlignedBox3f box() const
+        {
+            return { Eigen::Vector3f(bmin[0], bmin[1], bmin[2]), Eigen::Vector3f(bmax[0], bmax[1], bmax[2]) };
+        }
+    };
+
+    struct Hit
+    {
+        uint32_t primitive = std::numeric_limits<uint32_t>::max();
+        float t = std::numeric_limits<float>::infinity();
+        float u = 0.0f, v = 0.0f; // barycentrics of vertices 1 and 2
+
+        bool valid() const { return primitive != std::numeric_limits<uint32_t>::max(); }
+    };
+
+    // A run of primitives() indices
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct BuildStats
+    {
+        size_t primitives = 0;
+        size_t nodes = 0;
+        size_t leaves = 0;
+        unsigned threads = 0;
+        double seconds = 0.0;
+
+        double mprims_per_second() const { return seconds > 0.0 ? primitives / seconds * 1e-6 : 0.0; }
+    };
+
+    int max_leaf_size = 4;
+    // 0 = all hardware threads
+    unsigned threads = 0;
+
+    // The mesh must outlive the hierarchy; it is read again by refit() and
+    // intersect()
+    bool build(const MeshView& mesh, BuildStats* stats = nullptr);
+    bool build(const std::vector<Eigen::AlignedBox3f>& boxes, BuildStats* stats = nullptr);
+    void clear();
+    bool empty() const { return nodes_.empty(); }
+
+    // Recomputes the bounds after the vertices moved (same triangles), or
+    // after the boxes were changed in place
+    void refit(const MeshView& mesh);
+    void refit(const std::vector<Eigen::AlignedBox3f>& boxes);
+
+    // Closest triangle hit along the ray within (0, t_max); triangle mode only
+    bool intersect(const Ray& ray, Hit& hit, float t_max = std::numeric_limits<float>::infinity()) const;
+
+    // Ranges of primitives() whose bounds touch the frustum; adjacent ranges
+    // are merged
+    void cull(const Frustum& frustum, std::vector<Range>& visible) const;
+
+    // Triangle indices in hierarchy order, so that the ranges returned by
+    // cull() index straight into it (3 indices per primitive)
+    void reorder_indices(const MeshView& mesh, std::vector<uint32_t>& indices) const;
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+    const std::vector<uint32_t>& primitives() const { return primitives_; }
+    Eigen::AlignedBox3f bounds() const { return nodes_.empty() ? Eigen::AlignedBox3f() : nodes_[0].box(); }
+
+private:
+    Range subtree_range(uint32_t node) const;
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> primitives_;
+    std::vector<uint32_t> leaves_;
+    MeshView mesh_view_;
+};
@@ -0,0 +1,213 @@
+#include "Lod.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static const char LOD_MAGIC[8] = { 'G', 'V', 'L', 'O', 'D', 'C', 'H', 'N' };
+static const uint32_t LOD_VERSION = 1;
+
+using LodWrite = std::function<void(const void* data, size_t bytes)>;
+
+namespace
+{
+// Reads at most `left` more bytes
+struct LodSource
+{
+    const std::function<bool(void* data, size_t bytes)>& read;
+    uint64_t left;
+};
+}
+
+template <typename T>
+static void write(const LodWrite& out, const T* data, size_t count)
+{
+    out(data, count * sizeof(T));
+}
+
+template <typename T>
+static bool read(LodSource& in, T* data, size_t count)
+{
+    const uint64_t bytes = (uint64_t)count * sizeof(T);
+    if (bytes > in.left || !in.read(data, (size_t)bytes))
+    {
+        return false;
+    }
+    in.left -= bytes;
+    return true;
+}
+
+template <typename T>
+static void write_vector(const LodWrite& out, const std::vector<T>& v)
+{
+    uint64_t n = v.size();
+    write(out, &n, 1);
+    write(out, v.data(), v.size());
+}
+
+template <typename T>
+static bool read_vector(LodSource& in, std::vector<T>& v)
+{
+    uint64_t n = 0;
+    if (!read(in, &n, 1) || n > in.left / sizeof(T))
+    {
+        return false;
+    }
+    v.resize((size_t)n);
+    return read(in, v.data(), v.size());
+}
+
+bool LodChain::build(const MeshView& base, const LodOptions& options, LodStats* stats)
+{
+    clear();
+    if (base.num_triangles() == 0)
+    {
+        return false;
+    }
+    auto tic = std::chrono::steady_clock::now();
+    auto V = base.V();
+    bounds = Eigen::AlignedBox3f(V.colwise().minCoeff().transpose(), V.colwise().maxCoeff().transpose());
+
+    size_t input_triangles = 0;
+    const float ratio = std::min(std::max(options.ratio, 0.05f), 0.95f);
+    for (int i = 0; i + 1 < options.max_levels; ++i)
+    {
+        const MeshView source = level((int)levels.size(), base);
+        const size_t target = (size_t)(source.num_triangles() * ratio);
+        if (target < options.min_triangles)
+        {
+            break;
+        }
+        SimplifyOptions simplify = options.simplify;
+        simplify.cluster_offset = (i % 2) ? simplify.cluster_triangles / 2 : 0;
+        LodLevel next;
+        SimplifyStats pass;
+        if (!simplify_mesh(source, target, next.mesh, simplify, &pass))
+        {
+            break;
+        }
+        input_triangles += pass.input_triangles;
+        // Stop once the clusters cannot shrink any further
+        if (next.mesh.num_triangles() >= source.num_triangles() * 0.95)
+        {
+            break;
+        }
+        next.error = level_error((int)levels.size()) + pass.error;
+        levels.push_back(std::move(next));
+    }
+
+    if (stats)
+    {
+        stats->input_triangles = input_triangles;
+        stats->levels = num_levels();
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
+
+void LodChain::clear()
+{
+    levels.clear();
+    bounds.setEmpty();
+}
+
+int LodChain::select(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height,
+    float max_pixel_error) const
+{
+    if (levels.empty() || bounds.isEmpty())
+    {
+        return 0;
+    }
+    // Pixels per mesh unit at distance 1 (perspective) or anywhere (ortho)
+    const float pixels_per_unit = 0.5f * proj(1, 1) * viewport_height;
+    float distance = 1.0f;
+    if (proj(3, 3) == 0.0f)
+    {
+        const Eigen::Matrix3f R = view.topLeftCorner<3, 3>();
+        const Eigen::Vector3f eye = -R.transpose() * view.topRightCorner<3, 1>();
+        distance = bounds.exteriorDistance(eye);
+        if (distance <= 0.0f)
+        {
+            return 0;
+        }
+    }
+    int best = 0;
+    for (int i = 1; i < num_levels(); ++i)
+    {
+        if (level_error(i) * pixels_per_unit / distance <= max_pixel_error)
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void LodChain::serialize(std::vector<char>& buffer) const
+{
+    serialize([&](const void* data, size_t bytes)
+        {
+            const char* p = (const char*)data;
+            buffer.insert(buffer.end(), p, p + bytes);
+        });
+}
+
+bool LodChain::deserialize(const std::vector<char>& buffer, size_t& offset)
+{
+    if (offset > buffer.size())
+    {
+        clear();
+        return false;
+    }
+    return deserialize([&](void* data, size_t bytes)
+        {
+            memcpy(data, buffer.data() + offset, bytes);
+            offset += bytes;
+            return true;
+        }, buffer.size() - offset);
+}
+
+void LodChain::serialize(const LodWrite& out) const
+{
+    write(out, LOD_MAGIC, sizeof(LOD_MAGIC));
+    uint32_t header[2] = { LOD_VERSION, (uint32_t)levels.size() };
+    write(out, header, 2);
+    write(out, bounds.min().data(), 3);
+    write(out, bounds.max().data(), 3);
+    for (const LodLevel& level : levels)
+    {
+        write(out, &level.error, 1);
+        write_vector(out, level.mesh.positions);
+        write_vector(out, level.mesh.normals);
+        write_vector(out, level.mesh.uvs);
+        write_vector(out, level.mesh.indices);
+    }
+}
+
+bool LodChain::deserialize(const std::function<bool(void* data, size_t bytes)>& read_bytes, uint64_t bytes)
+{
+    clear();
+    LodSource in = { read_bytes, bytes };
+    char magic[8];
+    uint32_t header[2];
+    float lo[3], hi[3];
+    if (!read(in, magic, 8) || memcmp(magic, LOD_MAGIC, 8) != 0
+        || !read(in, header, 2) || header[0] != LOD_VERSION
+        || !read(in, lo, 3) || !read(in, hi, 3))
+    {
+        return false;
+    }
+    bounds = Eigen::AlignedBox3f(Eigen::Vector3f(lo[0], lo[1], lo[2]), Eigen::Vector3f(hi[0], hi[1], hi[2]));
+    levels.resize(header[1]);
+    for (LodLevel& level : levels)
+    {
+        if (!read(in, &level.error, 1)
+            || !read_vector(in, level.mesh.positions)
+            || !read_vector(in, level.mesh.normals)
+            || !read_vector(in, level.mesh.uvs)
+            || !read_vector(in, level.mesh.indices))
+        {
+            clear();
+            return false;
+        }
+    }
+    return true;
+}
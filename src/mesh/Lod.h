@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Mesh.h"
+#include "Simplify.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <functional>
+#include <vector>
+
+struct LodOptions
+{
+    int max_levels = 8;
+    // Triangles kept from one level to the next
+    float ratio = 0.5f;
+    // No level is made below this many triangles
+    size_t min_triangles = 1024;
+    SimplifyOptions simplify;
+};
+
+struct LodLevel
+{
+    MeshData mesh;
+    // Bound on the distance to the full mesh, in mesh units
+    float error = 0.0f;
+};
+
+struct LodStats
+{
+    size_t input_triangles = 0; // over all passes
+    int levels = 0;
+    double seconds = 0.0;
+
+    double mtris_per_second() const { return seconds > 0.0 ? input_triangles / seconds * 1e-6 : 0.0; }
+};
+
+// Chain of simplified versions of a mesh. Level 0 is the mesh itself (not
+// stored), level i + 1 is simplify_mesh() of level i. Each pass shifts the
+// cluster seams so they do not stay at full resolution.
+class LodChain
+{
+public:
+    bool build(const MeshView& base, const LodOptions& options, LodStats* stats = nullptr);
+    void clear();
+    bool empty() const { return levels.empty(); }
+
+    int num_levels() const { return 1 + (int)levels.size(); }
+    MeshView level(int i, const MeshView& base) const { return i <= 0 ? base : levels[i - 1].mesh.view(); }
+    float level_error(int i) const { return i <= 0 ? 0.0f : levels[i - 1].error; }
+
+    // Coarsest level whose error, projected at the mesh's nearest point,
+    // stays within max_pixel_error pixels
+    int select(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height,
+        float max_pixel_error) const;
+
+    // Appends the chain to `buffer`; deserialize reads it back from `offset`
+    // and advances it
+    void serialize(std::vector<char>& buffer) const;
+    bool deserialize(const std::vector<char>& buffer, size_t& offset);
+    // The same bytes through `write` / `read`, e.g. a snapshot stream, without
+    // a copy of the whole chain. `read` reads from at most `bytes` bytes.
+    void serialize(const std::function<void(const void* data, size_t bytes)>& write) const;
+    bool deserialize(const std::function<bool(void* data, size_t bytes)>& read, uint64_t bytes);
+
+    std::vector<LodLevel> levels;
+    Eigen::AlignedBox3f bounds;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../util/Span.h"
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+using RowMatrixX3f = Eigen::Matrix<float, Eigen::Dynamic, 3, Eigen::RowMajor>;
+using RowMatrixX2f = Eigen::Matrix<float, Eigen::Dynamic, 2, Eigen::RowMajor>;
+using RowMatrixX3u = Eigen::Matrix<uint32_t, Eigen::Dynamic, 3, Eigen::RowMajor>;
+
+// Read-only view of a triangle mesh, either owned by a MeshData or living
+// in a memory-mapped mesh cache.
+struct MeshView
+{
+    Span<const float> positions;
+    Span<const float> normals;
+    Span<const float> uvs;
+    Span<const uint32_t> indices;
+
+    size_t num_vertices() const { return positions.size() / 3; }
+    size_t num_triangles() const { return indices.size() / 3; }
+    bool has_normals() const { return !normals.empty(); }
+    bool has_uvs() const { return !uvs.empty(); }
+
+    Eigen::Map<const RowMatrixX3f> V() const { return { positions.data(), (Eigen::Index)num_vertices(), 3 }; }
+    Eigen::Map<const RowMatrixX3f> N() const { return { normals.data(), (Eigen::Index)(normals.size() / 3), 3 }; }
+    Eigen::Map<const RowMatrixX2f> UV() const { return { uvs.data(), (Eigen::Index)(uvs.size() / 2), 2 }; }
+    Eigen::Map<const RowMatrixX3u> F() const { return { indices.data(), (Eigen::Index)num_triangles(), 3 }; }
+};
+
+// Flat triangle mesh. Every attribute is its own tightly packed stream
+// (positions xyz, normals xyz, uvs uv, indices 3 per triangle) so each one
+// can be uploaded to a GL buffer or mapped as an Eigen matrix directly.
+struct MeshData
+{
+    std::vector<float> positions;
+    std::vector<float> normals;   // empty or 3 floats per vertex
+    std::vector<float> uvs;       // empty or 2 floats per vertex
+    std::vector<uint32_t> indices;
+
+    size_t num_vertices() const { return positions.size() / 3; }
+    size_t num_triangles() const { return indices.size() / 3; }
+    bool has_normals() const { return !normals.empty(); }
+    bool has_uvs() const { return !uvs.empty(); }
+
+    void clear()
+    {
+        positions.clear();
+        normals.clear();
+        uvs.clear();
+        indices.clear();
+    }
+
+    MeshView view() const
+    {
+        MeshView v;
+        v.positions = { positions.data(), positions.size() };
+        v.normals = { normals.data(), normals.size() };
+        v.uvs = { uvs.data(), uvs.size() };
+        v.indices = { indices.data(), indices.size() };
+        return v;
+    }
+
+    // Eigen views over the flat buffers (no copies)
+    Eigen::Map<RowMatrixX3f> V() { return { positions.data(), (Eigen::Index)num_vertices(), 3 }; }
+    Eigen::Map<const RowMatrixX3f> V() const { return { positions.data(), (Eigen::Index)num_vertices(), 3 }; }
+    Eigen::Map<RowMatrixX3f> N() { return { normals.data(), (Eigen::Index)(normals.size() / 3), 3 }; }
+    Eigen::Map<const RowMatrixX3f> N() const { return { normals.data(), (Eigen::Index)(normals.size() / 3), 3 }; }
+    Eigen::Map<RowMatrixX2f> UV() { return { uvs.data(), (Eigen::Index)(uvs.size() / 2), 2 }; }
+    Eigen::Map<const RowMatrixX2f> UV() const { return { uvs.data(), (Eigen::Index)(uvs.size() / 2), 2 }; }
+    Eigen::Map<RowMatrixX3u> F() { return { indices.data(), (Eigen::Index)num_triangles(), 3 }; }
+    Eigen::Map<const RowMatrixX3u> F() const { return { indices.data(), (Eigen::Index)num_triangles(), 3 }; }
+};
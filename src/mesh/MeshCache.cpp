@@ -0,0 +1,171 @@
+#include "MeshCache.h"
+#include "../util/Hash.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+static const char MESH_CACHE_MAGIC[8] = { 'G', 'L', 'F', 'W', 'V', 'M', 'S', 'H' };
+static const uint32_t MESH_CACHE_ENDIAN = 0x01020304u;
+
+static uint64_t align_up(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+bool describe_mesh_source(const std::string& filename, MeshCacheSource& source, bool hash_contents)
+{
+    std::error_code ec;
+    source.size = (uint64_t)fs::file_size(filename, ec);
+    if (ec)
+    {
+        return false;
+    }
+    source.mtime = (int64_t)fs::last_write_time(filename, ec).time_since_epoch().count();
+    source.hash = 0;
+    if (hash_contents)
+    {
+        MappedFile file;
+        if (!file.open(filename))
+        {
+            return false;
+        }
+        source.hash = hash_bytes_parallel(file.data(), file.size());
+    }
+    return true;
+}
+
+bool write_mesh_cache(const std::string& cache_file, const MeshView& mesh,
+    const MeshCacheSource& source, bool only_vertices)
+{
+    MeshCacheHeader header{};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.flags = only_vertices ? MESH_CACHE_ONLY_VERTICES : 0;
+    header.endian = MESH_CACHE_ENDIAN;
+    header.source = source;
+    header.num_vertices = mesh.num_vertices();
+    header.num_triangles = only_vertices ? 0 : mesh.num_triangles();
+
+    const void* payload[MeshCacheHeader::NumSections] = {
+        mesh.positions.data(), mesh.normals.data(), mesh.uvs.data(), mesh.indices.data() };
+    uint64_t bytes[MeshCacheHeader::NumSections] = {
+        mesh.positions.size_bytes(),
+        only_vertices ? 0 : mesh.normals.size_bytes(),
+        only_vertices ? 0 : mesh.uvs.size_bytes(),
+        only_vertices ? 0 : mesh.indices.size_bytes() };
+    uint64_t offset = align_up(sizeof(MeshCacheHeader));
+    for (int s = 0; s < MeshCacheHeader::NumSections; ++s)
+    {
+        header.sections[s].offset = offset;
+        header.sections[s].bytes = bytes[s];
+        offset = align_up(offset + bytes[s]);
+    }
+
+    std::string tmp_file = cache_file + ".tmp";
+    FILE* f = fopen(tmp_file.c_str(), "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", tmp_file.c_str());
+        return false;
+    }
+    static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t written = sizeof(header);
+    for (int s = 0; s < MeshCacheHeader::NumSections && ok; ++s)
+    {
+        uint64_t pad = header.sections[s].offset - written;
+        ok = fwrite(zeros, 1, (size_t)pad, f) == pad;
+        if (ok && bytes[s] > 0)
+        {
+            ok = fwrite(payload[s], 1, (size_t)bytes[s], f) == bytes[s];
+        }
+        written = header.sections[s].offset + bytes[s];
+    }
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+    {
+        fs::rename(tmp_file, cache_file, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", cache_file.c_str());
+        fs::remove(tmp_file, ec);
+    }
+    return ok;
+}
+
+bool open_mesh_cache(const std::string& cache_file, MappedFile& file, MeshView& mesh,
+    MeshCacheHeader* out_header)
+{
+    if (!file.open(cache_file))
+    {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    bool ok = file.size() >= sizeof(header);
+    if (ok)
+    {
+        memcpy(&header, file.data(), sizeof(header));
+        ok = memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0
+            && header.version == MESH_CACHE_VERSION
+            && header.endian == MESH_CACHE_ENDIAN;
+    }
+    if (ok)
+    {
+        uint64_t nv = header.num_vertices, nt = header.num_triangles;
+        const uint64_t expected[MeshCacheHeader::NumSections] = { 12 * nv, 12 * nv, 8 * nv, 12 * nt };
+        for (int s = 0; s < MeshCacheHeader::NumSections && ok; ++s)
+        {
+            const MeshCacheSection& section = header.sections[s];
+            bool optional = s == MeshCacheHeader::Normals || s == MeshCacheHeader::UVs;
+            ok = section.offset % MESH_CACHE_ALIGNMENT == 0
+                && section.offset <= file.size()
+                && section.bytes <= file.size() - section.offset
+                && (section.bytes == expected[s] || (optional && section.bytes == 0));
+        }
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: %s is not a valid mesh cache\n", cache_file.c_str());
+        file.close();
+        return false;
+    }
+
+    auto section = [&](int s) { return file.data() + header.sections[s].offset; };
+    auto count = [&](int s, size_t elem) { return (size_t)header.sections[s].bytes / elem; };
+    mesh.positions = { (const float*)section(MeshCacheHeader::Positions), count(MeshCacheHeader::Positions, 4) };
+    mesh.normals = { (const float*)section(MeshCacheHeader::Normals), count(MeshCacheHeader::Normals, 4) };
+    mesh.uvs = { (const float*)section(MeshCacheHeader::UVs), count(MeshCacheHeader::UVs, 4) };
+    mesh.indices = { (const uint32_t*)section(MeshCacheHeader::Indices), count(MeshCacheHeader::Indices, 4) };
+    if (out_header)
+    {
+        *out_header = header;
+    }
+    return true;
+}
+
+bool mesh_cache_is_fresh(const MeshCacheHeader& header, const std::string& source_file)
+{
+    MeshCacheSource current;
+    if (!describe_mesh_source(source_file, current, false))
+    {
+        // Source is gone, the cache is all we have
+        return true;
+    }
+    if (current.size != header.source.size)
+    {
+        return false;
+    }
+    if (current.mtime == header.source.mtime)
+    {
+        return true;
+    }
+    return describe_mesh_source(source_file, current, true) && current.hash == header.source.hash;
+}
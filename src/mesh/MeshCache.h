@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Mesh.h"
+#include "../util/MappedFile.h"
+#include <cstdint>
+#include <string>
+
+// Binary mesh container (.gvm). Layout:
+//   MeshCacheHeader
+//   positions, normals, uvs, indices  (each section 64-byte aligned)
+// The header records the size, modification time and content hash of the
+// text file the mesh was parsed from, so a stale cache can be detected.
+
+constexpr uint32_t MESH_CACHE_VERSION = 1;
+constexpr uint32_t MESH_CACHE_ONLY_VERTICES = 1u << 0;
+constexpr size_t MESH_CACHE_ALIGNMENT = 64;
+
+struct MeshCacheSection
+{
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+struct MeshCacheSource
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+};
+
+struct MeshCacheHeader
+{
+    enum Section
+    {
+        Positions, Normals, UVs, Indices, NumSections
+    };
+
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t endian;
+    uint32_t reserved;
+    MeshCacheSource source;
+    uint64_t num_vertices;
+    uint64_t num_triangles;
+    MeshCacheSection sections[NumSections];
+};
+
+// Size, mtime and (optionally) content hash of a source file.
+bool describe_mesh_source(const std::string& filename, MeshCacheSource& source, bool hash_contents = true);
+
+// Writes `mesh` to `cache_file`. The file is written next to its final
+// name and renamed into place, so readers never see a partial cache.
+bool write_mesh_cache(const std::string& cache_file, const MeshView& mesh,
+    const MeshCacheSource& source, bool only_vertices);
+
+// Maps `cache_file` and points `mesh` into the mapping (no copy). The view
+// stays valid for as long as `file` stays open.
+bool open_mesh_cache(const std::string& cache_file, MappedFile& file, MeshView& mesh,
+    MeshCacheHeader* header = nullptr);
+
+// True if the cache was built from the current content of `source_file`.
+// Size and mtime are checked first; the content is only hashed when the
+// size matches but the mtime does not (e.g. the file was touched or copied).
+bool mesh_cache_is_fresh(const MeshCacheHeader& header, const std::string& source_file);
@@ -0,0 +1,163 @@
+#include "MeshPager.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+MeshPager::MeshPager()
+{
+    cache.load = [this](uint32_t cluster, std::vector<char>& data)
+    {
+        const Span<const char> page = mesh.page(cluster);
+        data.assign(page.begin(), page.end());
+        return !page.empty();
+    };
+}
+
+MeshPager::~MeshPager()
+{
+    // The loaders read `mesh`, which is destroyed before `cache`
+    cache.stop();
+}
+
+bool MeshPager::open(const std::string& filename)
+{
+    close();
+    if (!mesh.open(filename))
+    {
+        return false;
+    }
+    std::vector<Eigen::AlignedBox3f> boxes;
+    boxes.reserve(mesh.clusters().size());
+    for (const PagedMeshCluster& cluster : mesh.clusters())
+    {
+        boxes.push_back(cluster.bounds());
+    }
+    bvh_.max_leaf_size = 1;
+    bvh_.build(boxes);
+    visible_mark_.assign(boxes.size(), 0);
+    cache.reset(boxes.size());
+    return true;
+}
+
+void MeshPager::close()
+{
+    cache.reset(0);
+    mesh.close();
+    bvh_.clear();
+    visible_mark_.clear();
+    resident.clear();
+    visible_clusters = missing_clusters = prefetched_clusters = loaded_clusters = visible_triangles = 0;
+    has_last_view_ = false;
+    linear_velocity_.setZero();
+    angular_velocity_.setZero();
+}
+
+void MeshPager::cull(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height,
+    std::vector<PagedCluster>& out)
+{
+    out.clear();
+    bvh_.cull(Frustum::from_matrix(proj * view), ranges_);
+    const bool perspective = proj(3, 3) == 0.0f;
+    const Eigen::Matrix3f R = view.topLeftCorner<3, 3>();
+    const Eigen::Vector3f eye = -R.transpose() * view.topRightCorner<3, 1>();
+    // Pixels per unit at distance 1 (perspective) or anywhere (ortho)
+    const float pixels_per_unit = 0.5f * proj(1, 1) * viewport_height;
+    for (const Bvh::Range& range : ranges_)
+    {
+        for (uint32_t i = range.first; i < range.first + range.count; ++i)
+        {
+            const uint32_t cluster = bvh_.primitives()[i];
+            const Eigen::AlignedBox3f box = mesh.clusters()[cluster].bounds();
+            const float diameter = box.diagonal().norm();
+            float pixel_size = diameter * pixels_per_unit;
+            if (perspective)
+            {
+                const float distance = (box.center() - eye).norm() - 0.5f * diameter;
+                pixel_size = distance > 0.0f ? pixel_size / distance : std::numeric_limits<float>::max();
+            }
+            out.push_back({ cluster, MeshView(), pixel_size });
+        }
+    }
+}
+
+void MeshPager::update(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height, float dt)
+{
+    ++frame_;
+    resident.clear();
+    visible_clusters = missing_clusters = prefetched_clusters = loaded_clusters = visible_triangles = 0;
+    if (!is_open())
+    {
+        return;
+    }
+
+    cull(view, proj, viewport_height, visible_);
+    size_t visible_bytes = 0;
+    for (const PagedCluster& c : visible_)
+    {
+        visible_mark_[c.cluster] = frame_;
+        visible_bytes += (size_t)mesh.clusters()[c.cluster].bytes;
+        const std::vector<char>* page = cache.acquire(c.cluster, c.pixel_size);
+        if (!page)
+        {
+            ++missing_clusters;
+            continue;
+        }
+        resident.push_back({ c.cluster, mesh.view(c.cluster, page->data()), c.pixel_size });
+        visible_triangles += mesh.clusters()[c.cluster].num_triangles;
+    }
+    visible_clusters = visible_.size();
+
+    // Camera velocity from the motion since the last frame: `delta` takes
+    // the last camera frame to the current one
+    if (has_last_view_ && dt > 0.0f)
+    {
+        const Eigen::Matrix4f delta = view * last_view_.inverse();
+        const Eigen::AngleAxisf rotation(Eigen::Matrix3f(delta.topLeftCorner<3, 3>()));
+        const Eigen::Vector3f angular = rotation.axis() * rotation.angle() / dt;
+        const Eigen::Vector3f linear = delta.topRightCorner<3, 1>() / dt;
+        angular_velocity_ += velocity_smoothing * (angular - angular_velocity_);
+        linear_velocity_ += velocity_smoothing * (linear - linear_velocity_);
+    }
+    last_view_ = view;
+    has_last_view_ = true;
+
+    const float angle = angular_velocity_.norm() * prefetch_seconds;
+    const Eigen::Vector3f offset = linear_velocity_ * prefetch_seconds;
+    const float still = 1e-4f * mesh.bounds().diagonal().norm();
+    // Prefetched clusters need room next to those in view, or they only
+    // evict each other
+    const bool room = visible_bytes <= cache.budget / 2;
+    if (prefetch && room && (angle > 1e-4f || offset.norm() > still))
+    {
+        Eigen::Matrix4f ahead = Eigen::Matrix4f::Identity();
+        if (angle > 0.0f)
+        {
+            ahead.topLeftCorner<3, 3>() = Eigen::AngleAxisf(angle, angular_velocity_.normalized()).toRotationMatrix();
+        }
+        ahead.topRightCorner<3, 1>() = offset;
+        cull(ahead * view, proj, viewport_height, predicted_);
+        for (const PagedCluster& c : predicted_)
+        {
+            if (visible_mark_[c.cluster] != frame_ && !cache.resident(c.cluster))
+            {
+                // Negative: below every cluster needed now, larger ones first
+                cache.prefetch(c.cluster, -1.0f / (1.0f + c.pixel_size));
+                ++prefetched_clusters;
+            }
+        }
+    }
+    loaded_clusters = cache.update();
+}
+
+void MeshPager::print_stats(FILE* out) const
+{
+    const PageCacheStats stats = cache.stats();
+    fprintf(out, "Mesh paging: %zu of %zu clusters resident (%.1f of %.1f MB budget)\n", stats.resident_pages,
+        mesh.clusters().size(), stats.resident_bytes / 1048576.0, cache.budget / 1048576.0);
+    fprintf(out, "  this frame: %zu visible, %zu missing, %zu prefetched, %zu triangles\n", visible_clusters,
+        missing_clusters, prefetched_clusters, visible_triangles);
+    fprintf(out, "  %llu hits, %llu misses (%.1f%% hit rate), %llu prefetched, %llu loads, %llu evictions, %.1f MB/s\n",
+        (unsigned long long)stats.hits, (unsigned long long)stats.misses, 100.0 * stats.hit_rate(),
+        (unsigned long long)stats.prefetches, (unsigned long long)stats.loads, (unsigned long long)stats.evictions,
+        stats.bytes_per_second / 1048576.0);
+}
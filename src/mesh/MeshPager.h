@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Bvh.h"
+#include "Mesh.h"
+#include "PagedMesh.h"
+#include "../util/PageCache.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// A resident cluster in view
+struct PagedCluster
+{
+    uint32_t cluster;
+    MeshView view;      // valid until the next update()
+    float pixel_size;   // projected bounding sphere diameter
+};
+
+// Keeps the clusters of a paged mesh that the camera needs in RAM, within
+// cache.budget bytes. Every frame update() culls the cluster boxes against
+// the frustum, returns the resident clusters in view and requests the
+// missing ones from the cache's loader threads, largest on screen first.
+//
+// Prefetch follows the camera: its velocity (translation and rotation,
+// smoothed over a few frames) is extrapolated prefetch_seconds ahead, and
+// the clusters in that predicted frustum are requested too, after every
+// cluster needed now. A camera at rest prefetches nothing, and neither does
+// a view whose clusters fill more than half of the cache.
+class MeshPager
+{
+public:
+    PageCache cache;
+    bool prefetch = true;
+    float prefetch_seconds = 0.5f;
+    // Weight of the newest frame in the velocity estimate
+    float velocity_smoothing = 0.3f;
+
+    MeshPager();
+    ~MeshPager();
+
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return mesh.is_open(); }
+
+    // Once per frame. `dt` is the time since the previous call.
+    void update(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height, float dt);
+
+    PagedMesh mesh;
+
+    // This frame
+    std::vector<PagedCluster> resident;
+    size_t visible_clusters = 0;
+    size_t missing_clusters = 0; // in view but not resident
+    size_t prefetched_clusters = 0;
+    size_t loaded_clusters = 0; // made resident by update(), drawn from the next frame on
+    size_t visible_triangles = 0; // of the resident clusters
+
+    // Cache statistics with this frame's counts
+    void print_stats(FILE* out = stdout) const;
+
+private:
+    void cull(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height,
+        std::vector<PagedCluster>& out);
+
+    Bvh bvh_; // over the cluster boxes
+    std::vector<Bvh::Range> ranges_;
+    std::vector<PagedCluster> visible_;
+    std::vector<PagedCluster> predicted_;
+    std::vector<uint64_t> visible_mark_;
+    uint64_t frame_ = 0;
+
+    // Camera motion, in camera space per second
+    bool has_last_view_ = false;
+    Eigen::Matrix4f last_view_ = Eigen::Matrix4f::Identity();
+    Eigen::Vector3f linear_velocity_ = Eigen::Vector3f::Zero();
+    Eigen::Vector3f angular_velocity_ = Eigen::Vector3f::Zero(); // axis * rad/s
+};
@@ -0,0 +1,470 @@
+#include "MeshPlugin.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+static const char* MESH_CACHE_EXTENSION = ".gvm";
+static const char* LOD_EXTENSION = ".lod";
+
+static bool has_extension(const std::string& filename, const char* ext)
+{
+    size_t n = strlen(ext);
+    if (filename.size() < n)
+    {
+        return false;
+    }
+    return std::equal(filename.end() - n, filename.end(), ext,
+        [](char a, char b) { return std::tolower((unsigned char)a) == b; });
+}
+
+// The chain is tagged with the source and the options it was built from
+static void lod_tag(const LodOptions& options, uint64_t (&tag)[3])
+{
+    tag[0] = (uint64_t)options.max_levels;
+    tag[1] = (uint64_t)options.min_triangles;
+    tag[2] = (uint64_t)(options.ratio * 1000.0f);
+}
+
+static bool lod_tag_matches(const MeshCacheSource& source, const uint64_t (&tag)[3],
+    const MeshCacheSource& expected_source, const LodOptions& options)
+{
+    uint64_t expected[3];
+    lod_tag(options, expected);
+    return source.size == expected_source.size && source.mtime == expected_source.mtime
+        && source.hash == expected_source.hash && memcmp(tag, expected, sizeof(tag)) == 0;
+}
+
+static void write_lod_blob(std::vector<char>& buffer, const MeshCacheSource& source, const LodOptions& options,
+    const LodChain& lod)
+{
+    uint64_t tag[3];
+    lod_tag(options, tag);
+    const size_t at = buffer.size();
+    buffer.resize(at + sizeof(source) + sizeof(tag));
+    memcpy(buffer.data() + at, &source, sizeof(source));
+    memcpy(buffer.data() + at + sizeof(source), tag, sizeof(tag));
+    lod.serialize(buffer);
+}
+
+static bool read_lod_blob(const std::vector<char>& buffer, const MeshCacheSource& expected_source,
+    const LodOptions& options, LodChain& lod)
+{
+    MeshCacheSource source;
+    uint64_t tag[3];
+    if (buffer.size() < sizeof(source) + sizeof(tag))
+    {
+        return false;
+    }
+    memcpy(&source, buffer.data(), sizeof(source));
+    memcpy(tag, buffer.data() + sizeof(source), sizeof(tag));
+    if (!lod_tag_matches(source, tag, expected_source, options))
+    {
+        return false;
+    }
+    size_t offset = sizeof(source) + sizeof(tag);
+    return lod.deserialize(buffer, offset);
+}
+
+MeshPlugin::MeshPlugin()
+{
+    mName = "mesh";
+}
+
+bool MeshPlugin::read_cache(const std::string& cache, const std::string& source_file, bool only_vertices,
+    LoadedMesh& out) const
+{
+    auto tic = std::chrono::steady_clock::now();
+    MeshCacheHeader header;
+    auto file = std::make_unique<MappedFile>();
+    MeshView cached;
+    if (!open_mesh_cache(cache, *file, cached, &header))
+    {
+        return false;
+    }
+    // A vertex-only cache cannot serve a full load
+    if ((!only_vertices && (header.flags & MESH_CACHE_ONLY_VERTICES))
+        || (!source_file.empty() && !mesh_cache_is_fresh(header, source_file)))
+    {
+        return false;
+    }
+    if (only_vertices)
+    {
+        cached.normals = {};
+        cached.uvs = {};
+        cached.indices = {};
+    }
+    out.mesh.clear();
+    out.cache_file = std::move(file);
+    out.view = cached;
+    out.source = header.source;
+    out.from_cache = true;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    printf("Mapped %s: %zu vertices, %zu triangles in %.2f ms\n",
+        cache.c_str(), out.view.num_vertices(), out.view.num_triangles(), 1000.0 * seconds);
+    return true;
+}
+
+bool MeshPlugin::read_mesh(const std::string& _filename, bool only_vertices, LoadedMesh& out) const
+{
+    out.filename = _filename;
+    if (has_extension(_filename, MESH_CACHE_EXTENSION))
+    {
+        if (!read_cache(_filename, "", only_vertices, out))
+        {
+            return false;
+        }
+    }
+    else if (!has_extension(_filename, ".obj"))
+    {
+        return false;
+    }
+    else
+    {
+        std::string cache = _filename + MESH_CACHE_EXTENSION;
+        if (!(use_cache && std::filesystem::exists(cache) && read_cache(cache, _filename, only_vertices, out)))
+        {
+            ObjLoadOptions options = load_options;
+            options.only_vertices = only_vertices;
+            if (!load_obj(_filename, out.mesh, options, &out.load_stats))
+            {
+                return false;
+            }
+            printf("Loaded %s: %zu vertices, %zu triangles in %.3f s (%.1f MB/s, %u threads)\n",
+                _filename.c_str(), out.mesh.num_vertices(), out.mesh.num_triangles(),
+                out.load_stats.seconds, out.load_stats.megabytes_per_second(), out.load_stats.threads);
+            if (compute_missing_normals && !out.mesh.has_normals() && out.mesh.num_triangles() > 0)
+            {
+                auto tic = std::chrono::steady_clock::now();
+                if (compute_normals(out.mesh.view(), out.mesh.normals, NormalWeighting::Angle, load_options.threads))
+                {
+                    printf("Computed normals in %.3f s\n",
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count());
+                }
+            }
+            out.view = out.mesh.view();
+
+            if (use_cache)
+            {
+                // A failed cache write only costs the next start-up, not this load
+                if (describe_mesh_source(_filename, out.source))
+                {
+                    write_mesh_cache(cache, out.view, out.source, only_vertices);
+                }
+            }
+        }
+    }
+
+    if (out.view.num_vertices() > 0)
+    {
+        auto V = out.view.V();
+        out.bounds = Eigen::AlignedBox3f(V.colwise().minCoeff().transpose(), V.colwise().maxCoeff().transpose());
+    }
+    return true;
+}
+
+void MeshPlugin::adopt(LoadedMesh& loaded)
+{
+    // Moving the vectors and the mapping keeps every pointer into them valid
+    mesh = std::move(loaded.mesh);
+    cache_file = std::move(loaded.cache_file);
+    view = loaded.view;
+    filename = loaded.filename;
+    cache_source = loaded.source;
+    loaded_from_cache = loaded.from_cache;
+    load_stats = loaded.load_stats;
+    bounds = loaded.bounds;
+    bvh = std::move(loaded.bvh);
+    bvh_stats = loaded.bvh_stats;
+    draw_indices = std::move(loaded.draw_indices);
+    lod = std::move(loaded.lod);
+    lod_stats = loaded.lod_stats;
+}
+
+bool MeshPlugin::load(const std::string& _filename, bool only_vertices)
+{
+    if (!has_extension(_filename, MESH_CACHE_EXTENSION) && !has_extension(_filename, ".obj"))
+    {
+        return false;
+    }
+    unload();
+    LoadedMesh loaded;
+    if (!read_mesh(_filename, only_vertices, loaded))
+    {
+        return false;
+    }
+    adopt(loaded);
+    return true;
+}
+
+bool MeshPlugin::load_async(Asset& asset)
+{
+    auto loaded = std::make_shared<LoadedMesh>();
+    if (!read_mesh(asset.filename, asset.only_vertices, *loaded))
+    {
+        return false;
+    }
+    // The expensive part of post_load happens here, off the render thread
+    if (use_bvh && loaded->view.num_triangles() > 0)
+    {
+        build_bvh(loaded->view, loaded->bvh, loaded->bvh_stats);
+        loaded->bvh.reorder_indices(loaded->view, loaded->draw_indices);
+    }
+    if (use_lod && loaded->view.num_triangles() > lod_options.min_triangles)
+    {
+        build_lod(loaded->view, loaded->filename, loaded->source, loaded->lod, loaded->lod_stats);
+    }
+    asset.view = loaded->view;
+    // Uploaded in hierarchy order, so every culled range is one draw
+    if (!loaded->bvh.empty())
+    {
+        asset.view.indices = Span<const uint32_t>(loaded->draw_indices.data(), loaded->draw_indices.size());
+    }
+    asset.payload = loaded;
+    return true;
+}
+
+bool MeshPlugin::load_finished(Asset& asset)
+{
+    auto loaded = std::static_pointer_cast<LoadedMesh>(asset.payload);
+    if (asset.plugin != this || !loaded)
+    {
+        return false;
+    }
+    unload();
+    adopt(*loaded);
+    gpu_positions = asset.positions;
+    gpu_normals = asset.normals;
+    gpu_uvs = asset.uvs;
+    gpu_indices = asset.indices;
+    asset.positions = asset.normals = asset.uvs = asset.indices = BufferSlice();
+    asset.payload.reset();
+    return true;
+}
+
+bool MeshPlugin::unload()
+{
+    bvh.clear();
+    draw_indices.clear();
+    lod.clear();
+    lod_level = 0;
+    triangles_drawn = 0;
+    visible_ranges.clear();
+    visible_triangles = 0;
+    picked_triangle = -1;
+    view = MeshView();
+    mesh.clear();
+    cache_file.reset();
+    filename.clear();
+    bounds.setEmpty();
+    cache_source = MeshCacheSource();
+    loaded_from_cache = false;
+    if (mViewer && mViewer->buffers)
+    {
+        for (BufferSlice* slice : { &gpu_positions, &gpu_normals, &gpu_uvs, &gpu_indices })
+        {
+            mViewer->buffers->free_static(*slice);
+            *slice = BufferSlice();
+        }
+    }
+    return false;
+}
+
+bool MeshPlugin::save(const std::string& _filename, bool only_vertices)
+{
+    if (!has_extension(_filename, MESH_CACHE_EXTENSION) || view.num_vertices() == 0)
+    {
+        return false;
+    }
+    MeshCacheSource source = cache_source;
+    if (!filename.empty() && !loaded_from_cache)
+    {
+        describe_mesh_source(filename, source);
+    }
+    return write_mesh_cache(_filename, view, source, only_vertices);
+}
+
+bool MeshPlugin::post_load()
+{
+    if (!bounds.isEmpty())
+    {
+        mViewer->camera.fit(bounds);
+    }
+    // Background loads arrive with both already built
+    if (use_bvh && bvh.empty() && view.num_triangles() > 0)
+    {
+        build_bvh(view, bvh, bvh_stats);
+        bvh.reorder_indices(view, draw_indices);
+    }
+    if (use_lod && lod.empty() && view.num_triangles() > lod_options.min_triangles)
+    {
+        build_lod(view, filename, cache_source, lod, lod_stats);
+    }
+    return false;
+}
+
+void MeshPlugin::build_bvh(const MeshView& _mesh, Bvh& out, Bvh::BuildStats& stats) const
+{
+    if (out.build(_mesh, &stats))
+    {
+        printf("Built BVH: %zu nodes over %zu triangles in %.3f s (%.1f Mtris/s, %u threads)\n",
+            stats.nodes, stats.primitives, stats.seconds, stats.mprims_per_second(), stats.threads);
+    }
+}
+
+void MeshPlugin::build_lod(const MeshView& _mesh, const std::string& source_file, const MeshCacheSource& source,
+    LodChain& out, LodStats& stats) const
+{
+    // Only meshes with a known source can be cached
+    const bool cached = use_cache && !source_file.empty() && source.size != 0;
+    const std::string lod_file = source_file + LOD_EXTENSION;
+    if (cached && std::filesystem::exists(lod_file))
+    {
+        MappedFile file;
+        if (file.open(lod_file))
+        {
+            std::vector<char> buffer(file.data(), file.data() + file.size());
+            if (read_lod_blob(buffer, source, lod_options, out))
+            {
+                printf("Loaded %s: %d levels\n", lod_file.c_str(), out.num_levels());
+                return;
+            }
+        }
+    }
+
+    if (!out.build(_mesh, lod_options, &stats))
+    {
+        return;
+    }
+    printf("Built LOD chain: %d levels, %zu -> %zu triangles in %.3f s (%.1f Mtris/s)\n",
+        out.num_levels(), _mesh.num_triangles(), out.level(out.num_levels() - 1, _mesh).num_triangles(),
+        stats.seconds, stats.mtris_per_second());
+    if (!cached)
+    {
+        return;
+    }
+    // Write then rename, so a crash never leaves a half-written chain behind
+    std::vector<char> buffer;
+    write_lod_blob(buffer, source, lod_options, out);
+    const std::string tmp = lod_file + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f)
+    {
+        return;
+    }
+    const bool ok = fwrite(buffer.data(), 1, buffer.size(), f) == buffer.size();
+    if (fclose(f) != 0 || !ok)
+    {
+        std::remove(tmp.c_str());
+        return;
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp, lod_file, error);
+    if (error)
+    {
+        std::remove(tmp.c_str());
+    }
+}
+
+bool MeshPlugin::serialize(std::vector<char>& buffer) const
+{
+    if (lod.empty())
+    {
+        return false;
+    }
+    write_lod_blob(buffer, cache_source, lod_options, lod);
+    return true;
+}
+
+bool MeshPlugin::deserialize(const std::vector<char>& buffer)
+{
+    return read_lod_blob(buffer, cache_source, lod_options, lod);
+}
+
+bool MeshPlugin::snapshot(SnapshotOut& out) const
+{
+    // The bytes of serialize(), written from the chain's own vectors
+    if (lod.empty())
+    {
+        return false;
+    }
+    uint64_t tag[3];
+    lod_tag(lod_options, tag);
+    out.write_value(cache_source);
+    out.write(tag, sizeof(tag));
+    lod.serialize([&](const void* data, size_t bytes) { out.write(data, bytes); });
+    return true;
+}
+
+bool MeshPlugin::restore(SnapshotIn& in)
+{
+    MeshCacheSource source;
+    uint64_t tag[3];
+    if (!in.read_value(source) || !in.read(tag, sizeof(tag))
+        || !lod_tag_matches(source, tag, cache_source, lod_options))
+    {
+        return false;
+    }
+    return lod.deserialize([&](void* data, size_t bytes) { return in.read(data, bytes); }, in.remaining());
+}
+
+bool MeshPlugin::pre_draw_tasks(TaskGraph& tasks, bool /*first*/)
+{
+    // Culling and the LOD selection are independent; the count needs both
+    const TaskGraph::Task cull = tasks.add([this]
+        {
+            visible_ranges.clear();
+            visible_triangles = 0;
+            if (!bvh.empty())
+            {
+                bvh.cull(Frustum::from_matrix(mViewer->proj * mViewer->view), visible_ranges);
+                for (const auto& range : visible_ranges)
+                {
+                    visible_triangles += range.count;
+                }
+            }
+            else
+            {
+                visible_triangles = view.num_triangles();
+            }
+        });
+    const TaskGraph::Task select = tasks.add([this]
+        {
+            lod_level = lod.empty() ? 0
+                                    : lod.select(mViewer->view, mViewer->proj, mViewer->framebuffer_height,
+                                          lod_pixel_error);
+        });
+    tasks.add([this]
+        {
+            // Nothing visible means nothing drawn at any level
+            if (visible_triangles == 0)
+            {
+                lod_level = 0;
+            }
+            triangles_drawn = lod_level == 0 ? visible_triangles : lod.level(lod_level, view).num_triangles();
+        }, { cull, select });
+    return false;
+}
+
+bool MeshPlugin::mouse_down(int /*button*/, int /*modifier*/)
+{
+    if (bvh.empty())
+    {
+        return false;
+    }
+    auto tic = std::chrono::steady_clock::now();
+    Ray ray;
+    mViewer->mouse_ray(mViewer->current_mouse_x, mViewer->current_mouse_y, ray.origin, ray.direction);
+    Bvh::Hit hit;
+    picked_triangle = -1;
+    if (bvh.intersect(ray, hit))
+    {
+        picked_triangle = (int)hit.primitive;
+        picked_point = ray.origin + hit.t * ray.direction;
+    }
+    pick_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    // Picking never consumes the click
+    return false;
+}
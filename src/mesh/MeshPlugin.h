@@ -0,0 +1,141 @@
+#pragma once
+
+#include "../viewer/Viewer.h"
+#include "../util/MappedFile.h"
+#include "Bvh.h"
+#include "Lod.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "Normals.h"
+#include "ObjLoader.h"
+#include <memory>
+
+// Owns the mesh loaded through Viewer::load_mesh_from_file or
+// Viewer::load_mesh_async. A background load also builds the BVH and the LOD
+// chain on the loader thread and leaves GPU copies of the streams in gpu_*,
+// the indices in draw_indices order.
+//
+// Loading foo.obj first looks for foo.obj.gvm and maps it if it is still
+// fresh; otherwise the text is parsed and the cache is rewritten. Always
+// read the mesh through `view`, which points either into `mesh` or into the
+// mapped cache.
+//
+// After a load the triangles are indexed by `bvh`: a mouse press casts a ray
+// through it (picked_triangle / picked_point) and every frame the camera
+// frustum is culled against it into visible_ranges.
+//
+// Large meshes also get a LOD chain, cached next to the source as foo.obj.lod
+// through serialize/deserialize. Each frame lod_level is the coarsest level
+// whose error stays under lod_pixel_error pixels; draw through draw_view().
+class MeshPlugin : public ViewerPluginBase<MeshPlugin>
+{
+public:
+    MeshPlugin();
+
+    bool load(const std::string& filename, bool only_vertices) override;
+    bool load_async(Asset& asset) override;
+    bool load_finished(Asset& asset) override;
+    bool unload() override;
+    // Writes the current mesh as a binary cache (.gvm)
+    bool save(const std::string& filename, bool only_vertices) override;
+    bool post_load() override;
+    // Frustum culling and LOD selection, as tasks on the viewer's job system
+    bool pre_draw_tasks(TaskGraph& tasks, bool first) override;
+    bool mouse_down(int button, int modifier) override;
+    // The LOD chain, tagged with the source it was built from
+    bool serialize(std::vector<char>& buffer) const override;
+    bool deserialize(const std::vector<char>& buffer) override;
+    // The same LOD chain, written to the snapshot stream without a copy
+    bool snapshot(SnapshotOut& out) const override;
+    bool restore(SnapshotIn& in) override;
+
+    MeshView view;
+    MeshData mesh;
+    std::string filename;
+    Eigen::AlignedBox3f bounds;
+
+    // GPU copies of `view`, set by background loads only; freed on unload.
+    // gpu_indices holds draw_indices, not view.indices.
+    BufferSlice gpu_positions;
+    BufferSlice gpu_normals;
+    BufferSlice gpu_uvs;
+    BufferSlice gpu_indices;
+
+    // Parser settings, set threads = 1 for the single-threaded baseline
+    ObjLoadOptions load_options;
+    ObjLoadStats load_stats;
+    // Meshes loaded without normals get angle-weighted vertex normals,
+    // computed before the cache is written
+    bool compute_missing_normals = true;
+
+    // Read and write <file>.gvm next to text meshes
+    bool use_cache = true;
+    bool loaded_from_cache = false;
+
+    // Spatial index over the triangles; call bvh.refit(view) after moving
+    // vertices
+    bool use_bvh = true;
+    Bvh bvh;
+    Bvh::BuildStats bvh_stats;
+
+    // Last pick, picked_triangle < 0 if the ray missed
+    int picked_triangle = -1;
+    Eigen::Vector3f picked_point = Eigen::Vector3f::Zero();
+    double pick_seconds = 0.0;
+
+    // view.indices in bvh.primitives() order: range r of visible_ranges is
+    // indices [3 * r.first, 3 * (r.first + r.count)) of it and of gpu_indices.
+    // view.indices keeps the file order, which picked_triangle refers to.
+    std::vector<uint32_t> draw_indices;
+
+    // Triangles in the view frustum this frame, as ranges of
+    // bvh.primitives() (see draw_indices)
+    std::vector<Bvh::Range> visible_ranges;
+    size_t visible_triangles = 0;
+
+    // Simplified levels, built after a load of more than
+    // lod_options.min_triangles triangles
+    bool use_lod = true;
+    LodOptions lod_options;
+    LodChain lod;
+    LodStats lod_stats;
+    float lod_pixel_error = 1.0f;
+    int lod_level = 0;
+    // Triangles submitted this frame: the visible ones at level 0, the
+    // whole selected level otherwise
+    size_t triangles_drawn = 0;
+
+    MeshView draw_view() const { return lod.level(lod_level, view); }
+
+private:
+    // Everything a load produces. Filled without touching the plugin, so
+    // that load_async can run it on a loader thread.
+    struct LoadedMesh
+    {
+        std::string filename;
+        MeshData mesh;
+        std::unique_ptr<MappedFile> cache_file;
+        MeshView view;
+        MeshCacheSource source;
+        bool from_cache = false;
+        ObjLoadStats load_stats;
+        Eigen::AlignedBox3f bounds;
+        Bvh bvh;
+        Bvh::BuildStats bvh_stats;
+        std::vector<uint32_t> draw_indices;
+        LodChain lod;
+        LodStats lod_stats;
+    };
+
+    bool read_mesh(const std::string& filename, bool only_vertices, LoadedMesh& out) const;
+    bool read_cache(const std::string& cache, const std::string& source_file, bool only_vertices,
+        LoadedMesh& out) const;
+    void build_bvh(const MeshView& mesh, Bvh& out, Bvh::BuildStats& stats) const;
+    // Reads <filename>.lod if it is fresh, otherwise builds and writes it
+    void build_lod(const MeshView& mesh, const std::string& source_file, const MeshCacheSource& source,
+        LodChain& out, LodStats& stats) const;
+    void adopt(LoadedMesh& loaded);
+
+    std::unique_ptr<MappedFile> cache_file;
+    MeshCacheSource cache_source;
+};
@@ -0,0 +1,277 @@
+#include "Normals.h"
+#include "../kernels/Kernels.h"
+#include "../util/Parallel.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Triangles per face task and vertices per gather task
+const size_t FACE_BLOCK = 4096;
+const size_t VERTEX_BLOCK = 8192;
+
+// One column per coordinate, one row per triangle of the block, so every
+// kernel below runs on contiguous float arrays
+using Block3 = Eigen::Array<float, Eigen::Dynamic, 3>;
+using Block2 = Eigen::Array<float, Eigen::Dynamic, 2>;
+
+// Attribute of the given corner of `count` triangles, one row per triangle
+template <typename Block>
+void gather(const float* data, const uint32_t* indices, size_t count, int corner, Block& out)
+{
+    const int dim = Block::ColsAtCompileTime;
+    out.resize((Eigen::Index)count, dim);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float* p = data + (size_t)dim * indices[3 * i + corner];
+        for (int d = 0; d < dim; ++d)
+        {
+            out((Eigen::Index)i, d) = p[d];
+        }
+    }
+}
+
+Eigen::ArrayXf dot(const Block3& a, const Block3& b)
+{
+    return a.col(0) * b.col(0) + a.col(1) * b.col(1) + a.col(2) * b.col(2);
+}
+
+// acos to within 7e-5 rad (Abramowitz and Stegun 4.4.45), plain array
+// arithmetic so it vectorizes, unlike Eigen's acos
+Eigen::ArrayXf fast_acos(const Eigen::ArrayXf& x)
+{
+    const Eigen::ArrayXf a = x.abs();
+    const Eigen::ArrayXf r = (1.0f - a).sqrt() * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+    return (x < 0.0f).select(3.14159265f - r, r);
+}
+
+// Angle between a and b, 0 if either is degenerate
+Eigen::ArrayXf angle(const Block3& a, const Block3& b)
+{
+    const Eigen::ArrayXf lengths = (dot(a, a) * dot(b, b)).sqrt();
+    const Eigen::ArrayXf cosine = (dot(a, b) / lengths.max(1e-30f)).max(-1.0f).min(1.0f);
+    return (lengths > 0.0f).select(fast_acos(cosine), 0.0f);
+}
+
+// Interior angles at the three corners of each triangle
+void corner_angles(const Block3& p0, const Block3& p1, const Block3& p2, float* out)
+{
+    const Block3 e0 = p1 - p0, e1 = p2 - p0, e2 = p2 - p1;
+    const Eigen::ArrayXf a0 = angle(e0, e1), a1 = angle(-e0, e2), a2 = angle(e1, e2);
+    for (Eigen::Index i = 0; i < a0.size(); ++i)
+    {
+        out[3 * i + 0] = a0[i];
+        out[3 * i + 1] = a1[i];
+        out[3 * i + 2] = a2[i];
+    }
+}
+
+void store(const Block3& block, float* out)
+{
+    for (Eigen::Index i = 0; i < block.rows(); ++i)
+    {
+        out[3 * i + 0] = block(i, 0);
+        out[3 * i + 1] = block(i, 1);
+        out[3 * i + 2] = block(i, 2);
+    }
+}
+
+bool valid_indices(const MeshView& mesh)
+{
+    const size_t nv = mesh.num_vertices();
+    return std::all_of(mesh.indices.begin(), mesh.indices.end(), [nv](uint32_t i) { return i < nv; });
+}
+
+// Runs fn(first, count) over blocks of [0, total)
+template <typename Fn>
+void for_blocks(size_t total, size_t block, unsigned threads, Fn&& fn)
+{
+    parallel_for((total + block - 1) / block, [&](size_t b, unsigned)
+        {
+            const size_t first = b * block;
+            fn(first, std::min(block, total - first));
+        }, threads);
+}
+}
+
+bool VertexCorners::build(const MeshView& mesh)
+{
+    const size_t nv = mesh.num_vertices();
+    offsets.assign(nv + 1, 0);
+    corners.resize(mesh.indices.size());
+    for (uint32_t v : mesh.indices)
+    {
+        if (v >= nv)
+        {
+            offsets.clear();
+            corners.clear();
+            return false;
+        }
+        ++offsets[v + 1];
+    }
+    for (size_t v = 0; v < nv; ++v)
+    {
+        offsets[v + 1] += offsets[v];
+    }
+    // Fill through a moving cursor, then shift the offsets back
+    for (uint32_t c = 0; c < (uint32_t)mesh.indices.size(); ++c)
+    {
+        corners[offsets[mesh.indices[c]]++] = c;
+    }
+    for (size_t v = nv; v > 0; --v)
+    {
+        offsets[v] = offsets[v - 1];
+    }
+    offsets[0] = 0;
+    return true;
+}
+
+bool compute_normals(const MeshView& mesh, std::vector<float>& normals, NormalWeighting weighting,
+    unsigned threads, const VertexCorners* adjacency)
+{
+    const size_t nv = mesh.num_vertices(), nf = mesh.num_triangles();
+    VertexCorners local;
+    if (!adjacency || adjacency->num_vertices() != nv)
+    {
+        if (!local.build(mesh))
+        {
+            return false;
+        }
+        adjacency = &local;
+    }
+    else if (!valid_indices(mesh))
+    {
+        return false;
+    }
+    if (threads == 0)
+    {
+        threads = hardware_threads();
+    }
+
+    // Face terms: the unnormalized normal (twice the area) for area weights,
+    // the unit normal and the corner angles for angle weights
+    const bool by_angle = weighting == NormalWeighting::Angle;
+    std::vector<float> face_normals(3 * nf), weights(by_angle ? 3 * nf : 0);
+    const Kernels& k = kernels();
+    for_blocks(nf, FACE_BLOCK, threads, [&](size_t first, size_t count)
+        {
+            k.face_normals(mesh.positions.data(), mesh.indices.data() + 3 * first, count,
+                face_normals.data() + 3 * first, by_angle ? weights.data() + 3 * first : nullptr);
+        });
+
+    // Gather: every task owns its vertices
+    normals.resize(3 * nv);
+    for_blocks(nv, VERTEX_BLOCK, threads, [&](size_t first, size_t count)
+        {
+            for (size_t v = first; v < first + count; ++v)
+            {
+                Eigen::Vector3f n = Eigen::Vector3f::Zero();
+                for (uint32_t k = adjacency->offsets[v]; k < adjacency->offsets[v + 1]; ++k)
+                {
+                    const uint32_t c = adjacency->corners[k];
+                    const float w = by_angle ? weights[c] : 1.0f;
+                    n += w * Eigen::Map<const Eigen::Vector3f>(&face_normals[3 * (size_t)(c / 3)]);
+                }
+                const float length = n.norm();
+                Eigen::Map<Eigen::Vector3f> out(&normals[3 * v]);
+                out = length > 0.0f ? Eigen::Vector3f(n / length) : Eigen::Vector3f::Zero();
+            }
+        });
+    return true;
+}
+
+bool compute_tangents(const MeshView& mesh, std::vector<float>& tangents, unsigned threads,
+    const VertexCorners* adjacency)
+{
+    const size_t nv = mesh.num_vertices(), nf = mesh.num_triangles();
+    if (mesh.normals.size() != 3 * nv || mesh.uvs.size() != 2 * nv)
+    {
+        return false;
+    }
+    VertexCorners local;
+    if (!adjacency || adjacency->num_vertices() != nv)
+    {
+        if (!local.build(mesh))
+        {
+            return false;
+        }
+        adjacency = &local;
+    }
+    else if (!valid_indices(mesh))
+    {
+        return false;
+    }
+    if (threads == 0)
+    {
+        threads = hardware_threads();
+    }
+
+    // Face terms: the uv derivatives dp/du (tangent) and dp/dv (bitangent),
+    // oriented by the sign of the uv area, plus the corner angles
+    std::vector<float> face_tangents(3 * nf), face_bitangents(3 * nf), weights(3 * nf);
+    for_blocks(nf, FACE_BLOCK, threads, [&](size_t first, size_t count)
+        {
+            const uint32_t* indices = mesh.indices.data() + 3 * first;
+            Block3 p0, p1, p2;
+            gather(mesh.positions.data(), indices, count, 0, p0);
+            gather(mesh.positions.data(), indices, count, 1, p1);
+            gather(mesh.positions.data(), indices, count, 2, p2);
+            Block2 t0, t1, t2;
+            gather(mesh.uvs.data(), indices, count, 0, t0);
+            gather(mesh.uvs.data(), indices, count, 1, t1);
+            gather(mesh.uvs.data(), indices, count, 2, t2);
+
+            const Block3 e0 = p1 - p0, e1 = p2 - p0;
+            const Block2 d0 = t1 - t0, d1 = t2 - t0;
+            const Eigen::ArrayXf area = d0.col(0) * d1.col(1) - d1.col(0) * d0.col(1);
+            // Faces without a uv area contribute nothing
+            const Eigen::ArrayXf orientation = area.sign();
+            Block3 t(count, 3), b(count, 3);
+            for (int d = 0; d < 3; ++d)
+            {
+                t.col(d) = (e0.col(d) * d1.col(1) - e1.col(d) * d0.col(1)) * orientation;
+                b.col(d) = (e1.col(d) * d0.col(0) - e0.col(d) * d1.col(0)) * orientation;
+            }
+            store(t, face_tangents.data() + 3 * first);
+            store(b, face_bitangents.data() + 3 * first);
+            corner_angles(p0, p1, p2, weights.data() + 3 * first);
+        });
+
+    tangents.resize(4 * nv);
+    for_blocks(nv, VERTEX_BLOCK, threads, [&](size_t first, size_t count)
+        {
+            // Component of v in the plane of n, normalized (0 if none)
+            auto project = [](const Eigen::Vector3f& n, const Eigen::Vector3f& v)
+            {
+                const Eigen::Vector3f p = v - n.dot(v) * n;
+                const float length = p.norm();
+                return length > 1e-20f ? Eigen::Vector3f(p / length) : Eigen::Vector3f::Zero();
+            };
+            for (size_t v = first; v < first + count; ++v)
+            {
+                const Eigen::Vector3f n = Eigen::Map<const Eigen::Vector3f>(&mesh.normals[3 * v]).normalized();
+                Eigen::Vector3f t = Eigen::Vector3f::Zero(), b = Eigen::Vector3f::Zero();
+                for (uint32_t k = adjacency->offsets[v]; k < adjacency->offsets[v + 1]; ++k)
+                {
+                    const uint32_t c = adjacency->corners[k];
+                    const size_t f = 3 * (size_t)(c / 3);
+                    t += weights[c] * project(n, Eigen::Map<const Eigen::Vector3f>(&face_tangents[f]));
+                    b += weights[c] * project(n, Eigen::Map<const Eigen::Vector3f>(&face_bitangents[f]));
+                }
+                t = project(n, t);
+                if (t.isZero())
+                {
+                    // No usable uvs around this vertex: any tangent of the plane
+                    t = project(n, std::abs(n.x()) < 0.9f ? Eigen::Vector3f::UnitX() : Eigen::Vector3f::UnitY());
+                }
+                float* out = &tangents[4 * v];
+                out[0] = t.x();
+                out[1] = t.y();
+                out[2] = t.z();
+                out[3] = n.cross(t).dot(b) < 0.0f ? -1.0f : 1.0f;
+            }
+        });
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstdint>
+#include <vector>
+
+enum class NormalWeighting
+{
+    Area,  // face normals weighted by triangle area
+    Angle  // weighted by the corner angle, independent of tessellation
+};
+
+// Vertex to corner adjacency in compressed sparse row form: the corners
+// (3 * triangle + k) that use vertex v are
+// corners[offsets[v]] .. corners[offsets[v + 1] - 1], in ascending order.
+struct VertexCorners
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> corners;
+
+    // Returns **false** if an index is out of range
+    bool build(const MeshView& mesh);
+    size_t num_vertices() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+};
+
+// Per-vertex unit normals (3 floats per vertex) of the triangles in `mesh`.
+//
+// Face terms are computed in parallel blocks, then every worker gathers the
+// corners of its own range of vertices through the adjacency, so no two
+// threads write the same vertex and the result does not depend on the thread
+// count. Vertices without a triangle get (0, 0, 0). Pass `adjacency` to reuse
+// one built for the same mesh.
+bool compute_normals(const MeshView& mesh, std::vector<float>& normals,
+    NormalWeighting weighting = NormalWeighting::Angle, unsigned threads = 0,
+    const VertexCorners* adjacency = nullptr);
+
+// Per-vertex tangents (4 floats per vertex: unit xyz and the bitangent sign
+// in w, bitangent = w * cross(normal, tangent)) following the MikkTSpace
+// conventions: per-face uv derivatives are projected into the vertex's
+// tangent plane, weighted by the corner angle and summed. Unlike the
+// reference implementation, vertices are not split where the handedness
+// flips; the OBJ loader already splits them at uv seams. Needs normals and
+// uvs.
+bool compute_tangents(const MeshView& mesh, std::vector<float>& tangents, unsigned threads = 0,
+    const VertexCorners* adjacency = nullptr);
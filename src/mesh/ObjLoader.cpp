@@ -0,0 +1,605 @@
+#include "ObjLoader.h"
+#include "../util/MappedFile.h"
+#include "../util/Parallel.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+    constexpr uint32_t NO_INDEX = 0xffffffffu;
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+        // Counted in the first pass, turned into offsets by a prefix sum
+        size_t v = 0, vt = 0, vn = 0, tris = 0;
+        bool bad_index = false;
+    };
+
+    // Raw attribute streams and per-corner indices straight from the file
+    struct RawObj
+    {
+        std::vector<float> v, vt, vn;
+        std::vector<uint32_t> pi, ti, ni;
+    };
+
+    inline bool is_blank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline const char* skip_blanks(const char* p, const char* end)
+    {
+        while (p < end && is_blank(*p))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    inline const char* next_line(const char* p, const char* end)
+    {
+        const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+        return nl ? nl + 1 : end;
+    }
+
+    inline const char* parse_int(const char* p, const char* end, int64_t& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+        int64_t v = 0;
+        while (p < end && (unsigned)(*p - '0') < 10u)
+        {
+            v = v * 10 + (*p - '0');
+            ++p;
+        }
+        value = negative ? -v : v;
+        return p;
+    }
+
+    // Line type of an OBJ statement starting at p
+    enum class Tag
+    {
+        Other, V, VT, VN, F
+    };
+
+    inline Tag line_tag(const char*& p, const char* end)
+    {
+        p = skip_blanks(p, end);
+        if (end - p < 2)
+        {
+            return Tag::Other;
+        }
+        if (p[0] == 'v')
+        {
+            if (is_blank(p[1]))
+            {
+                p += 2;
+                return Tag::V;
+            }
+            if (end - p >= 3 && is_blank(p[2]))
+            {
+                if (p[1] == 't')
+                {
+                    p += 3;
+                    return Tag::VT;
+                }
+                if (p[1] == 'n')
+                {
+                    p += 3;
+                    return Tag::VN;
+                }
+            }
+        }
+        else if (p[0] == 'f' && is_blank(p[1]))
+        {
+            p += 2;
+            return Tag::F;
+        }
+        return Tag::Other;
+    }
+
+    // Number of index tokens up to the end of the line or a comment
+    inline size_t count_tokens(const char* p, const char* end)
+    {
+        size_t n = 0;
+        while (p < end && *p != '\n')
+        {
+            p = skip_blanks(p, end);
+            if (p >= end || *p == '\n' || *p == '#')
+            {
+                break;
+            }
+            n += (unsigned)(*p - '0') < 10u || *p == '-' || *p == '+';
+            while (p < end && !is_blank(*p) && *p != '\n')
+            {
+                ++p;
+            }
+        }
+        return n;
+    }
+
+    void count_chunk(Chunk& chunk, bool only_vertices)
+    {
+        const char* end = chunk.end;
+        for (const char* p = chunk.begin; p < end; p = next_line(p, end))
+        {
+            switch (line_tag(p, end))
+            {
+            case Tag::V:
+                ++chunk.v;
+                break;
+            case Tag::VT:
+                chunk.vt += !only_vertices;
+                break;
+            case Tag::VN:
+                chunk.vn += !only_vertices;
+                break;
+            case Tag::F:
+                if (!only_vertices)
+                {
+                    size_t corners = count_tokens(p, end);
+                    chunk.tris += corners > 2 ? corners - 2 : 0;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // OBJ indices are 1-based, negative ones count back from the last
+    // element defined so far. `defined` is that global count.
+    inline uint32_t resolve(int64_t idx, size_t defined, size_t total, bool& bad)
+    {
+        int64_t r = idx > 0 ? idx - 1 : (int64_t)defined + idx;
+        if (idx == 0 || r < 0 || r >= (int64_t)total)
+        {
+            bad = true;
+            return 0;
+        }
+        return (uint32_t)r;
+    }
+
+    void parse_chunk(Chunk& chunk, RawObj& raw, const Chunk& totals, bool only_vertices)
+    {
+        float* v = raw.v.data() + 3 * chunk.v;
+        float* vt = raw.vt.data() + 2 * chunk.vt;
+        float* vn = raw.vn.data() + 3 * chunk.vn;
+        size_t corner = 3 * chunk.tris;
+        size_t nv = chunk.v, nvt = chunk.vt, nvn = chunk.vn;
+
+        const char* end = chunk.end;
+        for (const char* p = chunk.begin; p < end; p = next_line(p, end))
+        {
+            switch (line_tag(p, end))
+            {
+            case Tag::V:
+                p = parse_float(p, end, v[0]);
+                p = parse_float(p, end, v[1]);
+                p = parse_float(p, end, v[2]);
+                v += 3;
+                ++nv;
+                break;
+            case Tag::VT:
+                if (!only_vertices)
+                {
+                    vt[1] = 0.0f;
+                    p = parse_float(p, end, vt[0]);
+                    p = parse_float(p, end, vt[1]);
+                    vt += 2;
+                    ++nvt;
+                }
+                break;
+            case Tag::VN:
+                if (!only_vertices)
+                {
+                    p = parse_float(p, end, vn[0]);
+                    p = parse_float(p, end, vn[1]);
+                    p = parse_float(p, end, vn[2]);
+                    vn += 3;
+                    ++nvn;
+                }
+                break;
+            case Tag::F:
+            {
+                if (only_vertices)
+                {
+                    break;
+                }
+                uint32_t first[3] = {}, prev[3] = {};
+                int k = 0;
+                for (;;)
+                {
+                    p = skip_blanks(p, end);
+                    if (p >= end || *p == '\n' || *p == '#')
+                    {
+                        break;
+                    }
+                    uint32_t cur[3] = { NO_INDEX, NO_INDEX, NO_INDEX };
+                    int64_t idx;
+                    const char* q = parse_int(p, end, idx);
+                    if (q == p)
+                    {
+                        // Not an index, skip the token
+                        while (p < end && !is_blank(*p) && *p != '\n')
+                        {
+                            ++p;
+                        }
+                        continue;
+                    }
+                    p = q;
+                    cur[0] = resolve(idx, nv, totals.v, chunk.bad_index);
+                    if (p < end && *p == '/')
+                    {
+                        ++p;
+                        if (p < end && *p != '/')
+                        {
+                            p = parse_int(p, end, idx);
+                            cur[1] = resolve(idx, nvt, totals.vt, chunk.bad_index);
+                        }
+                        if (p < end && *p == '/')
+                        {
+                            ++p;
+                            p = parse_int(p, end, idx);
+                            cur[2] = resolve(idx, nvn, totals.vn, chunk.bad_index);
+                        }
+                    }
+                    if (k == 0)
+                    {
+                        memcpy(first, cur, sizeof(cur));
+                    }
+                    else if (k >= 2)
+                    {
+                        // Triangle fan (first, prev, cur)
+                        const uint32_t* tri[3] = { first, prev, cur };
+                        for (int c = 0; c < 3; ++c, ++corner)
+                        {
+                            raw.pi[corner] = tri[c][0];
+                            raw.ti[corner] = tri[c][1];
+                            raw.ni[corner] = tri[c][2];
+                        }
+                    }
+                    memcpy(prev, cur, sizeof(cur));
+                    ++k;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    // Scatter per-corner attributes onto positions when every position is
+    // always paired with the same vt/vn. Returns **false** on the first seam.
+    bool scatter_attributes(const RawObj& raw, MeshData& mesh, bool use_uv, bool use_normal)
+    {
+        size_t nv = raw.v.size() / 3;
+        std::vector<uint32_t> uv_of, normal_of;
+        if (use_uv)
+        {
+            uv_of.assign(nv, NO_INDEX);
+        }
+        if (use_normal)
+        {
+            normal_of.assign(nv, NO_INDEX);
+        }
+        for (size_t c = 0; c < raw.pi.size(); ++c)
+        {
+            uint32_t p = raw.pi[c];
+            if (use_uv)
+            {
+                if (uv_of[p] == NO_INDEX)
+                {
+                    uv_of[p] = raw.ti[c];
+                }
+                else if (uv_of[p] != raw.ti[c])
+                {
+                    return false;
+                }
+            }
+            if (use_normal)
+            {
+                if (normal_of[p] == NO_INDEX)
+                {
+                    normal_of[p] = raw.ni[c];
+                }
+                else if (normal_of[p] != raw.ni[c])
+                {
+                    return false;
+                }
+            }
+        }
+
+        mesh.positions = raw.v;
+        mesh.indices = raw.pi;
+        if (use_uv)
+        {
+            mesh.uvs.assign(2 * nv, 0.0f);
+            for (size_t i = 0; i < nv; ++i)
+            {
+                if (uv_of[i] != NO_INDEX)
+                {
+                    memcpy(&mesh.uvs[2 * i], &raw.vt[2 * (size_t)uv_of[i]], 2 * sizeof(float));
+                }
+            }
+        }
+        if (use_normal)
+        {
+            mesh.normals.assign(3 * nv, 0.0f);
+            for (size_t i = 0; i < nv; ++i)
+            {
+                if (normal_of[i] != NO_INDEX)
+                {
+                    memcpy(&mesh.normals[3 * i], &raw.vn[3 * (size_t)normal_of[i]], 3 * sizeof(float));
+                }
+            }
+        }
+        return true;
+    }
+
+    struct CornerKey
+    {
+        uint32_t p, t, n;
+        bool operator==(const CornerKey& o) const { return p == o.p && t == o.t && n == o.n; }
+    };
+
+    struct CornerHash
+    {
+        size_t operator()(const CornerKey& k) const
+        {
+            uint64_t h = (uint64_t)k.p * 0x9E3779B97F4A7C15ull;
+            h ^= ((uint64_t)k.t + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+            h ^= ((uint64_t)k.n + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+
+    // General case: one output vertex per distinct (v, vt, vn) triple
+    void split_seams(const RawObj& raw, MeshData& mesh, bool use_uv, bool use_normal)
+    {
+        std::unordered_map<CornerKey, uint32_t, CornerHash> remap;
+        remap.reserve(raw.v.size() / 3 + raw.v.size() / 12);
+        mesh.indices.resize(raw.pi.size());
+        for (size_t c = 0; c < raw.pi.size(); ++c)
+        {
+            CornerKey key{ raw.pi[c], use_uv ? raw.ti[c] : NO_INDEX, use_normal ? raw.ni[c] : NO_INDEX };
+            auto it = remap.emplace(key, (uint32_t)(mesh.positions.size() / 3));
+            if (it.second)
+            {
+                const float* v = &raw.v[3 * (size_t)key.p];
+                mesh.positions.insert(mesh.positions.end(), v, v + 3);
+                if (use_uv)
+                {
+                    float zero[2] = { 0.0f, 0.0f };
+                    const float* t = key.t != NO_INDEX ? &raw.vt[2 * (size_t)key.t] : zero;
+                    mesh.uvs.insert(mesh.uvs.end(), t, t + 2);
+                }
+                if (use_normal)
+                {
+                    float zero[3] = { 0.0f, 0.0f, 0.0f };
+                    const float* n = key.n != NO_INDEX ? &raw.vn[3 * (size_t)key.n] : zero;
+                    mesh.normals.insert(mesh.normals.end(), n, n + 3);
+                }
+            }
+            mesh.indices[c] = it.first->second;
+        }
+    }
+
+    bool any_index(const std::vector<uint32_t>& idx)
+    {
+        for (uint32_t i : idx)
+        {
+            if (i != NO_INDEX)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+const char* parse_float(const char* p, const char* end, float& value)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = skip_blanks(p, end);
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    const char* digits_begin = p;
+    while (p < end && (unsigned)(*p - '0') < 10u)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            ++exponent;
+        }
+        ++p;
+    }
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && (unsigned)(*p - '0') < 10u)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+            ++p;
+        }
+    }
+    if (p == digits_begin || (p == digits_begin + 1 && *digits_begin == '.'))
+    {
+        value = 0.0f;
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int64_t e;
+        const char* q = parse_int(p + 1, end, e);
+        if (q != p + 1 && (unsigned)(q[-1] - '0') < 10u)
+        {
+            exponent += (int)std::max<int64_t>(-400, std::min<int64_t>(400, e));
+            p = q;
+        }
+    }
+    double d = (double)mantissa;
+    if (exponent < 0)
+    {
+        d = -exponent <= 22 ? d / pow10[-exponent] : d * std::pow(10.0, exponent);
+    }
+    else if (exponent > 0)
+    {
+        d = exponent <= 22 ? d * pow10[exponent] : d * std::pow(10.0, exponent);
+    }
+    value = (float)(negative ? -d : d);
+    return p;
+}
+
+bool parse_obj(const char* data, size_t size, MeshData& mesh,
+    const ObjLoadOptions& options, ObjLoadStats* stats)
+{
+    auto tic = std::chrono::steady_clock::now();
+    unsigned threads = options.threads == 0 ? hardware_threads() : options.threads;
+    mesh.clear();
+
+    // Split into chunks that start right after a newline
+    std::vector<Chunk> chunks;
+    size_t chunk_size = std::max<size_t>(options.chunk_size, 4096);
+    const char* end = data + size;
+    for (const char* p = data; p < end;)
+    {
+        const char* q = (size_t)(end - p) > chunk_size ? next_line(p + chunk_size, end) : end;
+        Chunk chunk;
+        chunk.begin = p;
+        chunk.end = q;
+        chunks.push_back(chunk);
+        p = q;
+    }
+
+    // Pass 1: count elements per chunk, then exclusive prefix sums
+    parallel_for(chunks.size(), [&](size_t i, unsigned)
+        {
+            count_chunk(chunks[i], options.only_vertices);
+        }, threads);
+    Chunk totals;
+    for (auto& chunk : chunks)
+    {
+        size_t v = chunk.v, vt = chunk.vt, vn = chunk.vn, tris = chunk.tris;
+        chunk.v = totals.v;
+        chunk.vt = totals.vt;
+        chunk.vn = totals.vn;
+        chunk.tris = totals.tris;
+        totals.v += v;
+        totals.vt += vt;
+        totals.vn += vn;
+        totals.tris += tris;
+    }
+    if (totals.v > NO_INDEX || 3 * totals.tris > NO_INDEX)
+    {
+        fprintf(stderr, "Error: OBJ is too large for 32-bit indices\n");
+        return false;
+    }
+
+    // Pass 2: every chunk fills its own slice of the raw buffers
+    RawObj raw;
+    raw.v.resize(3 * totals.v);
+    raw.vt.resize(2 * totals.vt);
+    raw.vn.resize(3 * totals.vn);
+    raw.pi.resize(3 * totals.tris);
+    raw.ti.resize(3 * totals.tris);
+    raw.ni.resize(3 * totals.tris);
+    parallel_for(chunks.size(), [&](size_t i, unsigned)
+        {
+            parse_chunk(chunks[i], raw, totals, options.only_vertices);
+        }, threads);
+    for (const auto& chunk : chunks)
+    {
+        if (chunk.bad_index)
+        {
+            fprintf(stderr, "Error: OBJ face references an undefined element\n");
+            return false;
+        }
+    }
+
+    if (options.only_vertices || totals.tris == 0)
+    {
+        mesh.positions = std::move(raw.v);
+        // A point set may still carry one normal/uv per vertex
+        if (totals.vn == totals.v)
+        {
+            mesh.normals = std::move(raw.vn);
+        }
+        if (totals.vt == totals.v)
+        {
+            mesh.uvs = std::move(raw.vt);
+        }
+    }
+    else
+    {
+        bool use_uv = totals.vt > 0 && any_index(raw.ti);
+        bool use_normal = totals.vn > 0 && any_index(raw.ni);
+        if (!scatter_attributes(raw, mesh, use_uv, use_normal))
+        {
+            mesh.clear();
+            split_seams(raw, mesh, use_uv, use_normal);
+        }
+    }
+
+    if (stats)
+    {
+        stats->bytes = size;
+        stats->chunks = chunks.size();
+        stats->threads = threads;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
+
+bool load_obj(const std::string& filename, MeshData& mesh,
+    const ObjLoadOptions& options, ObjLoadStats* stats)
+{
+    auto tic = std::chrono::steady_clock::now();
+    MappedFile file;
+    if (!file.open(filename))
+    {
+        return false;
+    }
+    if (!parse_obj(file.data(), file.size(), mesh, options, stats))
+    {
+        fprintf(stderr, "Error: Could not parse %s\n", filename.c_str());
+        return false;
+    }
+    if (stats)
+    {
+        // Include the mapping and page faults in the measured time
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <string>
+
+struct ObjLoadOptions
+{
+    // Skip faces, normals and texture coordinates
+    bool only_vertices = false;
+    // Worker threads, 0 = one per hardware thread, 1 = single-threaded baseline
+    unsigned threads = 0;
+    // Target size in bytes of the line-aligned chunks handed to the workers
+    size_t chunk_size = size_t(4) << 20;
+};
+
+struct ObjLoadStats
+{
+    size_t bytes = 0;
+    size_t chunks = 0;
+    unsigned threads = 0;
+    double seconds = 0.0;
+
+    double megabytes_per_second() const
+    {
+        return seconds > 0.0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+};
+
+// Loads a Wavefront OBJ file. The file is memory-mapped, split into chunks at
+// line boundaries and parsed in two parallel passes (count, then fill), so
+// every worker writes straight into the final buffers. Polygons are fanned
+// into triangles; vertices whose v/vt/vn indices disagree are split.
+// Returns **false** (and prints the reason to stderr) on failure.
+bool load_obj(const std::string& filename, MeshData& mesh,
+    const ObjLoadOptions& options = ObjLoadOptions(), ObjLoadStats* stats = nullptr);
+
+// Same as load_obj on an in-memory buffer.
+bool parse_obj(const char* data, size_t size, MeshData& mesh,
+    const ObjLoadOptions& options = ObjLoadOptions(), ObjLoadStats* stats = nullptr);
+
+// Locale-independent float parser. Skips leading blanks, parses one number
+// and returns the position after it (or `p` if there was no number).
+const char* parse_float(const char* p, const char* end, float& value);
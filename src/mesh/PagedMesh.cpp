@@ -0,0 +1,369 @@
+#include "PagedMesh.h"
+#include "ObjLoader.h"
+#include "../util/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static const char PAGED_MESH_MAGIC[8] = { 'G', 'L', 'F', 'W', 'V', 'P', 'G', 'M' };
+static const uint32_t PAGED_MESH_ENDIAN = 0x01020304u;
+
+namespace
+{
+const size_t BLOCK = 65536;
+
+struct TriangleKey
+{
+    uint64_t code;
+    uint32_t triangle;
+};
+
+// Spreads the low 21 bits of v to every third bit
+uint64_t expand_bits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+size_t page_bytes(uint32_t flags, uint64_t num_vertices, uint64_t num_triangles)
+{
+    const uint64_t per_vertex = 3 + ((flags & PAGED_MESH_NORMALS) ? 3 : 0) + ((flags & PAGED_MESH_UVS) ? 2 : 0);
+    const uint64_t floats = num_vertices * per_vertex;
+    return (size_t)(floats * sizeof(float) + num_triangles * 3 * sizeof(uint32_t));
+}
+
+struct Page
+{
+    PagedMeshCluster cluster;
+    std::vector<char> data;
+    std::vector<uint32_t> vertices; // scratch, source indices
+};
+
+// Copies the triangles keys[0, count) with the vertices they use into a
+// self-contained page
+void gather_cluster(const MeshView& mesh, const TriangleKey* keys, size_t count, uint32_t flags, Page& page)
+{
+    std::vector<uint32_t>& vertices = page.vertices;
+    vertices.clear();
+    for (size_t t = 0; t < count; ++t)
+    {
+        const uint32_t* corners = &mesh.indices[(size_t)keys[t].triangle * 3];
+        vertices.insert(vertices.end(), corners, corners + 3);
+    }
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    const size_t nv = vertices.size();
+    page.data.resize(page_bytes(flags, nv, count));
+    float* out = reinterpret_cast<float*>(page.data.data());
+    Eigen::AlignedBox3f box;
+    for (uint32_t v : vertices)
+    {
+        const float* p = &mesh.positions[(size_t)v * 3];
+        box.extend(Eigen::Vector3f(p[0], p[1], p[2]));
+        out = std::copy(p, p + 3, out);
+    }
+    if (flags & PAGED_MESH_NORMALS)
+    {
+        for (uint32_t v : vertices)
+        {
+            out = std::copy(&mesh.normals[(size_t)v * 3], &mesh.normals[(size_t)v * 3] + 3, out);
+        }
+    }
+    if (flags & PAGED_MESH_UVS)
+    {
+        for (uint32_t v : vertices)
+        {
+            out = std::copy(&mesh.uvs[(size_t)v * 2], &mesh.uvs[(size_t)v * 2] + 2, out);
+        }
+    }
+    uint32_t* indices = reinterpret_cast<uint32_t*>(out);
+    for (size_t t = 0; t < count; ++t)
+    {
+        const uint32_t* corners = &mesh.indices[(size_t)keys[t].triangle * 3];
+        for (int k = 0; k < 3; ++k)
+        {
+            *indices++ = (uint32_t)(std::lower_bound(vertices.begin(), vertices.end(), corners[k]) - vertices.begin());
+        }
+    }
+
+    PagedMeshCluster& cluster = page.cluster;
+    for (int k = 0; k < 3; ++k)
+    {
+        cluster.bmin[k] = box.min()[k];
+        cluster.bmax[k] = box.max()[k];
+    }
+    cluster.bytes = page.data.size();
+    cluster.num_vertices = (uint32_t)nv;
+    cluster.num_triangles = (uint32_t)count;
+}
+}
+
+bool build_paged_mesh(const MeshView& mesh, const MeshCacheSource& source, const std::string& output,
+    const PagedMeshBuildOptions& options, PagedMeshBuildStats* stats)
+{
+    auto tic = std::chrono::steady_clock::now();
+    const size_t num_triangles = mesh.num_triangles();
+    if (num_triangles == 0 || num_triangles > UINT32_MAX)
+    {
+        fprintf(stderr, "Error: Cannot page a mesh of %zu triangles\n", num_triangles);
+        return false;
+    }
+    uint32_t flags = 0;
+    flags |= mesh.normals.size() == mesh.positions.size() ? PAGED_MESH_NORMALS : 0;
+    flags |= mesh.uvs.size() / 2 == mesh.num_vertices() ? PAGED_MESH_UVS : 0;
+
+    // Bounds, then the triangles in Morton order of their centroids
+    const size_t num_vertices = mesh.num_vertices();
+    std::vector<Eigen::AlignedBox3f> block_bounds((num_vertices + BLOCK - 1) / BLOCK);
+    parallel_for(block_bounds.size(), [&](size_t b, unsigned)
+        {
+            for (size_t v = b * BLOCK; v < std::min(num_vertices, (b + 1) * BLOCK); ++v)
+            {
+                const float* p = &mesh.positions[v * 3];
+                block_bounds[b].extend(Eigen::Vector3f(p[0], p[1], p[2]));
+            }
+        }, options.threads);
+    Eigen::AlignedBox3f bounds;
+    for (const Eigen::AlignedBox3f& box : block_bounds)
+    {
+        bounds.extend(box);
+    }
+    const Eigen::Vector3f lo = bounds.min();
+    const float cells = (float)((1 << 21) - 1);
+    const Eigen::Vector3f scale = cells * bounds.diagonal().cwiseMax(1e-20f).cwiseInverse();
+    std::vector<TriangleKey> keys(num_triangles);
+    parallel_for((num_triangles + BLOCK - 1) / BLOCK, [&](size_t b, unsigned)
+        {
+            for (size_t t = b * BLOCK; t < std::min(num_triangles, (b + 1) * BLOCK); ++t)
+            {
+                Eigen::Vector3f c = Eigen::Vector3f::Zero();
+                for (int k = 0; k < 3; ++k)
+                {
+                    const float* p = &mesh.positions[(size_t)mesh.indices[t * 3 + k] * 3];
+                    c += Eigen::Vector3f(p[0], p[1], p[2]);
+                }
+                const Eigen::Vector3f q = ((c / 3.0f - lo).cwiseProduct(scale)).cwiseMax(0.0f).cwiseMin(cells);
+                keys[t].code = expand_bits((uint64_t)q[0]) | expand_bits((uint64_t)q[1]) << 1
+                    | expand_bits((uint64_t)q[2]) << 2;
+                keys[t].triangle = (uint32_t)t;
+            }
+        }, options.threads);
+    std::sort(keys.begin(), keys.end(), [](const TriangleKey& a, const TriangleKey& b)
+        {
+            return a.code < b.code || (a.code == b.code && a.triangle < b.triangle);
+        });
+
+    const std::string tmp_file = output + ".tmp";
+    FILE* f = fopen(tmp_file.c_str(), "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", tmp_file.c_str());
+        return false;
+    }
+    static const char zeros[PAGED_MESH_ALIGNMENT] = {};
+    auto pad_to_alignment = [&](uint64_t& position)
+    {
+        const uint64_t pad = (PAGED_MESH_ALIGNMENT - position % PAGED_MESH_ALIGNMENT) % PAGED_MESH_ALIGNMENT;
+        position += pad;
+        return fwrite(zeros, 1, (size_t)pad, f) == pad;
+    };
+    PagedMeshHeader header{};
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    uint64_t position = sizeof(header);
+
+    // A few clusters per worker at a time, written in order
+    const size_t cluster_triangles = std::max<size_t>(options.cluster_triangles, 1);
+    const size_t num_clusters = (num_triangles + cluster_triangles - 1) / cluster_triangles;
+    const size_t batch = (size_t)(options.threads > 0 ? options.threads : hardware_threads()) * 4;
+    std::vector<Page> pages(std::min(batch, num_clusters));
+    std::vector<PagedMeshCluster> clusters;
+    clusters.reserve(num_clusters);
+    size_t vertices_written = 0;
+    for (size_t first = 0; first < num_clusters && ok; first += pages.size())
+    {
+        const size_t count = std::min(pages.size(), num_clusters - first);
+        parallel_for(count, [&](size_t i, unsigned)
+            {
+                const size_t begin = (first + i) * cluster_triangles;
+                gather_cluster(mesh, &keys[begin], std::min(cluster_triangles, num_triangles - begin), flags, pages[i]);
+            }, options.threads);
+        for (size_t i = 0; i < count && ok; ++i)
+        {
+            ok = pad_to_alignment(position);
+            pages[i].cluster.offset = position;
+            ok = ok && fwrite(pages[i].data.data(), 1, pages[i].data.size(), f) == pages[i].data.size();
+            position += pages[i].data.size();
+            vertices_written += pages[i].cluster.num_vertices;
+            clusters.push_back(pages[i].cluster);
+        }
+    }
+
+    ok = ok && pad_to_alignment(position);
+    memcpy(header.magic, PAGED_MESH_MAGIC, sizeof(header.magic));
+    header.version = PAGED_MESH_VERSION;
+    header.flags = flags;
+    header.endian = PAGED_MESH_ENDIAN;
+    header.source = source;
+    header.num_vertices = num_vertices;
+    header.num_triangles = num_triangles;
+    header.num_clusters = clusters.size();
+    header.clusters_offset = position;
+    for (int k = 0; k < 3; ++k)
+    {
+        header.bmin[k] = bounds.min()[k];
+        header.bmax[k] = bounds.max()[k];
+    }
+    ok = ok && fwrite(clusters.data(), sizeof(PagedMeshCluster), clusters.size(), f) == clusters.size()
+        && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+    {
+        fs::rename(tmp_file, output, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", output.c_str());
+        fs::remove(tmp_file, ec);
+        return false;
+    }
+
+    if (stats)
+    {
+        stats->clusters = clusters.size();
+        stats->triangles = num_triangles;
+        stats->vertices = vertices_written;
+        stats->bytes = position + clusters.size() * sizeof(PagedMeshCluster);
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
+
+bool build_paged_mesh(const std::string& input, const std::string& output, const PagedMeshBuildOptions& options,
+    PagedMeshBuildStats* stats)
+{
+    MeshCacheSource source;
+    if (!describe_mesh_source(input, source, false))
+    {
+        fprintf(stderr, "Error: Could not open %s\n", input.c_str());
+        return false;
+    }
+    const bool cache = input.size() >= 4 && input.compare(input.size() - 4, 4, ".gvm") == 0;
+    if (cache)
+    {
+        MappedFile file;
+        MeshView view;
+        return open_mesh_cache(input, file, view) && build_paged_mesh(view, source, output, options, stats);
+    }
+    MeshData mesh;
+    ObjLoadOptions load_options;
+    load_options.threads = options.threads;
+    return load_obj(input, mesh, load_options) && build_paged_mesh(mesh.view(), source, output, options, stats);
+}
+
+bool PagedMesh::open(const std::string& filename)
+{
+    close();
+    if (!file_.open(filename))
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    bool ok = file_.size() >= sizeof(header_);
+    if (ok)
+    {
+        memcpy(&header_, file_.data(), sizeof(header_));
+        ok = memcmp(header_.magic, PAGED_MESH_MAGIC, sizeof(header_.magic)) == 0
+            && header_.version == PAGED_MESH_VERSION && header_.endian == PAGED_MESH_ENDIAN
+            && header_.num_clusters > 0 && header_.clusters_offset % PAGED_MESH_ALIGNMENT == 0
+            && header_.clusters_offset <= file_.size()
+            && header_.num_clusters <= (file_.size() - header_.clusters_offset) / sizeof(PagedMeshCluster);
+    }
+    if (ok)
+    {
+        clusters_ = Span<const PagedMeshCluster>(
+            reinterpret_cast<const PagedMeshCluster*>(file_.data() + header_.clusters_offset),
+            (size_t)header_.num_clusters);
+        for (const PagedMeshCluster& cluster : clusters_)
+        {
+            if (cluster.offset > header_.clusters_offset || cluster.bytes > header_.clusters_offset - cluster.offset
+                || cluster.bytes != page_bytes(header_.flags, cluster.num_vertices, cluster.num_triangles))
+            {
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: %s is not a valid paged mesh\n", filename.c_str());
+        close();
+    }
+    return ok;
+}
+
+void PagedMesh::close()
+{
+    file_.close();
+    header_ = PagedMeshHeader();
+    clusters_ = Span<const PagedMeshCluster>();
+}
+
+Eigen::AlignedBox3f PagedMesh::bounds() const
+{
+    if (!is_open())
+    {
+        return Eigen::AlignedBox3f();
+    }
+    return { Eigen::Vector3f(header_.bmin[0], header_.bmin[1], header_.bmin[2]),
+        Eigen::Vector3f(header_.bmax[0], header_.bmax[1], header_.bmax[2]) };
+}
+
+Span<const char> PagedMesh::page(uint32_t cluster) const
+{
+    if (cluster >= clusters_.size())
+    {
+        return Span<const char>();
+    }
+    return Span<const char>(file_.data() + clusters_[cluster].offset, (size_t)clusters_[cluster].bytes);
+}
+
+MeshView PagedMesh::view(uint32_t cluster, const char* page) const
+{
+    MeshView view;
+    if (cluster >= clusters_.size() || !page)
+    {
+        return view;
+    }
+    const size_t nv = clusters_[cluster].num_vertices;
+    const float* p = reinterpret_cast<const float*>(page);
+    view.positions = Span<const float>(p, nv * 3);
+    p += nv * 3;
+    if (header_.flags & PAGED_MESH_NORMALS)
+    {
+        view.normals = Span<const float>(p, nv * 3);
+        p += nv * 3;
+    }
+    if (header_.flags & PAGED_MESH_UVS)
+    {
+        view.uvs = Span<const float>(p, nv * 2);
+        p += nv * 2;
+    }
+    view.indices = Span<const uint32_t>(reinterpret_cast<const uint32_t*>(p),
+        (size_t)clusters_[cluster].num_triangles * 3);
+    return view;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "../util/MappedFile.h"
+#include "../util/Span.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <string>
+
+// Mesh cut into spatial clusters for paging (.gvmp). Layout:
+//   PagedMeshHeader
+//   one page per cluster (64-byte aligned): positions, normals, uvs, indices
+//   PagedMeshCluster[num_clusters] (64-byte aligned)
+// Every page is a small self-contained mesh: its vertices are copied from
+// the source (those on cluster seams once per cluster) and its indices are
+// local, so a page read into memory is drawn without any fix-up.
+
+constexpr uint32_t PAGED_MESH_VERSION = 1;
+constexpr uint32_t PAGED_MESH_NORMALS = 1u << 0;
+constexpr uint32_t PAGED_MESH_UVS = 1u << 1;
+constexpr size_t PAGED_MESH_ALIGNMENT = 64;
+
+struct PagedMeshCluster
+{
+    float bmin[3];
+    float bmax[3];
+    uint64_t offset; // of the page, bytes into the file
+    uint64_t bytes;
+    uint32_t num_vertices;
+    uint32_t num_triangles;
+
+    Eigen::AlignedBox3f bounds() const
+    {
+        return { Eigen::Vector3f(bmin[0], bmin[1], bmin[2]), Eigen::Vector3f(bmax[0], bmax[1], bmax[2]) };
+    }
+};
+
+struct PagedMeshHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags; // PAGED_MESH_NORMALS, PAGED_MESH_UVS
+    uint32_t endian;
+    uint32_t reserved;
+    MeshCacheSource source;
+    uint64_t num_vertices; // of the source mesh
+    uint64_t num_triangles;
+    uint64_t num_clusters;
+    uint64_t clusters_offset;
+    float bmin[3];
+    float bmax[3];
+};
+
+struct PagedMeshBuildOptions
+{
+    // Triangles per cluster (the last one takes the rest)
+    uint32_t cluster_triangles = 4096;
+    // Worker threads, 0 = one per hardware thread
+    unsigned threads = 0;
+};
+
+struct PagedMeshBuildStats
+{
+    size_t clusters = 0;
+    size_t triangles = 0;
+    size_t vertices = 0; // written, seam vertices counted once per cluster
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+
+    double mtris_per_second() const { return seconds > 0.0 ? triangles / seconds * 1e-6 : 0.0; }
+};
+
+// Writes `mesh` as clusters of nearby triangles (runs along a Morton curve
+// of the triangle centroids). Besides the mesh, only 16 bytes per triangle
+// and the clusters being written are held in memory: for meshes larger than
+// RAM pass the view of a mapped .gvm cache (open_mesh_cache), which the OS
+// pages in as the clusters are gathered. The file is written next to its
+// final name and renamed into place.
+bool build_paged_mesh(const MeshView& mesh, const MeshCacheSource& source, const std::string& output,
+    const PagedMeshBuildOptions& options = PagedMeshBuildOptions(), PagedMeshBuildStats* stats = nullptr);
+
+// Same from a file: a .gvm cache is mapped, an OBJ is parsed into memory
+bool build_paged_mesh(const std::string& input, const std::string& output,
+    const PagedMeshBuildOptions& options = PagedMeshBuildOptions(), PagedMeshBuildStats* stats = nullptr);
+
+// A .gvmp file opened for paging. Only the header and the cluster table are
+// read up front; the pages stay on disk until asked for.
+class PagedMesh
+{
+public:
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+
+    const PagedMeshHeader& header() const { return header_; }
+    const Span<const PagedMeshCluster>& clusters() const { return clusters_; }
+    Eigen::AlignedBox3f bounds() const;
+
+    // The bytes of a page, in the mapping
+    Span<const char> page(uint32_t cluster) const;
+    // Mesh of a cluster over a copy of its page
+    MeshView view(uint32_t cluster, const char* page) const;
+
+private:
+    MappedFile file_;
+    PagedMeshHeader header_ = {};
+    Span<const PagedMeshCluster> clusters_;
+};
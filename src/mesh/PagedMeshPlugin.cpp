@@ -0,0 +1,133 @@
+#include "PagedMeshPlugin.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+static bool has_extension(const std::string& filename, const char* ext)
+{
+    size_t n = strlen(ext);
+    if (filename.size() < n)
+    {
+        return false;
+    }
+    return std::equal(filename.end() - n, filename.end(), ext,
+        [](char a, char b) { return std::tolower((unsigned char)a) == b; });
+}
+
+PagedMeshPlugin::PagedMeshPlugin()
+{
+    mName = "pagedmesh";
+    pager.cache.evicted = [this](uint32_t cluster)
+    {
+        if (cluster < gpu_clusters_.size() && gpu_clusters_[cluster].valid())
+        {
+            if (mViewer && mViewer->buffers)
+            {
+                mViewer->buffers->free_static(gpu_clusters_[cluster]);
+            }
+            gpu_clusters_[cluster] = BufferSlice();
+        }
+    };
+    // A cluster came in: draw a frame to show it
+    pager.cache.notify = [this]
+    {
+        if (mViewer)
+        {
+            damage().invalidate(Damage::Scene);
+        }
+    };
+}
+
+PagedMeshPlugin::~PagedMeshPlugin()
+{
+    // The eviction callback touches gpu_clusters_, destroyed before `pager`
+    pager.cache.stop();
+    pager.cache.evicted = nullptr;
+}
+
+bool PagedMeshPlugin::load(const std::string& filename, bool only_vertices)
+{
+    (void)only_vertices;
+    if (!has_extension(filename, ".gvmp"))
+    {
+        return false;
+    }
+    unload();
+    if (!pager.open(filename))
+    {
+        return false;
+    }
+    const PagedMeshHeader& header = pager.mesh.header();
+    gpu_clusters_.assign((size_t)header.num_clusters, BufferSlice());
+    fit_camera_ = true;
+    printf("Opened paged mesh %s: %llu triangles in %llu clusters\n", filename.c_str(),
+        (unsigned long long)header.num_triangles, (unsigned long long)header.num_clusters);
+    return true;
+}
+
+bool PagedMeshPlugin::unload()
+{
+    // Evicts every cluster, which frees its GPU copy
+    pager.close();
+    gpu_clusters_.clear();
+    draws.clear();
+    fit_camera_ = false;
+    last_time_ = -1.0;
+    return false;
+}
+
+bool PagedMeshPlugin::post_load()
+{
+    if (fit_camera_ && pager.is_open())
+    {
+        mViewer->camera.fit(pager.mesh.bounds());
+        fit_camera_ = false;
+    }
+    return false;
+}
+
+bool PagedMeshPlugin::pre_draw(bool first)
+{
+    (void)first;
+    draws.clear();
+    if (!pager.is_open())
+    {
+        return false;
+    }
+    const double now = mViewer->animation_time;
+    const float dt = last_time_ >= 0.0 ? (float)(now - last_time_) : 0.0f;
+    last_time_ = now;
+    pager.update(mViewer->view, mViewer->proj, mViewer->framebuffer_height, dt);
+
+    BufferManager* buffers = mViewer->buffers && mViewer->buffers->ready() ? mViewer->buffers.get() : nullptr;
+    size_t uploaded = 0;
+    bool waiting_upload = false;
+    for (const PagedCluster& c : pager.resident)
+    {
+        Draw draw;
+        draw.cluster = c.cluster;
+        draw.view = c.view;
+        if (buffers)
+        {
+            BufferSlice& gpu = gpu_clusters_[c.cluster];
+            const size_t bytes = (size_t)pager.mesh.clusters()[c.cluster].bytes;
+            // The budget spreads uploads over frames; one cluster always goes
+            if (!gpu.valid() && (uploaded == 0 || uploaded + bytes <= upload_budget))
+            {
+                gpu = buffers->allocate_static(bytes, c.view.positions.data());
+                uploaded += bytes;
+            }
+            waiting_upload |= !gpu.valid();
+            draw.gpu = gpu;
+        }
+        draws.push_back(draw);
+    }
+    // Keep drawing frames until every resident cluster is uploaded and
+    // drawn, including the ones pager.update() just took over
+    if (waiting_upload || pager.loaded_clusters > 0)
+    {
+        damage().invalidate(Damage::Scene);
+    }
+    return false;
+}
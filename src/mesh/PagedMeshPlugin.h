@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../viewer/Viewer.h"
+#include "MeshPager.h"
+#include "PagedMesh.h"
+#include <string>
+#include <vector>
+
+// Draws paged meshes (.gvmp, see build_paged_mesh) that need not fit in
+// RAM. Loading one reads only its cluster table; every frame `pager` culls
+// the clusters against the camera of the viewer, pages the ones in view
+// (and, while the camera moves, the ones about to come into view) through
+// an LRU cache of pager.cache.budget bytes, and lists the resident ones in
+// `draws`. With a GL context each drawn cluster also gets a GPU copy of its
+// page, uploaded up to upload_budget bytes per frame and freed when the
+// cluster is evicted.
+class PagedMeshPlugin : public ViewerPluginBase<PagedMeshPlugin>
+{
+public:
+    PagedMeshPlugin();
+    ~PagedMeshPlugin() override;
+
+    bool load(const std::string& filename, bool only_vertices) override;
+    bool unload() override;
+    bool post_load() override;
+    bool pre_draw(bool first) override;
+
+    MeshPager pager;
+    size_t upload_budget = size_t(16) << 20;
+
+    struct Draw
+    {
+        uint32_t cluster;
+        MeshView view;   // resident copy, valid for the frame
+        BufferSlice gpu; // the whole page (positions, normals, uvs, indices)
+    };
+
+    // This frame
+    std::vector<Draw> draws;
+
+private:
+    std::vector<BufferSlice> gpu_clusters_;
+    bool fit_camera_ = false;
+    double last_time_ = -1.0;
+};
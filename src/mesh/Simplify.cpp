@@ -0,0 +1,569 @@
+#include "Simplify.h"
+#include "../util/Parallel.h"
+#include <Eigen/Dense>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <vector>
+
+namespace
+{
+const uint32_t UNASSIGNED = 0xffffffffu;
+const uint32_t SHARED = 0xfffffffeu;
+// Weight of the planes that hold open borders in place
+const double BORDER_WEIGHT = 100.0;
+
+// Symmetric 4x4 quadric, upper triangle
+struct Quadric
+{
+    double q[10] = {};
+
+    void add_plane(double a, double b, double c, double d, double w)
+    {
+        q[0] += w * a * a; q[1] += w * a * b; q[2] += w * a * c; q[3] += w * a * d;
+        q[4] += w * b * b; q[5] += w * b * c; q[6] += w * b * d;
+        q[7] += w * c * c; q[8] += w * c * d;
+        q[9] += w * d * d;
+    }
+    Quadric& operator+=(const Quadric& o)
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            q[i] += o.q[i];
+        }
+        return *this;
+    }
+    double error(const Eigen::Vector3d& v) const
+    {
+        const double x = v.x(), y = v.y(), z = v.z();
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+            + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+            + q[7] * z * z + 2 * q[8] * z + q[9];
+    }
+    // Position minimizing the error, if the quadric is well conditioned
+    bool optimum(Eigen::Vector3d& v) const
+    {
+        Eigen::Matrix3d A;
+        A << q[0], q[1], q[2], q[1], q[4], q[5], q[2], q[5], q[7];
+        const double det = A.determinant();
+        if (std::abs(det) < 1e-12)
+        {
+            return false;
+        }
+        v = A.inverse() * Eigen::Vector3d(-q[3], -q[6], -q[8]);
+        return true;
+    }
+};
+
+struct Collapse
+{
+    double cost;
+    uint32_t a, b;
+    uint32_t version_a, version_b;
+
+    bool operator<(const Collapse& o) const { return cost > o.cost; } // min-heap
+};
+
+// One cluster: its triangles (global ids) are simplified with the vertices
+// it does not own locked. Writes the positions of the vertices it moved and
+// the surviving triangles.
+class ClusterSimplifier
+{
+public:
+    ClusterSimplifier(const MeshView& mesh, const std::vector<uint32_t>& owner, uint32_t cluster)
+        : mesh(mesh), owner(owner), cluster(cluster)
+    {
+    }
+
+    float run(const uint32_t* tris, size_t count, size_t target, float max_error,
+        float* out_positions, std::vector<uint32_t>& out_indices)
+    {
+        setup(tris, count);
+        size_t alive = count;
+        float worst = 0.0f;
+        const double max_cost = (double)max_error * max_error;
+
+        std::priority_queue<Collapse> heap;
+        for (uint32_t v = 0; v < (uint32_t)globals.size(); ++v)
+        {
+            for (uint32_t n : neighbors(v))
+            {
+                if (v < n)
+                {
+                    push(heap, v, n);
+                }
+            }
+        }
+
+        while (alive > target && !heap.empty())
+        {
+            Collapse c = heap.top();
+            heap.pop();
+            if (dead[c.a] || dead[c.b] || version[c.a] != c.version_a || version[c.b] != c.version_b)
+            {
+                continue;
+            }
+            if (c.cost > max_cost)
+            {
+                break;
+            }
+            Eigen::Vector3d p;
+            if (!target_position(c.a, c.b, p) || !can_collapse(c.a, c.b, p))
+            {
+                continue;
+            }
+            // Keep the locked vertex if there is one
+            uint32_t keep = c.a, drop = c.b;
+            if (locked[drop])
+            {
+                std::swap(keep, drop);
+            }
+            alive -= collapse(keep, drop, p);
+            worst = std::max(worst, (float)std::sqrt(std::max(0.0, c.cost)));
+            for (uint32_t n : neighbors(keep))
+            {
+                push(heap, keep, n);
+            }
+        }
+
+        for (uint32_t v = 0; v < (uint32_t)globals.size(); ++v)
+        {
+            if (!locked[v] && !dead[v])
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    out_positions[3 * (size_t)globals[v] + k] = (float)position[v][k];
+                }
+            }
+        }
+        for (const auto& t : triangles)
+        {
+            if (t.alive)
+            {
+                out_indices.push_back(globals[t.v[0]]);
+                out_indices.push_back(globals[t.v[1]]);
+                out_indices.push_back(globals[t.v[2]]);
+            }
+        }
+        return worst;
+    }
+
+private:
+    struct Triangle
+    {
+        uint32_t v[3];
+        bool alive;
+    };
+
+    void setup(const uint32_t* tris, size_t count)
+    {
+        const uint32_t* F = mesh.indices.data();
+        globals.clear();
+        for (size_t i = 0; i < count; ++i)
+        {
+            globals.insert(globals.end(), F + 3 * (size_t)tris[i], F + 3 * (size_t)tris[i] + 3);
+        }
+        std::sort(globals.begin(), globals.end());
+        globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+        auto local = [&](uint32_t g)
+        {
+            return (uint32_t)(std::lower_bound(globals.begin(), globals.end(), g) - globals.begin());
+        };
+
+        const size_t n = globals.size();
+        const float* P = mesh.positions.data();
+        position.resize(n);
+        quadric.assign(n, Quadric());
+        locked.resize(n);
+        dead.assign(n, 0);
+        version.assign(n, 0);
+        adjacency.assign(n, {});
+        for (size_t v = 0; v < n; ++v)
+        {
+            const float* p = P + 3 * (size_t)globals[v];
+            position[v] = Eigen::Vector3d(p[0], p[1], p[2]);
+            locked[v] = owner[globals[v]] != cluster;
+        }
+
+        triangles.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Triangle& t = triangles[i];
+            for (int k = 0; k < 3; ++k)
+            {
+                t.v[k] = local(F[3 * (size_t)tris[i] + k]);
+                adjacency[t.v[k]].push_back((uint32_t)i);
+            }
+            t.alive = t.v[0] != t.v[1] && t.v[1] != t.v[2] && t.v[2] != t.v[0];
+            if (!t.alive)
+            {
+                continue;
+            }
+            Eigen::Vector3d normal = (position[t.v[1]] - position[t.v[0]]).cross(position[t.v[2]] - position[t.v[0]]);
+            const double length = normal.norm();
+            if (length <= 0.0)
+            {
+                continue;
+            }
+            normal /= length;
+            const double d = -normal.dot(position[t.v[0]]);
+            for (int k = 0; k < 3; ++k)
+            {
+                quadric[t.v[k]].add_plane(normal.x(), normal.y(), normal.z(), d, 1.0);
+            }
+        }
+
+        // Edges used by one triangle are open borders (or cluster seams,
+        // whose vertices are locked anyway): hold them with a plane
+        // perpendicular to the triangle
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Triangle& t = triangles[i];
+            if (!t.alive)
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t a = t.v[k], b = t.v[(k + 1) % 3];
+                if (locked[a] && locked[b])
+                {
+                    continue;
+                }
+                if (edge_triangles(a, b) == 1)
+                {
+                    const Eigen::Vector3d edge = position[b] - position[a];
+                    const Eigen::Vector3d face = edge.cross(position[t.v[(k + 2) % 3]] - position[a]);
+                    Eigen::Vector3d normal = edge.cross(face);
+                    const double length = normal.norm();
+                    if (length <= 0.0)
+                    {
+                        continue;
+                    }
+                    normal /= length;
+                    const double d = -normal.dot(position[a]);
+                    quadric[a].add_plane(normal.x(), normal.y(), normal.z(), d, BORDER_WEIGHT);
+                    quadric[b].add_plane(normal.x(), normal.y(), normal.z(), d, BORDER_WEIGHT);
+                }
+            }
+        }
+    }
+
+    int edge_triangles(uint32_t a, uint32_t b) const
+    {
+        int n = 0;
+        for (uint32_t t : adjacency[a])
+        {
+            const Triangle& tri = triangles[t];
+            n += tri.alive && (tri.v[0] == b || tri.v[1] == b || tri.v[2] == b);
+        }
+        return n;
+    }
+
+    const std::vector<uint32_t>& neighbors(uint32_t v)
+    {
+        scratch.clear();
+        for (uint32_t t : adjacency[v])
+        {
+            const Triangle& tri = triangles[t];
+            if (!tri.alive)
+            {
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tri.v[k] != v)
+                {
+                    scratch.push_back(tri.v[k]);
+                }
+            }
+        }
+        std::sort(scratch.begin(), scratch.end());
+        scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+        return scratch;
+    }
+
+    bool target_position(uint32_t a, uint32_t b, Eigen::Vector3d& p) const
+    {
+        if (locked[a] && locked[b])
+        {
+            return false;
+        }
+        if (locked[a] || locked[b])
+        {
+            p = position[locked[a] ? a : b];
+            return true;
+        }
+        Quadric q = quadric[a];
+        q += quadric[b];
+        if (q.optimum(p))
+        {
+            return true;
+        }
+        // Degenerate quadric: best of the ends and the midpoint
+        const Eigen::Vector3d candidates[3] = { position[a], position[b], 0.5 * (position[a] + position[b]) };
+        double best = std::numeric_limits<double>::max();
+        for (const auto& c : candidates)
+        {
+            double e = q.error(c);
+            if (e < best)
+            {
+                best = e;
+                p = c;
+            }
+        }
+        return true;
+    }
+
+    void push(std::priority_queue<Collapse>& heap, uint32_t a, uint32_t b) const
+    {
+        Eigen::Vector3d p;
+        if (!target_position(a, b, p))
+        {
+            return;
+        }
+        Quadric q = quadric[a];
+        q += quadric[b];
+        heap.push({ std::max(0.0, q.error(p)), a, b, version[a], version[b] });
+    }
+
+    bool can_collapse(uint32_t a, uint32_t b, const Eigen::Vector3d& p)
+    {
+        // Link condition: an interior edge shares exactly two neighbors
+        std::vector<uint32_t> na = neighbors(a);
+        const std::vector<uint32_t>& nb = neighbors(b);
+        size_t common = 0;
+        for (uint32_t v : nb)
+        {
+            common += std::binary_search(na.begin(), na.end(), v);
+        }
+        if (common > 2)
+        {
+            return false;
+        }
+
+        // No triangle may flip or collapse to a sliver
+        for (uint32_t v : { a, b })
+        {
+            for (uint32_t t : adjacency[v])
+            {
+                const Triangle& tri = triangles[t];
+                if (!tri.alive)
+                {
+                    continue;
+                }
+                bool has_a = tri.v[0] == a || tri.v[1] == a || tri.v[2] == a;
+                bool has_b = tri.v[0] == b || tri.v[1] == b || tri.v[2] == b;
+                if (has_a && has_b)
+                {
+                    continue; // removed by the collapse
+                }
+                Eigen::Vector3d before[3], after[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    before[k] = position[tri.v[k]];
+                    after[k] = (tri.v[k] == a || tri.v[k] == b) ? p : before[k];
+                }
+                Eigen::Vector3d n0 = (before[1] - before[0]).cross(before[2] - before[0]);
+                Eigen::Vector3d n1 = (after[1] - after[0]).cross(after[2] - after[0]);
+                if (n1.dot(n0) <= 0.1 * n0.norm() * n1.norm() || n1.squaredNorm() <= 1e-24)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Merges `drop` into `keep`; returns the triangles removed
+    size_t collapse(uint32_t keep, uint32_t drop, const Eigen::Vector3d& p)
+    {
+        size_t removed = 0;
+        position[keep] = p;
+        quadric[keep] += quadric[drop];
+        for (uint32_t t : adjacency[drop])
+        {
+            Triangle& tri = triangles[t];
+            if (!tri.alive)
+            {
+                continue;
+            }
+            bool has_keep = tri.v[0] == keep || tri.v[1] == keep || tri.v[2] == keep;
+            if (has_keep)
+            {
+                tri.alive = false;
+                ++removed;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tri.v[k] == drop)
+                {
+                    tri.v[k] = keep;
+                }
+            }
+            adjacency[keep].push_back(t);
+        }
+        // Drop the dead entries while we are here
+        auto& list = adjacency[keep];
+        list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t) { return !triangles[t].alive; }),
+            list.end());
+        std::vector<uint32_t>().swap(adjacency[drop]);
+        dead[drop] = 1;
+        ++version[keep];
+        return removed;
+    }
+
+    const MeshView& mesh;
+    const std::vector<uint32_t>& owner;
+    const uint32_t cluster;
+
+    std::vector<uint32_t> globals;
+    std::vector<Eigen::Vector3d> position;
+    std::vector<Quadric> quadric;
+    std::vector<uint8_t> locked;
+    std::vector<uint8_t> dead;
+    std::vector<uint32_t> version;
+    std::vector<std::vector<uint32_t>> adjacency;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> scratch;
+};
+
+uint32_t expand_bits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+} // namespace
+
+bool simplify_mesh(const MeshView& mesh, size_t target_triangles, MeshData& out,
+    const SimplifyOptions& options, SimplifyStats* stats)
+{
+    const size_t num_triangles = mesh.num_triangles();
+    const size_t num_vertices = mesh.num_vertices();
+    if (num_triangles == 0 || num_vertices >= SHARED)
+    {
+        return false;
+    }
+    auto tic = std::chrono::steady_clock::now();
+    const unsigned threads = options.threads == 0 ? hardware_threads() : options.threads;
+    const uint32_t* F = mesh.indices.data();
+    const float* P = mesh.positions.data();
+
+    // Order the triangles along a Morton curve of their centroids
+    Eigen::Vector3f lo = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f hi = -lo;
+    for (size_t v = 0; v < num_vertices; ++v)
+    {
+        Eigen::Vector3f p(P[3 * v], P[3 * v + 1], P[3 * v + 2]);
+        lo = lo.cwiseMin(p);
+        hi = hi.cwiseMax(p);
+    }
+    const Eigen::Vector3f scale = (1023.0f / (hi - lo).cwiseMax(1e-20f).array()).matrix();
+    std::vector<uint64_t> keys(num_triangles);
+    parallel_for((num_triangles + 65535) / 65536, [&](size_t block, unsigned)
+        {
+            size_t end = std::min(num_triangles, (block + 1) * 65536);
+            for (size_t t = block * 65536; t < end; ++t)
+            {
+                Eigen::Vector3f c = Eigen::Vector3f::Zero();
+                for (int k = 0; k < 3; ++k)
+                {
+                    const float* p = P + 3 * (size_t)F[3 * t + k];
+                    c += Eigen::Vector3f(p[0], p[1], p[2]);
+                }
+                Eigen::Vector3f q = ((c / 3.0f - lo).cwiseProduct(scale)).cwiseMax(0.0f).cwiseMin(1023.0f);
+                uint64_t code = (expand_bits((uint32_t)q.x()) << 2) | (expand_bits((uint32_t)q.y()) << 1)
+                    | expand_bits((uint32_t)q.z());
+                keys[t] = (code << 32) | t;
+            }
+        }, threads);
+    std::sort(keys.begin(), keys.end());
+    std::vector<uint32_t> order(num_triangles);
+    for (size_t i = 0; i < num_triangles; ++i)
+    {
+        order[i] = (uint32_t)keys[i];
+    }
+    std::vector<uint64_t>().swap(keys);
+
+    // Consecutive runs form the clusters; the first one is shortened by the
+    // offset to move the seams
+    const size_t cluster_size = std::max<size_t>(options.cluster_triangles, 64);
+    std::vector<size_t> starts{ 0 };
+    for (size_t s = options.cluster_offset % cluster_size; s < num_triangles; s += cluster_size)
+    {
+        if (s > 0)
+        {
+            starts.push_back(s);
+        }
+    }
+    starts.push_back(num_triangles);
+    const size_t num_clusters = starts.size() - 1;
+
+    // A vertex belongs to the one cluster that uses it, or is shared
+    std::vector<uint32_t> owner(num_vertices, UNASSIGNED);
+    for (size_t c = 0; c < num_clusters; ++c)
+    {
+        for (size_t i = starts[c]; i < starts[c + 1]; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t& o = owner[F[3 * (size_t)order[i] + k]];
+                o = (o == UNASSIGNED || o == (uint32_t)c) ? (uint32_t)c : SHARED;
+            }
+        }
+    }
+
+    const double ratio = std::min(1.0, (double)target_triangles / num_triangles);
+    std::vector<float> positions(mesh.positions.begin(), mesh.positions.end());
+    std::vector<std::vector<uint32_t>> cluster_indices(num_clusters);
+    std::vector<float> cluster_error(num_clusters, 0.0f);
+    parallel_for(num_clusters, [&](size_t c, unsigned)
+        {
+            const size_t count = starts[c + 1] - starts[c];
+            const size_t target = (size_t)std::llround(count * ratio);
+            ClusterSimplifier simplifier(mesh, owner, (uint32_t)c);
+            cluster_error[c] = simplifier.run(order.data() + starts[c], count, target, options.max_error,
+                positions.data(), cluster_indices[c]);
+        }, threads);
+
+    // Compact the vertices still referenced
+    std::vector<uint32_t> remap(num_vertices, UNASSIGNED);
+    out.clear();
+    uint32_t next = 0;
+    for (const auto& indices : cluster_indices)
+    {
+        for (uint32_t v : indices)
+        {
+            if (remap[v] == UNASSIGNED)
+            {
+                remap[v] = next++;
+                out.positions.insert(out.positions.end(), &positions[3 * (size_t)v], &positions[3 * (size_t)v] + 3);
+                if (mesh.has_normals())
+                {
+                    out.normals.insert(out.normals.end(), &mesh.normals[3 * (size_t)v], &mesh.normals[3 * (size_t)v] + 3);
+                }
+                if (mesh.has_uvs())
+                {
+                    out.uvs.insert(out.uvs.end(), &mesh.uvs[2 * (size_t)v], &mesh.uvs[2 * (size_t)v] + 2);
+                }
+            }
+            out.indices.push_back(remap[v]);
+        }
+    }
+
+    if (stats)
+    {
+        stats->input_triangles = num_triangles;
+        stats->output_triangles = out.num_triangles();
+        stats->clusters = num_clusters;
+        stats->threads = threads;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+        stats->error = cluster_error.empty() ? 0.0f : *std::max_element(cluster_error.begin(), cluster_error.end());
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+
+struct SimplifyOptions
+{
+    // Triangles per independently simplified cluster
+    size_t cluster_triangles = 4096;
+    // Shifts the cluster boundaries (in triangles), so that successive
+    // passes do not keep the same vertices locked
+    size_t cluster_offset = 0;
+    // Collapses costing more than this (in mesh units) are not done
+    float max_error = 1e30f;
+    // 0 = all hardware threads
+    unsigned threads = 0;
+};
+
+struct SimplifyStats
+{
+    size_t input_triangles = 0;
+    size_t output_triangles = 0;
+    size_t clusters = 0;
+    unsigned threads = 0;
+    double seconds = 0.0;
+    // Largest collapse error, roughly the distance to the input surface
+    float error = 0.0f;
+
+    double mtris_per_second() const { return seconds > 0.0 ? input_triangles / seconds * 1e-6 : 0.0; }
+};
+
+// Quadric error metric edge collapse down to about target_triangles.
+//
+// The triangles are cut into spatially coherent clusters (runs along a
+// Morton curve) that are simplified in parallel. Vertices shared between
+// clusters stay where they are, so the clusters never crack apart and no
+// two threads write the same vertex; those seams are simplified by a later
+// pass with a different cluster_offset. Collapses that would flip a
+// triangle or pinch the surface are rejected, and open borders are held in
+// place by extra boundary quadrics. Normals and uvs follow the surviving
+// vertex of each collapse.
+bool simplify_mesh(const MeshView& mesh, size_t target_triangles, MeshData& out,
+    const SimplifyOptions& options = SimplifyOptions(), SimplifyStats* stats = nullptr);
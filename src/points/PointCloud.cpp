@@ -0,0 +1,988 @@
+#include "PointCloud.h"
+#include "../mesh/Bvh.h"
+#include "../util/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+
+namespace fs = std::filesystem;
+
+static const char POINT_CLOUD_MAGIC[8] = { 'G', 'L', 'F', 'W', 'V', 'P', 'C', 'L' };
+static const uint32_t POINT_CLOUD_ENDIAN = 0x01020304u;
+
+int PointNode::num_children() const
+{
+    int n = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        n += (child_mask >> i) & 1;
+    }
+    return n;
+}
+
+Eigen::AlignedBox3f PointNode::bounds() const
+{
+    const Eigen::Vector3f lo(bmin[0], bmin[1], bmin[2]);
+    return Eigen::AlignedBox3f(lo, lo + Eigen::Vector3f::Constant(size));
+}
+
+namespace
+{
+// LAS fields are little endian, as are the hosts we build for
+template <typename T>
+T read_le(const char* p)
+{
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+uint32_t pack_rgb(uint32_t r, uint32_t g, uint32_t b)
+{
+    return r | (g << 8) | (b << 16) | 0xff000000u;
+}
+
+// 16-bit LAS colors; some writers store 8-bit values in them
+uint32_t color8(uint16_t c)
+{
+    return c > 255 ? c >> 8 : c;
+}
+
+const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == ','))
+    {
+        ++p;
+    }
+    return p;
+}
+
+// Georeferenced coordinates need doubles, which parse_float does not give
+const char* parse_double(const char* p, const char* end, double& value)
+{
+    p = skip_blanks(p, end);
+    char token[64];
+    size_t n = 0;
+    while (p + n < end && n + 1 < sizeof(token) && p[n] != ' ' && p[n] != '\t' && p[n] != '\r' && p[n] != '\n'
+        && p[n] != ',')
+    {
+        token[n] = p[n];
+        ++n;
+    }
+    token[n] = '\0';
+    char* stop = nullptr;
+    value = strtod(token, &stop);
+    return stop == token ? p : p + (stop - token);
+}
+
+// Values of one text line; returns the start of the next line
+const char* parse_line(const char* p, const char* end, double* values, int& count)
+{
+    count = 0;
+    p = skip_blanks(p, end);
+    if (p < end && *p != '#' && *p != '/')
+    {
+        while (count < 7)
+        {
+            const char* next = parse_double(p, end, values[count]);
+            if (next == skip_blanks(p, end))
+            {
+                break;
+            }
+            ++count;
+            p = next;
+        }
+    }
+    const char* eol = static_cast<const char*>(memchr(p, '\n', (size_t)(end - p)));
+    return eol ? eol + 1 : end;
+}
+
+const size_t READ_BATCH = 65536;
+}
+
+bool PointReader::open(const std::string& filename)
+{
+    filename_ = filename;
+    if (!file_.open(filename))
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    las_ = file_.size() >= 4 && memcmp(file_.data(), "LASF", 4) == 0;
+    return las_ ? open_las() : open_xyz();
+}
+
+bool PointReader::open_las()
+{
+    const char* h = file_.data();
+    if (file_.size() < 227)
+    {
+        fprintf(stderr, "Error: %s: truncated LAS header\n", filename_.c_str());
+        return false;
+    }
+    const uint8_t minor = (uint8_t)h[25];
+    const uint16_t header_size = read_le<uint16_t>(h + 94);
+    point_offset_ = read_le<uint32_t>(h + 96);
+    const uint8_t format = (uint8_t)h[104];
+    record_length_ = read_le<uint16_t>(h + 105);
+    num_points_ = read_le<uint32_t>(h + 107);
+    if (minor >= 4 && header_size >= 375 && file_.size() >= 255)
+    {
+        num_points_ = std::max<uint64_t>(num_points_, read_le<uint64_t>(h + 247));
+    }
+    if (format & 0xc0)
+    {
+        fprintf(stderr, "Error: %s: compressed (LAZ) points are not supported\n", filename_.c_str());
+        return false;
+    }
+    static const int rgb_offsets[11] = { -1, -1, 20, 28, -1, 28, -1, 30, 30, -1, 30 };
+    static const uint32_t min_lengths[11] = { 20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67 };
+    if (format > 10 || record_length_ < min_lengths[format])
+    {
+        fprintf(stderr, "Error: %s: unsupported LAS point format %d\n", filename_.c_str(), (int)format);
+        return false;
+    }
+    rgb_offset_ = rgb_offsets[format];
+    for (int k = 0; k < 3; ++k)
+    {
+        scale_[k] = read_le<double>(h + 131 + 8 * k);
+        offset_[k] = read_le<double>(h + 155 + 8 * k);
+    }
+    const Eigen::Vector3d hi(read_le<double>(h + 179), read_le<double>(h + 195), read_le<double>(h + 211));
+    const Eigen::Vector3d lo(read_le<double>(h + 187), read_le<double>(h + 203), read_le<double>(h + 219));
+    bounds_ = Eigen::AlignedBox3d(lo, hi);
+
+    const uint64_t available = file_.size() > point_offset_ ? (file_.size() - point_offset_) / record_length_ : 0;
+    num_points_ = std::min(num_points_, available);
+    return true;
+}
+
+bool PointReader::open_xyz()
+{
+    bounds_.setEmpty();
+    num_points_ = 0;
+    const char* p = file_.data();
+    const char* end = p + file_.size();
+    double v[7];
+    int count;
+    while (p < end)
+    {
+        p = parse_line(p, end, v, count);
+        if (count >= 3)
+        {
+            bounds_.extend(Eigen::Vector3d(v[0], v[1], v[2]));
+            ++num_points_;
+        }
+    }
+    if (num_points_ == 0)
+    {
+        fprintf(stderr, "Error: %s: no points\n", filename_.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PointReader::read(const Eigen::Vector3d& origin, const std::function<void(const Point*, size_t)>& fn) const
+{
+    return las_ ? read_las(origin, fn) : read_xyz(origin, fn);
+}
+
+bool PointReader::read_las(const Eigen::Vector3d& origin, const std::function<void(const Point*, size_t)>& fn) const
+{
+    std::vector<Point> batch(READ_BATCH);
+    // Integer coordinates go to doubles, then relative to the origin
+    const double base[3] = { offset_[0] - origin[0], offset_[1] - origin[1], offset_[2] - origin[2] };
+    for (uint64_t first = 0; first < num_points_; first += READ_BATCH)
+    {
+        const size_t n = (size_t)std::min<uint64_t>(READ_BATCH, num_points_ - first);
+        const char* record = file_.data() + point_offset_ + first * record_length_;
+        for (size_t i = 0; i < n; ++i, record += record_length_)
+        {
+            Point& p = batch[i];
+            p.x = (float)(read_le<int32_t>(record + 0) * scale_[0] + base[0]);
+            p.y = (float)(read_le<int32_t>(record + 4) * scale_[1] + base[1]);
+            p.z = (float)(read_le<int32_t>(record + 8) * scale_[2] + base[2]);
+            if (rgb_offset_ >= 0)
+            {
+                p.rgba = pack_rgb(color8(read_le<uint16_t>(record + rgb_offset_)),
+                    color8(read_le<uint16_t>(record + rgb_offset_ + 2)),
+                    color8(read_le<uint16_t>(record + rgb_offset_ + 4)));
+            }
+            else
+            {
+                const uint32_t grey = color8(read_le<uint16_t>(record + 12));
+                p.rgba = pack_rgb(grey, grey, grey);
+            }
+        }
+        fn(batch.data(), n);
+    }
+    return true;
+}
+
+bool PointReader::read_xyz(const Eigen::Vector3d& origin, const std::function<void(const Point*, size_t)>& fn) const
+{
+    std::vector<Point> batch;
+    batch.reserve(READ_BATCH);
+    const char* p = file_.data();
+    const char* end = p + file_.size();
+    double v[7];
+    int count;
+    while (p < end)
+    {
+        p = parse_line(p, end, v, count);
+        if (count < 3)
+        {
+            continue;
+        }
+        // x y z r g b, or x y z intensity r g b
+        const double* rgb = count >= 7 ? v + 4 : count >= 6 ? v + 3 : nullptr;
+        auto to8 = [](double c) { return (uint32_t)std::min(std::max(c <= 1.0 ? c * 255.0 : c, 0.0), 255.0); };
+        batch.push_back({ (float)(v[0] - origin[0]), (float)(v[1] - origin[1]), (float)(v[2] - origin[2]),
+            rgb ? pack_rgb(to8(rgb[0]), to8(rgb[1]), to8(rgb[2])) : pack_rgb(255, 255, 255) });
+        if (batch.size() == READ_BATCH)
+        {
+            fn(batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+    if (!batch.empty())
+    {
+        fn(batch.data(), batch.size());
+    }
+    return true;
+}
+
+namespace
+{
+// Counting grid of 2^COUNT_LEVEL cells per axis that decides the chunks
+const int COUNT_LEVEL = 7;
+const int MAX_LEVEL = 24;
+const size_t CHUNK_BUFFER = 4096;
+
+struct BuildNode
+{
+    float bmin[3];
+    float size;
+    int level;
+    int32_t children[8];
+    std::vector<Point> points;
+    uint64_t offset = 0;
+    uint32_t count = 0;
+    bool sampled = false;
+    bool written = false;
+
+    bool is_leaf() const
+    {
+        return std::all_of(children, children + 8, [](int32_t c) { return c < 0; });
+    }
+};
+
+BuildNode make_node(const float bmin[3], float size, int level)
+{
+    BuildNode node;
+    std::copy(bmin, bmin + 3, node.bmin);
+    node.size = size;
+    node.level = level;
+    std::fill(node.children, node.children + 8, -1);
+    return node;
+}
+
+int octant(const BuildNode& node, const Point& p)
+{
+    const float half = 0.5f * node.size;
+    return (p.x >= node.bmin[0] + half) | ((p.y >= node.bmin[1] + half) << 1) | ((p.z >= node.bmin[2] + half) << 2);
+}
+
+// Appends to the output from any worker
+struct Writer
+{
+    FILE* file = nullptr;
+    uint64_t position = 0;
+    bool ok = true;
+    std::mutex mutex;
+
+    void write(BuildNode& node)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        node.offset = position;
+        node.count = (uint32_t)node.points.size();
+        const size_t bytes = node.points.size() * sizeof(Point);
+        ok = ok && (bytes == 0 || fwrite(node.points.data(), 1, bytes, file) == bytes);
+        position += bytes;
+        node.written = true;
+        std::vector<Point>().swap(node.points);
+    }
+};
+
+class Builder
+{
+public:
+    Builder(const PointCloudBuildOptions& options) : options_(options)
+    {
+        grid_ = std::max(1u, std::min(options.sample_grid, 1024u));
+        max_points_ = std::max(1u, options.max_node_points);
+    }
+
+    // Splits until the leaves hold at most max_points_
+    void split(std::vector<BuildNode>& nodes, int index, std::vector<Point>&& points)
+    {
+        if (points.size() <= max_points_ || nodes[index].level >= MAX_LEVEL)
+        {
+            nodes[index].points = std::move(points);
+            return;
+        }
+        size_t counts[8] = {};
+        for (const Point& p : points)
+        {
+            ++counts[octant(nodes[index], p)];
+        }
+        std::vector<Point> parts[8];
+        for (int o = 0; o < 8; ++o)
+        {
+            parts[o].reserve(counts[o]);
+        }
+        for (const Point& p : points)
+        {
+            parts[octant(nodes[index], p)].push_back(p);
+        }
+        std::vector<Point>().swap(points);
+        for (int o = 0; o < 8; ++o)
+        {
+            if (parts[o].empty())
+            {
+                continue;
+            }
+            const BuildNode& parent = nodes[index];
+            const float half = 0.5f * parent.size;
+            const float bmin[3] = { parent.bmin[0] + ((o & 1) ? half : 0.0f), parent.bmin[1] + ((o & 2) ? half : 0.0f),
+                parent.bmin[2] + ((o & 4) ? half : 0.0f) };
+            const int child = (int)nodes.size();
+            nodes.push_back(make_node(bmin, half, parent.level + 1));
+            nodes[index].children[o] = child;
+            split(nodes, child, std::move(parts[o]));
+        }
+    }
+
+    // Bottom-up: every inner node moves one point per grid cell up from
+    // its children. Subtrees already sampled are left alone.
+    void sample(std::vector<BuildNode>& nodes, int index, std::vector<uint32_t>& table)
+    {
+        if (nodes[index].sampled)
+        {
+            return;
+        }
+        nodes[index].sampled = true;
+        if (nodes[index].is_leaf())
+        {
+            return;
+        }
+        size_t candidates = 0;
+        for (int o = 0; o < 8; ++o)
+        {
+            const int32_t child = nodes[index].children[o];
+            if (child >= 0)
+            {
+                sample(nodes, child, table);
+                candidates += nodes[child].points.size();
+            }
+        }
+
+        size_t table_size = 1024;
+        while (table_size < 2 * candidates)
+        {
+            table_size <<= 1;
+        }
+        table.assign(table_size, ~0u);
+        const uint32_t mask = (uint32_t)table_size - 1;
+        BuildNode& node = nodes[index];
+        const float scale = (float)grid_ / node.size;
+        for (int o = 0; o < 8; ++o)
+        {
+            if (node.children[o] < 0)
+            {
+                continue;
+            }
+            BuildNode& child = nodes[node.children[o]];
+            size_t kept = 0;
+            for (const Point& p : child.points)
+            {
+                auto cell = [&](float v, float lo)
+                {
+                    return (uint32_t)std::min(std::max((int)((v - lo) * scale), 0), (int)grid_ - 1);
+                };
+                const uint32_t key = cell(p.x, node.bmin[0])
+                    + grid_ * (cell(p.y, node.bmin[1]) + grid_ * cell(p.z, node.bmin[2]));
+                uint32_t slot = (key * 2654435761u) & mask;
+                while (table[slot] != ~0u && table[slot] != key)
+                {
+                    slot = (slot + 1) & mask;
+                }
+                if (table[slot] == ~0u)
+                {
+                    table[slot] = key;
+                    node.points.push_back(p);
+                }
+                else
+                {
+                    child.points[kept++] = p;
+                }
+            }
+            child.points.resize(kept);
+            if (kept == 0 && child.is_leaf() && !child.written)
+            {
+                node.children[o] = -1;
+            }
+        }
+    }
+
+    uint32_t grid() const { return grid_; }
+
+private:
+    PointCloudBuildOptions options_;
+    uint32_t grid_;
+    uint32_t max_points_;
+};
+
+uint64_t count_index(int level, uint32_t x, uint32_t y, uint32_t z)
+{
+    return x + ((uint64_t)y << level) + ((uint64_t)z << (2 * level));
+}
+
+// Points still going to a chunk, flushed to its file in CHUNK_BUFFER blocks
+struct ChunkBuffer
+{
+    std::string file;
+    std::vector<Point> points;
+    uint64_t count = 0;
+};
+
+bool flush_chunk(ChunkBuffer& chunk)
+{
+    if (chunk.points.empty())
+    {
+        return true;
+    }
+    FILE* f = fopen(chunk.file.c_str(), "ab");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", chunk.file.c_str());
+        return false;
+    }
+    const size_t bytes = chunk.points.size() * sizeof(Point);
+    bool ok = fwrite(chunk.points.data(), 1, bytes, f) == bytes;
+    ok = fclose(f) == 0 && ok;
+    chunk.points.clear();
+    return ok;
+}
+
+bool read_chunk(const ChunkBuffer& chunk, std::vector<Point>& points)
+{
+    points.resize((size_t)chunk.count);
+    FILE* f = fopen(chunk.file.c_str(), "rb");
+    bool ok = f && fread(points.data(), sizeof(Point), points.size(), f) == points.size();
+    if (f)
+    {
+        fclose(f);
+    }
+    std::error_code ec;
+    fs::remove(chunk.file, ec);
+    return ok;
+}
+}
+
+bool build_point_cloud(const std::string& input, const std::string& output,
+    const PointCloudBuildOptions& options, PointCloudBuildStats* stats)
+{
+    auto tic = std::chrono::steady_clock::now();
+    PointReader reader;
+    if (!reader.open(input))
+    {
+        return false;
+    }
+    MeshCacheSource source;
+    describe_mesh_source(input, source, false);
+
+    // Cube around the points; a little margin keeps the maximum inside
+    const Eigen::AlignedBox3d& box = reader.bounds();
+    const Eigen::Vector3d origin = box.isEmpty() ? Eigen::Vector3d::Zero() : box.min();
+    const float size = (float)std::max(box.isEmpty() ? 1.0 : box.sizes().maxCoeff() * (1.0 + 1e-6), 1e-6);
+    const float root_min[3] = { 0.0f, 0.0f, 0.0f };
+
+    // Pass 1: points per cell of the counting grid, then summed up into
+    // the coarser levels
+    const uint32_t count_grid = 1u << COUNT_LEVEL;
+    std::vector<std::vector<uint64_t>> counts(COUNT_LEVEL + 1);
+    for (int level = 0; level <= COUNT_LEVEL; ++level)
+    {
+        counts[level].assign((size_t)1 << (3 * level), 0);
+    }
+    auto cell_of = [&](const Point& p, uint32_t& x, uint32_t& y, uint32_t& z)
+    {
+        const float scale = (float)count_grid / size;
+        auto cell = [&](float v) { return (uint32_t)std::min(std::max((int)(v * scale), 0), (int)count_grid - 1); };
+        x = cell(p.x);
+        y = cell(p.y);
+        z = cell(p.z);
+    };
+    uint64_t total = 0;
+    reader.read(origin, [&](const Point* points, size_t n)
+        {
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint32_t x, y, z;
+                cell_of(points[i], x, y, z);
+                ++counts[COUNT_LEVEL][count_index(COUNT_LEVEL, x, y, z)];
+            }
+            total += n;
+        });
+    if (total == 0)
+    {
+        fprintf(stderr, "Error: %s: no points\n", input.c_str());
+        return false;
+    }
+    for (int level = COUNT_LEVEL - 1; level >= 0; --level)
+    {
+        const uint32_t n = 1u << level;
+        for (uint32_t z = 0; z < n; ++z)
+        {
+            for (uint32_t y = 0; y < n; ++y)
+            {
+                for (uint32_t x = 0; x < n; ++x)
+                {
+                    uint64_t sum = 0;
+                    for (int o = 0; o < 8; ++o)
+                    {
+                        sum += counts[level + 1][count_index(level + 1, 2 * x + (o & 1), 2 * y + ((o >> 1) & 1),
+                            2 * z + ((o >> 2) & 1))];
+                    }
+                    counts[level][count_index(level, x, y, z)] = sum;
+                }
+            }
+        }
+    }
+
+    // The upper nodes: split until a cell fits in a chunk
+    std::vector<BuildNode> nodes;
+    std::vector<ChunkBuffer> chunks;
+    std::vector<int> chunk_nodes;
+    std::vector<int32_t> chunk_of_cell(counts[COUNT_LEVEL].size(), -1);
+    const size_t chunk_points = std::max<size_t>(options.chunk_points, options.max_node_points);
+    std::function<void(int, int, uint32_t, uint32_t, uint32_t)> partition =
+        [&](int index, int level, uint32_t x, uint32_t y, uint32_t z)
+    {
+        if (counts[level][count_index(level, x, y, z)] <= chunk_points || level == COUNT_LEVEL)
+        {
+            const int32_t chunk = (int32_t)chunks.size();
+            chunks.emplace_back();
+            chunks.back().file = output + ".chunk" + std::to_string(chunk);
+            chunk_nodes.push_back(index);
+            const uint32_t span = 1u << (COUNT_LEVEL - level);
+            for (uint32_t k = 0; k < span; ++k)
+            {
+                for (uint32_t j = 0; j < span; ++j)
+                {
+                    for (uint32_t i = 0; i < span; ++i)
+                    {
+                        chunk_of_cell[count_index(COUNT_LEVEL, x * span + i, y * span + j, z * span + k)] = chunk;
+                    }
+                }
+            }
+            return;
+        }
+        for (int o = 0; o < 8; ++o)
+        {
+            const uint32_t cx = 2 * x + (o & 1), cy = 2 * y + ((o >> 1) & 1), cz = 2 * z + ((o >> 2) & 1);
+            if (counts[level + 1][count_index(level + 1, cx, cy, cz)] == 0)
+            {
+                continue;
+            }
+            const float half = 0.5f * nodes[index].size;
+            const float bmin[3] = { cx * half, cy * half, cz * half };
+            const int child = (int)nodes.size();
+            nodes.push_back(make_node(bmin, half, level + 1));
+            nodes[index].children[o] = child;
+            partition(child, level + 1, cx, cy, cz);
+        }
+    };
+    nodes.push_back(make_node(root_min, size, 0));
+    partition(0, 0, 0, 0, 0);
+    counts.clear();
+
+    // Pass 2: points into their chunk. A single chunk stays in memory.
+    std::vector<Point> in_memory;
+    bool ok = true;
+    for (ChunkBuffer& chunk : chunks)
+    {
+        chunk.points.reserve(chunks.size() > 1 ? CHUNK_BUFFER : 0);
+    }
+    reader.read(origin, [&](const Point* points, size_t n)
+        {
+            for (size_t i = 0; i < n && ok; ++i)
+            {
+                if (chunks.size() == 1)
+                {
+                    in_memory.push_back(points[i]);
+                    continue;
+                }
+                uint32_t x, y, z;
+                cell_of(points[i], x, y, z);
+                ChunkBuffer& chunk = chunks[chunk_of_cell[count_index(COUNT_LEVEL, x, y, z)]];
+                chunk.points.push_back(points[i]);
+                ++chunk.count;
+                if (chunk.points.size() == CHUNK_BUFFER)
+                {
+                    ok = flush_chunk(chunk);
+                }
+            }
+        });
+    for (ChunkBuffer& chunk : chunks)
+    {
+        ok = ok && flush_chunk(chunk);
+        std::vector<Point>().swap(chunk.points);
+    }
+    std::vector<int32_t>().swap(chunk_of_cell);
+
+    const std::string tmp_file = output + ".tmp";
+    Writer writer;
+    writer.file = ok ? fopen(tmp_file.c_str(), "wb") : nullptr;
+    PointCloudHeader header{};
+    if (ok && !writer.file)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", tmp_file.c_str());
+    }
+    ok = ok && writer.file && fwrite(&header, sizeof(header), 1, writer.file) == 1;
+    writer.position = sizeof(header);
+    auto remove_files = [&]()
+    {
+        std::error_code ec;
+        for (const ChunkBuffer& chunk : chunks)
+        {
+            fs::remove(chunk.file, ec);
+        }
+        fs::remove(tmp_file, ec);
+    };
+    if (!ok)
+    {
+        if (writer.file)
+        {
+            fclose(writer.file);
+        }
+        remove_files();
+        return false;
+    }
+
+    // Pass 3: every chunk is built in memory; all its nodes but the root
+    // are written at once, the root stays for the upper levels to sample
+    Builder builder(options);
+    std::mutex nodes_mutex;
+    const unsigned threads = options.threads == 0 ? hardware_threads() : options.threads;
+    parallel_for(ok ? chunks.size() : 0, [&](size_t c, unsigned)
+        {
+            std::vector<Point> points;
+            if (chunks.size() == 1)
+            {
+                points.swap(in_memory);
+            }
+            else if (!read_chunk(chunks[c], points))
+            {
+                std::lock_guard<std::mutex> lock(nodes_mutex);
+                fprintf(stderr, "Error: Could not read %s\n", chunks[c].file.c_str());
+                ok = false;
+                return;
+            }
+
+            std::vector<BuildNode> local;
+            {
+                std::lock_guard<std::mutex> lock(nodes_mutex);
+                const BuildNode& root = nodes[chunk_nodes[c]];
+                local.push_back(make_node(root.bmin, root.size, root.level));
+            }
+            builder.split(local, 0, std::move(points));
+            std::vector<uint32_t> table;
+            builder.sample(local, 0, table);
+            for (size_t i = 1; i < local.size(); ++i)
+            {
+                writer.write(local[i]);
+            }
+
+            std::lock_guard<std::mutex> lock(nodes_mutex);
+            const int32_t base = (int32_t)nodes.size() - 1;
+            for (size_t i = 1; i < local.size(); ++i)
+            {
+                for (int32_t& child : local[i].children)
+                {
+                    child = child < 0 ? -1 : child + base;
+                }
+                nodes.push_back(std::move(local[i]));
+            }
+            BuildNode& root = nodes[chunk_nodes[c]];
+            for (int o = 0; o < 8; ++o)
+            {
+                root.children[o] = local[0].children[o] < 0 ? -1 : local[0].children[o] + base;
+            }
+            root.points = std::move(local[0].points);
+            root.sampled = true;
+        }, std::min<unsigned>(threads, (unsigned)std::max<size_t>(chunks.size(), 1)));
+
+    // The upper levels, then everything not written yet
+    std::vector<uint32_t> table;
+    builder.sample(nodes, 0, table);
+    for (BuildNode& node : nodes)
+    {
+        if (!node.written)
+        {
+            writer.write(node);
+        }
+    }
+
+    // Breadth-first, the children of a node next to each other
+    std::vector<int> order(1, 0);
+    std::vector<PointNode> records;
+    records.reserve(nodes.size());
+    int depth = 0;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        const BuildNode& node = nodes[order[i]];
+        PointNode record{};
+        std::copy(node.bmin, node.bmin + 3, record.bmin);
+        record.size = node.size;
+        record.spacing = node.size / (float)builder.grid();
+        record.count = node.count;
+        record.offset = node.offset;
+        record.first_child = (uint32_t)order.size();
+        record.level = (uint8_t)node.level;
+        for (int o = 0; o < 8; ++o)
+        {
+            if (node.children[o] >= 0)
+            {
+                record.child_mask |= (uint8_t)(1u << o);
+                order.push_back(node.children[o]);
+            }
+        }
+        depth = std::max(depth, node.level);
+        records.push_back(record);
+    }
+
+    static const char zeros[POINT_CLOUD_ALIGNMENT] = {};
+    const uint64_t pad = (POINT_CLOUD_ALIGNMENT - writer.position % POINT_CLOUD_ALIGNMENT) % POINT_CLOUD_ALIGNMENT;
+    memcpy(header.magic, POINT_CLOUD_MAGIC, sizeof(header.magic));
+    header.version = POINT_CLOUD_VERSION;
+    header.endian = POINT_CLOUD_ENDIAN;
+    header.source = source;
+    for (int k = 0; k < 3; ++k)
+    {
+        header.origin[k] = origin[k];
+    }
+    header.size = size;
+    header.sample_grid = builder.grid();
+    header.num_points = total;
+    header.num_nodes = records.size();
+    header.nodes_offset = writer.position + pad;
+    header.depth = (uint32_t)depth;
+    ok = ok && writer.ok && fwrite(zeros, 1, (size_t)pad, writer.file) == pad
+        && fwrite(records.data(), sizeof(PointNode), records.size(), writer.file) == records.size()
+        && fseek(writer.file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, writer.file) == 1;
+    ok = fclose(writer.file) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+    {
+        fs::rename(tmp_file, output, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", output.c_str());
+        remove_files();
+        return false;
+    }
+
+    if (stats)
+    {
+        stats->points = total;
+        stats->nodes = records.size();
+        stats->chunks = chunks.size();
+        stats->depth = depth;
+        stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    }
+    return true;
+}
+
+bool point_cloud_is_fresh(const std::string& file, const std::string& source)
+{
+    FILE* f = fopen(file.c_str(), "rb");
+    if (!f)
+    {
+        return false;
+    }
+    PointCloudHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1;
+    fclose(f);
+    MeshCacheSource current;
+    if (!ok || memcmp(header.magic, POINT_CLOUD_MAGIC, sizeof(header.magic)) != 0
+        || header.version != POINT_CLOUD_VERSION)
+    {
+        return false;
+    }
+    if (!describe_mesh_source(source, current, false))
+    {
+        // Source is gone, the octree is all we have
+        return true;
+    }
+    return current.size == header.source.size && current.mtime == header.source.mtime;
+}
+
+bool PointCloud::open(const std::string& filename)
+{
+    close();
+    if (!file_.open(filename))
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    bool ok = file_.size() >= sizeof(header_);
+    if (ok)
+    {
+        memcpy(&header_, file_.data(), sizeof(header_));
+        ok = memcmp(header_.magic, POINT_CLOUD_MAGIC, sizeof(header_.magic)) == 0
+            && header_.version == POINT_CLOUD_VERSION && header_.endian == POINT_CLOUD_ENDIAN
+            && header_.num_nodes > 0 && header_.nodes_offset % POINT_CLOUD_ALIGNMENT == 0
+            && header_.nodes_offset <= file_.size()
+            && header_.num_nodes <= (file_.size() - header_.nodes_offset) / sizeof(PointNode);
+    }
+    if (ok)
+    {
+        nodes_ = Span<const PointNode>(
+            reinterpret_cast<const PointNode*>(file_.data() + header_.nodes_offset), (size_t)header_.num_nodes);
+        for (const PointNode& node : nodes_)
+        {
+            const bool children_ok = node.is_leaf()
+                || (uint64_t)node.first_child + (uint64_t)node.num_children() <= nodes_.size();
+            if (!children_ok || node.offset > header_.nodes_offset
+                || node.count > (header_.nodes_offset - node.offset) / sizeof(Point))
+            {
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: %s is not a valid point cloud\n", filename.c_str());
+        close();
+    }
+    return ok;
+}
+
+void PointCloud::close()
+{
+    file_.close();
+    header_ = PointCloudHeader();
+    nodes_ = Span<const PointNode>();
+}
+
+Span<const Point> PointCloud::points(uint32_t node) const
+{
+    if (node >= nodes_.size())
+    {
+        return Span<const Point>();
+    }
+    return Span<const Point>(reinterpret_cast<const Point*>(file_.data() + nodes_[node].offset), nodes_[node].count);
+}
+
+Eigen::AlignedBox3f PointCloud::bounds() const
+{
+    return nodes_.empty() ? Eigen::AlignedBox3f() : nodes_[0].bounds();
+}
+
+uint64_t PointCloud::select(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height,
+    const PointSelectOptions& options, std::vector<PointSelection>& selection) const
+{
+    selection.clear();
+    if (nodes_.empty())
+    {
+        return 0;
+    }
+    const Frustum frustum = Frustum::from_matrix(proj * view);
+    const bool perspective = proj(3, 3) == 0.0f;
+    const Eigen::Matrix3f R = view.topLeftCorner<3, 3>();
+    const Eigen::Vector3f eye = -R.transpose() * view.topRightCorner<3, 1>();
+    // Pixels per unit at distance 1 (perspective) or anywhere (ortho)
+    const float pixels_per_unit = 0.5f * proj(1, 1) * viewport_height;
+    auto pixel_spacing = [&](const PointNode& node)
+    {
+        if (!perspective)
+        {
+            return node.spacing * pixels_per_unit;
+        }
+        const float distance = node.bounds().exteriorDistance(eye);
+        return distance > 0.0f ? node.spacing * pixels_per_unit / distance : std::numeric_limits<float>::max();
+    };
+
+    std::vector<PointSelection> heap;
+    auto by_size = [](const PointSelection& a, const PointSelection& b) { return a.pixel_spacing < b.pixel_spacing; };
+    if (frustum.classify(nodes_[0].bounds()) != Frustum::Outside)
+    {
+        heap.push_back({ 0, pixel_spacing(nodes_[0]), ~0u });
+    }
+    uint64_t points = 0;
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), by_size);
+        const PointSelection s = heap.back();
+        heap.pop_back();
+        const PointNode& node = nodes_[s.node];
+        if (points + node.count > options.point_budget)
+        {
+            continue;
+        }
+        points += node.count;
+        const uint32_t parent = (uint32_t)selection.size();
+        selection.push_back(s);
+        if (s.pixel_spacing <= options.max_pixel_error)
+        {
+            continue;
+        }
+        uint32_t child = node.first_child;
+        for (int o = 0; o < 8; ++o)
+        {
+            if (!((node.child_mask >> o) & 1))
+            {
+                continue;
+            }
+            if (frustum.classify(nodes_[child].bounds()) != Frustum::Outside)
+            {
+                heap.push_back({ child, pixel_spacing(nodes_[child]), parent });
+                std::push_heap(heap.begin(), heap.end(), by_size);
+            }
+            ++child;
+        }
+    }
+    return points;
+}
+
+void drawn_spacing(const std::vector<PointSelection>& selection, const std::vector<uint8_t>& drawn,
+    std::vector<float>& spacing)
+{
+    spacing.resize(selection.size());
+    for (size_t i = 0; i < selection.size(); ++i)
+    {
+        spacing[i] = selection[i].pixel_spacing;
+    }
+    // Children come after their parents, so one backward pass carries the
+    // finest spacing up
+    for (size_t i = selection.size(); i-- > 0;)
+    {
+        const uint32_t parent = selection[i].parent;
+        if ((drawn.empty() || drawn[i]) && parent < selection.size())
+        {
+            spacing[parent] = std::min(spacing[parent], spacing[i]);
+        }
+    }
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include "../mesh/MeshCache.h"
+#include "../util/MappedFile.h"
+#include "../util/Span.h"
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Point cloud octree (.gvpc). Layout:
+//   PointCloudHeader
+//   points of every node, contiguous per node
+//   PointNode[num_nodes], breadth-first, root first (64-byte aligned)
+// Every point is stored once. An inner node holds a sample of its subtree,
+// at most one point per cell of a sample_grid^3 grid over its cube; the
+// leaves hold what is left. Drawing a node together with its ancestors
+// therefore shows the subtree at a point spacing of about node.spacing.
+
+constexpr uint32_t POINT_CLOUD_VERSION = 1;
+constexpr size_t POINT_CLOUD_ALIGNMENT = 64;
+
+// Relative to PointCloudHeader::origin
+struct Point
+{
+    float x, y, z;
+    uint32_t rgba; // R in the low byte, as Framebuffer::color
+};
+
+struct PointNode
+{
+    float bmin[3]; // cube, relative to the origin
+    float size;
+    float spacing;        // of the sample; leaves share their parent's grid
+    uint32_t count;
+    uint64_t offset;      // of the points, bytes into the file
+    uint32_t first_child; // the children are stored next to each other
+    uint8_t child_mask;   // bit i: child i (x | y << 1 | z << 2) exists
+    uint8_t level;
+    uint16_t reserved;
+
+    bool is_leaf() const { return child_mask == 0; }
+    int num_children() const;
+    Eigen::AlignedBox3f bounds() const;
+};
+
+struct PointCloudHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    MeshCacheSource source;
+    double origin[3];
+    float size; // edge of the root cube
+    uint32_t sample_grid;
+    uint64_t num_points;
+    uint64_t num_nodes;
+    uint64_t nodes_offset;
+    uint32_t depth;
+    uint32_t reserved;
+};
+
+// Streams the points of a LAS (1.0 to 1.4, uncompressed) or XYZ text file
+// ("x y z", "x y z r g b" or "x y z intensity r g b" per line). Both are
+// memory-mapped and read front to back, so files larger than RAM are fine.
+class PointReader
+{
+public:
+    // Returns **false** (and prints the reason) if the file cannot be read
+    bool open(const std::string& filename);
+
+    // From the LAS header; XYZ files take one pass over the text
+    const Eigen::AlignedBox3d& bounds() const { return bounds_; }
+    uint64_t num_points() const { return num_points_; }
+
+    // Calls fn(points, count) for consecutive batches, the points made
+    // relative to `origin`
+    bool read(const Eigen::Vector3d& origin, const std::function<void(const Point*, size_t)>& fn) const;
+
+private:
+    bool open_las();
+    bool open_xyz();
+    bool read_las(const Eigen::Vector3d& origin, const std::function<void(const Point*, size_t)>& fn) const;
+    bool read_xyz(const Eigen::Vector3d& origin, const std::function<void(const Point*, size_t)>& fn) const;
+
+    MappedFile file_;
+    std::string filename_;
+    bool las_ = false;
+    Eigen::AlignedBox3d bounds_;
+    uint64_t num_points_ = 0;
+    // LAS
+    uint64_t point_offset_ = 0;
+    uint32_t record_length_ = 0;
+    int rgb_offset_ = -1;
+    double scale_[3] = { 1.0, 1.0, 1.0 };
+    double offset_[3] = { 0.0, 0.0, 0.0 };
+};
+
+struct PointCloudBuildOptions
+{
+    // Points of a leaf before it is split
+    uint32_t max_node_points = 20000;
+    // Inner nodes keep one point per cell of a sample_grid^3 grid
+    uint32_t sample_grid = 128;
+    // Points held in memory per worker. Larger inputs are first split into
+    // chunks of at most this many points on disk, then each chunk is built
+    // in memory and written out.
+    size_t chunk_points = size_t(4) << 20;
+    // Worker threads, 0 = one per hardware thread. Each holds one chunk.
+    unsigned threads = 0;
+};
+
+struct PointCloudBuildStats
+{
+    uint64_t points = 0;
+    size_t nodes = 0;
+    size_t chunks = 0;
+    int depth = 0;
+    double seconds = 0.0;
+
+    double points_per_second() const { return seconds > 0.0 ? (double)points / seconds : 0.0; }
+};
+
+// Builds the octree of `input` (LAS or XYZ) into `output`. Memory stays
+// around threads * chunk_points points whatever the input size; the
+// chunks go to temporary files next to `output`, which is written next
+// to its final name and renamed into place.
+bool build_point_cloud(const std::string& input, const std::string& output,
+    const PointCloudBuildOptions& options = PointCloudBuildOptions(), PointCloudBuildStats* stats = nullptr);
+
+// True if `file` is a point cloud octree built from the current `source`
+// (same size and modification time; the contents are not hashed).
+bool point_cloud_is_fresh(const std::string& file, const std::string& source);
+
+struct PointSelectOptions
+{
+    // A node is refined while its point spacing projects to more pixels
+    float max_pixel_error = 1.0f;
+    // At most this many points are selected, the nodes largest on screen
+    // first
+    uint64_t point_budget = 10000000;
+};
+
+struct PointSelection
+{
+    uint32_t node;
+    float pixel_spacing; // node spacing projected on screen
+    uint32_t parent;     // index in the selection, ~0u for the root
+};
+
+// A .gvpc file opened for drawing. Only the header and the nodes are read
+// up front; the points of a node are read when it is asked for.
+class PointCloud
+{
+public:
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+
+    const PointCloudHeader& header() const { return header_; }
+    const Span<const PointNode>& nodes() const { return nodes_; }
+    Span<const Point> points(uint32_t node) const;
+    // Relative to the origin
+    Eigen::AlignedBox3f bounds() const;
+
+    // Nodes to draw from this camera (GL conventions, in the cloud's frame):
+    // breadth-first by screen size, inside the frustum, refined down to
+    // max_pixel_error within the point budget. Parents always come before
+    // their children. Returns the points selected.
+    uint64_t select(const Eigen::Matrix4f& view, const Eigen::Matrix4f& proj, int viewport_height,
+        const PointSelectOptions& options, std::vector<PointSelection>& selection) const;
+
+private:
+    MappedFile file_;
+    PointCloudHeader header_ = {};
+    Span<const PointNode> nodes_;
+};
+
+// Projected spacing of the points drawn around each selected node. A
+// node's sample adds to its ancestors', so where descendants are drawn too
+// the points are as dense as the finest of them; splats sized by this do
+// not hide the detail of the children. `drawn` flags the selected nodes
+// actually drawn (empty: all of them).
+void drawn_spacing(const std::vector<PointSelection>& selection, const std::vector<uint8_t>& drawn,
+    std::vector<float>& spacing);
@@ -0,0 +1,309 @@
+#include "PointCloudPlugin.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+static const char* POINT_CLOUD_EXTENSION = ".gvpc";
+
+static bool has_extension(const std::string& filename, const char* ext)
+{
+    size_t n = strlen(ext);
+    if (filename.size() < n)
+    {
+        return false;
+    }
+    return std::equal(filename.end() - n, filename.end(), ext,
+        [](char a, char b) { return std::tolower((unsigned char)a) == b; });
+}
+
+namespace
+{
+// Handed from load_async() to load_finished()
+struct PreparedCloud
+{
+    std::string file;
+    PointCloudBuildStats stats;
+};
+}
+
+PointCloudPlugin::PointCloudPlugin()
+{
+    mName = "pointcloud";
+    cache.load = [this](uint32_t node, std::vector<char>& data)
+    {
+        const Span<const Point> points = cloud.points(node);
+        if (points.size() == 0)
+        {
+            return false;
+        }
+        const char* bytes = reinterpret_cast<const char*>(points.data());
+        data.assign(bytes, bytes + points.size_bytes());
+        return true;
+    };
+    cache.evicted = [this](uint32_t node)
+    {
+        if (node < gpu_nodes_.size() && gpu_nodes_[node].valid())
+        {
+            if (mViewer && mViewer->buffers)
+            {
+                mViewer->buffers->free_static(gpu_nodes_[node]);
+            }
+            gpu_nodes_[node] = BufferSlice();
+        }
+    };
+    // A node came in: draw a frame to show it
+    cache.notify = [this]
+    {
+        if (mViewer)
+        {
+            damage().invalidate(Damage::Scene);
+        }
+    };
+}
+
+PointCloudPlugin::~PointCloudPlugin()
+{
+    // The loaders read `cloud`, which is destroyed before `cache`
+    cache.stop();
+}
+
+bool PointCloudPlugin::is_point_cloud(const std::string& filename)
+{
+    return has_extension(filename, ".las") || has_extension(filename, ".xyz")
+        || has_extension(filename, POINT_CLOUD_EXTENSION);
+}
+
+bool PointCloudPlugin::prepare(const std::string& filename, std::string& file, PointCloudBuildStats& stats) const
+{
+    if (has_extension(filename, POINT_CLOUD_EXTENSION))
+    {
+        file = filename;
+        return true;
+    }
+    file = filename + POINT_CLOUD_EXTENSION;
+    if (point_cloud_is_fresh(file, filename))
+    {
+        return true;
+    }
+    if (!build_point_cloud(filename, file, build_options, &stats))
+    {
+        return false;
+    }
+    printf("Built point cloud octree: %llu points, %zu nodes, depth %d, %zu chunks in %.2f s (%.1f Mpoints/s)\n",
+        (unsigned long long)stats.points, stats.nodes, stats.depth, stats.chunks, stats.seconds,
+        stats.points_per_second() * 1e-6);
+    return true;
+}
+
+bool PointCloudPlugin::open_cloud(const std::string& file)
+{
+    unload();
+    if (!cloud.open(file))
+    {
+        return false;
+    }
+    cloud_file = file;
+    const PointCloudHeader& header = cloud.header();
+    gpu_nodes_.assign((size_t)header.num_nodes, BufferSlice());
+    cache.reset((size_t)header.num_nodes);
+    fit_camera_ = true;
+    printf("Opened point cloud %s: %llu points in %llu nodes, depth %u\n", file.c_str(),
+        (unsigned long long)header.num_points, (unsigned long long)header.num_nodes, header.depth);
+    return true;
+}
+
+bool PointCloudPlugin::load(const std::string& filename, bool only_vertices)
+{
+    (void)only_vertices;
+    if (!is_point_cloud(filename))
+    {
+        return false;
+    }
+    std::string file;
+    PointCloudBuildStats stats;
+    if (!prepare(filename, file, stats))
+    {
+        return false;
+    }
+    build_stats = stats;
+    return open_cloud(file);
+}
+
+bool PointCloudPlugin::load_async(Asset& asset)
+{
+    if (!is_point_cloud(asset.filename))
+    {
+        return false;
+    }
+    // Building the octree is the slow part; opening it only maps the file
+    auto prepared = std::make_shared<PreparedCloud>();
+    if (!prepare(asset.filename, prepared->file, prepared->stats))
+    {
+        return false;
+    }
+    asset.payload = prepared;
+    return true;
+}
+
+bool PointCloudPlugin::load_finished(Asset& asset)
+{
+    auto prepared = std::static_pointer_cast<PreparedCloud>(asset.payload);
+    if (asset.plugin != this || !prepared)
+    {
+        return false;
+    }
+    build_stats = prepared->stats;
+    const bool ok = open_cloud(prepared->file);
+    asset.payload.reset();
+    return ok;
+}
+
+bool PointCloudPlugin::unload()
+{
+    // Evicts every node, which frees its GPU copy
+    cache.reset(0);
+    for (BufferSlice& slice : gpu_nodes_)
+    {
+        if (slice.valid() && mViewer && mViewer->buffers)
+        {
+            mViewer->buffers->free_static(slice);
+        }
+    }
+    gpu_nodes_.clear();
+    cloud.close();
+    cloud_file.clear();
+    selection.clear();
+    points_selected = 0;
+    draws.clear();
+    points_drawn = 0;
+    fit_camera_ = false;
+    return false;
+}
+
+bool PointCloudPlugin::post_load()
+{
+    if (fit_camera_ && cloud.is_open())
+    {
+        mViewer->camera.fit(cloud.bounds());
+        fit_camera_ = false;
+    }
+    return false;
+}
+
+bool PointCloudPlugin::pre_draw_tasks(TaskGraph& tasks, bool first)
+{
+    (void)first;
+    if (!cloud.is_open())
+    {
+        return false;
+    }
+    tasks.add([this]()
+        {
+            points_selected = cloud.select(mViewer->view, mViewer->proj, mViewer->framebuffer_height,
+                select_options, selection);
+        });
+    return false;
+}
+
+int PointCloudPlugin::splat_size(float pixel_spacing) const
+{
+    const int size = (int)std::ceil(pixel_spacing);
+    return std::max(point_size, std::min(size, max_splat_size));
+}
+
+bool PointCloudPlugin::pre_draw(bool first)
+{
+    (void)first;
+    draws.clear();
+    points_drawn = 0;
+    if (!cloud.is_open())
+    {
+        return false;
+    }
+
+    resident_.resize(selection.size());
+    drawn_.resize(selection.size());
+    for (size_t i = 0; i < selection.size(); ++i)
+    {
+        resident_[i] = cache.acquire(selection[i].node, selection[i].pixel_spacing);
+        drawn_[i] = resident_[i] && !resident_[i]->empty();
+    }
+    drawn_spacing(selection, drawn_, spacing_);
+
+    BufferManager* buffers = mViewer->buffers && mViewer->buffers->ready() ? mViewer->buffers.get() : nullptr;
+    size_t uploaded = 0;
+    bool waiting_upload = false;
+    for (size_t i = 0; i < selection.size(); ++i)
+    {
+        if (!drawn_[i])
+        {
+            continue;
+        }
+        const std::vector<char>& data = *resident_[i];
+        Draw draw;
+        draw.node = selection[i].node;
+        draw.points = reinterpret_cast<const Point*>(data.data());
+        draw.count = (uint32_t)(data.size() / sizeof(Point));
+        draw.splat_size = splat_size(spacing_[i]);
+        if (buffers)
+        {
+            BufferSlice& gpu = gpu_nodes_[draw.node];
+            // The budget spreads uploads over frames; one node always goes
+            if (!gpu.valid() && (uploaded == 0 || uploaded + data.size() <= upload_budget))
+            {
+                gpu = buffers->allocate_static(data.size(), data.data());
+                uploaded += data.size();
+            }
+            waiting_upload |= !gpu.valid();
+            draw.gpu = gpu;
+        }
+        draws.push_back(draw);
+        points_drawn += draw.count;
+    }
+    // Keep drawing frames until every resident node is uploaded and drawn,
+    // including the ones update() takes over now
+    if (cache.update() > 0 || waiting_upload)
+    {
+        damage().invalidate(Damage::Scene);
+    }
+    return false;
+}
+
+void PointCloudPlugin::render_cpu(Framebuffer& fb, PointSplatter& splatter) const
+{
+    render_cpu(fb, splatter, mViewer->proj * mViewer->view);
+}
+
+void PointCloudPlugin::render_cpu(Framebuffer& fb, PointSplatter& splatter, const Eigen::Matrix4f& view_proj) const
+{
+    std::vector<SplatBatch> batches;
+    batches.reserve(draws.size());
+    for (const Draw& draw : draws)
+    {
+        SplatBatch batch;
+        batch.points = draw.points;
+        batch.count = draw.count;
+        batch.size = draw.splat_size;
+        batches.push_back(batch);
+    }
+    splatter.draw(fb, batches, view_proj);
+}
+
+void PointCloudPlugin::render_reference(Framebuffer& fb, PointSplatter& splatter,
+    const Eigen::Matrix4f& view_proj) const
+{
+    std::vector<SplatBatch> batches;
+    for (uint32_t node = 0; node < (uint32_t)cloud.nodes().size(); ++node)
+    {
+        const Span<const Point> points = cloud.points(node);
+        SplatBatch batch;
+        batch.points = points.data();
+        batch.count = points.size();
+        batch.size = point_size;
+        batches.push_back(batch);
+    }
+    splatter.draw(fb, batches, view_proj);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../viewer/Viewer.h"
+#include "../render/PointSplatter.h"
+#include "../util/PageCache.h"
+#include "PointCloud.h"
+#include <string>
+#include <vector>
+
+// Point clouds (LAS, XYZ) drawn out of core.
+//
+// Loading foo.las builds the octree foo.las.gvpc once (reused while the
+// source is unchanged) and opens it; only the node hierarchy is read up
+// front. Each frame the nodes in view are selected by screen-space error
+// within select_options.point_budget. The resident ones are drawn; missing
+// ones are paged in by `cache` on a loader thread, largest on screen
+// first, within cache.budget bytes of RAM. With a GL context the nodes
+// drawn also get a GPU copy, uploaded up to upload_budget bytes per frame;
+// draw the `draws` of the frame as GL_POINTS. render_cpu() splats the same
+// selection into a Framebuffer, for headless use and for comparing with
+// render_reference(), which splats every point.
+class PointCloudPlugin : public ViewerPluginBase<PointCloudPlugin>
+{
+public:
+    PointCloudPlugin();
+    ~PointCloudPlugin() override;
+
+    bool load(const std::string& filename, bool only_vertices) override;
+    bool load_async(Asset& asset) override;
+    bool load_finished(Asset& asset) override;
+    bool unload() override;
+    bool post_load() override;
+    // Node selection, as a task on the viewer's job system
+    bool pre_draw_tasks(TaskGraph& tasks, bool first) override;
+    // Paging and GPU uploads of the selection
+    bool pre_draw(bool first) override;
+
+    // .las, .xyz or an already built .gvpc
+    static bool is_point_cloud(const std::string& filename);
+
+    PointCloudBuildOptions build_options;
+    PointSelectOptions select_options;
+    // Splat edge in pixels: at least point_size, grown to the projected
+    // spacing of coarse nodes (up to max_splat_size) to close their gaps
+    int point_size = 1;
+    int max_splat_size = 8;
+    // Points of the nodes in RAM, paged from the .gvpc file
+    PageCache cache;
+    size_t upload_budget = size_t(16) << 20;
+
+    PointCloud cloud;
+    std::string cloud_file;
+    PointCloudBuildStats build_stats;
+
+    struct Draw
+    {
+        uint32_t node;
+        const Point* points; // resident copy, valid for the frame
+        uint32_t count;
+        int splat_size;
+        BufferSlice gpu; // invalid without a GL context or until uploaded
+    };
+
+    // This frame
+    std::vector<PointSelection> selection;
+    uint64_t points_selected = 0;
+    std::vector<Draw> draws;
+    uint64_t points_drawn = 0;
+
+    // Splats this frame's draws, or every point of the cloud, with the
+    // camera of the viewer (or `view_proj` in the cloud's frame)
+    void render_cpu(Framebuffer& fb, PointSplatter& splatter) const;
+    void render_cpu(Framebuffer& fb, PointSplatter& splatter, const Eigen::Matrix4f& view_proj) const;
+    void render_reference(Framebuffer& fb, PointSplatter& splatter, const Eigen::Matrix4f& view_proj) const;
+
+private:
+    bool open_cloud(const std::string& file);
+    // The octree of a point cloud file, built if needed
+    bool prepare(const std::string& filename, std::string& file, PointCloudBuildStats& stats) const;
+    int splat_size(float pixel_spacing) const;
+
+    std::vector<BufferSlice> gpu_nodes_;
+    // Per selected node, this frame
+    std::vector<const std::vector<char>*> resident_;
+    std::vector<uint8_t> drawn_;
+    std::vector<float> spacing_;
+    bool fit_camera_ = false;
+};
@@ -0,0 +1,379 @@
+#include "BufferManager.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+// Not part of the GL 3.3 loader, fetched at runtime
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFN_glBufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+static PFN_glBufferStorage buffer_storage = nullptr;
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return alignment <= 1 ? value : (value + alignment - 1) / alignment * alignment;
+}
+
+BufferManager::~BufferManager()
+{
+    // GL objects need the context; call shutdown() while it is current
+}
+
+bool BufferManager::init()
+{
+    if (ready_)
+    {
+        return true;
+    }
+    if (!glfwGetCurrentContext())
+    {
+        return false;
+    }
+
+    persistent_ = false;
+    if (prefer_persistent && (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4)
+        || glfwExtensionSupported("GL_ARB_buffer_storage")))
+    {
+        buffer_storage = (PFN_glBufferStorage)glfwGetProcAddress("glBufferStorage");
+        persistent_ = buffer_storage != nullptr;
+    }
+
+    glGenBuffers(1, &stream_buffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, stream_buffer_);
+    if (persistent_)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const GLsizeiptr size = (GLsizeiptr)(STREAM_REGIONS * stream_region_size);
+        buffer_storage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+        stream_mapped_ = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+        if (!stream_mapped_)
+        {
+            // Storage is immutable, start over with a plain buffer
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &stream_buffer_);
+            glGenBuffers(1, &stream_buffer_);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, stream_buffer_);
+            persistent_ = false;
+        }
+    }
+    if (!persistent_)
+    {
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)stream_region_size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    region_ = 0;
+    region_offset_ = 0;
+    ready_ = true;
+    return true;
+}
+
+void BufferManager::shutdown()
+{
+    if (!ready_)
+    {
+        return;
+    }
+    for (auto& fence : fences_)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (stream_mapped_)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream_buffer_);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        stream_mapped_ = nullptr;
+    }
+    glDeleteBuffers(1, &stream_buffer_);
+    stream_buffer_ = 0;
+    for (auto& arena : arenas_)
+    {
+        glDeleteBuffers(1, &arena.buffer);
+    }
+    arenas_.clear();
+    ready_ = false;
+}
+
+void BufferManager::count_upload(size_t bytes)
+{
+    current_.bytes_uploaded += bytes;
+    ++current_.upload_calls;
+}
+
+BufferSlice BufferManager::allocate_static(size_t bytes, const void* data, size_t alignment)
+{
+    BufferSlice slice;
+    if (!ready_ || bytes == 0)
+    {
+        return slice;
+    }
+
+    // First fit over the free blocks of every arena
+    for (int pass = 0; pass < 2 && !slice.valid(); ++pass)
+    {
+        if (pass == 1)
+        {
+            Arena arena;
+            arena.size = std::max(arena_size, align_up(bytes, 256));
+            glGenBuffers(1, &arena.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, arena.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)arena.size, nullptr, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            arena.free_blocks[0] = arena.size;
+            arenas_.push_back(arena);
+        }
+        for (auto& arena : arenas_)
+        {
+            for (auto it = arena.free_blocks.begin(); it != arena.free_blocks.end(); ++it)
+            {
+                size_t begin = it->first, end = it->first + it->second;
+                size_t offset = align_up(begin, alignment);
+                if (offset + bytes > end)
+                {
+                    continue;
+                }
+                arena.free_blocks.erase(it);
+                if (offset > begin)
+                {
+                    arena.free_blocks[begin] = offset - begin;
+                }
+                if (offset + bytes < end)
+                {
+                    arena.free_blocks[offset + bytes] = end - (offset + bytes);
+                }
+                slice.buffer = arena.buffer;
+                slice.offset = offset;
+                slice.size = bytes;
+                break;
+            }
+            if (slice.valid())
+            {
+                break;
+            }
+        }
+    }
+
+    if (data)
+    {
+        update(slice, data, bytes);
+    }
+    return slice;
+}
+
+void BufferManager::free_static(const BufferSlice& slice)
+{
+    for (auto& arena : arenas_)
+    {
+        if (arena.buffer != slice.buffer)
+        {
+            continue;
+        }
+        size_t offset = slice.offset, size = slice.size;
+        // Merge with the neighbours
+        auto next = arena.free_blocks.lower_bound(offset);
+        if (next != arena.free_blocks.end() && next->first == offset + size)
+        {
+            size += next->second;
+            next = arena.free_blocks.erase(next);
+        }
+        if (next != arena.free_blocks.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                offset = prev->first;
+                size += prev->second;
+                arena.free_blocks.erase(prev);
+            }
+        }
+        arena.free_blocks[offset] = size;
+        return;
+    }
+}
+
+BufferSlice BufferManager::create_dynamic(size_t bytes, const void* data)
+{
+    BufferSlice slice;
+    if (!ready_ || bytes == 0)
+    {
+        return slice;
+    }
+    glGenBuffers(1, &slice.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slice.buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)bytes, data, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    slice.size = bytes;
+    if (data)
+    {
+        count_upload(bytes);
+    }
+    return slice;
+}
+
+bool BufferManager::update(const BufferSlice& slice, const void* data, size_t bytes, size_t offset)
+{
+    if (!slice.valid() || offset + bytes > slice.size)
+    {
+        return false;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slice.buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)(slice.offset + offset), (GLsizeiptr)bytes, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    count_upload(bytes);
+    return true;
+}
+
+void BufferManager::destroy_dynamic(const BufferSlice& slice)
+{
+    if (slice.valid())
+    {
+        glDeleteBuffers(1, &slice.buffer);
+    }
+}
+
+BufferSlice BufferManager::stream(const void* data, size_t bytes, size_t alignment)
+{
+    BufferSlice slice;
+    if (!ready_)
+    {
+        return slice;
+    }
+    size_t offset = align_up(region_offset_, alignment);
+    if (offset + bytes > stream_region_size)
+    {
+        ++stream_overflows_;
+        return slice;
+    }
+    region_offset_ = offset + bytes;
+    slice.buffer = stream_buffer_;
+    slice.size = bytes;
+    if (persistent_)
+    {
+        slice.offset = (size_t)region_ * stream_region_size + offset;
+        memcpy(stream_mapped_ + slice.offset, data, bytes);
+    }
+    else
+    {
+        slice.offset = offset;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream_buffer_);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    count_upload(bytes);
+    return slice;
+}
+
+void BufferManager::begin_frame()
+{
+    if (!ready_ || in_frame_)
+    {
+        return;
+    }
+    in_frame_ = true;
+    region_ = (region_ + 1) % STREAM_REGIONS;
+    region_offset_ = 0;
+    if (persistent_)
+    {
+        // The GPU may still read this region from STREAM_REGIONS frames ago
+        GLsync& fence = fences_[region_];
+        if (fence)
+        {
+            auto tic = std::chrono::steady_clock::now();
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED)
+            {
+                ++current_.fence_waits;
+                do
+                {
+                    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                } while (result == GL_TIMEOUT_EXPIRED);
+            }
+            current_.fence_wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    else
+    {
+        // Orphan: the driver hands out fresh storage, no stall on the GPU
+        glBindBuffer(GL_COPY_WRITE_BUFFER, stream_buffer_);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)stream_region_size, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+void BufferManager::end_frame()
+{
+    if (!ready_ || !in_frame_)
+    {
+        return;
+    }
+    in_frame_ = false;
+    if (persistent_)
+    {
+        fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    last_frame_ = current_;
+    total_.bytes_uploaded += current_.bytes_uploaded;
+    total_.upload_calls += current_.upload_calls;
+    total_.draw_calls += current_.draw_calls;
+    total_.instances += current_.instances;
+    total_.fence_waits += current_.fence_waits;
+    total_.fence_wait_seconds += current_.fence_wait_seconds;
+    current_ = GpuFrameStats();
+}
+
+void BufferManager::draw_arrays(GLenum mode, GLint first, GLsizei count)
+{
+    glDrawArrays(mode, first, count);
+    ++current_.draw_calls;
+    ++current_.instances;
+}
+
+void BufferManager::draw_arrays_instanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+{
+    glDrawArraysInstanced(mode, first, count, instances);
+    ++current_.draw_calls;
+    current_.instances += (size_t)instances;
+}
+
+void BufferManager::draw_elements(GLenum mode, GLsizei count, GLenum type, size_t byte_offset, GLint base_vertex)
+{
+    if (base_vertex != 0)
+    {
+        glDrawElementsBaseVertex(mode, count, type, (const void*)byte_offset, base_vertex);
+    }
+    else
+    {
+        glDrawElements(mode, count, type, (const void*)byte_offset);
+    }
+    ++current_.draw_calls;
+    ++current_.instances;
+}
+
+void BufferManager::draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, size_t byte_offset,
+    GLsizei instances, GLint base_vertex)
+{
+    if (base_vertex != 0)
+    {
+        glDrawElementsInstancedBaseVertex(mode, count, type, (const void*)byte_offset, instances, base_vertex);
+    }
+    else
+    {
+        glDrawElementsInstanced(mode, count, type, (const void*)byte_offset, instances);
+    }
+    ++current_.draw_calls;
+    current_.instances += (size_t)instances;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// A range inside a GL buffer object
+struct BufferSlice
+{
+    GLuint buffer = 0;
+    size_t offset = 0;
+    size_t size = 0;
+
+    bool valid() const { return buffer != 0; }
+};
+
+// What reached the GPU in one frame
+struct GpuFrameStats
+{
+    size_t bytes_uploaded = 0;
+    size_t upload_calls = 0;
+    size_t draw_calls = 0;
+    size_t instances = 0;
+    size_t fence_waits = 0;
+    double fence_wait_seconds = 0.0;
+};
+
+// Owns the GL buffers of a context (share group) and hands out ranges:
+//  - static: suballocated from large arenas, uploaded once (at allocation
+//    or in pieces with update()),
+//  - dynamic: a buffer of its own, updated in place with update(),
+//  - stream: valid for the current frame only. Backed by a triple-buffered
+//    persistently mapped ring guarded by fences when glBufferStorage is
+//    available (GL 4.4 / ARB_buffer_storage), otherwise by a buffer that is
+//    orphaned at the start of every frame (GL 3.3).
+// Uploads go through GL_COPY_WRITE_BUFFER so the array and element array
+// bindings of the caller are left alone. Draws issued through the draw_*
+// wrappers are counted with the uploads in frame_stats().
+class BufferManager
+{
+public:
+    static constexpr int STREAM_REGIONS = 3;
+
+    // Size of each static arena and of each per-frame stream region
+    size_t arena_size = size_t(64) << 20;
+    size_t stream_region_size = size_t(16) << 20;
+    // Set to false before init() to force the orphaning path
+    bool prefer_persistent = true;
+
+    BufferManager() = default;
+    ~BufferManager();
+    BufferManager(const BufferManager&) = delete;
+    BufferManager& operator=(const BufferManager&) = delete;
+
+    // Needs a current GL context. Returns **false** if there is none.
+    bool init();
+    void shutdown();
+    bool ready() const { return ready_; }
+    bool persistent_mapping() const { return persistent_; }
+
+    BufferSlice allocate_static(size_t bytes, const void* data = nullptr, size_t alignment = 16);
+    void free_static(const BufferSlice& slice);
+
+    BufferSlice create_dynamic(size_t bytes, const void* data = nullptr);
+    bool update(const BufferSlice& slice, const void* data, size_t bytes, size_t offset = 0);
+    void destroy_dynamic(const BufferSlice& slice);
+
+    // Copies `bytes` into this frame's stream region. Returns an invalid
+    // slice if the region is full.
+    BufferSlice stream(const void* data, size_t bytes, size_t alignment = 16);
+
+    void begin_frame();
+    void end_frame();
+
+    void draw_arrays(GLenum mode, GLint first, GLsizei count);
+    void draw_arrays_instanced(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+    void draw_elements(GLenum mode, GLsizei count, GLenum type, size_t byte_offset, GLint base_vertex = 0);
+    void draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, size_t byte_offset,
+        GLsizei instances, GLint base_vertex = 0);
+
+    // Counters of the last completed frame, and since init()
+    const GpuFrameStats& frame_stats() const { return last_frame_; }
+    const GpuFrameStats& total_stats() const { return total_; }
+    size_t stream_overflows() const { return stream_overflows_; }
+
+private:
+    struct Arena
+    {
+        GLuint buffer = 0;
+        size_t size = 0;
+        std::map<size_t, size_t> free_blocks; // offset -> size
+    };
+
+    void count_upload(size_t bytes);
+
+    bool ready_ = false;
+    bool persistent_ = false;
+    std::vector<Arena> arenas_;
+
+    GLuint stream_buffer_ = 0;
+    unsigned char* stream_mapped_ = nullptr;
+    GLsync fences_[STREAM_REGIONS] = {};
+    int region_ = 0;
+    size_t region_offset_ = 0;
+    size_t stream_overflows_ = 0;
+    bool in_frame_ = false;
+
+    GpuFrameStats current_;
+    GpuFrameStats last_frame_;
+    GpuFrameStats total_;
+};
@@ -0,0 +1,167 @@
+#include "PointSplatter.h"
+#include "../util/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+const size_t BLOCK_POINTS = 16384;
+}
+
+void PointSplatter::draw(Framebuffer& fb, const Point* points, size_t count, const Eigen::Matrix4f& mvp, int size)
+{
+    SplatBatch batch;
+    batch.points = points;
+    batch.count = count;
+    batch.size = size;
+    draw(fb, std::vector<SplatBatch>(1, batch), mvp);
+}
+
+void PointSplatter::draw(Framebuffer& fb, const std::vector<SplatBatch>& batches, const Eigen::Matrix4f& mvp)
+{
+    auto tic = std::chrono::steady_clock::now();
+    stats_ = SplatStats();
+    const int num_bands = (fb.height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+    size_t num_blocks = 0;
+    for (const SplatBatch& batch : batches)
+    {
+        for (size_t first = 0; first < batch.count; first += BLOCK_POINTS)
+        {
+            if (blocks_.size() <= num_blocks)
+            {
+                blocks_.emplace_back();
+            }
+            Block& block = blocks_[num_blocks++];
+            block.points = batch.points + first;
+            block.count = std::min(BLOCK_POINTS, batch.count - first);
+            block.size = std::max(batch.size, 1);
+        }
+        stats_.points_submitted += batch.count;
+    }
+    if (num_blocks == 0 || num_bands == 0)
+    {
+        return;
+    }
+
+    // Project and bin
+    const Kernels& k = kernels();
+    const float w = (float)fb.width, h = (float)fb.height;
+    parallel_for(num_blocks, [&](size_t b, unsigned)
+        {
+            Block& block = blocks_[b];
+            block.splats.clear();
+            block.bands.resize(num_bands);
+            for (auto& band : block.bands)
+            {
+                band.clear();
+            }
+            const int lo = (block.size - 1) / 2, hi = block.size / 2;
+            block.clip.resize(4 * block.count);
+            k.transform_points(mvp.data(), &block.points->x, sizeof(Point) / sizeof(float), block.count,
+                block.clip.data(), 4);
+            for (size_t i = 0; i < block.count; ++i)
+            {
+                const Point& p = block.points[i];
+                const float* clip = &block.clip[4 * i];
+                if (clip[3] <= 0.0f || clip[2] < -clip[3] || clip[2] > clip[3])
+                {
+                    continue;
+                }
+                const float inv_w = 1.0f / clip[3];
+                const float sx = (clip[0] * inv_w * 0.5f + 0.5f) * w;
+                const float sy = (0.5f - clip[1] * inv_w * 0.5f) * h;
+                if (sx < -(float)block.size || sy < -(float)block.size || sx >= w + block.size || sy >= h + block.size)
+                {
+                    continue;
+                }
+                const int px = (int)std::floor(sx), py = (int)std::floor(sy);
+                const int x0 = std::max(px - lo, 0), x1 = std::min(px + hi, fb.width - 1);
+                const int y0 = std::max(py - lo, 0), y1 = std::min(py + hi, fb.height - 1);
+                if (x0 > x1 || y0 > y1)
+                {
+                    continue;
+                }
+                const uint32_t index = (uint32_t)block.splats.size();
+                block.splats.push_back({ (int16_t)x0, (int16_t)y0, (int16_t)x1, (int16_t)y1,
+                    clip[2] * inv_w * 0.5f + 0.5f, p.rgba });
+                for (int band = y0 / BAND_HEIGHT; band <= y1 / BAND_HEIGHT; ++band)
+                {
+                    block.bands[band].push_back(index);
+                }
+            }
+        }, threads);
+
+    // Fill the bands, the blocks in order within each
+    std::vector<size_t> written(num_bands, 0);
+    parallel_for((size_t)num_bands, [&](size_t band, unsigned)
+        {
+            const int band_y0 = (int)band * BAND_HEIGHT;
+            const int band_y1 = std::min(band_y0 + BAND_HEIGHT, fb.height) - 1;
+            size_t pixels = 0;
+            for (size_t b = 0; b < num_blocks; ++b)
+            {
+                const Block& block = blocks_[b];
+                for (uint32_t index : block.bands[band])
+                {
+                    const Splat& s = block.splats[index];
+                    for (int y = std::max<int>(s.y0, band_y0); y <= std::min<int>(s.y1, band_y1); ++y)
+                    {
+                        float* depth = &fb.depth[(size_t)y * fb.stride];
+                        uint32_t* color = &fb.color[(size_t)y * fb.stride];
+                        for (int x = s.x0; x <= s.x1; ++x)
+                        {
+                            if (s.depth < depth[x])
+                            {
+                                depth[x] = s.depth;
+                                color[x] = s.rgba;
+                                ++pixels;
+                            }
+                        }
+                    }
+                }
+            }
+            written[band] = pixels;
+        }, threads);
+
+    for (size_t b = 0; b < num_blocks; ++b)
+    {
+        stats_.points_splatted += blocks_[b].splats.size();
+    }
+    for (size_t pixels : written)
+    {
+        stats_.pixels_written += pixels;
+    }
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+}
+
+ImageDifference compare_images(const Framebuffer& a, const Framebuffer& b, uint32_t background, int tolerance)
+{
+    ImageDifference d;
+    if (a.width != b.width || a.height != b.height)
+    {
+        return d;
+    }
+    double sum = 0.0;
+    for (int y = 0; y < a.height; ++y)
+    {
+        for (int x = 0; x < a.width; ++x)
+        {
+            const uint32_t ca = a.pixel(x, y), cb = b.pixel(x, y);
+            int worst = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                const int delta = (int)((ca >> (8 * k)) & 0xff) - (int)((cb >> (8 * k)) & 0xff);
+                worst = std::max(worst, std::abs(delta));
+                sum += (double)delta * delta;
+            }
+            d.differing += worst > tolerance;
+            d.coverage_changed += (ca == background) != (cb == background);
+        }
+    }
+    d.pixels = (size_t)a.width * a.height;
+    d.rmse = d.pixels > 0 ? std::sqrt(sum / (3.0 * (double)d.pixels)) : 0.0;
+    return d;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "SoftwareRasterizer.h"
+#include "../points/PointCloud.h"
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+// Points drawn with one splat size, e.g. one octree node
+struct SplatBatch
+{
+    const Point* points = nullptr;
+    size_t count = 0;
+    int size = 1; // square splat edge in pixels
+};
+
+struct SplatStats
+{
+    size_t points_submitted = 0;
+    size_t points_splatted = 0; // inside the view
+    size_t pixels_written = 0;  // passed the depth test
+    double seconds = 0.0;
+};
+
+// Headless point renderer into a Framebuffer: every point covers a square
+// of `size` pixels around its projection, depth-tested against the
+// framebuffer. Points are projected in parallel and binned into bands of
+// rows; the bands are then filled in parallel, each walking the batches in
+// submission order, so the output does not depend on the thread count.
+class PointSplatter
+{
+public:
+    static constexpr int BAND_HEIGHT = 32;
+
+    // Worker threads, 0 = one per hardware thread
+    unsigned threads = 0;
+
+    void draw(Framebuffer& fb, const std::vector<SplatBatch>& batches, const Eigen::Matrix4f& mvp);
+    void draw(Framebuffer& fb, const Point* points, size_t count, const Eigen::Matrix4f& mvp, int size = 1);
+
+    const SplatStats& stats() const { return stats_; }
+
+private:
+    struct Splat
+    {
+        int16_t x0, y0, x1, y1; // covered pixels, inclusive
+        float depth;
+        uint32_t rgba;
+    };
+
+    // A run of points projected by one task, binned by band
+    struct Block
+    {
+        const Point* points;
+        size_t count;
+        int size;
+        std::vector<float> clip; // 4 per point
+        std::vector<Splat> splats;
+        std::vector<std::vector<uint32_t>> bands;
+    };
+
+    std::vector<Block> blocks_;
+    SplatStats stats_;
+};
+
+// Differences between two renderings of the same size, e.g. an LOD render
+// against a brute-force reference
+struct ImageDifference
+{
+    size_t pixels = 0;
+    size_t differing = 0;        // any channel off by more than the tolerance
+    size_t coverage_changed = 0; // background in one image only
+    double rmse = 0.0;           // over the RGB channels, in 0..255
+
+    double differing_fraction() const { return pixels > 0 ? (double)differing / (double)pixels : 0.0; }
+};
+
+ImageDifference compare_images(const Framebuffer& a, const Framebuffer& b, uint32_t background, int tolerance = 0);
@@ -0,0 +1,137 @@
+#include "RenderQueue.h"
+#include "BufferManager.h"
+#include <algorithm>
+#include <cstdio>
+
+uint32_t RenderQueue::add_mesh(const RenderMesh& mesh)
+{
+    // Handles past MAX_MESHES would alias earlier meshes in the sort key
+    if (meshes_.size() >= MAX_MESHES)
+    {
+        fprintf(stderr, "Error: Render queue holds the maximum of %u meshes\n", MAX_MESHES);
+        return NO_MESH;
+    }
+    meshes_.push_back(mesh);
+    return (uint32_t)meshes_.size() - 1;
+}
+
+uint64_t RenderQueue::make_key(uint32_t material, uint32_t mesh, uint8_t layer, uint16_t order)
+{
+    return ((uint64_t)layer << 56) | ((uint64_t)(material & (MAX_MATERIALS - 1)) << 36)
+        | ((uint64_t)(mesh & (MAX_MESHES - 1)) << 16) | order;
+}
+
+void RenderQueue::submit(uint32_t mesh, uint32_t material, const Eigen::Matrix4f& transform,
+    uint8_t layer, uint16_t order)
+{
+    if (mesh >= MAX_MESHES || mesh >= meshes_.size() || material >= MAX_MATERIALS)
+    {
+        return;
+    }
+    packets_.push_back({ make_key(material, mesh, layer, order), (uint32_t)transforms_.size() });
+    transforms_.push_back(transform);
+}
+
+const std::vector<RenderQueue::Batch>& RenderQueue::sort()
+{
+    std::sort(packets_.begin(), packets_.end(), [] (const Packet& a, const Packet& b)
+        {
+            return a.key != b.key ? a.key < b.key : a.transform < b.transform;
+        });
+
+    // Instance data in draw order, one run per batch
+    batches_.clear();
+    instance_data_.resize(packets_.size());
+    const uint64_t state_mask = ~uint64_t(0xffff); // ignore the order bits
+    for (size_t i = 0; i < packets_.size(); ++i)
+    {
+        const uint64_t key = packets_[i].key;
+        instance_data_[i] = transforms_[packets_[i].transform];
+        if (i > 0 && ((packets_[i - 1].key ^ key) & state_mask) == 0)
+        {
+            ++batches_.back().instances;
+            continue;
+        }
+        Batch batch;
+        batch.material = (uint32_t)(key >> 36) & (MAX_MATERIALS - 1);
+        batch.mesh = (uint32_t)(key >> 16) & (MAX_MESHES - 1);
+        batch.first = (uint32_t)i;
+        batch.instances = 1;
+        batches_.push_back(batch);
+    }
+    return batches_;
+}
+
+void RenderQueue::flush(BufferManager* buffers)
+{
+    sort();
+    stats_ = Stats();
+    stats_.submitted = packets_.size();
+    stats_.batches = batches_.size();
+
+    if (buffers && buffers->ready() && !batches_.empty())
+    {
+        const size_t stride = sizeof(Eigen::Matrix4f);
+        // All the transforms of the frame in one upload; if the stream
+        // region is too small, try batch by batch
+        BufferSlice all = buffers->stream(instance_data_.data(), instance_data_.size() * stride, stride);
+        uint32_t material = ~0u;
+        for (const Batch& batch : batches_)
+        {
+            BufferSlice slice = all;
+            if (all.valid())
+            {
+                slice.offset += batch.first * stride;
+            }
+            else
+            {
+                slice = buffers->stream(&instance_data_[batch.first], batch.instances * stride, stride);
+                if (!slice.valid())
+                {
+                    stats_.dropped += batch.instances;
+                    continue;
+                }
+            }
+
+            if (batch.material != material)
+            {
+                material = batch.material;
+                ++stats_.material_changes;
+                if (bind_material)
+                {
+                    bind_material(material);
+                }
+            }
+
+            const RenderMesh& mesh = meshes_[batch.mesh];
+            glBindVertexArray(mesh.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, slice.buffer);
+            for (GLuint c = 0; c < 4; ++c)
+            {
+                glEnableVertexAttribArray(instance_location + c);
+                glVertexAttribPointer(instance_location + c, 4, GL_FLOAT, GL_FALSE, (GLsizei)stride,
+                    (const void*)(slice.offset + c * 4 * sizeof(float)));
+                glVertexAttribDivisor(instance_location + c, 1);
+            }
+            if (mesh.index_type)
+            {
+                buffers->draw_elements_instanced(mesh.mode, mesh.count, mesh.index_type, mesh.index_offset,
+                    (GLsizei)batch.instances, mesh.base_vertex);
+            }
+            else
+            {
+                buffers->draw_arrays_instanced(mesh.mode, mesh.base_vertex, mesh.count, (GLsizei)batch.instances);
+            }
+            ++stats_.issued;
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    clear();
+}
+
+void RenderQueue::clear()
+{
+    packets_.clear();
+    transforms_.clear();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class BufferManager;
+
+// Geometry a draw packet refers to. The vertex array holds the vertex
+// attributes and the element buffer; the queue adds the per-instance
+// transform at RenderQueue::instance_location.
+struct RenderMesh
+{
+    GLuint vao = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLsizei count = 0;                  // indices, or vertices for glDrawArrays
+    GLenum index_type = GL_UNSIGNED_INT; // 0 draws without indices
+    size_t index_offset = 0;            // bytes into the element buffer
+    GLint base_vertex = 0;
+};
+
+// Collects the draws of a frame, sorts them by a 64-bit state key and
+// issues every run of packets sharing material and mesh as one instanced
+// draw. Key layout, most significant first:
+//   layer (8) | material (20) | mesh (20) | order (16)
+// so layers draw in sequence, material changes are minimized within a
+// layer and packets of a mesh end up next to each other.
+// The instance transforms of a frame are streamed through the
+// BufferManager in one upload; the shaders read them as a mat4 attribute
+// (column major) at instance_location.
+class RenderQueue
+{
+public:
+    static constexpr uint32_t MAX_MATERIALS = 1u << 20;
+    static constexpr uint32_t MAX_MESHES = 1u << 20;
+    // Returned by add_mesh() once MAX_MESHES meshes exist
+    static constexpr uint32_t NO_MESH = ~0u;
+
+    struct Batch
+    {
+        uint32_t material;
+        uint32_t mesh;
+        uint32_t first;     // into the sorted packets / instance data
+        uint32_t instances;
+    };
+
+    struct Stats
+    {
+        size_t submitted = 0;        // packets
+        size_t batches = 0;          // after merging
+        size_t issued = 0;           // draw calls that reached GL
+        size_t material_changes = 0;
+        size_t dropped = 0;          // packets whose instance data did not fit
+    };
+
+    // First of the four attribute locations of the instance transform
+    GLuint instance_location = 12;
+    // Called whenever the material changes during flush(); binds the
+    // program, textures and uniforms of `material`
+    std::function<void(uint32_t material)> bind_material;
+
+    uint32_t add_mesh(const RenderMesh& mesh);
+    RenderMesh& mesh(uint32_t handle) { return meshes_[handle]; }
+    size_t num_meshes() const { return meshes_.size(); }
+
+    static uint64_t make_key(uint32_t material, uint32_t mesh, uint8_t layer = 0, uint16_t order = 0);
+
+    void submit(uint32_t mesh, uint32_t material, const Eigen::Matrix4f& transform,
+        uint8_t layer = 0, uint16_t order = 0);
+    bool empty() const { return packets_.empty(); }
+
+    // Sorts the packets and merges them into batches (no GL calls)
+    const std::vector<Batch>& sort();
+    // sort(), then issues the batches when `buffers` is ready, and clears
+    // the queue for the next frame
+    void flush(BufferManager* buffers);
+    void clear();
+
+    const Stats& stats() const { return stats_; } // of the last flush
+
+private:
+    struct Packet
+    {
+        uint64_t key;
+        uint32_t transform;
+    };
+
+    std::vector<RenderMesh> meshes_;
+    std::vector<Packet> packets_;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> transforms_;
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> instance_data_;
+    std::vector<Batch> batches_;
+    Stats stats_;
+};
@@ -0,0 +1,305 @@
+#include "SoftwareRasterizer.h"
+#include "../util/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using Setup = SoftwareRasterizer::Setup;
+
+// transform_points() writes the positions straight into the vertices
+static_assert(sizeof(ClipVertex) == 7 * sizeof(float), "ClipVertex must be 7 packed floats");
+
+static uint32_t pack_rgba(float r, float g, float b, float a)
+{
+    auto to8 = [](float v) { return (uint32_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+    return to8(r) | (to8(g) << 8) | (to8(b) << 16) | (to8(a) << 24);
+}
+
+void Framebuffer::resize(int w, int h)
+{
+    width = std::max(w, 0);
+    height = std::max(h, 0);
+    stride = (width + RASTER_ALIGNMENT - 1) & ~(RASTER_ALIGNMENT - 1);
+    color.resize((size_t)stride * height);
+    depth.resize((size_t)stride * height);
+}
+
+void Framebuffer::clear(const Eigen::Vector4f& rgba, float clear_depth)
+{
+    std::fill(color.begin(), color.end(), pack_rgba(rgba[0], rgba[1], rgba[2], rgba[3]));
+    std::fill(depth.begin(), depth.end(), clear_depth);
+}
+
+bool Framebuffer::write_ppm(const std::string& filename) const
+{
+    FILE* f = fopen(filename.c_str(), "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", filename.c_str());
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(3 * (size_t)width);
+    bool ok = true;
+    for (int y = 0; y < height && ok; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            uint32_t c = pixel(x, y);
+            row[3 * x + 0] = (unsigned char)(c & 0xff);
+            row[3 * x + 1] = (unsigned char)((c >> 8) & 0xff);
+            row[3 * x + 2] = (unsigned char)((c >> 16) & 0xff);
+        }
+        ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+    }
+    return fclose(f) == 0 && ok;
+}
+
+void SoftwareRasterizer::setup_triangle(const ClipVertex (&tri)[3], const Framebuffer& fb,
+    const RasterState& state, Chunk& chunk)
+{
+    float sx[3], sy[3], sz[3], inv_w[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!(tri[i].w > 1e-20f))
+        {
+            return;
+        }
+        inv_w[i] = 1.0f / tri[i].w;
+        sx[i] = (tri[i].x * inv_w[i] * 0.5f + 0.5f) * (float)fb.width;
+        sy[i] = (0.5f - tri[i].y * inv_w[i] * 0.5f) * (float)fb.height;
+        sz[i] = tri[i].z * inv_w[i] * 0.5f + 0.5f;
+    }
+
+    Setup s;
+    float min_x = std::min(std::min(sx[0], sx[1]), sx[2]);
+    float max_x = std::max(std::max(sx[0], sx[1]), sx[2]);
+    float min_y = std::min(std::min(sy[0], sy[1]), sy[2]);
+    float max_y = std::max(std::max(sy[0], sy[1]), sy[2]);
+    if (max_x < 0.0f || max_y < 0.0f || min_x >= (float)fb.width || min_y >= (float)fb.height)
+    {
+        return;
+    }
+    s.min_x = std::max(0, (int)std::floor(min_x));
+    s.min_y = std::max(0, (int)std::floor(min_y));
+    s.max_x = std::min(fb.width - 1, (int)std::ceil(max_x));
+    s.max_y = std::min(fb.height - 1, (int)std::ceil(max_y));
+
+    // Edge i is opposite vertex i
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        s.A[i] = sy[j] - sy[k];
+        s.B[i] = sx[k] - sx[j];
+        s.C[i] = -s.A[i] * sx[j] - s.B[i] * sy[j];
+    }
+    float area = s.A[0] * sx[0] + s.B[0] * sy[0] + s.C[0];
+    // Counter-clockwise in NDC is clockwise (negative) once y points down
+    if (area == 0.0f || !std::isfinite(area) || (state.cull_backfaces && area > 0.0f))
+    {
+        return;
+    }
+    if (area < 0.0f)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            s.A[i] = -s.A[i];
+            s.B[i] = -s.B[i];
+            s.C[i] = -s.C[i];
+        }
+        area = -area;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        // A shared edge has opposite (A, B) in its two triangles, so
+        // exactly one of them owns the pixels lying on it
+        s.top_left[i] = s.A[i] > 0.0f || (s.A[i] == 0.0f && s.B[i] > 0.0f);
+    }
+
+    // Barycentric weight of vertex i is E_i / area; every attribute that is
+    // affine in screen space becomes a plane a x + b y + c
+    const float inv_area = 1.0f / area;
+    auto plane = [&](const float (&value)[3], float (&out)[3])
+    {
+        out[0] = out[1] = out[2] = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            float v = value[i] * inv_area;
+            out[0] += v * s.A[i];
+            out[1] += v * s.B[i];
+            out[2] += v * s.C[i];
+        }
+    };
+    plane(sz, s.z);
+    plane(inv_w, s.inv_w);
+    float r_w[3] = { tri[0].r * inv_w[0], tri[1].r * inv_w[1], tri[2].r * inv_w[2] };
+    float g_w[3] = { tri[0].g * inv_w[0], tri[1].g * inv_w[1], tri[2].g * inv_w[2] };
+    float b_w[3] = { tri[0].b * inv_w[0], tri[1].b * inv_w[1], tri[2].b * inv_w[2] };
+    plane(r_w, s.rgb_w[0]);
+    plane(g_w, s.rgb_w[1]);
+    plane(b_w, s.rgb_w[2]);
+
+    chunk.setups.push_back(s);
+    bin_triangle((uint32_t)(chunk.setups.size() - 1), chunk);
+}
+
+void SoftwareRasterizer::bin_triangle(uint32_t index, Chunk& chunk)
+{
+    const Setup& s = chunk.setups[index];
+    for (int ty = s.min_y / TILE_SIZE; ty <= s.max_y / TILE_SIZE; ++ty)
+    {
+        for (int tx = s.min_x / TILE_SIZE; tx <= s.max_x / TILE_SIZE; ++tx)
+        {
+            chunk.bins[(size_t)ty * tiles_x_ + tx].push_back(index);
+        }
+    }
+}
+
+void SoftwareRasterizer::draw(Framebuffer& fb,
+    const Eigen::Ref<const RowMatrixX3f>& V,
+    const Eigen::Ref<const RowMatrixX3u>& F,
+    const RasterState& state,
+    const float* colors,
+    const float* normals)
+{
+    auto tic = std::chrono::steady_clock::now();
+    stats_ = RasterStats();
+    stats_.triangles_submitted = (size_t)F.rows();
+    if (fb.width == 0 || fb.height == 0 || F.rows() == 0)
+    {
+        return;
+    }
+    const unsigned n_threads = threads == 0 ? hardware_threads() : threads;
+
+    // 1. Vertex stage
+    const Kernels& k = kernels();
+    const size_t nv = (size_t)V.rows();
+    const size_t vertex_block = 16384;
+    vertices_.resize(nv);
+    const Eigen::Vector3f light = state.light_dir.normalized();
+    parallel_for((nv + vertex_block - 1) / vertex_block, [&](size_t block, unsigned)
+        {
+            size_t begin = block * vertex_block, end = std::min(nv, (block + 1) * vertex_block);
+            k.transform_points(state.mvp.data(), V.data() + begin * V.outerStride(), (size_t)V.outerStride(),
+                end - begin, &vertices_[begin].x, sizeof(ClipVertex) / sizeof(float));
+            for (size_t i = begin; i < end; ++i)
+            {
+                Eigen::Vector3f rgb = state.base_color;
+                if (colors)
+                {
+                    rgb = Eigen::Vector3f(colors[3 * i], colors[3 * i + 1], colors[3 * i + 2]);
+                }
+                else if (normals)
+                {
+                    float lambert = std::fabs(Eigen::Vector3f(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]).dot(light));
+                    rgb *= 0.2f + 0.8f * lambert;
+                }
+                vertices_[i].r = rgb[0];
+                vertices_[i].g = rgb[1];
+                vertices_[i].b = rgb[2];
+            }
+        }, n_threads);
+
+    // 2. Clip, set up and bin, one contiguous triangle range per chunk
+    tiles_x_ = (fb.width + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y_ = (fb.height + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t num_tiles = (size_t)tiles_x_ * tiles_y_;
+    const size_t nt = (size_t)F.rows();
+    const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(4 * n_threads, (nt + 1023) / 1024));
+    chunks_.resize(num_chunks);
+    for (auto& chunk : chunks_)
+    {
+        chunk.setups.clear();
+        chunk.bins.resize(num_tiles);
+        for (auto& bin : chunk.bins)
+        {
+            bin.clear();
+        }
+    }
+    parallel_for(num_chunks, [&](size_t c, unsigned)
+        {
+            Chunk& chunk = chunks_[c];
+            size_t begin = nt * c / num_chunks, end = nt * (c + 1) / num_chunks;
+            for (size_t t = begin; t < end; ++t)
+            {
+                ClipVertex tri[3];
+                float d[3];
+                int inside = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    tri[k] = vertices_[F(t, k)];
+                    d[k] = tri[k].z + tri[k].w;
+                    inside += d[k] >= 0.0f;
+                }
+                if (inside == 3)
+                {
+                    setup_triangle(tri, fb, state, chunk);
+                    continue;
+                }
+                if (inside == 0)
+                {
+                    continue;
+                }
+                // Near plane clip (z + w >= 0) gives a triangle or a quad
+                ClipVertex poly[4];
+                int n = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    int l = (k + 1) % 3;
+                    if (d[k] >= 0.0f)
+                    {
+                        poly[n++] = tri[k];
+                    }
+                    if ((d[k] >= 0.0f) != (d[l] >= 0.0f))
+                    {
+                        float a = d[k] / (d[k] - d[l]);
+                        const ClipVertex& p = tri[k];
+                        const ClipVertex& q = tri[l];
+                        poly[n++] = { p.x + a * (q.x - p.x), p.y + a * (q.y - p.y), p.z + a * (q.z - p.z),
+                            p.w + a * (q.w - p.w), p.r + a * (q.r - p.r), p.g + a * (q.g - p.g), p.b + a * (q.b - p.b) };
+                    }
+                }
+                for (int k = 1; k + 1 < n; ++k)
+                {
+                    ClipVertex fan[3] = { poly[0], poly[k], poly[k + 1] };
+                    setup_triangle(fan, fb, state, chunk);
+                }
+            }
+        }, n_threads);
+
+    // 3. Rasterize tiles
+    std::vector<size_t> shaded(num_tiles, 0);
+    const RasterTarget target = fb.target();
+    parallel_for(num_tiles, [&](size_t tile, unsigned)
+        {
+            int tx0 = (int)(tile % tiles_x_) * TILE_SIZE;
+            int ty0 = (int)(tile / tiles_x_) * TILE_SIZE;
+            for (const auto& chunk : chunks_)
+            {
+                for (uint32_t index : chunk.bins[tile])
+                {
+                    shaded[tile] += k.rasterize_tile(chunk.setups[index], target, tx0, ty0, tx0 + TILE_SIZE, ty0 + TILE_SIZE);
+                }
+            }
+        }, n_threads);
+
+    for (const auto& chunk : chunks_)
+    {
+        stats_.triangles_rasterized += chunk.setups.size();
+        for (const auto& bin : chunk.bins)
+        {
+            stats_.tile_triangle_pairs += bin.size();
+        }
+    }
+    for (size_t s : shaded)
+    {
+        stats_.pixels_shaded += s;
+    }
+    stats_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+}
+
+void SoftwareRasterizer::draw(Framebuffer& fb, const MeshView& mesh, const RasterState& state)
+{
+    draw(fb, mesh.V(), mesh.F(), state, nullptr, mesh.has_normals() ? mesh.normals.data() : nullptr);
+}
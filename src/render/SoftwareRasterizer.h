@@ -0,0 +1,98 @@
+#pragma once
+
+#include "../kernels/Kernels.h"
+#include "../mesh/Mesh.h"
+#include <Eigen/Core>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU color + depth target. Rows are padded to a multiple of
+// RASTER_ALIGNMENT pixels so the rasterizer can always load and store
+// whole vectors.
+struct Framebuffer
+{
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    std::vector<uint32_t> color; // RGBA8, row 0 is the top row
+    std::vector<float> depth;    // [0, 1], 1 = far
+
+    void resize(int w, int h);
+    void clear(const Eigen::Vector4f& rgba, float clear_depth = 1.0f);
+    uint32_t pixel(int x, int y) const { return color[(size_t)y * stride + x]; }
+    RasterTarget target() { return { color.data(), depth.data(), width, height, stride }; }
+
+    // Binary PPM (P6), alpha is dropped
+    bool write_ppm(const std::string& filename) const;
+};
+
+struct RasterState
+{
+    Eigen::Matrix4f mvp = Eigen::Matrix4f::Identity();
+    Eigen::Vector3f base_color = Eigen::Vector3f(0.8f, 0.8f, 0.8f);
+    // Model-space headlight used when normals are given
+    Eigen::Vector3f light_dir = Eigen::Vector3f(0.0f, 0.0f, 1.0f);
+    bool cull_backfaces = false;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+struct RasterStats
+{
+    size_t triangles_submitted = 0;
+    size_t triangles_rasterized = 0; // after clipping and culling
+    size_t tile_triangle_pairs = 0;
+    size_t pixels_shaded = 0;        // passed coverage and early-z
+    double seconds = 0.0;
+};
+
+// Tile-binned rasterizer:
+//   1. vertices are transformed and lit in parallel,
+//   2. triangles are clipped to the near plane, set up and binned into
+//      64x64 tiles, one bin list per contiguous triangle chunk,
+//   3. tiles are rasterized in parallel; within a tile the chunks are
+//      walked in order so the output does not depend on the thread count.
+// Vertices and tiles go through kernels(), which evaluate the edge
+// functions 4 to 16 pixels at a time depending on the CPU; the depth test
+// runs before any attribute is interpolated.
+class SoftwareRasterizer
+{
+public:
+    static constexpr int TILE_SIZE = 64;
+
+    // Worker threads, 0 = one per hardware thread
+    unsigned threads = 0;
+
+    // colors and normals are optional, 3 floats per vertex. Without colors
+    // the vertices get base_color, lit by light_dir if normals are given.
+    void draw(Framebuffer& fb,
+        const Eigen::Ref<const RowMatrixX3f>& V,
+        const Eigen::Ref<const RowMatrixX3u>& F,
+        const RasterState& state,
+        const float* colors = nullptr,
+        const float* normals = nullptr);
+
+    void draw(Framebuffer& fb, const MeshView& mesh, const RasterState& state);
+
+    const RasterStats& stats() const { return stats_; }
+
+    using ClipVertex = ::ClipVertex;
+    using Setup = TriangleSetup;
+
+private:
+    struct Chunk
+    {
+        std::vector<Setup> setups;
+        std::vector<std::vector<uint32_t>> bins;
+    };
+
+    void setup_triangle(const ClipVertex (&tri)[3], const Framebuffer& fb, const RasterState& state, Chunk& chunk);
+    void bin_triangle(uint32_t index, Chunk& chunk);
+
+    std::vector<ClipVertex> vertices_;
+    std::vector<Chunk> chunks_;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+    RasterStats stats_;
+};
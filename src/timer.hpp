@@ -2,21 +2,20 @@
 #ifndef TIMER
 #define TIMER
 #include <iostream>
-#include <windows.h>   
+#include <chrono>
 class MyTimer
 {
 public:
 	inline MyTimer(void);
-	inline ~MyTimer(void);//
+	inline ~MyTimer(void);
 
 private:
-	LARGE_INTEGER start_time;
+	std::chrono::steady_clock::time_point start_time;
 
-	LARGE_INTEGER end_time;
-
-	LARGE_INTEGER CPUfrenquency;
+	std::chrono::steady_clock::time_point end_time;
 
 public:
+	// Seconds between begin() and end()
 	double interval;
 
 public:
@@ -26,7 +25,7 @@ public:
 
 inline MyTimer::MyTimer(void)
 {
-	QueryPerformanceFrequency(&CPUfrenquency);
+	interval = 0;
 }
 inline MyTimer::~MyTimer(void)
 {
@@ -34,13 +33,13 @@ inline MyTimer::~MyTimer(void)
 inline void MyTimer::begin()
 {
 	interval = 0;
-	QueryPerformanceCounter(&start_time);
+	start_time = std::chrono::steady_clock::now();
 }
 
 inline void MyTimer::end()
 {
-	QueryPerformanceCounter(&end_time);
+	end_time = std::chrono::steady_clock::now();
 
-	interval = ((double)end_time.QuadPart - (double)start_time.QuadPart) / (double)CPUfrenquency.QuadPart;
+	interval = std::chrono::duration<double>(end_time - start_time).count();
 }
-#endif
\ No newline at end of file
+#endif
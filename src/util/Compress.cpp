@@ -0,0 +1,203 @@
+#include "Compress.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    constexpr int HASH_BITS = 14;
+    constexpr size_t MIN_MATCH = 4;
+    // The last bytes are always literals, and no match starts in the last 12
+    constexpr size_t LAST_LITERALS = 5;
+    constexpr size_t MATCH_MARGIN = 12;
+    constexpr size_t MAX_OFFSET = 65535;
+
+    inline uint32_t read32(const unsigned char* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint32_t hash4(uint32_t v)
+    {
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Lengths from 15 on continue in bytes, 255 meaning more follows
+    inline unsigned char* write_length(unsigned char* op, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *op++ = 255;
+        }
+        *op++ = (unsigned char)length;
+        return op;
+    }
+
+    inline bool read_length(const unsigned char*& ip, const unsigned char* end, size_t& length)
+    {
+        unsigned char b;
+        do
+        {
+            if (ip >= end)
+            {
+                return false;
+            }
+            b = *ip++;
+            length += b;
+        } while (b == 255);
+        return true;
+    }
+}
+
+size_t lz_compress(const void* src, size_t size, void* dst, size_t capacity)
+{
+    const unsigned char* const base = (const unsigned char*)src;
+    const unsigned char* const end = base + size;
+    const unsigned char* anchor = base;
+    unsigned char* op = (unsigned char*)dst;
+    unsigned char* const op_end = op + capacity;
+
+    if (size > MATCH_MARGIN)
+    {
+        // Last position seen for each hash of 4 bytes
+        std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+        const unsigned char* const match_limit = end - MATCH_MARGIN;
+        const unsigned char* const literal_limit = end - LAST_LITERALS;
+        const unsigned char* ip = base + 1;
+        while (ip < match_limit)
+        {
+            // Step faster through data that does not match
+            const unsigned char* match = nullptr;
+            for (size_t misses = 0; ip < match_limit; ip += 1 + (misses++ >> 6))
+            {
+                const uint32_t h = hash4(read32(ip));
+                const unsigned char* candidate = base + table[h];
+                table[h] = (uint32_t)(ip - base);
+                if ((size_t)(ip - candidate) <= MAX_OFFSET && read32(candidate) == read32(ip))
+                {
+                    match = candidate;
+                    break;
+                }
+            }
+            if (!match)
+            {
+                break;
+            }
+
+            while (ip > anchor && match > base && ip[-1] == match[-1])
+            {
+                --ip;
+                --match;
+            }
+            const unsigned char* p = ip + MIN_MATCH;
+            const unsigned char* m = match + MIN_MATCH;
+            while (p < literal_limit && *p == *m)
+            {
+                ++p;
+                ++m;
+            }
+
+            const size_t literals = (size_t)(ip - anchor);
+            const size_t match_length = (size_t)(p - ip) - MIN_MATCH;
+            if ((size_t)(op_end - op) < literals + literals / 255 + match_length / 255 + 8)
+            {
+                return 0;
+            }
+            unsigned char* token = op++;
+            *token = (unsigned char)(std::min<size_t>(literals, 15) << 4 | std::min<size_t>(match_length, 15));
+            if (literals >= 15)
+            {
+                op = write_length(op, literals - 15);
+            }
+            memcpy(op, anchor, literals);
+            op += literals;
+            const size_t offset = (size_t)(ip - match);
+            *op++ = (unsigned char)offset;
+            *op++ = (unsigned char)(offset >> 8);
+            if (match_length >= 15)
+            {
+                op = write_length(op, match_length - 15);
+            }
+
+            ip = anchor = p;
+            if (ip < match_limit)
+            {
+                table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+            }
+        }
+    }
+
+    const size_t literals = (size_t)(end - anchor);
+    if ((size_t)(op_end - op) < literals + literals / 255 + 2)
+    {
+        return 0;
+    }
+    *op++ = (unsigned char)(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15)
+    {
+        op = write_length(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+    return (size_t)(op - (unsigned char*)dst);
+}
+
+bool lz_decompress(const void* src, size_t size, void* dst, size_t dst_size)
+{
+    const unsigned char* ip = (const unsigned char*)src;
+    const unsigned char* const end = ip + size;
+    unsigned char* const out = (unsigned char*)dst;
+    unsigned char* op = out;
+    unsigned char* const op_end = out + dst_size;
+    while (ip < end)
+    {
+        const unsigned token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !read_length(ip, end, literals))
+        {
+            return false;
+        }
+        if ((size_t)(end - ip) < literals || (size_t)(op_end - op) < literals)
+        {
+            return false;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == end)
+        {
+            break; // the last sequence has no match
+        }
+
+        if (end - ip < 2)
+        {
+            return false;
+        }
+        const size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !read_length(ip, end, length))
+        {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || (size_t)(op_end - op) < length)
+        {
+            return false;
+        }
+        // Overlapping copies repeat the last `offset` bytes; the distance
+        // to the source doubles with every step
+        const unsigned char* from = op - offset;
+        while (length > 0)
+        {
+            const size_t n = std::min(length, (size_t)(op - from));
+            memcpy(op, from, n);
+            op += n;
+            length -= n;
+        }
+    }
+    return op == op_end;
+}
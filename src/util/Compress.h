@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Fast byte-oriented LZ77 in the LZ4 block layout: sequences of a token,
+// literals and a 16-bit back offset, no entropy coding. Compresses at about
+// a GB/s per thread (incompressible data passes faster still) and
+// decompresses several times faster. Inputs must be smaller than 4 GB.
+
+// Largest output of lz_compress() for `size` input bytes
+inline size_t lz_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Returns the compressed size, or 0 if it does not fit in `capacity`
+size_t lz_compress(const void* src, size_t size, void* dst, size_t capacity);
+
+// Decompresses exactly `dst_size` bytes. Returns **false** on damaged input.
+bool lz_decompress(const void* src, size_t size, void* dst, size_t dst_size);
@@ -0,0 +1,144 @@
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define GV_CPU_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+const char* LEVEL_NAMES[] = { "baseline", "sse4.2", "avx2", "avx512" };
+
+// -1 until the first simd_level() call
+std::atomic<int> active_level{ -1 };
+
+#ifdef GV_CPU_X86
+void cpuid(unsigned leaf, unsigned subleaf, unsigned (&r)[4])
+{
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuidex(regs, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; ++i)
+    {
+        r[i] = (unsigned)regs[i];
+    }
+#else
+    __cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+SimdLevel detect()
+{
+    unsigned r[4];
+    cpuid(0, 0, r);
+    const unsigned max_leaf = r[0];
+    cpuid(1, 0, r);
+    const unsigned ecx1 = r[2];
+    const bool sse42 = (ecx1 >> 20 & 1) && (ecx1 >> 23 & 1);
+    if (!sse42)
+    {
+        return SimdLevel::Baseline;
+    }
+    const bool osxsave = ecx1 >> 27 & 1;
+    if (!osxsave || max_leaf < 7 || (xgetbv0() & 0x6) != 0x6)
+    {
+        return SimdLevel::SSE42;
+    }
+    cpuid(7, 0, r);
+    const unsigned ebx7 = r[1];
+    const bool avx2 = (ecx1 >> 28 & 1) && (ecx1 >> 12 & 1) && (ebx7 >> 5 & 1);
+    if (!avx2)
+    {
+        return SimdLevel::SSE42;
+    }
+    // F, DQ, BW, VL and the opmask/zmm state
+    const unsigned avx512 = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+    if ((ebx7 & avx512) != avx512 || (xgetbv0() & 0xe0) != 0xe0)
+    {
+        return SimdLevel::AVX2;
+    }
+    return SimdLevel::AVX512;
+}
+#else
+SimdLevel detect()
+{
+    return SimdLevel::Baseline;
+}
+#endif
+}
+
+SimdLevel detect_simd_level()
+{
+    static const SimdLevel level = detect();
+    return level;
+}
+
+SimdLevel simd_level()
+{
+    int level = active_level.load(std::memory_order_relaxed);
+    if (level < 0)
+    {
+        level = (int)detect_simd_level();
+        const char* cap = getenv("GLFW_VIEWER_SIMD");
+        SimdLevel parsed;
+        if (cap && parse_simd_level(cap, parsed))
+        {
+            level = std::min(level, (int)parsed);
+        }
+        else if (cap)
+        {
+            fprintf(stderr, "Error: Unknown GLFW_VIEWER_SIMD level %s\n", cap);
+        }
+        int expected = -1;
+        // A concurrent set_simd_level() wins
+        if (!active_level.compare_exchange_strong(expected, level))
+        {
+            level = expected;
+        }
+    }
+    return (SimdLevel)level;
+}
+
+void set_simd_level(SimdLevel level)
+{
+    active_level = std::min((int)level, (int)detect_simd_level());
+}
+
+const char* simd_level_name(SimdLevel level)
+{
+    return (int)level < (int)SimdLevel::Count ? LEVEL_NAMES[(int)level] : "unknown";
+}
+
+bool parse_simd_level(const char* name, SimdLevel& level)
+{
+    for (int i = 0; i < (int)SimdLevel::Count; ++i)
+    {
+        if (strcmp(name, LEVEL_NAMES[i]) == 0)
+        {
+            level = (SimdLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
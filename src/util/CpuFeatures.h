@@ -0,0 +1,30 @@
+#pragma once
+
+// Instruction set levels the hot kernels (src/kernels) are compiled for.
+// Each level includes the ones below it.
+enum class SimdLevel
+{
+    Baseline, // what the whole build targets (SSE2 on x86-64)
+    SSE42,    // SSE4.2 + POPCNT
+    AVX2,     // AVX2 + FMA
+    AVX512,   // AVX-512 F/VL/BW/DQ
+    Count
+};
+
+// Highest level this CPU and OS support (AVX state saved by the OS)
+SimdLevel detect_simd_level();
+
+// Level the kernels run at: the detected one, capped by the
+// GLFW_VIEWER_SIMD environment variable (baseline, sse4.2, avx2, avx512)
+// and by set_simd_level().
+SimdLevel simd_level();
+
+// Caps the level, e.g. to compare kernels in one process. Levels above the
+// detected one are clamped.
+void set_simd_level(SimdLevel level);
+
+const char* simd_level_name(SimdLevel level);
+
+// Accepts the names returned by simd_level_name(). Returns **false** on
+// anything else.
+bool parse_simd_level(const char* name, SimdLevel& level);
@@ -0,0 +1,72 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <cstdint>
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+LinearArena::LinearArena(size_t block_size) : block_size_(std::max<size_t>(block_size, 4096))
+{
+}
+
+void* LinearArena::allocate(size_t bytes, size_t alignment)
+{
+    for (;;)
+    {
+        if (current_ < blocks_.size())
+        {
+            Block& block = blocks_[current_];
+            // Align the address, not the offset: new[] only guarantees
+            // max_align_t
+            const uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            const size_t offset = align_up(base + offset_, alignment) - base;
+            if (offset + bytes <= block.size)
+            {
+                used_ += offset + bytes - offset_;
+                peak_ = std::max(peak_, used_);
+                offset_ = offset + bytes;
+                return block.data.get() + offset;
+            }
+            if (current_ + 1 < blocks_.size())
+            {
+                ++current_;
+                offset_ = 0;
+                continue;
+            }
+        }
+        Block block;
+        block.size = std::max(block_size_, bytes + alignment);
+        block.data.reset(new char[block.size]);
+        blocks_.push_back(std::move(block));
+        current_ = blocks_.size() - 1;
+        offset_ = 0;
+    }
+}
+
+void LinearArena::reset()
+{
+    if (blocks_.size() > 1)
+    {
+        // One block that fits the whole peak, so the next run never grows
+        Block block;
+        block.size = std::max(block_size_, align_up(peak_ + peak_ / 4, 4096));
+        block.data.reset(new char[block.size]);
+        blocks_.clear();
+        blocks_.push_back(std::move(block));
+    }
+    current_ = 0;
+    offset_ = 0;
+    used_ = 0;
+}
+
+size_t LinearArena::capacity() const
+{
+    size_t total = 0;
+    for (const Block& block : blocks_)
+    {
+        total += block.size;
+    }
+    return total;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator over a list of blocks. Nothing is freed individually;
+// reset() drops everything at once. When a run needed more than one block,
+// reset() replaces them with a single block of the peak size, so a steady
+// workload stops allocating after its first few runs.
+class LinearArena
+{
+public:
+    explicit LinearArena(size_t block_size = size_t(1) << 20);
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+    void reset();
+
+    size_t used() const { return used_; }
+    size_t capacity() const;
+    size_t peak() const { return peak_; }
+    size_t blocks() const { return blocks_.size(); }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_ = 0; // block being filled
+    size_t offset_ = 0;  // in that block
+    size_t used_ = 0;    // bytes handed out, padding included
+    size_t peak_ = 0;
+};
+
+// Per-frame scratch memory, double-buffered: what is allocated during frame
+// N stays valid until the start of frame N + 2, long enough for the next
+// frame to upload it. Only trivially destructible types may live in it
+// since nothing is destroyed.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t block_size = size_t(1) << 20) : arenas_{ LinearArena(block_size), LinearArena(block_size) } {}
+
+    // Called by Viewer::draw() at the start of every frame
+    void begin_frame()
+    {
+        current_ ^= 1;
+        arenas_[current_].reset();
+    }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        return arenas_[current_].allocate(bytes, alignment);
+    }
+
+    // Value-initialized array of n elements
+    template <typename T>
+    T* allocate_array(size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "frame arena objects are never destroyed");
+        T* p = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < n; ++i)
+        {
+            new (p + i) T();
+        }
+        return p;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "frame arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // The arena of the current frame
+    const LinearArena& current() const { return arenas_[current_]; }
+
+private:
+    LinearArena arenas_[2];
+    int current_ = 0;
+};
+
+// std allocator over a FrameArena, for containers that only live for a
+// frame. Freed memory is not reused until the arena is reset, so reserve()
+// up front rather than letting the container grow.
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(FrameArena& arena) : arena_(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+    FrameArena* arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+private:
+    FrameArena* arena_;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,101 @@
+#include "Hash.h"
+#include "Parallel.h"
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+    constexpr size_t BLOCK_SIZE = size_t(8) << 20;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t read64(const unsigned char* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+
+    inline uint64_t avalanche(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + size;
+
+    // Four independent lanes keep the multipliers busy
+    uint64_t h;
+    if (size >= 32)
+    {
+        uint64_t a = seed + P1 + P2, b = seed + P2, c = seed, d = seed - P1;
+        for (; end - p >= 32; p += 32)
+        {
+            a = round(a, read64(p));
+            b = round(b, read64(p + 8));
+            c = round(c, read64(p + 16));
+            d = round(d, read64(p + 24));
+        }
+        h = rotl(a, 1) + rotl(b, 7) + rotl(c, 12) + rotl(d, 18);
+        h = (h ^ round(0, a)) * P1;
+        h = (h ^ round(0, b)) * P1;
+        h = (h ^ round(0, c)) * P1;
+        h = (h ^ round(0, d)) * P1;
+    }
+    else
+    {
+        h = seed + P3;
+    }
+    h += (uint64_t)size;
+
+    for (; end - p >= 8; p += 8)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * P1 + P3;
+    }
+    for (; p < end; ++p)
+    {
+        h ^= (uint64_t)(*p) * P3;
+        h = rotl(h, 11) * P1;
+    }
+    return avalanche(h);
+}
+
+uint64_t hash_bytes_parallel(const void* data, size_t size, unsigned threads)
+{
+    size_t blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (blocks <= 1)
+    {
+        return hash_bytes(data, size);
+    }
+    std::vector<uint64_t> block_hashes(blocks);
+    const unsigned char* p = (const unsigned char*)data;
+    parallel_for(blocks, [&](size_t i, unsigned)
+        {
+            size_t begin = i * BLOCK_SIZE;
+            size_t bytes = std::min(BLOCK_SIZE, size - begin);
+            block_hashes[i] = hash_bytes(p + begin, bytes, i);
+        }, threads);
+    return hash_bytes(block_hashes.data(), blocks * sizeof(uint64_t), size);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fast non-cryptographic 64-bit hash, used to detect changed content
+// (mesh cache sources, snapshot chunks). Not stable across endianness.
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Same purpose for large buffers: fixed-size blocks are hashed in parallel
+// and the block hashes are hashed together. The result only depends on the
+// content, never on the thread count.
+uint64_t hash_bytes_parallel(const void* data, size_t size, unsigned threads = 0);
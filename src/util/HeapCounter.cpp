@@ -0,0 +1,128 @@
+#include "HeapCounter.h"
+
+#ifdef GLFW_VIEWER_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+thread_local HeapCounters thread_counters;
+std::atomic<uint64_t> process_allocations{ 0 };
+std::atomic<uint64_t> process_frees{ 0 };
+std::atomic<uint64_t> process_bytes{ 0 };
+
+void count_allocation(size_t size)
+{
+    ++thread_counters.allocations;
+    thread_counters.bytes += size;
+    process_allocations.fetch_add(1, std::memory_order_relaxed);
+    process_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void count_free()
+{
+    ++thread_counters.frees;
+    process_frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+void* counted_malloc(size_t size, size_t alignment)
+{
+    count_allocation(size);
+    size = size ? size : 1;
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    if (alignment <= alignof(std::max_align_t))
+    {
+        return std::malloc(size);
+    }
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+#endif
+}
+
+void counted_free(void* p)
+{
+    if (!p)
+    {
+        return;
+    }
+    count_free();
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* throwing_malloc(size_t size, size_t alignment)
+{
+    void* p = counted_malloc(size, alignment);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+}
+
+bool heap_counting_enabled()
+{
+    return true;
+}
+
+HeapCounters thread_heap_counters()
+{
+    return thread_counters;
+}
+
+HeapCounters process_heap_counters()
+{
+    return { process_allocations.load(std::memory_order_relaxed), process_frees.load(std::memory_order_relaxed),
+        process_bytes.load(std::memory_order_relaxed) };
+}
+
+void* operator new(size_t size) { return throwing_malloc(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size) { return throwing_malloc(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_malloc(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_malloc(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t al) { return throwing_malloc(size, (size_t)al); }
+void* operator new[](size_t size, std::align_val_t al) { return throwing_malloc(size, (size_t)al); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return counted_malloc(size, (size_t)al); }
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return counted_malloc(size, (size_t)al); }
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { counted_free(p); }
+
+#else
+
+bool heap_counting_enabled()
+{
+    return false;
+}
+
+HeapCounters thread_heap_counters()
+{
+    return HeapCounters();
+}
+
+HeapCounters process_heap_counters()
+{
+    return HeapCounters();
+}
+
+#endif
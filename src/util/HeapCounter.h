@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counters. With GLFW_VIEWER_COUNT_ALLOCATIONS defined
+// (cmake -DGLFW_VIEWER_COUNT_ALLOCATIONS=ON) HeapCounter.cpp replaces the
+// global operator new/delete to count every allocation; otherwise counting
+// is compiled out and the counters stay at zero.
+struct HeapCounters
+{
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0; // allocated, frees are not subtracted
+
+    HeapCounters operator-(const HeapCounters& o) const
+    {
+        return { allocations - o.allocations, frees - o.frees, bytes - o.bytes };
+    }
+};
+
+bool heap_counting_enabled();
+// Allocations made by the calling thread
+HeapCounters thread_heap_counters();
+// Allocations made by all threads
+HeapCounters process_heap_counters();
@@ -0,0 +1,341 @@
+#include "JobSystem.h"
+#include "Parallel.h"
+#include <algorithm>
+
+namespace
+{
+// Worker index of the calling thread, per system
+struct WorkerId
+{
+    const void* system = nullptr;
+    unsigned index = 0;
+};
+thread_local WorkerId this_worker;
+
+int64_t elapsed_ns(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+}
+
+TaskGraph::Task TaskGraph::add(std::function<void()> fn)
+{
+    functions_.push_back(std::move(fn));
+    return (Task)(functions_.size() - 1);
+}
+
+TaskGraph::Task TaskGraph::add(std::function<void()> fn, std::initializer_list<Task> after)
+{
+    const Task task = add(std::move(fn));
+    for (Task before : after)
+    {
+        precede(before, task);
+    }
+    return task;
+}
+
+void TaskGraph::precede(Task before, Task after)
+{
+    edges_.emplace_back(before, after);
+}
+
+void TaskGraph::clear()
+{
+    functions_.clear();
+    edges_.clear();
+}
+
+bool TaskGraph::prepare()
+{
+    const size_t n = functions_.size();
+    if (waiting_capacity_ < n)
+    {
+        waiting_capacity_ = std::max(n, 2 * waiting_capacity_);
+        waiting_.reset(new std::atomic<uint32_t>[waiting_capacity_]);
+    }
+
+    offsets_.assign(n + 1, 0);
+    scratch_.assign(n, 0);
+    for (const auto& edge : edges_)
+    {
+        if (edge.first >= n || edge.second >= n)
+        {
+            return false;
+        }
+        ++offsets_[edge.first + 1];
+        ++scratch_[edge.second];
+    }
+    for (size_t t = 0; t < n; ++t)
+    {
+        offsets_[t + 1] += offsets_[t];
+        waiting_[t].store(scratch_[t], std::memory_order_relaxed);
+    }
+    successors_.resize(edges_.size());
+    for (const auto& edge : edges_)
+    {
+        successors_[offsets_[edge.first]++] = edge.second;
+    }
+    for (size_t t = n; t > 0; --t)
+    {
+        offsets_[t] = offsets_[t - 1];
+    }
+    offsets_[0] = 0;
+
+    // Kahn's algorithm on the countdowns in scratch_: every task must
+    // become ready, otherwise run() would wait forever
+    std::vector<uint32_t>& in_degree = scratch_;
+    size_t ready = 0;
+    roots_.clear();
+    for (size_t t = 0; t < n; ++t)
+    {
+        if (in_degree[t] == 0)
+        {
+            roots_.push_back((Task)t);
+            successors_.push_back((Task)t);
+        }
+    }
+    const size_t stack = edges_.size();
+    while (successors_.size() > stack)
+    {
+        const Task t = successors_.back();
+        successors_.pop_back();
+        ++ready;
+        for (uint32_t k = offsets_[t]; k < offsets_[t + 1]; ++k)
+        {
+            const Task next = successors_[k];
+            if (--in_degree[next] == 0)
+            {
+                successors_.push_back(next);
+            }
+        }
+    }
+    remaining_.store((uint32_t)n, std::memory_order_relaxed);
+    return ready == n;
+}
+
+JobSystem::~JobSystem()
+{
+    stop();
+}
+
+void JobSystem::start(unsigned threads)
+{
+    stop();
+    if (threads == 0)
+    {
+        threads = hardware_threads();
+    }
+    stopping_ = false;
+    for (unsigned w = 0; w < threads; ++w)
+    {
+        workers_.emplace_back(new Worker());
+        workers_.back()->ring.resize(64);
+    }
+    for (unsigned w = 1; w < threads; ++w)
+    {
+        workers_[w]->thread = std::thread(&JobSystem::worker_loop, this, w);
+    }
+    reset_stats();
+}
+
+void JobSystem::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+    workers_.clear();
+    queued_ = 0;
+}
+
+unsigned JobSystem::current_worker() const
+{
+    // Threads other than the workers share the queue of worker 0
+    return this_worker.system == this ? this_worker.index : 0;
+}
+
+void JobSystem::push(unsigned worker, const Job& job)
+{
+    // Counted first so a thief never sees the count below the jobs it takes
+    queued_.fetch_add(1);
+    {
+        Worker& w = *workers_[worker];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.count == w.ring.size())
+        {
+            std::vector<Job> ring(2 * w.ring.size());
+            for (size_t i = 0; i < w.count; ++i)
+            {
+                ring[i] = w.ring[(w.head + i) & (w.ring.size() - 1)];
+            }
+            w.ring.swap(ring);
+            w.head = 0;
+        }
+        w.ring[(w.head + w.count) & (w.ring.size() - 1)] = job;
+        ++w.count;
+    }
+    if (sleepers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        wake_.notify_one();
+    }
+}
+
+bool JobSystem::pop(unsigned worker, Job& job)
+{
+    const unsigned n = (unsigned)workers_.size();
+    for (unsigned k = 0; k < n; ++k)
+    {
+        const unsigned victim = (worker + k) % n;
+        Worker& w = *workers_[victim];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (w.count == 0)
+        {
+            continue;
+        }
+        if (k == 0)
+        {
+            // Own queue: newest first
+            job = w.ring[(w.head + w.count - 1) & (w.ring.size() - 1)];
+        }
+        else
+        {
+            // Someone else's: oldest first, the far end from its owner
+            job = w.ring[w.head];
+            w.head = (w.head + 1) & (w.ring.size() - 1);
+            workers_[worker]->steals.fetch_add(1, std::memory_order_relaxed);
+        }
+        --w.count;
+        queued_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::execute(unsigned worker, const Job& job)
+{
+    TaskGraph& graph = *job.graph;
+    const auto begin = std::chrono::steady_clock::now();
+    graph.functions_[job.task]();
+    Worker& w = *workers_[worker];
+    w.busy_ns.fetch_add(elapsed_ns(begin), std::memory_order_relaxed);
+    w.tasks.fetch_add(1, std::memory_order_relaxed);
+
+    for (uint32_t k = graph.offsets_[job.task]; k < graph.offsets_[job.task + 1]; ++k)
+    {
+        const TaskGraph::Task next = graph.successors_[k];
+        if (graph.waiting_[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            push(worker, { &graph, next });
+        }
+    }
+    // Last: once remaining_ reaches zero run() returns and the graph may go
+    graph.remaining_.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::worker_loop(unsigned worker)
+{
+    this_worker = { this, worker };
+    for (;;)
+    {
+        Job job;
+        if (pop(worker, job))
+        {
+            execute(worker, job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleepers_.fetch_add(1);
+        wake_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+        sleepers_.fetch_sub(1);
+        if (stopping_)
+        {
+            return;
+        }
+    }
+}
+
+bool JobSystem::run(TaskGraph& graph)
+{
+    if (graph.empty())
+    {
+        return true;
+    }
+    if (!graph.prepare())
+    {
+        fprintf(stderr, "Error: task graph has a dependency cycle\n");
+        return false;
+    }
+    if (workers_.empty())
+    {
+        start();
+    }
+
+    const unsigned worker = current_worker();
+    // From the list made up front: the countdowns of the others may reach
+    // zero while the roots are pushed
+    for (TaskGraph::Task t : graph.roots_)
+    {
+        push(worker, { &graph, t });
+    }
+    // Help until the graph is done; the jobs taken may belong to other
+    // graphs when run() is nested
+    while (graph.remaining_.load(std::memory_order_acquire) > 0)
+    {
+        Job job;
+        if (pop(worker, job))
+        {
+            execute(worker, job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    return true;
+}
+
+std::vector<JobSystem::WorkerStats> JobSystem::stats() const
+{
+    const double wall = elapsed_ns(stats_begin_) * 1e-9;
+    std::vector<WorkerStats> stats(workers_.size());
+    for (size_t w = 0; w < workers_.size(); ++w)
+    {
+        stats[w].tasks = workers_[w]->tasks.load(std::memory_order_relaxed);
+        stats[w].steals = workers_[w]->steals.load(std::memory_order_relaxed);
+        stats[w].busy_seconds = workers_[w]->busy_ns.load(std::memory_order_relaxed) * 1e-9;
+        stats[w].utilization = wall > 0.0 ? stats[w].busy_seconds / wall : 0.0;
+    }
+    return stats;
+}
+
+void JobSystem::reset_stats()
+{
+    for (auto& worker : workers_)
+    {
+        worker->tasks = 0;
+        worker->steals = 0;
+        worker->busy_ns = 0;
+    }
+    stats_begin_ = std::chrono::steady_clock::now();
+}
+
+void JobSystem::print_stats(FILE* out) const
+{
+    const std::vector<WorkerStats> all = stats();
+    fprintf(out, "Job system: %zu workers\n", all.size());
+    for (size_t w = 0; w < all.size(); ++w)
+    {
+        fprintf(out, "  worker %zu%s: %llu tasks, %llu stolen, %.1f ms busy, %.1f%% utilization\n", w,
+            w == 0 ? " (caller)" : "", (unsigned long long)all[w].tasks, (unsigned long long)all[w].steals,
+            1000.0 * all[w].busy_seconds, 100.0 * all[w].utilization);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Tasks and the dependencies between them, built up front and run as a
+// whole by JobSystem::run(). Clearing keeps the storage, so a graph refilled
+// every frame stops allocating once it has seen its largest frame.
+class TaskGraph
+{
+public:
+    using Task = uint32_t;
+
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    Task add(std::function<void()> fn);
+    // `fn` runs once every task of `after` has finished
+    Task add(std::function<void()> fn, std::initializer_list<Task> after);
+    // `after` runs once `before` has finished
+    void precede(Task before, Task after);
+
+    void clear();
+    size_t size() const { return functions_.size(); }
+    bool empty() const { return functions_.empty(); }
+
+private:
+    friend class JobSystem;
+
+    // Successors in CSR form and the dependency countdowns, filled by
+    // JobSystem::run(). False if the dependencies have a cycle.
+    bool prepare();
+
+    std::vector<std::function<void()>> functions_;
+    std::vector<std::pair<Task, Task>> edges_;
+    std::vector<uint32_t> offsets_;
+    std::vector<Task> successors_;
+    std::vector<Task> roots_;
+    std::vector<uint32_t> scratch_;
+    std::unique_ptr<std::atomic<uint32_t>[]> waiting_;
+    size_t waiting_capacity_ = 0;
+    std::atomic<uint32_t> remaining_{ 0 };
+};
+
+// Work-stealing scheduler. Every worker takes from the back of its own queue
+// (the task it just made ready, whose inputs are still in cache) and, once
+// that runs dry, steals from the front of the others. The thread calling
+// run() works as well, so with no background threads, as on a single core,
+// everything runs inline. Tasks must not throw.
+class JobSystem
+{
+public:
+    struct WorkerStats
+    {
+        uint64_t tasks = 0;
+        uint64_t steals = 0; // tasks taken from another worker's queue
+        double busy_seconds = 0.0;
+        double utilization = 0.0; // busy share of the time since reset_stats()
+    };
+
+    JobSystem() = default;
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Starts workers for `threads` threads in total, the one calling run()
+    // included (0: all hardware threads). run() starts them on first use.
+    void start(unsigned threads = 0);
+    void stop();
+    bool started() const { return !workers_.empty(); }
+    // Background workers plus the calling thread (worker 0)
+    unsigned num_workers() const { return (unsigned)workers_.size(); }
+
+    // Runs every task of the graph in dependency order and returns once all
+    // have finished. May be called from inside a task. Returns **false**,
+    // without running anything, if the dependencies have a cycle.
+    bool run(TaskGraph& graph);
+
+    std::vector<WorkerStats> stats() const;
+    void reset_stats();
+    void print_stats(FILE* out = stdout) const;
+
+private:
+    struct Job
+    {
+        TaskGraph* graph;
+        TaskGraph::Task task;
+    };
+
+    // Ring of jobs, grown by doubling and never shrunk
+    struct Worker
+    {
+        std::mutex mutex;
+        std::vector<Job> ring;
+        size_t head = 0;
+        size_t count = 0;
+        std::thread thread;
+        std::atomic<uint64_t> tasks{ 0 };
+        std::atomic<uint64_t> steals{ 0 };
+        std::atomic<int64_t> busy_ns{ 0 };
+    };
+
+    unsigned current_worker() const;
+    void push(unsigned worker, const Job& job);
+    bool pop(unsigned worker, Job& job);
+    void execute(unsigned worker, const Job& job);
+    void worker_loop(unsigned worker);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Jobs pushed and not taken yet, across all queues
+    std::atomic<int64_t> queued_{ 0 };
+    std::atomic<int> sleepers_{ 0 };
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::chrono::steady_clock::time_point stats_begin_ = std::chrono::steady_clock::now();
+};
@@ -0,0 +1,117 @@
+#include "MappedFile.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    size_ = (size_t)file_size.QuadPart;
+    file_handle_ = file;
+    opened_ = true;
+    if (size_ == 0)
+    {
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        fprintf(stderr, "Error: Could not map %s\n", filename.c_str());
+        close();
+        return false;
+    }
+    mapping_handle_ = mapping;
+    data_ = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    size_ = (size_t)st.st_size;
+    opened_ = true;
+    if (size_ == 0)
+    {
+        ::close(fd);
+        return true;
+    }
+    void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Could not map %s\n", filename.c_str());
+        size_ = 0;
+        opened_ = false;
+        return false;
+    }
+    madvise(ptr, size_, MADV_SEQUENTIAL);
+    data_ = (const char*)ptr;
+#endif
+    if (!data_)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (data_)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_handle_)
+    {
+        CloseHandle((HANDLE)mapping_handle_);
+    }
+    if (file_handle_)
+    {
+        CloseHandle((HANDLE)file_handle_);
+    }
+    mapping_handle_ = nullptr;
+    file_handle_ = nullptr;
+#else
+    if (data_)
+    {
+        munmap((void*)data_, size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    opened_ = false;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Fixed-size slots for objects of one type, recycled through a free list.
+// Slots come in blocks of BlockSize that are never returned to the heap, so
+// once a pool has seen its peak, acquire/release never allocate. Objects
+// must be released before the pool is destroyed.
+template <typename T, size_t BlockSize = 256>
+class ObjectPool
+{
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template <typename... Args>
+    T* acquire(Args&&... args)
+    {
+        if (!free_)
+        {
+            grow();
+        }
+        Slot* slot = free_;
+        free_ = slot->next;
+        ++live_;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+
+    void release(T* object)
+    {
+        if (!object)
+        {
+            return;
+        }
+        object->~T();
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->next = free_;
+        free_ = slot;
+        --live_;
+    }
+
+    // Makes room for `count` live objects without further allocation
+    void reserve(size_t count)
+    {
+        while (capacity() < count)
+        {
+            grow();
+        }
+    }
+
+    size_t live() const { return live_; }
+    size_t capacity() const { return blocks_.size() * BlockSize; }
+
+private:
+    union Slot
+    {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    void grow()
+    {
+        blocks_.emplace_back(new Slot[BlockSize]);
+        Slot* block = blocks_.back().get();
+        for (size_t i = BlockSize; i-- > 0;)
+        {
+            block[i].next = free_;
+            free_ = &block[i];
+        }
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> blocks_;
+    Slot* free_ = nullptr;
+    size_t live_ = 0;
+};
+
+// One ObjectPool per type, created on first use
+class PoolSet
+{
+public:
+    template <typename T>
+    ObjectPool<T>& get()
+    {
+        auto& pool = pools_[std::type_index(typeid(T))];
+        if (!pool)
+        {
+            pool.reset(new Holder<T>());
+        }
+        return static_cast<Holder<T>*>(pool.get())->pool;
+    }
+
+private:
+    struct HolderBase
+    {
+        virtual ~HolderBase() = default;
+    };
+    template <typename T>
+    struct Holder : HolderBase
+    {
+        ObjectPool<T> pool;
+    };
+
+    std::unordered_map<std::type_index, std::unique_ptr<HolderBase>> pools_;
+};
@@ -0,0 +1,277 @@
+#include "PageCache.h"
+#include <algorithm>
+
+PageCache::~PageCache()
+{
+    stop();
+}
+
+void PageCache::reset(size_t num_pages)
+{
+    stop();
+    for (uint32_t page = lru_front_; page != NONE; page = entries_[page].next)
+    {
+        if (evicted)
+        {
+            evicted(page);
+        }
+    }
+    entries_.clear();
+    entries_.resize(num_pages);
+    lru_front_ = lru_back_ = NONE;
+    incoming_.clear();
+    stats_.resident_pages = 0;
+    stats_.resident_bytes = 0;
+    stats_.queued = 0;
+
+    stopping_ = false;
+    for (unsigned t = 0; t < std::max(1u, threads) && num_pages > 0; ++t)
+    {
+        loaders_.emplace_back(&PageCache::loader, this);
+    }
+}
+
+void PageCache::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        queue_.clear();
+    }
+    wake_.notify_all();
+    for (auto& thread : loaders_)
+    {
+        thread.join();
+    }
+    loaders_.clear();
+    in_flight_.clear();
+    completed_.clear();
+}
+
+void PageCache::request(uint32_t page, float priority)
+{
+    Entry& entry = entries_[page];
+    if (entry.requested_frame != frame_)
+    {
+        entry.requested_frame = frame_;
+        incoming_.push_back({ priority, page });
+    }
+}
+
+const std::vector<char>* PageCache::acquire(uint32_t page, float priority)
+{
+    if (page >= entries_.size())
+    {
+        return nullptr;
+    }
+    Entry& entry = entries_[page];
+    if (entry.state == State::Failed)
+    {
+        return nullptr;
+    }
+    if (entry.state == State::Resident)
+    {
+        ++stats_.hits;
+        entry.used_frame = frame_;
+        unlink(page);
+        link_front(page);
+        return &entry.data;
+    }
+    if (!entry.missed)
+    {
+        entry.missed = true;
+        ++stats_.misses;
+    }
+    request(page, priority);
+    return nullptr;
+}
+
+void PageCache::prefetch(uint32_t page, float priority)
+{
+    if (page >= entries_.size() || entries_[page].state != State::Absent)
+    {
+        return;
+    }
+    Entry& entry = entries_[page];
+    if (!entry.missed)
+    {
+        entry.missed = true;
+        ++stats_.prefetches;
+    }
+    request(page, priority);
+}
+
+void PageCache::link_front(uint32_t page)
+{
+    Entry& entry = entries_[page];
+    entry.prev = NONE;
+    entry.next = lru_front_;
+    if (lru_front_ != NONE)
+    {
+        entries_[lru_front_].prev = page;
+    }
+    lru_front_ = page;
+    if (lru_back_ == NONE)
+    {
+        lru_back_ = page;
+    }
+}
+
+void PageCache::unlink(uint32_t page)
+{
+    Entry& entry = entries_[page];
+    (entry.prev != NONE ? entries_[entry.prev].next : lru_front_) = entry.next;
+    (entry.next != NONE ? entries_[entry.next].prev : lru_back_) = entry.prev;
+    entry.prev = entry.next = NONE;
+}
+
+void PageCache::evict(uint32_t page)
+{
+    Entry& entry = entries_[page];
+    if (evicted)
+    {
+        evicted(page);
+    }
+    unlink(page);
+    stats_.resident_bytes -= entry.data.size();
+    --stats_.resident_pages;
+    ++stats_.evictions;
+    std::vector<char>().swap(entry.data);
+    entry.state = State::Absent;
+    entry.missed = false;
+}
+
+size_t PageCache::update()
+{
+    std::vector<Loaded> completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed.swap(completed_);
+    }
+    size_t taken = 0;
+    for (Loaded& loaded : completed)
+    {
+        Entry& entry = entries_[loaded.page];
+        if (entry.state == State::Resident)
+        {
+            continue;
+        }
+        if (!loaded.ok)
+        {
+            // A damaged page would fail the same way on every request
+            entry.state = State::Failed;
+            ++stats_.failed;
+            continue;
+        }
+        entry.data = std::move(loaded.data);
+        entry.state = State::Resident;
+        entry.missed = false;
+        // Counts as used now: it was wanted in the last frame or two
+        entry.used_frame = frame_;
+        link_front(loaded.page);
+        ++taken;
+        ++stats_.loads;
+        ++stats_.resident_pages;
+        stats_.resident_bytes += entry.data.size();
+        stats_.bytes_loaded += entry.data.size();
+        rate_bytes_ += entry.data.size();
+    }
+
+    // Down to the budget, or below it when pages are waiting to come in (no
+    // new load starts at the budget)
+    auto over_budget = [&]()
+    {
+        return stats_.resident_bytes > budget || (stats_.resident_bytes == budget && !incoming_.empty());
+    };
+    while (over_budget() && lru_back_ != NONE && entries_[lru_back_].used_frame < frame_)
+    {
+        evict(lru_back_);
+    }
+
+    // Highest priority last, where the loaders take from
+    std::sort(incoming_.begin(), incoming_.end(),
+        [](const Request& a, const Request& b) { return a.priority < b.priority; });
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+        if (stats_.resident_bytes < budget)
+        {
+            for (const Request& r : incoming_)
+            {
+                if (entries_[r.page].state == State::Absent
+                    && std::find(in_flight_.begin(), in_flight_.end(), r.page) == in_flight_.end()
+                    && std::none_of(completed_.begin(), completed_.end(),
+                        [&](const Loaded& l) { return l.page == r.page; }))
+                {
+                    queue_.push_back(r);
+                }
+            }
+        }
+        stats_.queued = queue_.size();
+    }
+    incoming_.clear();
+    if (stats_.queued > 0)
+    {
+        wake_.notify_all();
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - rate_begin_).count();
+    if (elapsed >= 1.0)
+    {
+        stats_.bytes_per_second = (double)rate_bytes_ / elapsed;
+        rate_bytes_ = 0;
+        rate_begin_ = now;
+    }
+    ++frame_;
+    return taken;
+}
+
+void PageCache::loader()
+{
+    std::vector<char> data;
+    for (;;)
+    {
+        Request r;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+            {
+                return;
+            }
+            r = queue_.back();
+            queue_.pop_back();
+            in_flight_.push_back(r.page);
+        }
+
+        data.clear();
+        const bool ok = load && load(r.page, data);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            in_flight_.erase(std::find(in_flight_.begin(), in_flight_.end(), r.page));
+            completed_.push_back({ r.page, ok, std::move(data) });
+        }
+        data = std::vector<char>();
+        if (notify)
+        {
+            notify();
+        }
+    }
+}
+
+PageCacheStats PageCache::stats() const
+{
+    return stats_;
+}
+
+void PageCache::reset_stats()
+{
+    const size_t pages = stats_.resident_pages, bytes = stats_.resident_bytes, queued = stats_.queued;
+    stats_ = PageCacheStats();
+    stats_.resident_pages = pages;
+    stats_.resident_bytes = bytes;
+    stats_.queued = queued;
+    rate_bytes_ = 0;
+    rate_begin_ = std::chrono::steady_clock::now();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct PageCacheStats
+{
+    uint64_t hits = 0;       // acquire() of a resident page
+    uint64_t misses = 0;     // pages acquire() found absent, once per absence
+    uint64_t prefetches = 0; // pages prefetch() found absent, once per absence
+    uint64_t loads = 0;
+    uint64_t failed = 0;     // pages that could not be loaded, once each
+    uint64_t evictions = 0;
+    uint64_t bytes_loaded = 0;
+    size_t resident_pages = 0;
+    size_t resident_bytes = 0;
+    size_t queued = 0;             // requests handed to the loaders by the last update()
+    double bytes_per_second = 0.0; // paged in, over the last second or so
+
+    double hit_rate() const { return hits + misses > 0 ? (double)hits / (double)(hits + misses) : 0.0; }
+};
+
+// Fixed-budget cache of variable-size pages (octree nodes, mesh clusters)
+// filled by background loader threads. Every frame the render thread asks
+// for the pages it needs: resident ones are returned and move to the front
+// of the LRU list, absent ones are queued by priority, highest first.
+// Requests not renewed before the next update() are dropped, so the queue
+// always follows the current view. update() takes over the finished loads
+// and evicts least recently used pages above the budget, never one used in
+// the current frame; while the pages in use alone exceed the budget no new
+// loads start. A page whose load fails is not requested again until the
+// next reset().
+class PageCache
+{
+public:
+    size_t budget = size_t(512) << 20;
+    // Loader threads, started by reset()
+    unsigned threads = 1;
+    // Reads `page` into `data`; runs on a loader thread
+    std::function<bool(uint32_t page, std::vector<char>& data)> load;
+    // Called by update() on the render thread for every page it evicts
+    std::function<void(uint32_t page)> evicted;
+    // Called from a loader thread when a load is done, failed or not, e.g.
+    // to wake up an event loop: update() takes it over in the next frame
+    std::function<void()> notify;
+
+    PageCache() = default;
+    ~PageCache();
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    // Drops every page and sizes the cache for pages [0, num_pages)
+    void reset(size_t num_pages);
+    // Waits for the loads in flight and stops the loader threads
+    void stop();
+
+    // Data of a resident page. Null if the page is not resident; it is then
+    // requested at `priority`. A page acquired in a frame is not evicted by
+    // that frame's update(), so the data stays valid until the update() of
+    // the frame after.
+    const std::vector<char>* acquire(uint32_t page, float priority);
+    // Requests a page ahead of use; nothing happens if it is resident or failed
+    void prefetch(uint32_t page, float priority);
+    bool resident(uint32_t page) const { return page < entries_.size() && entries_[page].state == State::Resident; }
+    bool failed(uint32_t page) const { return page < entries_.size() && entries_[page].state == State::Failed; }
+
+    // Once per frame, after the pages of the frame have been acquired.
+    // Returns the loaded pages it made resident, which the next frame can use.
+    size_t update();
+
+    PageCacheStats stats() const;
+    void reset_stats();
+
+private:
+    static constexpr uint32_t NONE = ~0u;
+
+    enum class State : uint8_t
+    {
+        Absent, Resident, Failed
+    };
+
+    struct Entry
+    {
+        std::vector<char> data;
+        State state = State::Absent;
+        bool missed = false;        // counted since it went absent
+        uint32_t prev = NONE;       // LRU list, front = most recent
+        uint32_t next = NONE;
+        uint64_t used_frame = 0;
+        uint64_t requested_frame = 0;
+    };
+
+    struct Request
+    {
+        float priority;
+        uint32_t page;
+    };
+
+    struct Loaded
+    {
+        uint32_t page;
+        bool ok;
+        std::vector<char> data;
+    };
+
+    void request(uint32_t page, float priority);
+    void link_front(uint32_t page);
+    void unlink(uint32_t page);
+    void evict(uint32_t page);
+    void loader();
+
+    std::vector<Entry> entries_;
+    uint32_t lru_front_ = NONE;
+    uint32_t lru_back_ = NONE;
+    uint64_t frame_ = 1;
+    std::vector<Request> incoming_; // this frame's requests, render thread only
+    PageCacheStats stats_;
+
+    // Shared with the loaders
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<Request> queue_;      // ascending priority, taken from the back
+    std::vector<uint32_t> in_flight_; // being loaded
+    std::vector<Loaded> completed_;
+    std::vector<std::thread> loaders_;
+    bool stopping_ = false;
+
+    std::chrono::steady_clock::time_point rate_begin_ = std::chrono::steady_clock::now();
+    uint64_t rate_bytes_ = 0;
+};
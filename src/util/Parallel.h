@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller passes 0.
+inline unsigned hardware_threads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+// Runs fn(task, worker) for every task in [0, count) on up to `threads`
+// threads. Tasks are handed out in order, one at a time, so uneven tasks
+// still balance. The calling thread takes part as worker 0.
+template <typename Fn>
+void parallel_for(size_t count, Fn&& fn, unsigned threads = 0)
+{
+    if (threads == 0)
+    {
+        threads = hardware_threads();
+    }
+    threads = (unsigned)std::min<size_t>(threads, count);
+    if (threads <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            fn(i, 0u);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next{ 0 };
+    auto work = [&](unsigned worker)
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            fn(i, worker);
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        pool.emplace_back(work, t);
+    }
+    work(0);
+    for (auto& thread : pool)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <span>
+
+// Non-owning view of a contiguous array
+template <typename T>
+using Span = std::span<T>;
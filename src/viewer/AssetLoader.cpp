@@ -0,0 +1,213 @@
+#include "AssetLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+AssetLoader::~AssetLoader()
+{
+    stop();
+}
+
+std::shared_ptr<Asset> AssetLoader::request(const std::string& filename, bool only_vertices)
+{
+    auto asset = std::make_shared<Asset>();
+    asset->filename = filename;
+    asset->only_vertices = only_vertices;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = false;
+        queue_.push_back(asset);
+        ++in_flight_;
+        ++stats_.requested;
+        if (workers_.empty())
+        {
+            for (unsigned t = 0; t < std::max(1u, threads); ++t)
+            {
+                workers_.emplace_back(&AssetLoader::worker, this);
+            }
+        }
+    }
+    wake_.notify_one();
+    return asset;
+}
+
+void AssetLoader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        in_flight_ -= queue_.size();
+        queue_.clear();
+    }
+    wake_.notify_all();
+    for (auto& thread : workers_)
+    {
+        thread.join();
+    }
+    workers_.clear();
+}
+
+void AssetLoader::release(BufferManager* buffers, Asset& asset)
+{
+    if (buffers)
+    {
+        buffers->free_static(asset.positions);
+        buffers->free_static(asset.normals);
+        buffers->free_static(asset.uvs);
+        buffers->free_static(asset.indices);
+    }
+    asset.positions = asset.normals = asset.uvs = asset.indices = BufferSlice();
+}
+
+void AssetLoader::discard(BufferManager* buffers)
+{
+    for (auto& asset : uploads_)
+    {
+        release(buffers, *asset);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_ -= uploads_.size() + completed_.size();
+    uploads_.clear();
+    completed_.clear();
+}
+
+void AssetLoader::worker()
+{
+    for (;;)
+    {
+        std::shared_ptr<Asset> asset;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+            {
+                return;
+            }
+            asset = queue_.front();
+            queue_.pop_front();
+            asset->state = Asset::State::Loading;
+        }
+
+        auto tic = std::chrono::steady_clock::now();
+        const bool ok = load && load(*asset);
+        asset->load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            asset->state = ok ? Asset::State::Uploading : Asset::State::Failed;
+            ++(ok ? stats_.loaded : stats_.failed);
+            completed_.push_back(std::move(asset));
+        }
+        if (notify)
+        {
+            notify();
+        }
+    }
+}
+
+void AssetLoader::update(BufferManager* buffers, std::vector<std::shared_ptr<Asset>>& finished)
+{
+    std::vector<std::shared_ptr<Asset>> completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed.swap(completed_);
+    }
+    const bool gpu = buffers && buffers->ready();
+    size_t handed_out = 0;
+    for (auto& asset : completed)
+    {
+        if (asset->state == Asset::State::Failed)
+        {
+            finished.push_back(std::move(asset));
+            ++handed_out;
+            continue;
+        }
+        if (gpu)
+        {
+            // Only the space is reserved here; the data follows under budget
+            const MeshView& v = asset->view;
+            asset->positions = buffers->allocate_static(v.positions.size_bytes());
+            asset->normals = buffers->allocate_static(v.normals.size_bytes());
+            asset->uvs = buffers->allocate_static(v.uvs.size_bytes());
+            asset->indices = buffers->allocate_static(v.indices.size_bytes());
+            asset->upload_bytes = v.positions.size_bytes() + v.normals.size_bytes() + v.uvs.size_bytes()
+                + v.indices.size_bytes();
+        }
+        uploads_.push_back(std::move(asset));
+    }
+
+    size_t budget = upload_budget ? upload_budget : SIZE_MAX;
+    size_t uploaded = 0;
+    while (!uploads_.empty())
+    {
+        Asset& asset = *uploads_.front();
+        const size_t before = asset.uploaded_bytes;
+        const bool done = !gpu || upload(buffers, asset, budget);
+        uploaded += asset.uploaded_bytes - before;
+        ++asset.upload_frames;
+        if (!done)
+        {
+            break;
+        }
+        asset.state = Asset::State::Ready;
+        finished.push_back(std::move(uploads_.front()));
+        uploads_.pop_front();
+        ++handed_out;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_ -= handed_out;
+    stats_.bytes_uploaded = uploaded;
+}
+
+bool AssetLoader::upload(BufferManager* buffers, Asset& asset, size_t& budget)
+{
+    struct Stream
+    {
+        const void* data;
+        size_t bytes;
+        const BufferSlice& slice;
+    };
+    const MeshView& v = asset.view;
+    const Stream streams[] = {
+        { v.positions.data(), v.positions.size_bytes(), asset.positions },
+        { v.normals.data(), v.normals.size_bytes(), asset.normals },
+        { v.uvs.data(), v.uvs.size_bytes(), asset.uvs },
+        { v.indices.data(), v.indices.size_bytes(), asset.indices } };
+
+    // uploaded_bytes runs over the streams back to back
+    size_t first = 0;
+    for (const Stream& stream : streams)
+    {
+        const size_t end = first + stream.bytes;
+        if (asset.uploaded_bytes < end)
+        {
+            if (budget == 0)
+            {
+                return false;
+            }
+            const size_t offset = asset.uploaded_bytes - first;
+            const size_t bytes = std::min(budget, stream.bytes - offset);
+            buffers->update(stream.slice, static_cast<const char*>(stream.data) + offset, bytes, offset);
+            asset.uploaded_bytes += bytes;
+            budget -= bytes;
+            if (asset.uploaded_bytes < end)
+            {
+                return false;
+            }
+        }
+        first = end;
+    }
+    return true;
+}
+
+size_t AssetLoader::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+AssetLoader::Stats AssetLoader::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../mesh/Mesh.h"
+#include "../render/BufferManager.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ViewerPlugin;
+
+// A file loaded in the background. A plugin fills `mesh` / `view` (and
+// whatever it needs in `payload`) on a loader thread; the render thread then
+// uploads the view's streams and hands the asset back to that plugin.
+struct Asset
+{
+    enum class State
+    {
+        Queued, Loading, Uploading, Ready, Failed
+    };
+
+    std::string filename;
+    bool only_vertices = false;
+    // The plugin that took the file
+    ViewerPlugin* plugin = nullptr;
+
+    // Geometry to upload; `view` points into `mesh` or into `payload`
+    MeshData mesh;
+    MeshView view;
+    std::shared_ptr<void> payload;
+
+    // GPU copies of the view's streams, invalid without a buffer manager.
+    // Whoever takes the asset over owns them.
+    BufferSlice positions;
+    BufferSlice normals;
+    BufferSlice uvs;
+    BufferSlice indices;
+
+    State state = State::Queued;
+    size_t upload_bytes = 0;
+    size_t uploaded_bytes = 0;
+    int upload_frames = 0;
+    double load_seconds = 0.0;
+
+    float progress() const { return upload_bytes ? (float)uploaded_bytes / upload_bytes : 1.0f; }
+};
+
+// Loads files on background threads and uploads them to the GPU a slice at
+// a time, so the render thread never blocks on a load:
+//  - request() queues a file (any thread),
+//  - a loader thread runs `load` on it, then moves it to the completion queue,
+//  - update(), once per frame on the render thread, takes the completed
+//    assets and uploads at most upload_budget bytes over all of them.
+// Assets come out of update() in completion order once fully uploaded.
+class AssetLoader
+{
+public:
+    struct Stats
+    {
+        size_t requested = 0;
+        size_t loaded = 0;
+        size_t failed = 0;
+        size_t bytes_uploaded = 0; // last update()
+    };
+
+    // Loader threads, started with the first request. Loads are parallel
+    // internally, so one is usually enough.
+    unsigned threads = 1;
+    // Bytes uploaded per frame over all assets
+    size_t upload_budget = size_t(8) << 20;
+
+    // Runs on a loader thread; returns **false** if the file could not be
+    // loaded
+    std::function<bool(Asset& asset)> load;
+    // Called from a loader thread when an asset is done loading, e.g. to
+    // wake up an event loop
+    std::function<void()> notify;
+
+    AssetLoader() = default;
+    ~AssetLoader();
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    std::shared_ptr<Asset> request(const std::string& filename, bool only_vertices = false);
+    // Drops the queued requests and waits for the loads in flight
+    void stop();
+    // After stop(): releases the GPU space of the assets not handed out yet
+    void discard(BufferManager* buffers);
+    // Frees the GPU copies of an asset nobody took over
+    static void release(BufferManager* buffers, Asset& asset);
+
+    // Appends the assets that became ready or failed to `finished`
+    void update(BufferManager* buffers, std::vector<std::shared_ptr<Asset>>& finished);
+
+    // Requests not handed out by update() yet
+    size_t pending() const;
+    // Loaded assets waiting for upload budget
+    size_t uploading() const { return uploads_.size(); }
+    Stats stats() const;
+
+private:
+    void worker();
+    bool upload(BufferManager* buffers, Asset& asset, size_t& budget);
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::shared_ptr<Asset>> queue_;
+    std::vector<std::shared_ptr<Asset>> completed_;
+    std::vector<std::thread> workers_;
+    size_t in_flight_ = 0;
+    bool stopping_ = false;
+    Stats stats_;
+
+    // Render thread only
+    std::deque<std::shared_ptr<Asset>> uploads_;
+};
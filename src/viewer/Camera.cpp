@@ -0,0 +1,197 @@
+#include "Camera.h"
+#include <algorithm>
+#include <cmath>
+
+static const float PI = 3.14159265358979f;
+// Below these the pose snaps to its target and the inertia stops
+static const float ANGLE_EPSILON = 1e-5f;
+static const float RELATIVE_EPSILON = 1e-5f;
+// Inertia below this (rad/s, distances/s) is not worth another frame
+static const float VELOCITY_EPSILON = 1e-3f;
+
+// Point on the virtual trackball (sphere blended into a hyperbolic sheet)
+static Eigen::Vector3f trackball_point(int x, int y, int width, int height)
+{
+    const float size = (float)std::max(1, std::min(width, height));
+    const float px = (2.0f * x - width) / size;
+    const float py = (height - 2.0f * y) / size;
+    const float r2 = px * px + py * py;
+    const float pz = r2 <= 0.5f ? std::sqrt(1.0f - r2) : 0.5f / std::sqrt(r2);
+    return Eigen::Vector3f(px, py, pz).normalized();
+}
+
+Camera::Camera()
+{
+    set_pose(Eigen::Quaternionf::Identity(), Eigen::Vector3f::Zero(), 5.0f);
+}
+
+void Camera::fit(const Eigen::AlignedBox3f& box)
+{
+    if (box.isEmpty())
+    {
+        return;
+    }
+    const float radius = std::max(0.5f * box.diagonal().norm(), 1e-6f);
+    const float half_fov = 0.5f * fov_y_degrees * PI / 180.0f;
+    const float distance = radius / std::sin(half_fov);
+    near_plane = std::max(distance - radius, distance * 1e-3f) * 0.5f;
+    far_plane = (distance + radius) * 2.0f;
+    set_pose(target_rotation_, box.center(), distance);
+}
+
+void Camera::set_pose(const Eigen::Quaternionf& rotation, const Eigen::Vector3f& pivot, float distance)
+{
+    rotation_ = target_rotation_ = last_target_rotation_ = rotation.normalized();
+    pivot_ = target_pivot_ = last_target_pivot_ = pivot;
+    distance_ = target_distance_ = distance;
+    stop();
+}
+
+void Camera::grab()
+{
+    // Catching a coasting camera stops it where the target is
+    dragging_ = true;
+    angular_velocity_.setZero();
+    pan_velocity_.setZero();
+    last_target_rotation_ = target_rotation_;
+    last_target_pivot_ = target_pivot_;
+}
+
+void Camera::rotate_to(const Eigen::Quaternionf& down_rotation, int down_x, int down_y, int x, int y,
+    int width, int height)
+{
+    Eigen::AngleAxisf delta(Eigen::Quaternionf::FromTwoVectors(
+        trackball_point(down_x, down_y, width, height), trackball_point(x, y, width, height)));
+    delta.angle() *= rotation_speed;
+    target_rotation_ = (Eigen::Quaternionf(delta) * down_rotation).normalized();
+}
+
+void Camera::pan_to(const Eigen::Vector3f& down_pivot, float down_distance, int dx, int dy, int height)
+{
+    // World units per pixel at the pivot depth
+    const float scale = 2.0f * down_distance * std::tan(0.5f * fov_y_degrees * PI / 180.0f)
+        / (float)std::max(1, height);
+    const Eigen::Quaternionf to_world = target_rotation_.conjugate();
+    target_pivot_ = down_pivot + scale * (dy * (to_world * Eigen::Vector3f::UnitY())
+        - dx * (to_world * Eigen::Vector3f::UnitX()));
+}
+
+void Camera::zoom_to(float down_distance, int dy, int height)
+{
+    target_distance_ = down_distance * std::exp(4.0f * dy / (float)std::max(1, height));
+}
+
+void Camera::release()
+{
+    dragging_ = false;
+}
+
+void Camera::zoom_by(float steps)
+{
+    target_distance_ = std::min(std::max(target_distance_ * std::pow(1.0f - zoom_speed, steps), 1e-6f), 1e9f);
+}
+
+void Camera::stop()
+{
+    angular_velocity_.setZero();
+    pan_velocity_.setZero();
+    dragging_ = false;
+}
+
+bool Camera::update(float dt)
+{
+    if (dt <= 0.0f)
+    {
+        return is_moving();
+    }
+    // After an idle wait the first step would jump
+    dt = std::min(dt, 0.05f);
+
+    if (dragging_)
+    {
+        // Track how fast the targets move to coast on after the release
+        const float blend = 1.0f - std::exp(-20.0f * dt);
+        Eigen::AngleAxisf step(target_rotation_ * last_target_rotation_.conjugate());
+        if (step.angle() > PI)
+        {
+            step.angle() -= 2.0f * PI;
+        }
+        angular_velocity_ += blend * (step.axis() * (step.angle() / dt) - angular_velocity_);
+        pan_velocity_ += blend * ((target_pivot_ - last_target_pivot_) / dt - pan_velocity_);
+        last_target_rotation_ = target_rotation_;
+        last_target_pivot_ = target_pivot_;
+    }
+    else if (damping > 0.0f)
+    {
+        const float speed = angular_velocity_.norm();
+        if (speed * dt > 0.0f)
+        {
+            target_rotation_ = (Eigen::Quaternionf(Eigen::AngleAxisf(speed * dt, angular_velocity_ / speed))
+                * target_rotation_).normalized();
+        }
+        target_pivot_ += pan_velocity_ * dt;
+        const float decay = std::exp(-damping * dt);
+        angular_velocity_ *= decay;
+        pan_velocity_ *= decay;
+        if (angular_velocity_.norm() < VELOCITY_EPSILON
+            && pan_velocity_.norm() < VELOCITY_EPSILON * target_distance_)
+        {
+            angular_velocity_.setZero();
+            pan_velocity_.setZero();
+        }
+    }
+    else
+    {
+        angular_velocity_.setZero();
+        pan_velocity_.setZero();
+    }
+
+    const float alpha = 1.0f - std::exp(-smoothing * dt);
+    rotation_ = rotation_.slerp(alpha, target_rotation_).normalized();
+    pivot_ += alpha * (target_pivot_ - pivot_);
+    distance_ *= std::pow(target_distance_ / distance_, alpha);
+
+    if (rotation_.angularDistance(target_rotation_) < ANGLE_EPSILON)
+    {
+        rotation_ = target_rotation_;
+    }
+    if ((pivot_ - target_pivot_).norm() < RELATIVE_EPSILON * distance_)
+    {
+        pivot_ = target_pivot_;
+    }
+    if (std::abs(distance_ - target_distance_) < RELATIVE_EPSILON * target_distance_)
+    {
+        distance_ = target_distance_;
+    }
+    return is_moving();
+}
+
+bool Camera::is_moving() const
+{
+    const bool coasting = !dragging_ && (!angular_velocity_.isZero(0.0f) || !pan_velocity_.isZero(0.0f));
+    return coasting || !(rotation_.coeffs() == target_rotation_.coeffs()) || pivot_ != target_pivot_
+        || distance_ != target_distance_;
+}
+
+Eigen::Matrix4f Camera::view_matrix() const
+{
+    // translate(0, 0, -distance) * rotation * translate(-pivot)
+    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+    const Eigen::Matrix3f R = rotation_.toRotationMatrix();
+    view.topLeftCorner<3, 3>() = R;
+    view.topRightCorner<3, 1>() = Eigen::Vector3f(0.0f, 0.0f, -distance_) - R * pivot_;
+    return view;
+}
+
+Eigen::Matrix4f Camera::projection_matrix(int width, int height) const
+{
+    const float aspect = (float)std::max(1, width) / (float)std::max(1, height);
+    const float f = 1.0f / std::tan(0.5f * fov_y_degrees * PI / 180.0f);
+    Eigen::Matrix4f proj = Eigen::Matrix4f::Zero();
+    proj(0, 0) = f / aspect;
+    proj(1, 1) = f;
+    proj(2, 2) = (far_plane + near_plane) / (near_plane - far_plane);
+    proj(2, 3) = 2.0f * far_plane * near_plane / (near_plane - far_plane);
+    proj(3, 2) = -1.0f;
+    return proj;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+// Orbit camera: the eye looks at `pivot` from `distance`, oriented by
+// `rotation`. Input only moves the targets (rotate_to, pan_to, zoom_by...);
+// update() then eases the pose towards them once per frame with an
+// exponential filter and, after a drag is released, keeps the last drag
+// velocity decaying with `damping`. All rates are per second, so the motion
+// does not depend on the frame or input event rate. Only fixed-size Eigen
+// types are used, nothing here allocates.
+class Camera
+{
+public:
+    // Viewer::update_camera() drives the view/proj matrices when enabled
+    bool enabled = true;
+
+    float fov_y_degrees = 45.0f;
+    float near_plane = 0.01f;
+    float far_plane = 1000.0f;
+
+    float rotation_speed = 2.0f;
+    // Fraction of the distance per scroll step
+    float zoom_speed = 0.1f;
+    // How fast the pose follows its target, 1/s
+    float smoothing = 25.0f;
+    // How fast the inertia dies out after a release, 1/s (0 = no inertia)
+    float damping = 4.0f;
+
+    Camera();
+
+    // Looks at the whole box and stops any motion
+    void fit(const Eigen::AlignedBox3f& box);
+    void set_pose(const Eigen::Quaternionf& rotation, const Eigen::Vector3f& pivot, float distance);
+
+    // Drag input in framebuffer pixels, relative to where the drag started
+    void grab();
+    void rotate_to(const Eigen::Quaternionf& down_rotation, int down_x, int down_y, int x, int y,
+        int width, int height);
+    void pan_to(const Eigen::Vector3f& down_pivot, float down_distance, int dx, int dy, int height);
+    void zoom_to(float down_distance, int dy, int height);
+    void release();
+    // Scroll steps, positive zooms in
+    void zoom_by(float steps);
+    void stop();
+
+    // Advances the pose by dt seconds; returns is_moving()
+    bool update(float dt);
+    // Still converging or coasting; the viewer keeps drawing meanwhile
+    bool is_moving() const;
+
+    Eigen::Matrix4f view_matrix() const;
+    Eigen::Matrix4f projection_matrix(int width, int height) const;
+
+    const Eigen::Quaternionf& rotation() const { return rotation_; }
+    const Eigen::Vector3f& pivot() const { return pivot_; }
+    float distance() const { return distance_; }
+    const Eigen::Quaternionf& target_rotation() const { return target_rotation_; }
+    const Eigen::Vector3f& target_pivot() const { return target_pivot_; }
+    float target_distance() const { return target_distance_; }
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+private:
+    Eigen::Quaternionf rotation_, target_rotation_, last_target_rotation_;
+    Eigen::Vector3f pivot_, target_pivot_, last_target_pivot_;
+    float distance_, target_distance_;
+
+    // Of the targets while dragging, applied after the release
+    Eigen::Vector3f angular_velocity_; // axis * rad/s
+    Eigen::Vector3f pan_velocity_;
+    bool dragging_ = false;
+};
@@ -0,0 +1,182 @@
+#include "DamageTracker.h"
+#include <algorithm>
+
+void DamageRect::unite(const DamageRect& other)
+{
+    if (other.empty())
+    {
+        return;
+    }
+    if (empty())
+    {
+        *this = other;
+        return;
+    }
+    const int x1 = std::max(x + width, other.x + other.width);
+    const int y1 = std::max(y + height, other.y + other.height);
+    x = std::min(x, other.x);
+    y = std::min(y, other.y);
+    width = x1 - x;
+    height = y1 - y;
+}
+
+// Part of `rect` inside a width x height framebuffer
+static DamageRect clip(const DamageRect& rect, int width, int height)
+{
+    DamageRect clipped;
+    clipped.x = std::max(rect.x, 0);
+    clipped.y = std::max(rect.y, 0);
+    clipped.width = std::min(rect.x + rect.width, width) - clipped.x;
+    clipped.height = std::min(rect.y + rect.height, height) - clipped.y;
+    return clipped.empty() ? DamageRect() : clipped;
+}
+
+void DamageTracker::marked(bool was_clean)
+{
+    if (was_clean && notify)
+    {
+        notify();
+    }
+}
+
+void DamageTracker::invalidate(Damage kind)
+{
+    bool was_clean;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        was_clean = mask_ == 0;
+        mask_ |= damage_bit(kind);
+    }
+    marked(was_clean);
+}
+
+void DamageTracker::invalidate_all()
+{
+    bool was_clean;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        was_clean = mask_ == 0;
+        mask_ = ALL_DAMAGE;
+    }
+    marked(was_clean);
+}
+
+void DamageTracker::invalidate_region(int x, int y, int width, int height)
+{
+    DamageRect rect;
+    rect.x = x;
+    rect.y = y;
+    rect.width = width;
+    rect.height = height;
+    if (rect.empty())
+    {
+        return;
+    }
+    bool was_clean;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        was_clean = mask_ == 0;
+        mask_ |= damage_bit(Damage::Overlay);
+        region_.unite(rect);
+    }
+    marked(was_clean);
+}
+
+void DamageTracker::invalidate_object(uint32_t id)
+{
+    bool was_clean;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        was_clean = mask_ == 0;
+        mask_ |= damage_bit(Damage::Scene);
+        objects_.push_back(id);
+    }
+    marked(was_clean);
+}
+
+bool DamageTracker::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mask_ != 0;
+}
+
+bool DamageTracker::begin_frame(int width, int height, bool full)
+{
+    DamageRect region;
+    frame_objects_.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame_mask_ = mask_;
+        region = region_;
+        // Swap to keep both capacities
+        frame_objects_.swap(objects_);
+        mask_ = 0;
+        region_ = DamageRect();
+    }
+    std::sort(frame_objects_.begin(), frame_objects_.end());
+    frame_objects_.erase(std::unique(frame_objects_.begin(), frame_objects_.end()), frame_objects_.end());
+
+    // The back buffers hold nothing usable at another size
+    if (width != width_ || height != height_)
+    {
+        width_ = width;
+        height_ = height;
+        history_.clear();
+        frame_mask_ |= damage_bit(Damage::Resize);
+    }
+
+    if (frame_mask_ == 0 && !full)
+    {
+        ++stats_.skipped;
+        return false;
+    }
+
+    DamageRect screen;
+    screen.width = width;
+    screen.height = height;
+    const size_t keep = buffer_count > 1 ? (size_t)(buffer_count - 1) : 0;
+    region = clip(region, width, height);
+    if (full || frame_mask_ != damage_bit(Damage::Overlay) || region.empty())
+    {
+        region = screen;
+    }
+    // Back buffers not drawn yet since the start or a resize are undefined
+    frame_rect_ = region;
+    for (const DamageRect& previous : history_)
+    {
+        frame_rect_.unite(previous);
+    }
+    frame_full_ = history_.size() < keep
+        || (double)frame_rect_.area() > full_frame_ratio * (double)screen.area();
+    if (frame_full_)
+    {
+        frame_rect_ = screen;
+    }
+
+    // The frame's own damage, which the other back buffers still miss
+    history_.push_back(region);
+    if (history_.size() > keep)
+    {
+        history_.erase(history_.begin(), history_.end() - keep);
+    }
+
+    ++stats_.rendered;
+    if (!frame_full_)
+    {
+        ++stats_.partial;
+    }
+    return true;
+}
+
+bool DamageTracker::object_dirty(uint32_t id) const
+{
+    return std::binary_search(frame_objects_.begin(), frame_objects_.end(), id);
+}
+
+void DamageTracker::print_stats(FILE* out) const
+{
+    const uint64_t frames = stats_.rendered + stats_.skipped;
+    fprintf(out, "Frames: %llu rendered (%llu scissored), %llu skipped (%.1f%%)\n",
+        (unsigned long long)stats_.rendered, (unsigned long long)stats_.partial,
+        (unsigned long long)stats_.skipped, frames ? 100.0 * stats_.skipped / frames : 0.0);
+}
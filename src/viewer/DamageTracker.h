@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// What changed since the last drawn frame
+enum class Damage : uint32_t
+{
+    Camera,  // view or projection matrix
+    Scene,   // anything else in the 3D scene
+    Overlay, // 2D content inside the regions passed to invalidate_region()
+    Resize,  // framebuffer size, or a window that needs repainting
+    NumKinds
+};
+
+constexpr uint32_t damage_bit(Damage kind) { return 1u << (uint32_t)kind; }
+constexpr uint32_t ALL_DAMAGE = (1u << (uint32_t)Damage::NumKinds) - 1;
+
+// Rectangle in framebuffer pixels, origin at the top left like the mouse
+// coordinates
+struct DamageRect
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    bool empty() const { return width <= 0 || height <= 0; }
+    int64_t area() const { return empty() ? 0 : (int64_t)width * height; }
+    // Bounding box of both
+    void unite(const DamageRect& other);
+};
+
+// Invalidation marks for lazy redraw. Plugins mark what they changed, from
+// any thread; the render loop takes the marks once per frame and skips the
+// frame when there are none.
+//
+// Only Overlay damage can be drawn partially: the frame is then scissored
+// to the bounding box of the regions marked in it and in the previous
+// buffer_count - 1 drawn frames, since the back buffer being drawn last
+// showed that many frames ago. Any other damage, or regions covering more
+// than full_frame_ratio of the framebuffer, draw the whole frame.
+class DamageTracker
+{
+public:
+    // Back buffers the swap chain rotates through (2 for double buffering)
+    int buffer_count = 2;
+    float full_frame_ratio = 0.5f;
+
+    // Called on the first mark after the render loop took the previous
+    // ones, on the marking thread; the viewer wakes glfwWaitEvents with it
+    std::function<void()> notify;
+
+    void invalidate(Damage kind = Damage::Scene);
+    void invalidate_all();
+    // Overlay damage within the rectangle
+    void invalidate_region(int x, int y, int width, int height);
+    // Scene damage; the id is listed in frame_objects() so plugins can
+    // rebuild only what changed
+    void invalidate_object(uint32_t id);
+
+    // True if something is marked for the next frame
+    bool pending() const;
+
+    // Render thread, once per frame: takes the marks. Returns **false** if
+    // the frame can be skipped (counted in stats()); `full` draws the whole
+    // frame whatever the damage.
+    bool begin_frame(int width, int height, bool full = false);
+
+    // Damage of the frame begun last
+    uint32_t frame_damage() const { return frame_mask_; }
+    bool frame_has(Damage kind) const { return (frame_mask_ & damage_bit(kind)) != 0; }
+    // False if only frame_rect() has to be drawn
+    bool frame_full() const { return frame_full_; }
+    const DamageRect& frame_rect() const { return frame_rect_; }
+    // Ids passed to invalidate_object(), sorted and unique
+    const std::vector<uint32_t>& frame_objects() const { return frame_objects_; }
+    bool object_dirty(uint32_t id) const;
+
+    struct Stats
+    {
+        uint64_t rendered = 0;
+        uint64_t partial = 0; // of the rendered, scissored to frame_rect()
+        uint64_t skipped = 0;
+    };
+    const Stats& stats() const { return stats_; }
+    void print_stats(FILE* out = stdout) const;
+
+private:
+    // Calls notify if a mark made the tracker go from clean to damaged
+    void marked(bool was_clean);
+
+    mutable std::mutex mutex_;
+    uint32_t mask_ = 0;
+    DamageRect region_;
+    std::vector<uint32_t> objects_;
+
+    uint32_t frame_mask_ = 0;
+    bool frame_full_ = true;
+    DamageRect frame_rect_;
+    std::vector<uint32_t> frame_objects_;
+
+    // Regions drawn by the last buffer_count - 1 frames, newest last
+    std::vector<DamageRect> history_;
+    int width_ = 0;
+    int height_ = 0;
+
+    Stats stats_;
+};
@@ -0,0 +1,112 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <thread>
+
+FramePacer::FramePacer()
+{
+    reset();
+}
+
+void FramePacer::reset()
+{
+    frame_start_ = clock::now();
+    deadline_ = frame_start_;
+    window_frames_ = 0;
+    window_missed_ = 0;
+    window_work_seconds_ = 0.0;
+}
+
+double FramePacer::effective_fps() const
+{
+    return target_fps > 0.0 ? target_fps / (adaptive ? divisor_ : 1) : 0.0;
+}
+
+void FramePacer::wait_until(clock::time_point deadline, double period)
+{
+    // Capped so one bad estimate can never turn the whole wait into a spin
+    const double margin = std::min(std::max(spin_seconds, 1.25 * oversleep_seconds_), 0.5 * period);
+    const auto sleep_target = deadline - std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(margin));
+    auto now = clock::now();
+    if (now < sleep_target)
+    {
+        std::this_thread::sleep_until(sleep_target);
+        double over = std::chrono::duration<double>(clock::now() - sleep_target).count();
+        // Oversleeping by a whole frame is preemption or a system wake, not
+        // timer granularity: keep it out of the estimate
+        if (over < period)
+        {
+            // Fast attack, slow decay
+            oversleep_seconds_ = over > oversleep_seconds_ ? over : 0.99 * oversleep_seconds_ + 0.01 * over;
+        }
+    }
+    else
+    {
+        // No sleep, no sample: let the estimate decay so the pacer gets back to sleeping
+        oversleep_seconds_ *= 0.9;
+    }
+    while (clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void FramePacer::adapt(double period)
+{
+    if (++window_frames_ < adapt_window)
+    {
+        return;
+    }
+    const double load = window_work_seconds_ / window_frames_ / period;
+    const int max_divisor = std::max(1, (int)(target_fps / std::max(min_fps, 1e-3)));
+    if (window_missed_ * 4 > window_frames_ && divisor_ < max_divisor)
+    {
+        ++divisor_;
+    }
+    else if (window_missed_ == 0 && divisor_ > 1)
+    {
+        // Work would take `faster_load` of the shorter period
+        const double faster_load = load * divisor_ / (divisor_ - 1);
+        if (faster_load < 0.7)
+        {
+            --divisor_;
+        }
+    }
+    window_frames_ = 0;
+    window_missed_ = 0;
+    window_work_seconds_ = 0.0;
+}
+
+void FramePacer::end_frame()
+{
+    auto now = clock::now();
+    last_work_seconds_ = std::chrono::duration<double>(now - frame_start_).count();
+    ++frames_;
+    if (target_fps <= 0.0)
+    {
+        frame_start_ = now;
+        deadline_ = now;
+        return;
+    }
+
+    const double period = 1.0 / effective_fps();
+    deadline_ += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(period));
+    bool missed = now > deadline_;
+    if (missed)
+    {
+        ++missed_frames_;
+        deadline_ = now;
+    }
+    else
+    {
+        wait_until(deadline_, period);
+    }
+
+    if (adaptive)
+    {
+        window_missed_ += missed;
+        window_work_seconds_ += last_work_seconds_;
+        adapt(period);
+    }
+    frame_start_ = clock::now();
+}
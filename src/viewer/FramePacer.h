@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Caps the frame rate of an animating render loop. end_frame() blocks until
+// the next frame deadline: it sleeps for most of the wait and yields for the
+// last stretch, where OS sleeps are too coarse. A frame that ends after its
+// deadline counts as missed and the schedule restarts from now instead of
+// trying to catch up.
+//
+// With `adaptive` set, the rate steps down to target_fps / 2, / 3, ... (not
+// below min_fps) when frames keep missing over a window of frames, and steps
+// back up once there is enough headroom at the faster rate.
+class FramePacer
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    FramePacer();
+
+    // 0 = uncapped
+    double target_fps = 60.0;
+    bool adaptive = false;
+    double min_fps = 15.0;
+    // Frames per adaptation decision
+    int adapt_window = 60;
+    // Minimum time before a deadline at which sleeping stops
+    double spin_seconds = 0.002;
+
+    // Call once per frame after presenting; returns when the next frame may start
+    void end_frame();
+
+    // Restart the schedule, e.g. after the loop blocked waiting for events
+    void reset();
+
+    // Current frame rate cap after adaptation (0 if uncapped)
+    double effective_fps() const;
+
+    uint64_t frames() const { return frames_; }
+    uint64_t missed_frames() const { return missed_frames_; }
+    // Time between the start of the last frame and its end_frame() call
+    double last_work_seconds() const { return last_work_seconds_; }
+
+private:
+    void wait_until(clock::time_point deadline, double period);
+    void adapt(double period);
+
+    clock::time_point frame_start_;
+    clock::time_point deadline_;
+    uint64_t frames_ = 0;
+    uint64_t missed_frames_ = 0;
+    double last_work_seconds_ = 0.0;
+    // Measured oversleep, grows the spin margin on coarse timers (up to half
+    // a frame period)
+    double oversleep_seconds_ = 0.0;
+
+    // Frame rate divisor picked by the adaptive mode
+    int divisor_ = 1;
+    int window_frames_ = 0;
+    int window_missed_ = 0;
+    double window_work_seconds_ = 0.0;
+};
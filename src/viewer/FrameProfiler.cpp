@@ -0,0 +1,200 @@
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cmath>
+
+static uint16_t thread_index()
+{
+    static std::atomic<uint16_t> next{ 0 };
+    thread_local uint16_t index = next.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+FrameProfiler::FrameProfiler(size_t capacity)
+{
+    size_t n = 1;
+    while (n < capacity)
+    {
+        n <<= 1;
+    }
+    slots_.reset(new Slot[n]);
+    mask_ = n - 1;
+    epoch_ = std::chrono::steady_clock::now();
+    stage_names_ = { "frame", "callback_pre_draw", "DrawAction", "callback_post_draw",
+        "glfwSwapBuffers", "glfwPollEvents", "glfwWaitEvents", "frame_pacing", "input_events",
+        "render_queue", "assets", "pre_draw_tasks", "snapshot" };
+}
+
+uint16_t FrameProfiler::register_stage(const std::string& name)
+{
+    for (size_t i = 0; i < stage_names_.size(); ++i)
+    {
+        if (stage_names_[i] == name)
+        {
+            return (uint16_t)i;
+        }
+    }
+    stage_names_.push_back(name);
+    return (uint16_t)(stage_names_.size() - 1);
+}
+
+void FrameProfiler::record(uint16_t stage, int64_t begin_ns, int64_t end_ns)
+{
+    uint64_t i = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[i & mask_];
+    slot.seq.store(2 * i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint64_t key = (uint64_t)frame() | ((uint64_t)stage << 32) | ((uint64_t)thread_index() << 48);
+    slot.key.store(key, std::memory_order_relaxed);
+    slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(end_ns - begin_ns, std::memory_order_relaxed);
+    slot.seq.store(2 * (i + 1), std::memory_order_release);
+}
+
+void FrameProfiler::snapshot(std::vector<Sample>& samples, uint32_t last_frames) const
+{
+    samples.clear();
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t capacity = mask_ + 1;
+    uint64_t first = head > capacity ? head - capacity : 0;
+    uint32_t current = frame();
+    samples.reserve((size_t)(head - first));
+    for (uint64_t i = first; i < head; ++i)
+    {
+        const Slot& slot = slots_[i & mask_];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * (i + 1))
+        {
+            // Still being written or already overwritten
+            continue;
+        }
+        Sample s;
+        uint64_t key = slot.key.load(std::memory_order_relaxed);
+        s.index = i;
+        s.frame = (uint32_t)key;
+        s.stage = (uint16_t)(key >> 32);
+        s.thread = (uint16_t)(key >> 48);
+        s.begin_ns = slot.begin_ns.load(std::memory_order_relaxed);
+        s.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq)
+        {
+            continue;
+        }
+        if (last_frames > 0 && current - s.frame >= last_frames)
+        {
+            continue;
+        }
+        samples.push_back(s);
+    }
+}
+
+std::vector<FrameProfiler::StageSummary> FrameProfiler::summarize(uint32_t last_frames) const
+{
+    std::vector<Sample> samples;
+    snapshot(samples, last_frames);
+    std::vector<std::vector<int64_t>> durations(stage_names_.size());
+    for (const auto& s : samples)
+    {
+        if (s.stage < durations.size())
+        {
+            durations[s.stage].push_back(s.duration_ns);
+        }
+    }
+
+    std::vector<StageSummary> summaries;
+    for (size_t stage = 0; stage < durations.size(); ++stage)
+    {
+        auto& d = durations[stage];
+        if (d.empty())
+        {
+            continue;
+        }
+        std::sort(d.begin(), d.end());
+        // Nearest-rank percentile
+        auto percentile = [&](double p)
+        {
+            size_t rank = (size_t)std::ceil(p * (double)d.size());
+            return (double)d[std::min(d.size(), std::max<size_t>(rank, 1)) - 1] * 1e-3;
+        };
+        StageSummary summary;
+        summary.name = stage_names_[stage];
+        summary.count = d.size();
+        double total = 0.0;
+        for (int64_t v : d)
+        {
+            total += (double)v;
+        }
+        summary.mean_us = total * 1e-3 / (double)d.size();
+        summary.p50_us = percentile(0.50);
+        summary.p95_us = percentile(0.95);
+        summary.p99_us = percentile(0.99);
+        summary.max_us = (double)d.back() * 1e-3;
+        summaries.push_back(summary);
+    }
+    return summaries;
+}
+
+void FrameProfiler::print_summary(FILE* out, uint32_t last_frames) const
+{
+    fprintf(out, "%-32s %8s %10s %10s %10s %10s %10s\n", "stage", "count", "mean us", "p50 us", "p95 us", "p99 us", "max us");
+    for (const auto& s : summarize(last_frames))
+    {
+        fprintf(out, "%-32s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            s.name.c_str(), s.count, s.mean_us, s.p50_us, s.p95_us, s.p99_us, s.max_us);
+    }
+}
+
+static void write_json_string(FILE* f, const std::string& s)
+{
+    fputc('"', f);
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            fputc('\\', f);
+            fputc(c, f);
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            fprintf(f, "\\u%04x", (unsigned)c);
+        }
+        else
+        {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+bool FrameProfiler::write_chrome_trace(const std::string& filename) const
+{
+    FILE* f = fopen(filename.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", filename.c_str());
+        return false;
+    }
+    std::vector<Sample> samples;
+    snapshot(samples);
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        const Sample& s = samples[i];
+        fprintf(f, "{\"name\":");
+        write_json_string(f, s.stage < stage_names_.size() ? stage_names_[s.stage] : std::string("?"));
+        fprintf(f, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}%s\n",
+            (unsigned)s.thread, (double)s.begin_ns * 1e-3, (double)s.duration_ns * 1e-3, s.frame,
+            i + 1 < samples.size() ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    return fclose(f) == 0;
+}
+
+void FrameProfiler::clear()
+{
+    // A zero sequence never matches a valid index
+    for (size_t i = 0; i <= mask_; ++i)
+    {
+        slots_[i].seq.store(0, std::memory_order_release);
+    }
+}
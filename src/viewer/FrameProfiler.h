@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Records how long each stage of a frame takes (plugin pre_draw/post_draw,
+// the callbacks, DrawAction, buffer swap, event handling) into a fixed-size
+// ring buffer. Recording is lock-free and may happen on any thread; stage
+// registration and the queries are meant for the render thread.
+class FrameProfiler
+{
+public:
+    enum BuiltinStage : uint16_t
+    {
+        Frame,
+        CallbackPreDraw,
+        DrawAction,
+        CallbackPostDraw,
+        SwapBuffers,
+        Events,
+        WaitEvents,
+        FramePacing,
+        InputEvents,
+        RenderQueue,
+        Assets,
+        Tasks,
+        Snapshot,
+        NumBuiltinStages
+    };
+
+    struct Sample
+    {
+        uint64_t index;     // position in the ring, monotonically increasing
+        uint32_t frame;
+        uint16_t stage;
+        uint16_t thread;
+        int64_t begin_ns;   // since the profiler was created
+        int64_t duration_ns;
+    };
+
+    struct StageSummary
+    {
+        std::string name;
+        size_t count = 0;
+        double mean_us = 0.0;
+        double p50_us = 0.0;
+        double p95_us = 0.0;
+        double p99_us = 0.0;
+        double max_us = 0.0;
+    };
+
+    // capacity is rounded up to a power of two
+    explicit FrameProfiler(size_t capacity = size_t(1) << 16);
+
+    bool enabled = true;
+
+    // Returns the id of `name`, registering it on first use
+    uint16_t register_stage(const std::string& name);
+    const std::string& stage_name(uint16_t stage) const { return stage_names_[stage]; }
+
+    void begin_frame() { frame_.fetch_add(1, std::memory_order_relaxed); }
+    uint32_t frame() const { return frame_.load(std::memory_order_relaxed); }
+
+    int64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch_).count();
+    }
+
+    void record(uint16_t stage, int64_t begin_ns, int64_t end_ns);
+
+    // Copies the samples still in the ring, oldest first. last_frames > 0
+    // keeps only samples of the most recent frames.
+    void snapshot(std::vector<Sample>& samples, uint32_t last_frames = 0) const;
+
+    std::vector<StageSummary> summarize(uint32_t last_frames = 0) const;
+    void print_summary(FILE* out = stdout, uint32_t last_frames = 0) const;
+
+    // Chrome trace event format (chrome://tracing, Perfetto)
+    bool write_chrome_trace(const std::string& filename) const;
+
+    void clear();
+
+private:
+    // Per-slot seqlock: odd while being written, 2 * (index + 1) once done
+    struct Slot
+    {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<uint64_t> key{ 0 };   // frame | stage << 32 | thread << 48
+        std::atomic<int64_t> begin_ns{ 0 };
+        std::atomic<int64_t> duration_ns{ 0 };
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    std::atomic<uint64_t> head_{ 0 };
+    std::atomic<uint32_t> frame_{ 0 };
+    std::chrono::steady_clock::time_point epoch_;
+    std::vector<std::string> stage_names_;
+};
+
+// Times the enclosing scope as one sample of `stage`
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler& profiler, uint16_t stage)
+        : profiler_(profiler), stage_(stage), begin_ns_(profiler.enabled ? profiler.now_ns() : -1)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if (begin_ns_ >= 0)
+        {
+            profiler_.record(stage_, begin_ns_, profiler_.now_ns());
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    FrameProfiler& profiler_;
+    uint16_t stage_;
+    int64_t begin_ns_;
+};
@@ -0,0 +1,219 @@
+#include "InputLog.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static const char INPUT_LOG_MAGIC[8] = { 'G', 'L', 'F', 'W', 'V', 'I', 'N', 'P' };
+static const uint32_t ENDIAN_TAG = 0x01020304;
+static const size_t FRAME_BYTES = 12;
+static const size_t EVENT_BYTES = 21;
+
+template <typename T>
+static unsigned char* put(unsigned char* p, const T& value)
+{
+    memcpy(p, &value, sizeof(T));
+    return p + sizeof(T);
+}
+
+template <typename T>
+static const unsigned char* get(const unsigned char* p, T& value)
+{
+    memcpy(&value, p, sizeof(T));
+    return p + sizeof(T);
+}
+
+InputRecorder::~InputRecorder()
+{
+    close();
+}
+
+bool InputRecorder::open(const std::string& filename, int width, int height)
+{
+    close();
+    file_ = fopen(filename.c_str(), "wb");
+    if (!file_)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", filename.c_str());
+        return false;
+    }
+    filename_ = filename;
+    header_ = InputLogHeader();
+    memcpy(header_.magic, INPUT_LOG_MAGIC, sizeof(header_.magic));
+    header_.version = INPUT_LOG_VERSION;
+    header_.endian = ENDIAN_TAG;
+    header_.width = width;
+    header_.height = height;
+    ok_ = fwrite(&header_, sizeof(header_), 1, file_) == 1;
+    start_ = std::chrono::steady_clock::now();
+    frame_events_.clear();
+    return ok_;
+}
+
+bool InputRecorder::close()
+{
+    if (!file_)
+    {
+        return true;
+    }
+    bool ok = ok_ && fseek(file_, 0, SEEK_SET) == 0 && fwrite(&header_, sizeof(header_), 1, file_) == 1;
+    ok = fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", filename_.c_str());
+    }
+    return ok;
+}
+
+void InputRecorder::add_event(const InputEvent& event)
+{
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    frame_events_.push_back({ event,
+        (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() });
+}
+
+void InputRecorder::end_frame(double animation_time)
+{
+    if (!file_)
+    {
+        return;
+    }
+    buffer_.resize(FRAME_BYTES + EVENT_BYTES * frame_events_.size());
+    unsigned char* p = buffer_.data();
+    p = put(p, (uint32_t)frame_events_.size());
+    p = put(p, animation_time);
+    for (const InputLogEvent& e : frame_events_)
+    {
+        p = put(p, (uint8_t)e.event.type);
+        p = put(p, e.event.a);
+        p = put(p, e.event.b);
+        p = put(p, e.event.delta_y);
+        p = put(p, e.time_us);
+    }
+    ok_ = ok_ && fwrite(buffer_.data(), 1, buffer_.size(), file_) == buffer_.size();
+    ++header_.num_frames;
+    header_.num_events += frame_events_.size();
+    frame_events_.clear();
+}
+
+bool InputLog::load(const std::string& filename)
+{
+    frames.clear();
+    events.clear();
+    std::error_code ec;
+    const uintmax_t size = fs::file_size(filename, ec);
+    FILE* f = ec ? nullptr : fopen(filename.c_str(), "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    std::vector<unsigned char> data((size_t)size);
+    const bool read = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    if (!read || data.size() < sizeof(header))
+    {
+        fprintf(stderr, "Error: Could not read %s\n", filename.c_str());
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, INPUT_LOG_MAGIC, sizeof(header.magic)) != 0 || header.version != INPUT_LOG_VERSION
+        || header.endian != ENDIAN_TAG)
+    {
+        fprintf(stderr, "Error: %s is not an input log\n", filename.c_str());
+        return false;
+    }
+
+    const unsigned char* p = data.data() + sizeof(header);
+    const unsigned char* end = data.data() + data.size();
+    frames.reserve((size_t)std::min<uint64_t>(header.num_frames, (uint64_t)(end - p) / FRAME_BYTES));
+    events.reserve((size_t)std::min<uint64_t>(header.num_events, (uint64_t)(end - p) / EVENT_BYTES));
+    for (uint64_t i = 0; i < header.num_frames; ++i)
+    {
+        InputLogFrame frame;
+        if ((size_t)(end - p) < FRAME_BYTES)
+        {
+            break;
+        }
+        p = get(p, frame.num_events);
+        p = get(p, frame.animation_time);
+        frame.first_event = (uint32_t)events.size();
+        if ((size_t)(end - p) / EVENT_BYTES < frame.num_events)
+        {
+            break;
+        }
+        for (uint32_t j = 0; j < frame.num_events; ++j)
+        {
+            InputLogEvent e;
+            uint8_t type;
+            p = get(p, type);
+            p = get(p, e.event.a);
+            p = get(p, e.event.b);
+            p = get(p, e.event.delta_y);
+            p = get(p, e.time_us);
+            e.event.type = (InputEvent::Type)type;
+            events.push_back(e);
+        }
+        frames.push_back(frame);
+    }
+    if (frames.size() != header.num_frames || events.size() != header.num_events)
+    {
+        fprintf(stderr, "Error: %s is truncated (%zu of %llu frames)\n", filename.c_str(), frames.size(),
+            (unsigned long long)header.num_frames);
+        return false;
+    }
+    return true;
+}
+
+void ReplayStats::summarize()
+{
+    mean_ms = p50_ms = p95_ms = p99_ms = max_ms = 0.0;
+    if (frame_ns.empty())
+    {
+        return;
+    }
+    std::vector<int64_t> d = frame_ns;
+    std::sort(d.begin(), d.end());
+    // Nearest-rank percentile, as in FrameProfiler
+    auto percentile = [&](double p)
+    {
+        size_t rank = (size_t)std::ceil(p * (double)d.size());
+        return (double)d[std::min(d.size(), std::max<size_t>(rank, 1)) - 1] * 1e-6;
+    };
+    double total = 0.0;
+    for (int64_t v : d)
+    {
+        total += (double)v;
+    }
+    mean_ms = total * 1e-6 / (double)d.size();
+    p50_ms = percentile(0.50);
+    p95_ms = percentile(0.95);
+    p99_ms = percentile(0.99);
+    max_ms = (double)d.back() * 1e-6;
+}
+
+void ReplayStats::print(FILE* out) const
+{
+    fprintf(out, "Replay: %d frames, %llu events in %.2f s\n", frames, (unsigned long long)events, seconds);
+    fprintf(out, "frame ms: mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", mean_ms, p50_ms, p95_ms, p99_ms,
+        max_ms);
+}
+
+bool ReplayStats::write_csv(const std::string& filename) const
+{
+    FILE* f = fopen(filename.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", filename.c_str());
+        return false;
+    }
+    fprintf(f, "frame,ms\n");
+    for (size_t i = 0; i < frame_ns.size(); ++i)
+    {
+        fprintf(f, "%zu,%.4f\n", i, frame_ns[i] * 1e-6);
+    }
+    return fclose(f) == 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "InputQueue.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Recorded input session (.gvi): the events the viewer took from its input
+// queue, frame by frame. Layout:
+//   InputLogHeader
+//   per frame: uint32 event count, float64 animation_time
+//              per event: uint8 type, int32 a, int32 b, float32 delta_y,
+//                         uint64 microseconds since the recording started
+// Fields are packed in native byte order (see the header's endian tag),
+// without padding: 12 bytes per frame and 21 per event.
+// Replaying the events into the same frames with the same animation_time
+// reproduces the session exactly.
+
+constexpr uint32_t INPUT_LOG_VERSION = 1;
+
+struct InputLogHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    int32_t width; // framebuffer size while recording
+    int32_t height;
+    uint64_t num_frames;
+    uint64_t num_events;
+};
+
+struct InputLogEvent
+{
+    InputEvent event;
+    uint64_t time_us;
+};
+
+struct InputLogFrame
+{
+    double animation_time;
+    uint32_t first_event;
+    uint32_t num_events;
+};
+
+// Streams the log to disk as frames are recorded; the counts in the header
+// are filled in by close().
+class InputRecorder
+{
+public:
+    InputRecorder() = default;
+    ~InputRecorder();
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+
+    bool open(const std::string& filename, int width, int height);
+    bool close();
+    bool is_open() const { return file_ != nullptr; }
+
+    // The events of one frame, as taken from the queue
+    void add_event(const InputEvent& event);
+    void end_frame(double animation_time);
+
+    uint64_t frames() const { return header_.num_frames; }
+    uint64_t events() const { return header_.num_events; }
+
+private:
+    FILE* file_ = nullptr;
+    std::string filename_;
+    InputLogHeader header_ = {};
+    std::chrono::steady_clock::time_point start_;
+    std::vector<InputLogEvent> frame_events_;
+    std::vector<unsigned char> buffer_;
+    bool ok_ = true;
+};
+
+// A whole log read into memory
+class InputLog
+{
+public:
+    bool load(const std::string& filename);
+
+    InputLogHeader header = {};
+    std::vector<InputLogFrame> frames;
+    std::vector<InputLogEvent> events;
+};
+
+// Frame times of a replay, to compare builds on the same session
+struct ReplayStats
+{
+    int frames = 0;
+    uint64_t events = 0;
+    double seconds = 0.0;
+    std::vector<int64_t> frame_ns; // draw() and buffer swap of each frame
+
+    double mean_ms = 0.0;
+    double p50_ms = 0.0;
+    double p95_ms = 0.0;
+    double p99_ms = 0.0;
+    double max_ms = 0.0;
+
+    // Fills the summary from frame_ns
+    void summarize();
+    void print(FILE* out = stdout) const;
+    // One line per frame: frame, ms
+    bool write_csv(const std::string& filename) const;
+};
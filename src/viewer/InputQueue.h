@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Compact record of one input callback
+struct InputEvent
+{
+    enum class Type : uint8_t
+    {
+        MouseDown, MouseUp, MouseMove, MouseScroll,
+        KeyPressed, KeyDown, KeyUp, KeyRepeat
+    };
+
+    Type type;
+    int32_t a;      // key, codepoint, button or mouse x
+    int32_t b;      // modifiers or mouse y
+    float delta_y;  // scroll only
+
+    static InputEvent mouse_move(int x, int y) { return { Type::MouseMove, x, y, 0.0f }; }
+    static InputEvent mouse_scroll(float dy) { return { Type::MouseScroll, 0, 0, dy }; }
+    static InputEvent mouse_button(Type type, int button, int modifier) { return { type, button, modifier, 0.0f }; }
+    static InputEvent key(Type type, int key, int modifier) { return { type, key, modifier, 0.0f }; }
+};
+
+// Bounded lock-free queue (Vyukov's MPMC ring): the GLFW callbacks and any
+// other thread push, the render thread pops. push() fails instead of
+// blocking when the queue is full.
+class InputQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit InputQueue(size_t capacity = 4096);
+
+    bool push(const InputEvent& event);
+    bool pop(InputEvent& event);
+
+    // Events rejected because the queue was full
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        InputEvent event;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{ 0 };
+    alignas(64) std::atomic<size_t> dequeue_pos_{ 0 };
+    std::atomic<uint64_t> dropped_{ 0 };
+};
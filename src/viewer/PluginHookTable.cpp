@@ -0,0 +1,24 @@
+#include "PluginHookTable.h"
+#include "Viewer.h"
+
+void PluginHookTable::update(const std::vector<ViewerPlugin*>& plugins)
+{
+    registered_ = plugins;
+    for (size_t hook = 0; hook < NUM_HOOKS; ++hook)
+    {
+        plugins_[hook].clear();
+        indices_[hook].clear();
+    }
+    for (size_t i = 0; i < plugins.size(); ++i)
+    {
+        const uint32_t mask = plugins[i]->hooks();
+        for (size_t hook = 0; hook < NUM_HOOKS; ++hook)
+        {
+            if (mask & plugin_hook_bit((PluginHook)hook))
+            {
+                plugins_[hook].push_back(plugins[i]);
+                indices_[hook].push_back((uint32_t)i);
+            }
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ViewerPlugin;
+
+// Hooks of ViewerPlugin that run every frame or on every input event, as
+// bit indices of ViewerPlugin::hooks(). The rare ones (load, save, resize,
+// ...) always go to every plugin.
+enum class PluginHook : uint32_t
+{
+    PreDrawTasks, PreDraw, PostDraw,
+    MouseDown, MouseUp, MouseMove, MouseScroll,
+    KeyPressed, KeyDown, KeyUp, KeyRepeat,
+    NumHooks
+};
+
+constexpr uint32_t plugin_hook_bit(PluginHook hook) { return 1u << (uint32_t)hook; }
+constexpr uint32_t ALL_PLUGIN_HOOKS = (1u << (uint32_t)PluginHook::NumHooks) - 1;
+
+// For every hook, the plugins that implement it, in registration order, so
+// that an event costs one call per interested plugin instead of a virtual
+// call into every plugin. The masks are read by update(); the viewer calls
+// it whenever its plugin list has changed, before the next frame.
+class PluginHookTable
+{
+public:
+    void update(const std::vector<ViewerPlugin*>& plugins);
+    // True if `plugins` is not the list of the last update()
+    bool stale(const std::vector<ViewerPlugin*>& plugins) const { return plugins != registered_; }
+
+    const std::vector<ViewerPlugin*>& plugins(PluginHook hook) const { return plugins_[(size_t)hook]; }
+    // Their positions in the plugin list
+    const std::vector<uint32_t>& indices(PluginHook hook) const { return indices_[(size_t)hook]; }
+
+private:
+    static constexpr size_t NUM_HOOKS = (size_t)PluginHook::NumHooks;
+
+    std::vector<ViewerPlugin*> registered_;
+    std::vector<ViewerPlugin*> plugins_[NUM_HOOKS];
+    std::vector<uint32_t> indices_[NUM_HOOKS];
+};
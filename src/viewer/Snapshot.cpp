@@ -0,0 +1,596 @@
+#include "Snapshot.h"
+#include "Viewer.h"
+#include "../util/Compress.h"
+#include "../util/Hash.h"
+#include "../util/Parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+static const char SNAPSHOT_MAGIC[8] = { 'G', 'L', 'F', 'W', 'V', 'S', 'N', 'P' };
+static const uint32_t ENDIAN_TAG = 0x01020304;
+static const char* SNAPSHOT_EXTENSION = ".gvs";
+
+// Plugin names are stored truncated and zero-padded
+static void stream_name(const std::string& name, char (&out)[sizeof(SnapshotStream::name)])
+{
+    memset(out, 0, sizeof(out));
+    memcpy(out, name.data(), std::min(name.size(), sizeof(out) - 1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Writing
+////////////////////////////////////////////////////////////////////////////////
+
+SnapshotOut::SnapshotOut(SnapshotWriter& writer, const SnapshotChunk* previous, size_t num_previous)
+    : writer_(writer), previous_(previous), num_previous_(num_previous)
+{
+}
+
+void SnapshotOut::write(const void* data, size_t bytes)
+{
+    const char* p = (const char*)data;
+    const size_t chunk = writer_.job_options_.chunk_bytes;
+    std::vector<char>& staging = writer_.staging_;
+    bytes_ += bytes;
+    while (bytes > 0)
+    {
+        if (staging.empty() && bytes >= chunk)
+        {
+            const size_t count = bytes / chunk;
+            add_chunks(p, count);
+            p += count * chunk;
+            bytes -= count * chunk;
+            continue;
+        }
+        const size_t n = std::min(bytes, chunk - staging.size());
+        staging.insert(staging.end(), p, p + n);
+        p += n;
+        bytes -= n;
+        if (staging.size() == chunk)
+        {
+            add_chunk(staging.data(), chunk, hash_bytes(staging.data(), chunk));
+            staging.clear();
+        }
+    }
+}
+
+void SnapshotOut::add_chunks(const char* data, size_t count)
+{
+    const size_t chunk = writer_.job_options_.chunk_bytes;
+    std::vector<uint64_t>& hashes = writer_.hashes_;
+    hashes.resize(count);
+    parallel_for(count, [&](size_t i, unsigned)
+        {
+            hashes[i] = hash_bytes(data + i * chunk, chunk);
+        }, writer_.job_options_.threads);
+    for (size_t i = 0; i < count; ++i)
+    {
+        add_chunk(data + i * chunk, chunk, hashes[i]);
+    }
+}
+
+void SnapshotOut::add_chunk(const char* data, size_t bytes, uint64_t hash)
+{
+    const size_t index = num_chunks_++;
+    if (index < num_previous_ && previous_[index].hash == hash && previous_[index].raw_bytes == bytes)
+    {
+        // Stays where the previous snapshot points
+        writer_.chunks_.push_back(previous_[index]);
+        return;
+    }
+
+    SnapshotChunk chunk = {};
+    chunk.hash = hash;
+    chunk.sequence = writer_.sequence_;
+    chunk.raw_bytes = (uint32_t)bytes;
+    std::vector<char> copy;
+    if (!writer_.spare_.empty())
+    {
+        copy = std::move(writer_.spare_.back());
+        writer_.spare_.pop_back();
+    }
+    copy.assign(data, data + bytes);
+    writer_.pending_.push_back({ writer_.chunks_.size(), std::move(copy) });
+    writer_.chunks_.push_back(chunk);
+}
+
+void SnapshotOut::finish()
+{
+    std::vector<char>& staging = writer_.staging_;
+    if (!staging.empty())
+    {
+        add_chunk(staging.data(), staging.size(), hash_bytes(staging.data(), staging.size()));
+        staging.clear();
+    }
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    wait();
+}
+
+void SnapshotWriter::open(const std::string& path)
+{
+    wait();
+    path_ = path;
+    next_sequence_ = 0;
+    base_sequence_ = 0;
+    has_last_ = false;
+    last_streams_.clear();
+    last_chunks_.clear();
+}
+
+std::string SnapshotWriter::file_name(const std::string& path, uint64_t sequence)
+{
+    return path + "." + std::to_string(sequence) + SNAPSHOT_EXTENSION;
+}
+
+bool SnapshotWriter::save(const std::vector<ViewerPlugin*>& plugins)
+{
+    wait();
+    if (path_.empty())
+    {
+        fprintf(stderr, "Error: No snapshot path is open\n");
+        return false;
+    }
+    auto tic = std::chrono::steady_clock::now();
+
+    options.chunk_bytes = std::max(options.chunk_bytes, 1u);
+    job_options_ = options;
+    sequence_ = next_sequence_++;
+    delta_ = has_last_ && sequence_ - base_sequence_ < std::max(options.full_every, 1u);
+    superseded_ = false;
+    if (!delta_)
+    {
+        superseded_ = sequence_ > base_sequence_;
+        superseded_base_ = base_sequence_;
+        base_sequence_ = sequence_;
+    }
+
+    for (Pending& pending : pending_)
+    {
+        spare_.push_back(std::move(pending.data));
+    }
+    pending_.clear();
+    streams_.clear();
+    chunks_.clear();
+    staging_.clear();
+    staging_.reserve(options.chunk_bytes);
+
+    for (size_t i = 0; i < plugins.size(); ++i)
+    {
+        SnapshotStream stream = {};
+        stream_name(plugins[i]->name(), stream.name);
+        stream.plugin = (uint32_t)i;
+        stream.first_chunk = chunks_.size();
+
+        // The same plugin in the previous snapshot, also for a full one:
+        // write_file() copies its unchanged chunks from the chain
+        const SnapshotChunk* previous = nullptr;
+        size_t num_previous = 0;
+        for (const SnapshotStream& last : last_streams_)
+        {
+            if (has_last_ && last.plugin == stream.plugin && memcmp(last.name, stream.name, sizeof(stream.name)) == 0)
+            {
+                previous = last_chunks_.data() + last.first_chunk;
+                num_previous = (size_t)last.num_chunks;
+                break;
+            }
+        }
+
+        SnapshotOut out(*this, previous, num_previous);
+        const bool saved = plugins[i]->snapshot(out);
+        out.finish();
+        if (saved)
+        {
+            stream.bytes = out.bytes();
+        }
+        else
+        {
+            // Drop whatever it wrote before giving up
+            while (!pending_.empty() && pending_.back().chunk >= stream.first_chunk)
+            {
+                spare_.push_back(std::move(pending_.back().data));
+                pending_.pop_back();
+            }
+            chunks_.resize((size_t)stream.first_chunk);
+            stream.flags = SNAPSHOT_STREAM_EMPTY;
+        }
+        stream.num_chunks = chunks_.size() - stream.first_chunk;
+        streams_.push_back(stream);
+    }
+
+    capture_ = SnapshotStats();
+    capture_.sequence = sequence_;
+    capture_.delta = delta_;
+    capture_.streams = streams_.size();
+    capture_.chunks = chunks_.size();
+    capture_.changed_chunks = pending_.size();
+    for (const SnapshotStream& stream : streams_)
+    {
+        capture_.bytes += stream.bytes;
+    }
+    for (const Pending& pending : pending_)
+    {
+        capture_.changed_bytes += pending.data.size();
+    }
+    capture_.capture_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+
+    busy_ = true;
+    thread_ = std::thread([this]
+        {
+            write_file();
+            busy_ = false;
+        });
+    return true;
+}
+
+void SnapshotWriter::wait()
+{
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+SnapshotStats SnapshotWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+std::string SnapshotWriter::last_file() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_file_;
+}
+
+// The stored bytes of `chunk` in an earlier file of the chain, each file
+// mapped once
+static const char* chain_chunk(const std::string& path, std::map<uint64_t, std::unique_ptr<MappedFile>>& files,
+    const SnapshotChunk& chunk)
+{
+    std::unique_ptr<MappedFile>& file = files[chunk.sequence];
+    if (!file)
+    {
+        file.reset(new MappedFile());
+        if (!file->open(SnapshotWriter::file_name(path, chunk.sequence)))
+        {
+            return nullptr;
+        }
+    }
+    if (!file->is_open() || chunk.offset > file->size() || chunk.stored_bytes > file->size() - chunk.offset)
+    {
+        return nullptr;
+    }
+    return file->data() + chunk.offset;
+}
+
+void SnapshotWriter::write_file()
+{
+    auto tic = std::chrono::steady_clock::now();
+    SnapshotStats stats = capture_;
+    const std::string file = file_name(path_, sequence_);
+    const std::string tmp_file = file + ".tmp";
+    FILE* f = fopen(tmp_file.c_str(), "wb");
+    if (!f)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", tmp_file.c_str());
+    }
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.flags = delta_ ? SNAPSHOT_DELTA : 0;
+    header.endian = ENDIAN_TAG;
+    header.chunk_bytes = job_options_.chunk_bytes;
+    header.sequence = sequence_;
+    header.base_sequence = base_sequence_;
+    header.num_streams = streams_.size();
+    header.num_chunks = chunks_.size();
+
+    uint64_t offset = sizeof(header);
+    auto pad = [&]()
+    {
+        static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+        const size_t n = (size_t)((SNAPSHOT_ALIGNMENT - offset % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT);
+        offset += n;
+        return n == 0 || fwrite(zeros, 1, n, f) == n;
+    };
+
+    bool ok = f && fwrite(&header, sizeof(header), 1, f) == 1;
+    std::vector<char> compressed;
+    // A delta stores the changed chunks only. A full snapshot stores every
+    // chunk: the unchanged ones are copied as stored from the previous chain.
+    std::map<uint64_t, std::unique_ptr<MappedFile>> chain;
+    size_t next_pending = 0;
+    for (size_t i = 0; ok && i < chunks_.size(); ++i)
+    {
+        SnapshotChunk& chunk = chunks_[i];
+        const char* data;
+        size_t bytes;
+        if (next_pending < pending_.size() && pending_[next_pending].chunk == i)
+        {
+            const Pending& pending = pending_[next_pending++];
+            data = pending.data.data();
+            bytes = pending.data.size();
+            chunk.codec = SNAPSHOT_CODEC_NONE;
+            if (job_options_.compress)
+            {
+                compressed.resize(lz_compress_bound(bytes));
+                const size_t n = lz_compress(data, bytes, compressed.data(), compressed.size());
+                if (n > 0 && n < bytes)
+                {
+                    data = compressed.data();
+                    bytes = n;
+                    chunk.codec = SNAPSHOT_CODEC_LZ;
+                }
+            }
+        }
+        else if (delta_)
+        {
+            continue;
+        }
+        else
+        {
+            data = chain_chunk(path_, chain, chunk);
+            if (!data)
+            {
+                fprintf(stderr, "Error: Chunk %zu of the previous snapshot is missing\n", i);
+                ok = false;
+                break;
+            }
+            bytes = chunk.stored_bytes;
+            chunk.sequence = sequence_;
+            stats.copied_bytes += bytes;
+        }
+        ok = pad();
+        chunk.offset = offset;
+        chunk.stored_bytes = (uint32_t)bytes;
+        ok = ok && fwrite(data, 1, bytes, f) == bytes;
+        offset += bytes;
+        stats.stored_bytes += bytes;
+    }
+    ok = ok && pad();
+    header.table_offset = offset;
+    ok = ok && fwrite(streams_.data(), sizeof(SnapshotStream), streams_.size(), f) == streams_.size()
+        && fwrite(chunks_.data(), sizeof(SnapshotChunk), chunks_.size(), f) == chunks_.size()
+        && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    if (f)
+    {
+        ok = fclose(f) == 0 && ok;
+    }
+
+    std::error_code ec;
+    if (ok)
+    {
+        fs::rename(tmp_file, file, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        fs::remove(tmp_file, ec);
+        fprintf(stderr, "Error: Could not write snapshot %s\n", file.c_str());
+    }
+
+    // A failed write leaves no base, the next snapshot is a full one
+    has_last_ = ok;
+    if (ok)
+    {
+        std::swap(last_streams_, streams_);
+        std::swap(last_chunks_, chunks_);
+        if (superseded_ && job_options_.remove_superseded)
+        {
+            for (uint64_t sequence = superseded_base_; sequence < sequence_; ++sequence)
+            {
+                fs::remove(file_name(path_, sequence), ec);
+            }
+        }
+    }
+
+    stats.ok = ok;
+    stats.write_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tic).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = stats;
+    if (ok)
+    {
+        last_file_ = file;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Reading
+////////////////////////////////////////////////////////////////////////////////
+
+SnapshotIn::SnapshotIn(const SnapshotReader& reader, const SnapshotStream& stream)
+    : reader_(reader), chunks_(reader.chunks_.data() + stream.first_chunk), num_chunks_((size_t)stream.num_chunks),
+    size_(stream.bytes)
+{
+}
+
+bool SnapshotIn::read(void* data, size_t bytes)
+{
+    if (bytes > remaining())
+    {
+        return false;
+    }
+    char* out = (char*)data;
+    position_ += bytes;
+    while (bytes > 0)
+    {
+        if (data_position_ == data_size_ && !next_chunk())
+        {
+            return false;
+        }
+        const size_t n = std::min(bytes, data_size_ - data_position_);
+        memcpy(out, data_ + data_position_, n);
+        out += n;
+        bytes -= n;
+        data_position_ += n;
+    }
+    return true;
+}
+
+bool SnapshotIn::next_chunk()
+{
+    if (chunk_ >= num_chunks_)
+    {
+        return false;
+    }
+    const SnapshotChunk& chunk = chunks_[chunk_++];
+    data_ = reader_.chunk_data(chunk, buffer_);
+    data_size_ = data_ ? chunk.raw_bytes : 0;
+    data_position_ = 0;
+    return data_ != nullptr;
+}
+
+static bool read_header(const MappedFile& file, SnapshotHeader& header)
+{
+    if (file.size() < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    return memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) == 0 && header.version == SNAPSHOT_VERSION
+        && header.endian == ENDIAN_TAG;
+}
+
+bool SnapshotReader::open(const std::string& filename)
+{
+    close();
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(filename))
+    {
+        fprintf(stderr, "Error: Could not open %s\n", filename.c_str());
+        return false;
+    }
+    const uint64_t size = file->size();
+    if (!read_header(*file, header_) || header_.table_offset > size
+        || header_.num_streams > (size - header_.table_offset) / sizeof(SnapshotStream)
+        || header_.num_chunks > (size - header_.table_offset - header_.num_streams * sizeof(SnapshotStream))
+            / sizeof(SnapshotChunk))
+    {
+        fprintf(stderr, "Error: %s is not a valid snapshot\n", filename.c_str());
+        return false;
+    }
+    const char* table = file->data() + header_.table_offset;
+    streams_.resize((size_t)header_.num_streams);
+    chunks_.resize((size_t)header_.num_chunks);
+    memcpy(streams_.data(), table, streams_.size() * sizeof(SnapshotStream));
+    memcpy(chunks_.data(), table + streams_.size() * sizeof(SnapshotStream), chunks_.size() * sizeof(SnapshotChunk));
+    files_[header_.sequence] = std::move(file);
+
+    bool ok = true;
+    for (const SnapshotStream& stream : streams_)
+    {
+        ok = ok && stream.first_chunk <= chunks_.size() && stream.num_chunks <= chunks_.size() - stream.first_chunk;
+    }
+
+    // The other files of the chain are named like this one
+    std::string suffix = ".";
+    suffix += std::to_string(header_.sequence);
+    suffix += SNAPSHOT_EXTENSION;
+    const bool named = filename.size() > suffix.size()
+        && filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0;
+    const std::string path = named ? filename.substr(0, filename.size() - suffix.size()) : std::string();
+    for (size_t i = 0; ok && i < chunks_.size(); ++i)
+    {
+        const SnapshotChunk& chunk = chunks_[i];
+        if (chunk.sequence < header_.base_sequence || chunk.sequence > header_.sequence)
+        {
+            ok = false;
+            break;
+        }
+        auto it = files_.find(chunk.sequence);
+        if (it == files_.end())
+        {
+            const std::string other = SnapshotWriter::file_name(path, chunk.sequence);
+            std::unique_ptr<MappedFile> mapped(new MappedFile());
+            SnapshotHeader other_header;
+            if (!named || !mapped->open(other) || !read_header(*mapped, other_header)
+                || other_header.base_sequence != header_.base_sequence)
+            {
+                fprintf(stderr, "Error: Snapshot %s needs %s of the same chain\n", filename.c_str(), other.c_str());
+                close();
+                return false;
+            }
+            it = files_.emplace(chunk.sequence, std::move(mapped)).first;
+        }
+        ok = chunk.offset <= it->second->size() && chunk.stored_bytes <= it->second->size() - chunk.offset;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Error: %s is not a valid snapshot\n", filename.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SnapshotReader::close()
+{
+    header_ = SnapshotHeader();
+    streams_.clear();
+    chunks_.clear();
+    files_.clear();
+}
+
+const char* SnapshotReader::chunk_data(const SnapshotChunk& chunk, std::vector<char>& buffer) const
+{
+    const char* stored = files_.at(chunk.sequence)->data() + chunk.offset;
+    const char* data = nullptr;
+    if (chunk.codec == SNAPSHOT_CODEC_NONE && chunk.stored_bytes == chunk.raw_bytes)
+    {
+        data = stored;
+    }
+    else if (chunk.codec == SNAPSHOT_CODEC_LZ)
+    {
+        buffer.resize(chunk.raw_bytes);
+        if (lz_decompress(stored, chunk.stored_bytes, buffer.data(), buffer.size()))
+        {
+            data = buffer.data();
+        }
+    }
+    if (!data || hash_bytes(data, chunk.raw_bytes) != chunk.hash)
+    {
+        fprintf(stderr, "Error: Damaged snapshot chunk in file %llu at offset %llu\n",
+            (unsigned long long)chunk.sequence, (unsigned long long)chunk.offset);
+        return nullptr;
+    }
+    return data;
+}
+
+bool SnapshotReader::restore(const std::vector<ViewerPlugin*>& plugins) const
+{
+    bool ok = true;
+    for (const SnapshotStream& stream : streams_)
+    {
+        if (stream.flags & SNAPSHOT_STREAM_EMPTY)
+        {
+            continue;
+        }
+        char name[sizeof(SnapshotStream::name)];
+        if (stream.plugin < plugins.size())
+        {
+            stream_name(plugins[stream.plugin]->name(), name);
+        }
+        if (stream.plugin >= plugins.size() || memcmp(name, stream.name, sizeof(name)) != 0)
+        {
+            fprintf(stderr, "Warning: No plugin %.*s at position %u to restore\n", (int)sizeof(stream.name),
+                stream.name, stream.plugin);
+            continue;
+        }
+        SnapshotIn in(*this, stream);
+        if (!plugins[stream.plugin]->restore(in))
+        {
+            fprintf(stderr, "Error: Plugin %s could not restore its state\n", plugins[stream.plugin]->name().c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "../util/MappedFile.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ViewerPlugin;
+class SnapshotWriter;
+class SnapshotReader;
+
+// Snapshot of the plugins' state (.gvs), one stream per plugin cut into
+// fixed-size chunks. Layout:
+//   SnapshotHeader
+//   the chunks stored in this file, raw or LZ-compressed (64-byte aligned)
+//   SnapshotStream[num_streams], SnapshotChunk[num_chunks]
+// A delta snapshot only stores the chunks whose content hash changed since
+// the previous save; its table points the others into the earlier files of
+// the chain, which starts at a full snapshot. A full snapshot stores every
+// chunk. Files are named <path>.<sequence>.gvs.
+
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint32_t SNAPSHOT_DELTA = 1u << 0;
+constexpr uint32_t SNAPSHOT_STREAM_EMPTY = 1u << 0; // the plugin had nothing to save
+constexpr uint32_t SNAPSHOT_CODEC_NONE = 0;
+constexpr uint32_t SNAPSHOT_CODEC_LZ = 1;
+constexpr size_t SNAPSHOT_ALIGNMENT = 64;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags; // SNAPSHOT_DELTA
+    uint32_t endian;
+    uint32_t chunk_bytes;
+    uint64_t sequence;
+    uint64_t base_sequence; // the full snapshot the chain starts at
+    uint64_t num_streams;
+    uint64_t num_chunks;
+    uint64_t table_offset;
+};
+
+struct SnapshotStream
+{
+    char name[48]; // of the plugin, truncated
+    uint32_t plugin; // position in the plugin list
+    uint32_t flags; // SNAPSHOT_STREAM_EMPTY
+    uint64_t bytes;
+    uint64_t first_chunk;
+    uint64_t num_chunks;
+};
+
+struct SnapshotChunk
+{
+    uint64_t hash; // of the raw bytes
+    uint64_t sequence; // of the file holding them
+    uint64_t offset;
+    uint32_t raw_bytes;
+    uint32_t stored_bytes;
+    uint32_t codec;
+    uint32_t reserved;
+};
+
+// The stream a plugin writes its state to (ViewerPlugin::snapshot). Bytes
+// are cut into chunks as they come: a chunk equal to the one at the same
+// place in the previous save is only hashed, a changed one is copied for
+// the background writer. Whole chunks of a large write() are hashed in
+// place, so unchanged state is never copied.
+class SnapshotOut
+{
+public:
+    void write(const void* data, size_t bytes);
+    template <typename T>
+    void write_value(const T& value) { write(&value, sizeof(T)); }
+
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    friend class SnapshotWriter;
+    SnapshotOut(SnapshotWriter& writer, const SnapshotChunk* previous, size_t num_previous);
+
+    void add_chunks(const char* data, size_t count);
+    void add_chunk(const char* data, size_t bytes, uint64_t hash);
+    void finish();
+
+    SnapshotWriter& writer_;
+    const SnapshotChunk* previous_;
+    size_t num_previous_;
+    size_t num_chunks_ = 0;
+    uint64_t bytes_ = 0;
+};
+
+// The stream a plugin reads its state back from (ViewerPlugin::restore)
+class SnapshotIn
+{
+public:
+    // False past the end of the stream or on a damaged chunk
+    bool read(void* data, size_t bytes);
+    template <typename T>
+    bool read_value(T& value) { return read(&value, sizeof(T)); }
+
+    uint64_t size() const { return size_; }
+    uint64_t remaining() const { return size_ - position_; }
+
+private:
+    friend class SnapshotReader;
+    SnapshotIn(const SnapshotReader& reader, const SnapshotStream& stream);
+
+    bool next_chunk();
+
+    const SnapshotReader& reader_;
+    const SnapshotChunk* chunks_;
+    size_t num_chunks_;
+    size_t chunk_ = 0;
+    const char* data_ = nullptr; // of the current chunk
+    size_t data_size_ = 0;
+    size_t data_position_ = 0;
+    std::vector<char> buffer_; // decompressed chunk
+    uint64_t size_;
+    uint64_t position_ = 0;
+};
+
+struct SnapshotOptions
+{
+    uint32_t chunk_bytes = 1u << 20;
+    // LZ-compress the changed chunks on the background thread
+    bool compress = true;
+    // Every n-th save is a full snapshot and starts a new chain
+    uint32_t full_every = 32;
+    // Delete the files of the previous chain once a full snapshot is written
+    bool remove_superseded = true;
+    // Threads hashing large writes, 0 = one per hardware thread
+    unsigned threads = 0;
+};
+
+struct SnapshotStats
+{
+    uint64_t sequence = 0;
+    bool delta = false;
+    bool ok = false;
+    size_t streams = 0;
+    size_t chunks = 0;
+    size_t changed_chunks = 0;
+    uint64_t bytes = 0; // state over all streams
+    uint64_t changed_bytes = 0;
+    uint64_t stored_bytes = 0; // of the changed chunks, after compression
+    uint64_t copied_bytes = 0; // unchanged chunks a full snapshot copied from the previous chain
+    double capture_seconds = 0.0; // on the thread calling save()
+    double write_seconds = 0.0; // on the background thread
+};
+
+// Takes snapshots of the plugins' state. save() runs every plugin's
+// snapshot() on the calling thread, which only hashes the state and copies
+// the chunks that changed; compression and file IO run on a background
+// thread. That holds for full snapshots too: the background thread copies
+// their unchanged chunks from the mapped files of the previous chain. Each
+// file is written next to its final name and renamed into place, so a
+// crash never leaves a partial snapshot.
+class SnapshotWriter
+{
+public:
+    SnapshotOptions options;
+
+    SnapshotWriter() = default;
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Starts a new chain of <path>.<sequence>.gvs files at sequence 0
+    void open(const std::string& path);
+    bool is_open() const { return !path_.empty(); }
+
+    // Waits for the previous snapshot to be written, then captures this
+    // one. Returns **false** if no path is open. Callers that must not wait
+    // (autosave) check busy() first.
+    bool save(const std::vector<ViewerPlugin*>& plugins);
+    bool busy() const { return busy_; }
+    void wait();
+
+    // Of the last snapshot written
+    SnapshotStats stats() const;
+    std::string last_file() const;
+
+    static std::string file_name(const std::string& path, uint64_t sequence);
+
+private:
+    friend class SnapshotOut;
+
+    struct Pending
+    {
+        size_t chunk; // in chunks_
+        std::vector<char> data;
+    };
+
+    // On the background thread
+    void write_file();
+
+    std::string path_;
+    uint64_t next_sequence_ = 0;
+    uint64_t base_sequence_ = 0;
+    uint64_t superseded_base_ = 0; // first file of the chain a full snapshot replaces
+    bool superseded_ = false;
+
+    // The snapshot being captured or written
+    SnapshotOptions job_options_;
+    uint64_t sequence_ = 0;
+    bool delta_ = false;
+    std::vector<SnapshotStream> streams_;
+    std::vector<SnapshotChunk> chunks_;
+    std::vector<Pending> pending_;
+    std::vector<char> staging_; // partial chunk of the current stream
+    std::vector<uint64_t> hashes_;
+    std::vector<std::vector<char>> spare_; // recycled chunk copies
+    SnapshotStats capture_;
+
+    // Table of the last snapshot written, the base of the next delta
+    bool has_last_ = false;
+    std::vector<SnapshotStream> last_streams_;
+    std::vector<SnapshotChunk> last_chunks_;
+
+    std::thread thread_;
+    std::atomic<bool> busy_{ false };
+    mutable std::mutex mutex_;
+    SnapshotStats stats_;
+    std::string last_file_;
+};
+
+// A snapshot opened for restoring, with the files of its chain it points
+// into. Stored chunks are read from the mappings; raw ones without a copy.
+class SnapshotReader
+{
+public:
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return !files_.empty(); }
+
+    const SnapshotHeader& header() const { return header_; }
+    const std::vector<SnapshotStream>& streams() const { return streams_; }
+
+    // Hands every plugin the stream saved at its position under its name;
+    // plugins without one are left alone. Returns **false** if a plugin
+    // could not restore its stream.
+    bool restore(const std::vector<ViewerPlugin*>& plugins) const;
+
+private:
+    friend class SnapshotIn;
+
+    // The bytes of `chunk`, in a mapping or decompressed into `buffer`
+    const char* chunk_data(const SnapshotChunk& chunk, std::vector<char>& buffer) const;
+
+    SnapshotHeader header_ = {};
+    std::vector<SnapshotStream> streams_;
+    std::vector<SnapshotChunk> chunks_;
+    std::map<uint64_t, std::unique_ptr<MappedFile>> files_; // by sequence
+};
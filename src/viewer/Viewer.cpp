@@ -1,15 +1,20 @@
 #include "Viewer.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include<chrono>
-// Internal global variables used for glfw event handling
-static Viewer* __viewer;
-static int highdpi = 1;
-static double scroll_x = 0;
-static double scroll_y = 0;
+#include <thread>
+// GLFW is initialized with the first viewer and terminated with the last
+static int glfw_users = 0;
+
+// Every window carries its Viewer as the GLFW user pointer
+static Viewer* viewer_of(GLFWwindow* window)
+{
+    return static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+}
 
 
-static void glfw_mouse_press(GLFWwindow* /*window*/, int button, int action, int modifier)
+static void glfw_mouse_press(GLFWwindow* window, int button, int action, int modifier)
 {
     Viewer::MouseButton mb;
 
@@ -26,14 +31,8 @@ static void glfw_mouse_press(GLFWwindow* /*window*/, int button, int action, int
         mb = Viewer::MouseButton::Middle;
     }
 
-    if (action == GLFW_PRESS)
-    {
-        __viewer->mouse_down(mb, modifier);
-    }
-    else
-    {
-        __viewer->mouse_up(mb, modifier);
-    }
+    auto type = action == GLFW_PRESS ? InputEvent::Type::MouseDown : InputEvent::Type::MouseUp;
+    viewer_of(window)->input_queue.push(InputEvent::mouse_button(type, static_cast<int>(mb), modifier));
 }
 
 static void glfw_error_callback(int /*error*/, const char* description)
@@ -41,9 +40,9 @@ static void glfw_error_callback(int /*error*/, const char* description)
     fputs(description, stderr);
 }
 
-static void glfw_char_mods_callback(GLFWwindow* /*window*/, unsigned int codepoint, int modifier)
+static void glfw_char_mods_callback(GLFWwindow* window, unsigned int codepoint, int modifier)
 {
-    __viewer->key_pressed(codepoint, modifier);
+    viewer_of(window)->input_queue.push(InputEvent::key(InputEvent::Type::KeyPressed, (int)codepoint, modifier));
 }
 
 static void glfw_key_callback(GLFWwindow* window, int key, int /*scancode*/, int action, int modifier)
@@ -53,53 +52,93 @@ static void glfw_key_callback(GLFWwindow* window, int key, int /*scancode*/, int
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
+    Viewer* viewer = viewer_of(window);
     if (action == GLFW_PRESS)
     {
-        __viewer->key_down(key, modifier);
+        viewer->input_queue.push(InputEvent::key(InputEvent::Type::KeyDown, key, modifier));
     }
     else if (action == GLFW_RELEASE)
     {
-        __viewer->key_up(key, modifier);
+        viewer->input_queue.push(InputEvent::key(InputEvent::Type::KeyUp, key, modifier));
     }
     else if (action == GLFW_REPEAT)
     {
-        __viewer->key_repeat(key, modifier);
+        viewer->input_queue.push(InputEvent::key(InputEvent::Type::KeyRepeat, key, modifier));
     }
 }
 
 static void glfw_window_size(GLFWwindow* window, int width, int height)
 {
-    int w = (int)(width * highdpi);
-    int h = (int)(height * highdpi);
+    Viewer* viewer = viewer_of(window);
+    int w = (int)(width * viewer->highdpi);
+    int h = (int)(height * viewer->highdpi);
 
-    __viewer->post_resize(w, h);
+    viewer->post_resize(w, h);
 }
 
-static void glfw_mouse_move(GLFWwindow* /*window*/, double x, double y)
+static void glfw_mouse_move(GLFWwindow* window, double x, double y)
 {
-    __viewer->mouse_move((int)x * highdpi, (int)y * highdpi);
+    Viewer* viewer = viewer_of(window);
+    viewer->input_queue.push(InputEvent::mouse_move((int)x * viewer->highdpi, (int)y * viewer->highdpi));
 }
 
-static void glfw_mouse_scroll(GLFWwindow* /*window*/, double x, double y)
+static void glfw_mouse_scroll(GLFWwindow* window, double x, double y)
 {
     using namespace std;
-    scroll_x += x;
-    scroll_y += y;
+    Viewer* viewer = viewer_of(window);
+    viewer->scroll_x += x;
+    viewer->scroll_y += y;
 
-    __viewer->mouse_scroll((float)y);
+    viewer->input_queue.push(InputEvent::mouse_scroll((float)y));
 }
 
-static void glfw_drop_callback(GLFWwindow* /*window*/, int /*count*/, const char** /*filenames*/)
+// The window was uncovered or restored; its contents are gone
+static void glfw_window_refresh(GLFWwindow* window)
 {
+    viewer_of(window)->damage.invalidate(Damage::Resize);
+}
 
+static void glfw_drop_callback(GLFWwindow* window, int count, const char** filenames)
+{
+    Viewer* viewer = viewer_of(window);
+    for (int i = 0; i < count; ++i)
+    {
+        viewer->load_mesh_async(filenames[i]);
+    }
 }
 
 
 
+bool Viewer::acquire_glfw()
+{
+    if (!holds_glfw)
+    {
+        if (glfw_users == 0 && !glfwInit())
+        {
+            return false;
+        }
+        ++glfw_users;
+        holds_glfw = true;
+    }
+    return true;
+}
+
+void Viewer::release_glfw()
+{
+    if (holds_glfw)
+    {
+        holds_glfw = false;
+        if (--glfw_users == 0)
+        {
+            glfwTerminate();
+        }
+    }
+}
+
 [[maybe_unused]] int Viewer::launch(bool resizable /*= true*/, bool fullscreen /*= false*/, bool maximize /*= false*/,
-    const std::string& name, int windowWidth /*= 0*/, int windowHeight /*= 0*/)
+    const std::string& name, int windowWidth /*= 0*/, int windowHeight /*= 0*/, Viewer* share /*= nullptr*/)
 {
-    if (launch_init(resizable, fullscreen, maximize, name, windowWidth, windowHeight) == EXIT_FAILURE)
+    if (launch_init(resizable, fullscreen, maximize, name, windowWidth, windowHeight, share) == EXIT_FAILURE)
     {
         launch_shut();
         return EXIT_FAILURE;
@@ -110,10 +149,12 @@ static void glfw_drop_callback(GLFWwindow* /*window*/, int /*count*/, const char
 }
 
 int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
-    const std::string& name, int windowWidth, int windowHeight)
+    const std::string& name, int windowWidth, int windowHeight, Viewer* share)
 {
+    // Windows sharing a context share its buffers and textures
+    GLFWwindow* share_window = share ? share->window : nullptr;
     glfwSetErrorCallback(glfw_error_callback);
-    if (!glfwInit())
+    if (!acquire_glfw())
     {
         fprintf(stderr, "Error: Could not initialize OpenGL context");
         return EXIT_FAILURE;
@@ -130,7 +171,7 @@ int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
     {
         GLFWmonitor* monitor = glfwGetPrimaryMonitor();
         const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-        window = glfwCreateWindow(mode->width, mode->height, name.c_str(), monitor, nullptr);
+        window = glfwCreateWindow(mode->width, mode->height, name.c_str(), monitor, share_window);
         windowWidth = mode->width;
         windowHeight = mode->height;
     }
@@ -146,7 +187,7 @@ int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
         {
             windowHeight = 800;
         }
-        window = glfwCreateWindow(windowWidth, windowHeight, name.c_str(), nullptr, nullptr);
+        window = glfwCreateWindow(windowWidth, windowHeight, name.c_str(), nullptr, share_window);
         if (maximize)
         {
             glfwMaximizeWindow(window);
@@ -155,7 +196,7 @@ int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
     if (!window)
     {
         fprintf(stderr, "Error: Could not create GLFW window");
-        glfwTerminate();
+        release_glfw();
         return EXIT_FAILURE;
     }
     glfwMakeContextCurrent(window);
@@ -177,9 +218,10 @@ int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
     printf("Supported GLSL is %s\n", (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
 #endif
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+    init_buffers(share);
 
-    // Initialize one and only reference
-    __viewer = this;
+    // Route the callbacks of this window to this viewer
+    glfwSetWindowUserPointer(window, this);
 
     // Register callbacks
     glfwSetKeyCallback(window, glfw_key_callback);
@@ -189,6 +231,11 @@ int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
     glfwSetScrollCallback(window, glfw_mouse_scroll);
     glfwSetCharModsCallback(window, glfw_char_mods_callback);
     glfwSetDropCallback(window, glfw_drop_callback);
+    glfwSetWindowRefreshCallback(window, glfw_window_refresh);
+
+    // Wakes glfwWaitEvents in launch_rendering when a plugin marks damage
+    // from another thread
+    damage.notify = [] { glfwPostEmptyEvent(); };
 
     // Handle retina displays (windows and mac)
     int width, height;
@@ -205,36 +252,247 @@ int Viewer::launch_init(bool resizable, bool fullscreen, bool maximize,
     return EXIT_SUCCESS;
 }
 
-void Viewer::launch_rendering(bool loop)
+int Viewer::launch_init_offscreen(int windowWidth, int windowHeight, bool require_context, Viewer* share)
 {
-    // glfwMakeContextCurrent(window);
-    // Rendering loop
-    bool first = true;
-    const int num_extra_frames = 5;
-    int frame_counter = 0;
-    while (!glfwWindowShouldClose(window))
+    offscreen = true;
+    if (windowWidth <= 0)
+    {
+        windowWidth = 1280;
+    }
+    if (windowHeight <= 0)
+    {
+        windowHeight = 800;
+    }
+
+    glfwSetErrorCallback(glfw_error_callback);
+    if (acquire_glfw())
     {
-        double tic = std::chrono::duration<double>(
-            std::chrono::system_clock::now().time_since_epoch()).count();
-        draw(first);
-        if (first)
+        glfwDefaultWindowHints();
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_SAMPLES, 0);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        window = glfwCreateWindow(windowWidth, windowHeight, "offscreen", nullptr, share ? share->window : nullptr);
+    }
+
+    if (window)
+    {
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
         {
-            first = false;
+            fprintf(stderr, "Error: Failed to load OpenGL and its extensions\n");
+            return EXIT_FAILURE;
         }
-        glfwSwapBuffers(window);
-        if (is_animating || frame_counter++ < num_extra_frames)
+        // Offscreen frames are not tied to a display refresh
+        glfwSwapInterval(0);
+        init_buffers(share);
+    }
+    else if (require_context)
+    {
+        fprintf(stderr, "Error: Could not create an offscreen OpenGL context\n");
+        release_glfw();
+        return EXIT_FAILURE;
+    }
+    else
+    {
+        fprintf(stderr, "Warning: No OpenGL context, running without a window\n");
+    }
+
+    if (window)
+    {
+        glfwSetWindowUserPointer(window, this);
+    }
+    highdpi = 1;
+    post_resize(windowWidth, windowHeight);
+
+    init();
+    return EXIT_SUCCESS;
+}
+
+int Viewer::launch_frames(int num_frames, double time_step,
+    const std::function<bool(Viewer& viewer)>& until)
+{
+    int frames = 0;
+    while (num_frames < 0 || frames < num_frames)
+    {
+        if (window && glfwWindowShouldClose(window))
         {
+            break;
+        }
+        profiler.begin_frame();
+        ProfileScope frame_scope(profiler, FrameProfiler::Frame);
+        animation_time = frame_index * time_step;
+        if (window)
+        {
+            glfwMakeContextCurrent(window);
+        }
+        draw(frame_index == 0);
+        ++frame_index;
+        ++frames;
+        if (window)
+        {
+            {
+                ProfileScope scope(profiler, FrameProfiler::SwapBuffers);
+                glfwSwapBuffers(window);
+            }
+            // Never block: there is nobody to send the events
+            ProfileScope scope(profiler, FrameProfiler::Events);
             glfwPollEvents();
-            // In microseconds
-            double toc = std::chrono::duration<double>(
-                std::chrono::system_clock::now().time_since_epoch()).count();
-            double duration = 1000000. * (toc - tic);
+        }
+        if (until && until(*this))
+        {
+            break;
+        }
+    }
+    return frames;
+}
+
+bool Viewer::start_recording(const std::string& filename)
+{
+    return input_recorder.open(filename, framebuffer_width, framebuffer_height);
+}
+
+bool Viewer::stop_recording()
+{
+    return input_recorder.close();
+}
+
+int Viewer::replay_input(const InputLog& log, bool realtime, ReplayStats* stats)
+{
+    ReplayStats local;
+    ReplayStats& replay = stats ? *stats : local;
+    replay = ReplayStats();
+    replay.frame_ns.reserve(log.frames.size());
+    const double first_time = log.frames.empty() ? 0.0 : log.frames.front().animation_time;
+    camera_time = first_time;
+    const auto start = std::chrono::steady_clock::now();
+    for (const InputLogFrame& frame : log.frames)
+    {
+        if (window && glfwWindowShouldClose(window))
+        {
+            break;
+        }
+        if (realtime)
+        {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(frame.animation_time - first_time)));
+        }
+        for (uint32_t i = 0; i < frame.num_events; ++i)
+        {
+            input_queue.push(log.events[frame.first_event + i].event);
+        }
+        replay.events += frame.num_events;
 
+        profiler.begin_frame();
+        const int64_t begin_ns = profiler.now_ns();
+        {
+            ProfileScope frame_scope(profiler, FrameProfiler::Frame);
+            animation_time = frame.animation_time;
+            if (window)
+            {
+                glfwMakeContextCurrent(window);
+            }
+            draw(frame_index == 0);
+            ++frame_index;
+            if (window)
+            {
+                ProfileScope scope(profiler, FrameProfiler::SwapBuffers);
+                glfwSwapBuffers(window);
+            }
         }
-        else
+        replay.frame_ns.push_back(profiler.now_ns() - begin_ns);
+        ++replay.frames;
+        if (window)
         {
+            ProfileScope scope(profiler, FrameProfiler::Events);
+            glfwPollEvents();
+        }
+    }
+    replay.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    replay.summarize();
+    return replay.frames;
+}
+
+bool Viewer::render_frame()
+{
+    profiler.begin_frame();
+    frame_begin_ns = profiler.now_ns();
+    animation_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    glfwMakeContextCurrent(window);
+    if (draw_frame(frame_index == 0, lazy_redraw))
+    {
+        ++frame_index;
+        ProfileScope scope(profiler, FrameProfiler::SwapBuffers);
+        glfwSwapBuffers(window);
+    }
+    // Keep polling while uploads are spread over frames
+    if (is_animating || camera.is_moving() || assets.uploading() > 0)
+    {
+        return true;
+    }
+    // Damage marked during this frame is drawn by the next one
+    return lazy_redraw ? damage.pending() : extra_frame_counter++ < num_extra_frames;
+}
+
+void Viewer::launch_rendering(bool loop)
+{
+    launch_rendering({ this }, loop);
+}
+
+void Viewer::launch_rendering(const std::vector<Viewer*>& viewers, bool loop)
+{
+    // Rendering loop: every open window draws, then the events of all
+    // windows are handled at once
+    for (;;)
+    {
+        Viewer* lead = nullptr;
+        bool poll = false;
+        for (Viewer* viewer : viewers)
+        {
+            if (!viewer->window || glfwWindowShouldClose(viewer->window))
+            {
+                continue;
+            }
+            lead = lead ? lead : viewer;
+            poll = viewer->render_frame() || poll;
+        }
+        if (!lead)
+        {
+            return;
+        }
+
+        if (poll)
+        {
+            ProfileScope scope(lead->profiler, FrameProfiler::Events);
+            glfwPollEvents();
+        }
+        // Idle time spent waiting for events is not part of the frame
+        for (Viewer* viewer : viewers)
+        {
+            if (viewer->window && viewer->profiler.enabled)
+            {
+                viewer->profiler.record(FrameProfiler::Frame, viewer->frame_begin_ns, viewer->profiler.now_ns());
+            }
+        }
+        if (!poll)
+        {
+            ProfileScope scope(lead->profiler, FrameProfiler::WaitEvents);
             glfwWaitEvents();
-            frame_counter = 0;
+            for (Viewer* viewer : viewers)
+            {
+                viewer->extra_frame_counter = 0;
+                // Time spent idle must not count as missed frames
+                viewer->frame_pacer.reset();
+            }
+        }
+        else
+        {
+            ProfileScope scope(lead->profiler, FrameProfiler::FramePacing);
+            lead->frame_pacer.end_frame();
         }
         if (!loop)
         {
@@ -244,8 +502,14 @@ void Viewer::launch_rendering(bool loop)
 #ifdef __APPLE__
         static bool first_time_hack = true;
         if (first_time_hack) {
-            glfwHideWindow(window);
-            glfwShowWindow(window);
+            for (Viewer* viewer : viewers)
+            {
+                if (viewer->window)
+                {
+                    glfwHideWindow(viewer->window);
+                    glfwShowWindow(viewer->window);
+                }
+            }
             first_time_hack = false;
         }
 #endif
@@ -256,9 +520,26 @@ void Viewer::launch_shut()
 {
 
    // core().shut(); // Doesn't do anything
+    // No plugin may be loading while the plugins shut down
+    assets.stop();
+    jobs.stop();
+    snapshots.wait();
+    stop_recording();
     shutdown_plugins();
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (window)
+    {
+        // The last viewer of a share group deletes the GL buffers
+        glfwMakeContextCurrent(window);
+        assets.discard(buffers.get());
+        if (buffers && buffers.use_count() == 1)
+        {
+            buffers->shutdown();
+        }
+        buffers.reset();
+        glfwDestroyWindow(window);
+        window = nullptr;
+    }
+    release_glfw();
 }
 
 void Viewer::init()
@@ -283,6 +564,21 @@ void Viewer::init_plugins()
     {
         plugin->init(this);
     }
+    update_plugin_stages();
+}
+
+void Viewer::update_plugin_stages()
+{
+    plugin_hooks.update(plugins);
+    plugin_pre_draw_stages.clear();
+    plugin_post_draw_stages.clear();
+    for (size_t i = 0; i < plugins.size(); ++i)
+    {
+        // Index first: several plugins may share a name
+        std::string name = std::to_string(i) + ":" + plugins[i]->name();
+        plugin_pre_draw_stages.push_back(profiler.register_stage("pre_draw[" + name + "]"));
+        plugin_post_draw_stages.push_back(profiler.register_stage("post_draw[" + name + "]"));
+    }
 }
 
 void Viewer::shutdown_plugins()
@@ -293,9 +589,137 @@ void Viewer::shutdown_plugins()
     }
 }
 
+bool Viewer::load_mesh_from_file(const std::string& mesh_file_name, bool only_vertices)
+{
+    bool loaded = false;
+    for (auto& plugin : plugins)
+    {
+        if (plugin->load(mesh_file_name, only_vertices))
+        {
+            loaded = true;
+            break;
+        }
+    }
+    if (!loaded)
+    {
+        fprintf(stderr, "Error: No plugin could load %s\n", mesh_file_name.c_str());
+        return false;
+    }
+
+    post_load_plugins();
+    damage.invalidate(Damage::Scene);
+    return true;
+}
+
+bool Viewer::save_snapshot()
+{
+    ProfileScope scope(profiler, FrameProfiler::Snapshot);
+    last_autosave = std::chrono::steady_clock::now();
+    return snapshots.save(plugins);
+}
+
+bool Viewer::load_snapshot(const std::string& filename)
+{
+    SnapshotReader reader;
+    if (!reader.open(filename) || !reader.restore(plugins))
+    {
+        return false;
+    }
+    damage.invalidate(Damage::Scene);
+    return true;
+}
+
+void Viewer::post_load_plugins()
+{
+    for (auto& plugin : plugins)
+    {
+        if (plugin->post_load())
+        {
+            break;
+        }
+    }
+}
+
+std::shared_ptr<Asset> Viewer::load_mesh_async(const std::string& mesh_file_name, bool only_vertices)
+{
+    if (!assets.load)
+    {
+        // Plugins are registered before the first request and stay put, so
+        // the loader threads may walk the list
+        assets.load = [this](Asset& asset)
+        {
+            for (auto& plugin : plugins)
+            {
+                if (plugin->load_async(asset))
+                {
+                    asset.plugin = plugin;
+                    return true;
+                }
+            }
+            return false;
+        };
+        // Wakes glfwWaitEvents in launch_rendering when a load completes
+        if (window)
+        {
+            assets.notify = [] { glfwPostEmptyEvent(); };
+        }
+    }
+    return assets.request(mesh_file_name, only_vertices);
+}
+
+void Viewer::update_assets()
+{
+    std::vector<std::shared_ptr<Asset>> finished;
+    assets.update(buffers.get(), finished);
+    for (auto& asset : finished)
+    {
+        if (asset->state == Asset::State::Failed || !asset->plugin)
+        {
+            fprintf(stderr, "Error: No plugin could load %s\n", asset->filename.c_str());
+            continue;
+        }
+        if (asset->plugin->load_finished(*asset))
+        {
+            post_load_plugins();
+        }
+        else
+        {
+            AssetLoader::release(buffers.get(), *asset);
+        }
+        damage.invalidate(Damage::Scene);
+    }
+}
+
+bool Viewer::save_mesh_to_file(const std::string& mesh_file_name, bool only_vertices)
+{
+    for (auto& plugin : plugins)
+    {
+        if (plugin->save(mesh_file_name, only_vertices))
+        {
+            return true;
+        }
+    }
+    fprintf(stderr, "Error: No plugin could save %s\n", mesh_file_name.c_str());
+    return false;
+}
+
 Viewer::Viewer()
 {
     window = nullptr;
+    highdpi = 1;
+    scroll_x = 0;
+    scroll_y = 0;
+    holds_glfw = false;
+    extra_frame_counter = 0;
+    frame_begin_ns = 0;
+    start_time = std::chrono::steady_clock::now();
+    is_animating = false;
+    offscreen = false;
+    framebuffer_width = 0;
+    framebuffer_height = 0;
+    frame_index = 0;
+    animation_time = 0.0;
+    camera_time = 0.0;
 
 
     // Temporary variables initialization
@@ -342,7 +766,7 @@ Viewer::~Viewer() = default;
 
 bool Viewer::key_pressed(unsigned int key, int modifiers)
 {
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::KeyPressed))
     {
         if (plugin->key_pressed(key, modifiers))
         {
@@ -363,7 +787,7 @@ bool Viewer::key_pressed(unsigned int key, int modifiers)
 
 bool Viewer::key_down(int key, int modifiers)
 {
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::KeyDown))
     {
         if (plugin->key_down(key, modifiers))
         {
@@ -384,7 +808,7 @@ bool Viewer::key_down(int key, int modifiers)
 
 bool Viewer::key_up(int key, int modifiers)
 {
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::KeyUp))
     {
         if (plugin->key_up(key, modifiers))
         {
@@ -405,7 +829,7 @@ bool Viewer::key_up(int key, int modifiers)
 
 bool Viewer::key_repeat(int key, int modifiers)
 {
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::KeyRepeat))
     {
         if (plugin->key_repeat(key, modifiers))
         {
@@ -432,7 +856,7 @@ bool Viewer::mouse_down(MouseButton button, int modifier)
     down_mouse_x = current_mouse_x;
     down_mouse_y = current_mouse_y;
 
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::MouseDown))
     {
         if (plugin->mouse_down(static_cast<int>(button), modifier))
         {
@@ -450,23 +874,25 @@ bool Viewer::mouse_down(MouseButton button, int modifier)
 
     down = true;
 
-
-   
-
-    // Initialization code for the trackball
-    Eigen::RowVector3d center;
-  
-    mouse_mode = MouseMode::Rotation;
+    // Initialization code for the trackball: the drag is applied relative
+    // to the camera target at press time
+    down_rotation = camera.target_rotation();
+    down_translation = camera.target_pivot();
+    down_mouse_z = camera.target_distance();
+    camera.grab();
 
     switch (button)
     {
     case MouseButton::Left:
+        mouse_mode = (modifier & GLFW_MOD_SHIFT) ? MouseMode::Translation : MouseMode::Rotation;
         break;
 
     case MouseButton::Right:
+        mouse_mode = MouseMode::Translation;
         break;
 
     default:
+        mouse_mode = MouseMode::Zoom;
         break;
     }
 
@@ -477,7 +903,7 @@ bool Viewer::mouse_up(MouseButton button, int modifier)
 {
     down = false;
 
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::MouseUp))
     {
         if (plugin->mouse_up(static_cast<int>(button), modifier))
         {
@@ -494,14 +920,17 @@ bool Viewer::mouse_up(MouseButton button, int modifier)
     }
 
     mouse_mode = MouseMode::None;
+    camera.release();
 
     return true;
 }
 
 bool Viewer::mouse_move(int mouse_x, int mouse_y)
 {
+    current_mouse_x = mouse_x;
+    current_mouse_y = mouse_y;
   
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::MouseMove))
     {
         if (plugin->mouse_move(mouse_x, mouse_y))
         {
@@ -517,35 +946,7 @@ bool Viewer::mouse_move(int mouse_x, int mouse_y)
         }
     }
 
-    if (down)
-    {
-        // We need the window height to transform the mouse click coordinates
-        // into viewport-mouse-click coordinates for trackball and
-        // two_axis_valuator_fixed_up
-        int width_window, height_window;
-        glfwGetFramebufferSize(window, &width_window, &height_window);
-        switch (mouse_mode)
-        {
-        case MouseMode::Rotation:
-        {
-  
-            break;
-        }
-
-        case MouseMode::Translation:
-        {
-          
-            break;
-        }
-        case MouseMode::Zoom:
-        {
-            break;
-        }
-
-        default:
-            break;
-        }
-    }
+    // The camera follows the drag in update_camera(), once per frame
     return true;
 }
 
@@ -556,7 +957,7 @@ bool Viewer::mouse_scroll(float delta_y)
    
     scroll_position += delta_y;
 
-    for (auto& plugin : plugins)
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::MouseScroll))
     {
         if (plugin->mouse_scroll(delta_y))
         {
@@ -572,30 +973,206 @@ bool Viewer::mouse_scroll(float delta_y)
         }
     }
 
+    camera.zoom_by(delta_y);
+
 
     return true;
 }
 
+void Viewer::dispatch_input_events()
+{
+    ProfileScope scope(profiler, FrameProfiler::InputEvents);
+    input_stats = InputStats();
+    InputEvent pending;
+    bool has_pending = false;
+    InputEvent event;
+    const bool recording = input_recorder.is_open();
+    while (input_stats.received < max_input_events_per_frame && input_queue.pop(event))
+    {
+        ++input_stats.received;
+        if (recording)
+        {
+            input_recorder.add_event(event);
+        }
+        if (has_pending && pending.type == event.type)
+        {
+            if (event.type == InputEvent::Type::MouseMove)
+            {
+                pending = event;
+                ++input_stats.coalesced;
+                continue;
+            }
+            if (event.type == InputEvent::Type::MouseScroll)
+            {
+                pending.delta_y += event.delta_y;
+                ++input_stats.coalesced;
+                continue;
+            }
+        }
+        if (has_pending)
+        {
+            dispatch_event(pending);
+            ++input_stats.dispatched;
+        }
+        pending = event;
+        has_pending = true;
+    }
+    if (has_pending)
+    {
+        dispatch_event(pending);
+        ++input_stats.dispatched;
+    }
+    if (redraw_on_input && input_stats.dispatched > 0)
+    {
+        damage.invalidate_all();
+    }
+    if (recording)
+    {
+        input_recorder.end_frame(animation_time);
+    }
+}
+
+bool Viewer::dispatch_event(const InputEvent& event)
+{
+    switch (event.type)
+    {
+    case InputEvent::Type::MouseDown:
+        return mouse_down(static_cast<MouseButton>(event.a), event.b);
+    case InputEvent::Type::MouseUp:
+        return mouse_up(static_cast<MouseButton>(event.a), event.b);
+    case InputEvent::Type::MouseMove:
+        return mouse_move(event.a, event.b);
+    case InputEvent::Type::MouseScroll:
+        return mouse_scroll(event.delta_y);
+    case InputEvent::Type::KeyPressed:
+        return key_pressed((unsigned int)event.a, event.b);
+    case InputEvent::Type::KeyDown:
+        return key_down(event.a, event.b);
+    case InputEvent::Type::KeyUp:
+        return key_up(event.a, event.b);
+    case InputEvent::Type::KeyRepeat:
+        return key_repeat(event.a, event.b);
+    }
+    return false;
+}
+
+void Viewer::init_buffers(Viewer* share)
+{
+    // One set of GL buffers per share group; the slices in it stay owned by
+    // the plugin of the viewer that allocated them
+    buffers = (share && share->buffers) ? share->buffers : std::make_shared<BufferManager>();
+    if (!buffers->init())
+    {
+        fprintf(stderr, "Warning: Could not initialize the GPU buffer manager\n");
+        buffers.reset();
+    }
+}
+
 void Viewer::draw(bool first)
 {
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
+    draw_frame(first, false);
+}
 
-    int width_window, height_window;
-    glfwGetWindowSize(window, &width_window, &height_window);
+bool Viewer::draw_frame(bool first, bool lazy)
+{
+    const HeapCounters heap_begin = thread_heap_counters();
+    frame_arena.begin_frame();
+
+    // Plugins added or removed since the last frame
+    if (plugin_hooks.stale(plugins))
+    {
+        update_plugin_stages();
+    }
 
-    auto highdpi_tmp = (width_window == 0 || width == 0) ? highdpi : (width / width_window);
+    dispatch_input_events();
 
-    if (fabs(highdpi_tmp - highdpi) > 1e-8)
+    if (assets.pending() > 0)
     {
-        post_resize(width, height);
-        highdpi = highdpi_tmp;
+        ProfileScope scope(profiler, FrameProfiler::Assets);
+        update_assets();
     }
 
+    update_camera();
 
-    for (auto& plugin : plugins)
+    if (window)
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+
+        int width_window, height_window;
+        glfwGetWindowSize(window, &width_window, &height_window);
+
+        auto highdpi_tmp = (width_window == 0 || width == 0) ? highdpi : (width / width_window);
+
+        if (fabs(highdpi_tmp - highdpi) > 1e-8)
+        {
+            post_resize(width, height);
+            highdpi = highdpi_tmp;
+        }
+    }
+
+    if (is_animating)
+    {
+        damage.invalidate_all();
+    }
+    const bool drawn = damage.begin_frame(framebuffer_width, framebuffer_height, !lazy);
+    if (drawn)
+    {
+        render(first);
+    }
+
+    if (autosave_seconds > 0.0 && snapshots.is_open() && !snapshots.busy()
+        && std::chrono::steady_clock::now() - last_autosave >= std::chrono::duration<double>(autosave_seconds))
+    {
+        save_snapshot();
+    }
+
+    heap_stats.last_frame = thread_heap_counters() - heap_begin;
+    heap_stats.max_frame_allocations = std::max(heap_stats.max_frame_allocations, heap_stats.last_frame.allocations);
+    ++heap_stats.frames;
+    if (heap_stats.last_frame.allocations > 0)
+    {
+        ++heap_stats.frames_allocating;
+    }
+    return drawn;
+}
+
+void Viewer::render(bool first)
+{
+    if (buffers)
+    {
+        buffers->begin_frame();
+    }
+
+    // Clears and draws stay inside the damage; plugins that set their own
+    // scissor rectangle should intersect it with damage.frame_rect()
+    const bool scissor = window && !damage.frame_full();
+    if (scissor)
+    {
+        const DamageRect& rect = damage.frame_rect();
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(rect.x, framebuffer_height - rect.y - rect.height, rect.width, rect.height);
+    }
+
+    frame_tasks.clear();
+    for (ViewerPlugin* plugin : plugin_hooks.plugins(PluginHook::PreDrawTasks))
     {
-        if (plugin->pre_draw(first))
+        if (plugin->pre_draw_tasks(frame_tasks, first))
+        {
+            break;
+        }
+    }
+    if (!frame_tasks.empty())
+    {
+        ProfileScope scope(profiler, FrameProfiler::Tasks);
+        jobs.run(frame_tasks);
+    }
+
+    const std::vector<uint32_t>& pre_draw_plugins = plugin_hooks.indices(PluginHook::PreDraw);
+    for (uint32_t i : pre_draw_plugins)
+    {
+        ProfileScope scope(profiler, plugin_pre_draw_stages[i]);
+        if (plugins[i]->pre_draw(first))
         {
             break;
         }
@@ -603,6 +1180,7 @@ void Viewer::draw(bool first)
 
     if (callback_pre_draw)
     {
+        ProfileScope scope(profiler, FrameProfiler::CallbackPreDraw);
         if (callback_pre_draw(*this))
         {
 
@@ -612,14 +1190,25 @@ void Viewer::draw(bool first)
 
 
     //pre-draw finish
-    DrawAction();
+    if (DrawAction)
+    {
+        ProfileScope scope(profiler, FrameProfiler::DrawAction);
+        DrawAction();
+    }
+
+    {
+        ProfileScope scope(profiler, FrameProfiler::RenderQueue);
+        render_queue.flush(buffers.get());
+    }
     //post-draw action
 
 
 
-    for (auto& plugin : plugins)
+    const std::vector<uint32_t>& post_draw_plugins = plugin_hooks.indices(PluginHook::PostDraw);
+    for (uint32_t i : post_draw_plugins)
     {
-        if (plugin->post_draw(first))
+        ProfileScope scope(profiler, plugin_post_draw_stages[i]);
+        if (plugins[i]->post_draw(first))
         {
             break;
         }
@@ -627,18 +1216,100 @@ void Viewer::draw(bool first)
 
     if (callback_post_draw)
     {
+        ProfileScope scope(profiler, FrameProfiler::CallbackPostDraw);
         if (callback_post_draw(*this))
         {
 
         }
     }
+
+    if (scissor)
+    {
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    if (buffers)
+    {
+        buffers->end_frame();
+    }
+}
+
+void Viewer::print_heap_stats(FILE* out) const
+{
+    if (!heap_counting_enabled())
+    {
+        fprintf(out, "Heap allocations are not counted in this build (GLFW_VIEWER_COUNT_ALLOCATIONS)\n");
+        return;
+    }
+    fprintf(out, "Heap allocations: %llu in the last frame (%llu bytes), at most %llu per frame, "
+        "%d of %d frames allocating; frame arena peak %zu bytes\n",
+        (unsigned long long)heap_stats.last_frame.allocations, (unsigned long long)heap_stats.last_frame.bytes,
+        (unsigned long long)heap_stats.max_frame_allocations, heap_stats.frames_allocating, heap_stats.frames,
+        frame_arena.current().peak());
 }
 
 
 
+void Viewer::update_camera()
+{
+    const float dt = (float)(animation_time - camera_time);
+    camera_time = animation_time;
+    if (!camera.enabled)
+    {
+        return;
+    }
+
+    if (down)
+    {
+        // Mouse coordinates are in framebuffer pixels
+        switch (mouse_mode)
+        {
+        case MouseMode::Rotation:
+            camera.rotate_to(down_rotation, down_mouse_x, down_mouse_y, current_mouse_x, current_mouse_y,
+                framebuffer_width, framebuffer_height);
+            break;
+
+        case MouseMode::Translation:
+        case MouseMode::Pan:
+            camera.pan_to(down_translation, down_mouse_z, current_mouse_x - down_mouse_x,
+                current_mouse_y - down_mouse_y, framebuffer_height);
+            break;
+
+        case MouseMode::Zoom:
+            camera.zoom_to(down_mouse_z, current_mouse_y - down_mouse_y, framebuffer_height);
+            break;
+
+        default:
+            break;
+        }
+    }
+    camera.update(dt);
+    const Eigen::Matrix4f new_view = camera.view_matrix();
+    const Eigen::Matrix4f new_proj = camera.projection_matrix(framebuffer_width, framebuffer_height);
+    if (new_view != view || new_proj != proj)
+    {
+        view = new_view;
+        proj = new_proj;
+        damage.invalidate(Damage::Camera);
+    }
+}
+
+void Viewer::mouse_ray(int x, int y, Eigen::Vector3f& origin, Eigen::Vector3f& direction) const
+{
+    const float ndc_x = 2.0f * (x + 0.5f) / std::max(1, framebuffer_width) - 1.0f;
+    const float ndc_y = 1.0f - 2.0f * (y + 0.5f) / std::max(1, framebuffer_height);
+    const Eigen::Matrix4f inverse = (proj * view).inverse();
+    Eigen::Vector4f near_point = inverse * Eigen::Vector4f(ndc_x, ndc_y, -1.0f, 1.0f);
+    Eigen::Vector4f far_point = inverse * Eigen::Vector4f(ndc_x, ndc_y, 1.0f, 1.0f);
+    origin = near_point.head<3>() / near_point.w();
+    direction = (far_point.head<3>() / far_point.w() - origin).normalized();
+}
+
 void Viewer::post_resize(int w, int h){
 
- 
+    framebuffer_width = w;
+    framebuffer_height = h;
+    damage.invalidate(Damage::Resize);
     for (auto& plugin : plugins)
     {
         plugin->post_resize(w, h);
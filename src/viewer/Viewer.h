@@ -6,6 +6,24 @@
 #include <string>
 #include <iostream>
 #include <functional>
+#include <chrono>
+#include "FramePacer.h"
+#include "FrameProfiler.h"
+#include "Camera.h"
+#include "DamageTracker.h"
+#include "InputLog.h"
+#include "InputQueue.h"
+#include "PluginHookTable.h"
+#include "Snapshot.h"
+#include "AssetLoader.h"
+#include "../render/BufferManager.h"
+#include "../render/RenderQueue.h"
+#include "../util/FrameArena.h"
+#include "../util/HeapCounter.h"
+#include "../util/JobSystem.h"
+#include "../util/ObjectPool.h"
+#include <memory>
+#include <type_traits>
 
 
 
@@ -28,22 +46,55 @@ public:
         None, Rotation, Zoom, Pan, Translation
     };
 
+    // `share`: an already launched viewer whose GL context (buffers,
+    // textures, shaders) and BufferManager the new window shares. Loaded
+    // meshes are not shared: each viewer uploads its own.
     [[maybe_unused]] int launch(
         bool resizable = true, bool fullscreen = false, bool maximize = false,
-        const std::string& name = "viewer", int width = 0, int height = 0);
+        const std::string& name = "viewer", int width = 0, int height = 0,
+        Viewer* share = nullptr);
 
     [[maybe_unused]] int launch_init(
         bool resizable = true, bool fullscreen = false, bool maximize = false,
-        const std::string& name = "viewer", int width = 0, int height = 0);
+        const std::string& name = "viewer", int width = 0, int height = 0,
+        Viewer* share = nullptr);
 
     void launch_rendering(bool loop = true);
+    // Renders several viewers (windows) from one loop until all are closed
+    static void launch_rendering(const std::vector<Viewer*>& viewers, bool loop = true);
     void launch_shut();
 
+    // Offscreen mode for batch jobs and CI. Creates a hidden window (or an
+    // OSMesa context when GLFW is built with GLFW_USE_OSMESA). Without a
+    // display the viewer runs with no window and no GL context at all,
+    // unless require_context is set.
+    int launch_init_offscreen(int width = 1280, int height = 800, bool require_context = false,
+        Viewer* share = nullptr);
+
+    // Deterministic frame loop: runs draw() num_frames times (forever if
+    // negative) with animation_time advancing by a fixed time_step, and
+    // stops early once `until` returns true. Returns the frames drawn.
+    int launch_frames(int num_frames, double time_step = 1.0 / 60.0,
+        const std::function<bool(Viewer& viewer)>& until = nullptr);
+
     void init();
 
     void init_plugins();
     void shutdown_plugins();
 
+    // Mesh IO: offered to the plugins in order, the first one that handles
+    // the file wins. post_load runs on every plugin after a successful load.
+    bool load_mesh_from_file(const std::string& mesh_file_name, bool only_vertices = false);
+    bool save_mesh_to_file(const std::string& mesh_file_name, bool only_vertices = false);
+
+    // Background load (also used for files dropped on the window): the file
+    // is read by the first plugin whose load_async() takes it, uploaded
+    // within assets.upload_budget bytes per frame, then handed to that
+    // plugin's load_finished() and post_load runs as usual. Returns at once.
+    std::shared_ptr<Asset> load_mesh_async(const std::string& mesh_file_name, bool only_vertices = false);
+    // Takes over the assets that finished; runs once per frame in draw()
+    void update_assets();
+
     Viewer();
     ~Viewer();
 
@@ -57,9 +108,23 @@ public:
     bool mouse_move(int mouse_x, int mouse_y);
     bool mouse_scroll(float delta_y);
 
-    // Draw everything
+    // Input from the GLFW callbacks is queued and dispatched once per frame
+    // at the start of draw(). Consecutive mouse moves collapse into the last
+    // one and consecutive scrolls are summed before the handlers run.
+    void dispatch_input_events();
+    bool dispatch_event(const InputEvent& event);
+
+    // Draw everything, whatever the damage
     void draw(bool first);
 
+    // Applies the drag in progress to the camera and advances it to
+    // animation_time; runs once per frame in draw() after the input
+    void update_camera();
+
+    // World-space ray through framebuffer pixel (x, y), origin on the near
+    // plane
+    void mouse_ray(int x, int y, Eigen::Vector3f& origin, Eigen::Vector3f& direction) const;
+
 
     // OpenGL context resize
     void resize(int w, int h); // explicitly set window size
@@ -83,11 +148,128 @@ public:
     
 
     GLFWwindow* window;
+    // Framebuffer pixels per window coordinate
+    int highdpi;
+    // Accumulated scroll wheel offsets
+    double scroll_x;
+    double scroll_y;
     bool is_animating;
+    bool offscreen;
+
+    // Framebuffer size in pixels, also valid without a window
+    int framebuffer_width;
+    int framebuffer_height;
+
+    // Frames drawn so far and the time they were drawn at, in seconds. In
+    // offscreen mode the time advances by the fixed step of launch_frames.
+    int frame_index;
+    double animation_time;
   
     // List of registered plugins
     std::vector<ViewerPlugin*> plugins;
 
+    // Per-stage frame timings (see FrameProfiler)
+    FrameProfiler profiler;
+
+    // Frame rate cap while animating (frame_pacer.target_fps, 0 = uncapped)
+    FramePacer frame_pacer;
+
+    // Lazy redraw: launch_rendering only draws frames with damage, marked by
+    // the plugins (damage.invalidate*()) and by the viewer itself (camera
+    // motion, resizes, finished loads, is_animating). Overlay-only damage
+    // is drawn with the scissor test on; damage.stats() counts the frames
+    // rendered and skipped. Without lazy_redraw every frame after an event
+    // is drawn, as in the plain event loop.
+    DamageTracker damage;
+    bool lazy_redraw = true;
+    // Damage the whole frame on every input event, for plugins and
+    // callbacks that change what they draw without marking it. Plugins
+    // that mark their own damage turn it off.
+    bool redraw_on_input = true;
+
+    // Pending input events; any thread may push into it
+    InputQueue input_queue;
+    // Raw events taken from the queue per frame, the rest waits a frame
+    int max_input_events_per_frame = 1024;
+    struct InputStats
+    {
+        int received = 0;   // taken from the queue
+        int dispatched = 0; // handed to plugins/callbacks after coalescing
+        int coalesced = 0;
+    };
+    InputStats input_stats; // of the last frame
+
+    // Input record and replay (see InputLog.h). While recording, every
+    // event taken from input_queue is logged with its time and frame.
+    InputRecorder input_recorder;
+    bool start_recording(const std::string& filename);
+    bool stop_recording();
+    // Plays a recorded session back in this (usually offscreen) viewer:
+    // each frame's events go through input_queue into draw(), which runs at
+    // the recorded animation_time, so plugins see the same events in the
+    // same frames. realtime paces the frames to the recorded times,
+    // otherwise they run as fast as possible. Returns the frames drawn;
+    // `stats` gets the time of every frame.
+    int replay_input(const InputLog& log, bool realtime = false, ReplayStats* stats = nullptr);
+
+    // GPU buffers of this context, shared with the viewers created with
+    // `share`. Null without a GL context. Framed by draw().
+    std::shared_ptr<BufferManager> buffers;
+
+    // Draw packets submitted by the plugins and callbacks during a frame;
+    // sorted, instanced and issued by draw() right after DrawAction.
+    // render_queue.stats() has the submitted vs issued draws of the frame.
+    RenderQueue render_queue;
+
+    // Background loads and their upload queue (see load_mesh_async)
+    AssetLoader assets;
+
+    // Snapshots of the plugins' state: snapshots.open("session") once, then
+    // save_snapshot() captures on the render thread and writes the changed
+    // chunks in the background. With autosave_seconds > 0, draw() saves
+    // that often, skipping frames while the previous one is still written.
+    SnapshotWriter snapshots;
+    double autosave_seconds = 0.0;
+    bool save_snapshot();
+    // Restores the plugins from a .gvs file and the chain it points into
+    bool load_snapshot(const std::string& filename);
+
+    // Worker threads for the plugins' CPU work. Every frame draw() collects
+    // frame_tasks from pre_draw_tasks() of each plugin and runs them here,
+    // then the serial pre_draw() calls and GL submission follow. Started on
+    // first use with all hardware threads; jobs.start(n) before the first
+    // frame picks another count, jobs.stats() has per-worker utilization.
+    JobSystem jobs;
+    TaskGraph frame_tasks;
+
+    // Scratch memory for the current frame, valid until the start of the
+    // frame after next; reset by draw(). Use it (or a FrameVector over it)
+    // instead of the heap for anything that lives only a frame or two.
+    FrameArena frame_arena;
+    // Recycled objects of any type: pools.get<T>().acquire(...) / release()
+    PoolSet pools;
+
+    // Heap allocations of the render thread during draw(). Only counted in
+    // builds with GLFW_VIEWER_COUNT_ALLOCATIONS; steady-state frames should
+    // report zero.
+    struct HeapStats
+    {
+        HeapCounters last_frame;
+        uint64_t max_frame_allocations = 0;
+        int frames = 0;
+        int frames_allocating = 0;
+    };
+    HeapStats heap_stats;
+    void print_heap_stats(FILE* out = stdout) const;
+
+    // Camera matrices (GL conventions), used for picking and culling.
+    // Written by update_camera() every frame while camera.enabled.
+    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+    Eigen::Matrix4f proj = Eigen::Matrix4f::Identity();
+
+    // Trackball (left), pan (right), zoom (middle, scroll)
+    Camera camera;
+
     // Temporary data stored when the mouse button is pressed
     MouseMode mouse_mode = Viewer::MouseMode::None;
     Eigen::Quaternionf down_rotation;
@@ -134,6 +316,41 @@ public:
     void* callback_key_up_data;
     void* callback_key_repeat_data;
 
+private:
+    // One frame of launch_rendering; returns **true** if the viewer wants
+    // to keep polling (animating, damaged or drawing its extra frames)
+    bool render_frame();
+    // Input, loads and camera of a frame, then the draw unless `lazy` and
+    // nothing is damaged; returns **true** if it drew
+    bool draw_frame(bool first, bool lazy);
+    // The plugins' draw hooks, scissored to the damage
+    void render(bool first);
+    static constexpr int num_extra_frames = 5;
+    int extra_frame_counter;
+    int64_t frame_begin_ns;
+    std::chrono::steady_clock::time_point start_time;
+    double camera_time;
+
+    // Reference on the process-wide GLFW initialization
+    bool acquire_glfw();
+    void release_glfw();
+    bool holds_glfw;
+
+    // Creates `buffers`, or joins the ones of `share`
+    void init_buffers(Viewer* share);
+
+    // post_load on every plugin until one stops the event
+    void post_load_plugins();
+
+    std::chrono::steady_clock::time_point last_autosave;
+
+    // Rebuilds plugin_hooks and the profiler stage ids of each plugin's
+    // pre_draw / post_draw after the plugin list has changed
+    void update_plugin_stages();
+    PluginHookTable plugin_hooks;
+    std::vector<uint16_t> plugin_pre_draw_stages;
+    std::vector<uint16_t> plugin_post_draw_stages;
+
 public:
 
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -153,6 +370,13 @@ public:
     // This function is called before shutdown
     virtual void shutdown();
 
+    const std::string& name() const { return mName; }
+
+    // The hooks (PluginHook bits) this plugin implements; the viewer only
+    // calls those on it. Read when the plugin is registered. Defaults to all
+    // of them; ViewerPluginBase detects them at compile time.
+    virtual uint32_t hooks() const;
+
     // This function is called before a mesh is loaded
     virtual bool load(const std::string& filename, bool only_vertices);
 
@@ -168,9 +392,32 @@ public:
     // This function is called when the scene is deserialized
     virtual bool deserialize(const std::vector<char>& buffer);
 
+    // State for snapshots (see SnapshotWriter). The defaults go through
+    // serialize() / deserialize() and a copy of the whole state; plugins
+    // with large state write it from their own memory instead, where
+    // unchanged chunks are only hashed. snapshot() returns **false** if
+    // there is nothing to save.
+    virtual bool snapshot(SnapshotOut& out) const;
+    virtual bool restore(SnapshotIn& in);
+
+    // Background variant of load(), called on a loader thread: read the
+    // file into `asset` without touching the plugin or the viewer. Returns
+    // **true** if this plugin takes the file.
+    virtual bool load_async(Asset& asset);
+
+    // Called on the render thread once the asset taken by load_async() is
+    // uploaded; the plugin takes it over as if load() had run.
+    virtual bool load_finished(Asset& asset);
+
     // Runs immediately after a new mesh has been loaded.
     virtual bool post_load();
 
+    // Called before pre_draw to add this frame's CPU work to `tasks`; the
+    // viewer runs the tasks of all plugins on its job system and waits for
+    // them before any pre_draw. Tasks may run concurrently with each other
+    // and must not call GL.
+    virtual bool pre_draw_tasks(TaskGraph& tasks, bool first);
+
     // This function is called before the draw procedure of Preview3D
     virtual bool pre_draw(bool first);
 
@@ -218,9 +465,51 @@ public:
 
 protected:
 
+    // Marks what this plugin changed for the next frame (see Viewer::damage)
+    DamageTracker& damage() { return mViewer->damage; }
+
+    // The viewer's per-frame scratch memory and object pools
+    FrameArena& frame_arena() { return mViewer->frame_arena; }
+    template <typename T>
+    ObjectPool<T>& pool() { return mViewer->pools.get<T>(); }
+
     // Pointer to the main Viewer class
     Viewer* mViewer;
 
     // Plugin name
     std::string mName;
 };
+
+// PluginHook bits of the hooks that plugin class T overrides
+template <typename T>
+constexpr uint32_t detected_hooks()
+{
+    uint32_t mask = 0;
+#define GLFW_VIEWER_DETECT_HOOK(method, hook) \
+    if (!std::is_same<decltype(&T::method), decltype(&ViewerPlugin::method)>::value) \
+        mask |= plugin_hook_bit(PluginHook::hook);
+    GLFW_VIEWER_DETECT_HOOK(pre_draw_tasks, PreDrawTasks)
+    GLFW_VIEWER_DETECT_HOOK(pre_draw, PreDraw)
+    GLFW_VIEWER_DETECT_HOOK(post_draw, PostDraw)
+    GLFW_VIEWER_DETECT_HOOK(mouse_down, MouseDown)
+    GLFW_VIEWER_DETECT_HOOK(mouse_up, MouseUp)
+    GLFW_VIEWER_DETECT_HOOK(mouse_move, MouseMove)
+    GLFW_VIEWER_DETECT_HOOK(mouse_scroll, MouseScroll)
+    GLFW_VIEWER_DETECT_HOOK(key_pressed, KeyPressed)
+    GLFW_VIEWER_DETECT_HOOK(key_down, KeyDown)
+    GLFW_VIEWER_DETECT_HOOK(key_up, KeyUp)
+    GLFW_VIEWER_DETECT_HOOK(key_repeat, KeyRepeat)
+#undef GLFW_VIEWER_DETECT_HOOK
+    return mask;
+}
+
+// Base for plugins that only get the hooks they override:
+//   class MyPlugin : public ViewerPluginBase<MyPlugin> { ... };
+// A hook overridden further down (in a class deriving from MyPlugin) is not
+// seen; such a class derives from ViewerPluginBase itself or overrides hooks().
+template <typename Derived>
+class ViewerPluginBase : public ViewerPlugin
+{
+public:
+    uint32_t hooks() const override { return detected_hooks<Derived>(); }
+};
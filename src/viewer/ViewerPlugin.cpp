@@ -0,0 +1,143 @@
+#include "Viewer.h"
+
+// Default implementations: every hook does nothing and lets the event
+// propagate to the next plugin.
+
+ViewerPlugin::ViewerPlugin()
+{
+    mViewer = nullptr;
+    mName = "dummy";
+}
+
+ViewerPlugin::~ViewerPlugin() = default;
+
+void ViewerPlugin::init(Viewer* _viewer)
+{
+    mViewer = _viewer;
+}
+
+void ViewerPlugin::shutdown()
+{
+}
+
+uint32_t ViewerPlugin::hooks() const
+{
+    return ALL_PLUGIN_HOOKS;
+}
+
+bool ViewerPlugin::load(const std::string& /*filename*/, bool /*only_vertices*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::unload()
+{
+    return false;
+}
+
+bool ViewerPlugin::save(const std::string& /*filename*/, bool /*only_vertices*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::serialize(std::vector<char>& /*buffer*/) const
+{
+    return false;
+}
+
+bool ViewerPlugin::deserialize(const std::vector<char>& /*buffer*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::snapshot(SnapshotOut& out) const
+{
+    std::vector<char> buffer;
+    if (!serialize(buffer))
+    {
+        return false;
+    }
+    out.write(buffer.data(), buffer.size());
+    return true;
+}
+
+bool ViewerPlugin::restore(SnapshotIn& in)
+{
+    std::vector<char> buffer((size_t)in.size());
+    return in.read(buffer.data(), buffer.size()) && deserialize(buffer);
+}
+
+bool ViewerPlugin::load_async(Asset& /*asset*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::load_finished(Asset& /*asset*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::post_load()
+{
+    return false;
+}
+
+bool ViewerPlugin::pre_draw_tasks(TaskGraph& /*tasks*/, bool /*first*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::pre_draw(bool /*first*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::post_draw(bool /*first*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::post_resize(int /*w*/, int /*h*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::mouse_down(int /*button*/, int /*modifier*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::mouse_up(int /*button*/, int /*modifier*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::mouse_move(int /*mouse_x*/, int /*mouse_y*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::mouse_scroll(float /*delta_y*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::key_pressed(unsigned int /*key*/, int /*modifiers*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::key_down(int /*key*/, int /*modifiers*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::key_up(int /*key*/, int /*modifiers*/)
+{
+    return false;
+}
+
+bool ViewerPlugin::key_repeat(int /*key*/, int /*modifiers*/)
+{
+    return false;
+}